@@ -89,9 +89,14 @@ Returns an array of all processes running for the current user. */
 
 /*!
 @method processForProcessIdentifier:
-Returns the process for the given process identifier, or nil if no such process exists. */
+Returns the process for the given process identifier, or nil if no such process exists. Processes are cached by process identifier and start time, so a reused process identifier returns a new instance. */
 + (AGProcess *)processForProcessIdentifier:(pid_t)pid;
 
+/*!
+@method getCacheHits:misses:
+Returns how many calls to +processForProcessIdentifier: were answered from the cache of recently used processes, and how many had to look up the process. */
++ (void)getCacheHits:(unsigned long *)hits misses:(unsigned long *)misses;
+
 /*!
 @method processesForProcessGroup:
 Returns an array of all processes in the given process group. */
@@ -199,17 +204,17 @@ Returns the current state without querying the Mach task port. Return values are
 
 /*!
 @method state
-Returns the current state. Possible values are defined by AGProcessState. */
+Returns the current state of the task as a whole: runnable when any of its threads is running, otherwise sleeping, suspended or a zombie. The threads are walked for a process of another user, which proc_pidinfo() doesn't describe unless we run as root. Possible values are defined by AGProcessState. */
 - (AGProcessState)state;
 
 /*!
 @method priority
-Returns the current priority. */
+Returns the priority of the task. The current priority of each thread differs from it while the thread is boosted or decayed, and is only read for the processes shown in the processor panel. For a process of another user, the highest current priority of its threads. */
 - (integer_t)priority;
 
 /*!
 @method basePriority
-Returns the base priority. */
+Returns the base priority of the task, the same as -priority except for a process of another user, where it is the highest base priority of its threads. */
 - (integer_t)basePriority;
 
 /*!
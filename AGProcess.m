@@ -57,13 +57,15 @@
 #include <mach/thread_act.h>
 #include <mach/mach_vm.h>
 #include <mach/vm_map.h>
+#include <libproc.h>
 #include <sys/param.h>
 #include <sys/sysctl.h>
 #include <sys/types.h>
 #include <signal.h>
 #include <unistd.h>
 
-static int argument_buffer_size;
+#include "ProcessArguments.h"
+
 static int major_version;
 static int minor_version;
 static int update_version;
@@ -90,26 +92,6 @@ AGMachStatsInit() {
 	sscanf(rel, "%d.%d.%d", &major_version, &minor_version, &update_version);
 	//NSLog(@"AGProcess: AGMacStatsInit: major_version = %d, minor_version = %d, update_version = %d", major_version, minor_version, update_version);
 	
-	// get the buffer size that will be large enough to hold the maximum arguments
-	size_t	size = sizeof(argument_buffer_size);
-	
-	mib[0] = CTL_KERN;
-	mib[1] = KERN_ARGMAX;
-
-	if (sysctl(mib, 2, &argument_buffer_size, &size, NULL, 0) == -1) {
-		//NSLog(@"AGProcess: AGMachStatsInit: using default for argument_buffer_size");
-		argument_buffer_size = 4096; // kernel failed to provide the maximum size, use a default of 4K
-	}
-	if (major_version < 7) // kernel version < 7.0 (Mac OS X 10.3 - Panther)
-	{
-		if (argument_buffer_size > 8192) {
-			//NSLog(@"AGProcess: AGMachStatsInit: adjusting argument_buffer_size = %d", argument_buffer_size);
-			argument_buffer_size = 8192; // avoid a kernel bug and use a maximum of 8K
-		}
-	}
-	
-	//NSLog(@"AGProcess: AGMachStatsInit: argument_buffer_size = %d", argument_buffer_size);
-
 	return KERN_SUCCESS;
 }
 
@@ -317,6 +299,70 @@ AGGetMachTaskCPUUsage(task_t task, double *user_time, double *system_time, doubl
 	return error;
 }
 
+// the state, priority and thread count of a task as a whole come from one call instead of a walk of its threads,
+// ProcessThreads has the state and priority of each thread for the few processes that are shown;
+// the call only answers for the processes of the same user unless we run as root
+static kern_return_t
+AGGetProcTaskInfo(pid_t pid, struct proc_taskallinfo *info) {
+	if (proc_pidinfo(pid, PROC_PIDTASKALLINFO, 0, info, sizeof(struct proc_taskallinfo)) != sizeof(struct proc_taskallinfo))
+		return KERN_FAILURE;
+	return KERN_SUCCESS;
+}
+
+static kern_return_t
+AGGetProcTaskPriority(pid_t pid, integer_t *priority) {
+	kern_return_t error;
+	struct proc_taskallinfo info;
+	
+	if ((error = AGGetProcTaskInfo(pid, &info)) != KERN_SUCCESS)
+		return error;
+	
+	if (priority != NULL) *priority = info.ptinfo.pti_priority;
+	
+	return error;
+}
+
+static kern_return_t
+AGGetProcTaskState(pid_t pid, int *state) {
+	kern_return_t error;
+	struct proc_taskallinfo info;
+	int my_state;
+	
+	if ((error = AGGetProcTaskInfo(pid, &info)) != KERN_SUCCESS)
+		return error;
+	
+	switch (info.pbsd.pbi_status) {
+	case SSTOP:
+		my_state = AGProcessStateSuspended;
+		break;
+	case SZOMB:
+		my_state = AGProcessStateZombie;
+		break;
+	default:
+		// a running thread makes the task runnable, sleeping and idle threads can't be told apart without walking them
+		my_state = info.ptinfo.pti_numrunning > 0 ? AGProcessStateRunnable : AGProcessStateSleeping;
+	}
+	
+	if (state != NULL) *state = my_state;
+	
+	return error;
+}
+
+static kern_return_t
+AGGetProcTaskThreadCount(pid_t pid, integer_t *count) {
+	kern_return_t error;
+	struct proc_taskallinfo info;
+	
+	if ((error = AGGetProcTaskInfo(pid, &info)) != KERN_SUCCESS)
+		return error;
+	
+	if (count != NULL) *count = info.ptinfo.pti_threadnum;
+	
+	return error;
+}
+
+// the walks of the threads of a task, for the processes of other users whose task port we have
+// but that proc_pidinfo() won't describe
 static kern_return_t
 AGGetMachThreadPriority(thread_t thread, integer_t *current_priority, integer_t *base_priority) {
 	kern_return_t error;
@@ -487,6 +533,7 @@ AGGetMachTaskThreadCount(task_t task, integer_t *count) {
 	return error;
 }
 
+
 static kern_return_t
 AGGetMachTaskEvents(task_t task, integer_t *faults, integer_t *pageins, integer_t *cow_faults, integer_t *messages_sent, integer_t *messages_received, integer_t *syscalls_mach, integer_t *syscalls_unix, integer_t *csw) {
 	kern_return_t error;
@@ -508,35 +555,162 @@ AGGetMachTaskEvents(task_t task, integer_t *faults, integer_t *pageins, integer_
 	return error;
 }
 
+// the start time tells apart two processes that had the same pid
+static BOOL
+AGGetProcessStartTime(pid_t pid, struct timeval *startTime) {
+	struct kinfo_proc info;
+	size_t length = sizeof(struct kinfo_proc);
+	int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, pid };
+	
+	if (sysctl(mib, 4, &info, &length, NULL, 0) < 0 || length == 0)
+		return NO;
+	*startTime = info.kp_proc.p_starttime;
+	return YES;
+}
+
+///////////////////
+
+// an LRU cache of processes keyed by pid and start time (since task_for_pid through taskgated is relatively slow)
+// entries are chained in hash buckets and in a list from the most to the least recently used, so every operation is O(1)
+
+#define AGProcessCacheSize 512			// entries, and hash buckets
+#define AGProcessCacheNegativeLifetime 5.0	// seconds a process that couldn't be inspected is remembered
+
+typedef struct _AGProcessCacheEntry {
+	pid_t pid;
+	struct timeval startTime;
+	AGProcess *process;		// retained, nil when the process couldn't be inspected
+	NSTimeInterval expires;		// when a nil process is tried again
+	int newer, older;		// recently used list, -1 at the ends
+	int next;			// next entry in the same bucket, -1 at the end
+} AGProcessCacheEntry;
+
+static AGProcessCacheEntry processCache[AGProcessCacheSize];
+static int processCacheBuckets[AGProcessCacheSize];
+static int processCacheNewest, processCacheOldest, processCacheFree;
+static unsigned long processCacheHits, processCacheMisses;
+static BOOL processCacheInitialized = NO;
+
+// command names and arguments by pid, start time and short name, shared by every instance
+static ProcessArguments *processArguments = NULL;
+
+static void
+AGProcessCacheInit() {
+	int i;
+	
+	for (i = 0; i < AGProcessCacheSize; i++) {
+		processCacheBuckets[i] = -1;
+		// unused entries are chained through next
+		processCache[i].next = (i + 1 < AGProcessCacheSize ? i + 1 : -1);
+	}
+	processCacheFree = 0;
+	processCacheNewest = -1;
+	processCacheOldest = -1;
+	processCacheInitialized = YES;
+}
+
+static inline int
+AGProcessCacheBucket(pid_t pid, struct timeval startTime) {
+	unsigned int hash = ((unsigned int)pid * 2654435761u) ^ ((unsigned int)startTime.tv_sec * 2246822519u) ^ (unsigned int)startTime.tv_usec;
+	return (hash ^ (hash >> 15)) & (AGProcessCacheSize - 1);
+}
+
+static int
+AGProcessCacheFind(pid_t pid, struct timeval startTime) {
+	int index = processCacheBuckets[AGProcessCacheBucket(pid, startTime)];
+	
+	while (index >= 0) {
+		AGProcessCacheEntry *entry = &processCache[index];
+		if (entry->pid == pid && entry->startTime.tv_sec == startTime.tv_sec && entry->startTime.tv_usec == startTime.tv_usec)
+			break;
+		index = entry->next;
+	}
+	return index;
+}
+
+static void
+AGProcessCacheUnlink(int index) {
+	AGProcessCacheEntry *entry = &processCache[index];
+	
+	if (entry->newer >= 0)
+		processCache[entry->newer].older = entry->older;
+	else
+		processCacheNewest = entry->older;
+	if (entry->older >= 0)
+		processCache[entry->older].newer = entry->newer;
+	else
+		processCacheOldest = entry->newer;
+}
+
+static void
+AGProcessCacheLinkNewest(int index) {
+	AGProcessCacheEntry *entry = &processCache[index];
+	
+	entry->newer = -1;
+	entry->older = processCacheNewest;
+	if (processCacheNewest >= 0)
+		processCache[processCacheNewest].newer = index;
+	else
+		processCacheOldest = index;
+	processCacheNewest = index;
+}
+
+static void
+AGProcessCacheMoveToNewest(int index) {
+	if (index != processCacheNewest) {
+		AGProcessCacheUnlink(index);
+		AGProcessCacheLinkNewest(index);
+	}
+}
+
+static void
+AGProcessCacheRemove(int index) {
+	AGProcessCacheEntry *entry = &processCache[index];
+	int *link = &processCacheBuckets[AGProcessCacheBucket(entry->pid, entry->startTime)];
+	
+	while (*link != index)
+		link = &processCache[*link].next;
+	*link = entry->next;
+	AGProcessCacheUnlink(index);
+	
+	// the caller may still be using the process it got earlier
+	[entry->process autorelease];
+	entry->process = nil;
+	entry->next = processCacheFree;
+	processCacheFree = index;
+}
+
+// returns a new entry for the process, evicting the least recently used one when the cache is full
+static int
+AGProcessCacheAdd(pid_t pid, struct timeval startTime) {
+	int bucket = AGProcessCacheBucket(pid, startTime);
+	int index;
+	
+	if (processCacheFree < 0)
+		AGProcessCacheRemove(processCacheOldest);
+	index = processCacheFree;
+	processCacheFree = processCache[index].next;
+	
+	processCache[index].pid = pid;
+	processCache[index].startTime = startTime;
+	processCache[index].process = nil;
+	processCache[index].expires = 0.0;
+	processCache[index].next = processCacheBuckets[bucket];
+	processCacheBuckets[bucket] = index;
+	AGProcessCacheLinkNewest(index);
+	return index;
+}
+
+///////////////////
+
 @interface AGProcess (Private)
 + (NSArray *)processesForThirdLevelName:(int)name value:(int)value;
++ (AGProcess *)processForProcessIdentifier:(pid_t)pid startTime:(struct timeval)startTime;
 - (void)doProcargs;
 @end
 
 @implementation AGProcess (Private)
 
-// this function is taken from: http://mikeash.com/pyblog/friday-qa-2011-03-18-random-numbers.html
-// modified slightly so that it calls srandom() for us if it hasn't
-static int RandomUnder(int topPlusOne)
-{
-    static BOOL initialized = NO;
-    
-    if (!initialized) {
-        srandom(time(NULL));
-        initialized = YES;
-    }
-    
-    const unsigned two31 = 1U << 31;
-    const unsigned maxUsable = (two31 / topPlusOne) * topPlusOne;
-    
-    while (1) {
-        const unsigned num = random();
-        if(num < maxUsable) {
-            return num % topPlusOne;
-        }
-    }
-}
-
 + (NSArray *)processesForThirdLevelName:(int)name value:(int)value {
 	AGProcess *proc;
 	NSMutableArray *processes = [NSMutableArray array];
@@ -564,7 +738,7 @@ static int RandomUnder(int topPlusOne)
 		pid_t pid = info[i].kp_proc.p_pid;
 		//NSLog(@"AGProcess: processesForThirdLevelName: pid = %d", pid);
 		if (pid != 0) {
-			proc = [self processForProcessIdentifier:pid];
+			proc = [self processForProcessIdentifier:pid startTime:info[i].kp_proc.p_starttime];
 			if (proc) {
 				[processes addObject:proc];
 			}
@@ -575,190 +749,103 @@ static int RandomUnder(int topPlusOne)
 	return processes;
 }
 
++ (AGProcess *)processForProcessIdentifier:(pid_t)pid startTime:(struct timeval)startTime {
+	AGProcessCacheEntry *entry;
+	int index;
+	
+	if (!processCacheInitialized)
+		AGProcessCacheInit();
+	
+	index = AGProcessCacheFind(pid, startTime);
+	if (index >= 0) {
+		entry = &processCache[index];
+		if (entry->process || [NSDate timeIntervalSinceReferenceDate] < entry->expires) {
+			processCacheHits++;
+			AGProcessCacheMoveToNewest(index);
+			return entry->process;
+		}
+		// the failed lookup has expired, try again
+		AGProcessCacheRemove(index);
+	}
+	
+	processCacheMisses++;
+	index = AGProcessCacheAdd(pid, startTime);
+	entry = &processCache[index];
+	entry->process = [[self alloc] initWithProcessIdentifier:pid];
+	if (!entry->process) {
+		// no information available for this process, remember for a while that we tried
+		entry->expires = [NSDate timeIntervalSinceReferenceDate] + AGProcessCacheNegativeLifetime;
+	}
+	return entry->process;
+}
+
 - (void)doProcargs
 {       
-	id args = [NSMutableArray array];
-	id env = [NSMutableDictionary dictionary];
-	int mib[3];
+	NSMutableArray *args = [NSMutableArray array];
+	NSMutableDictionary *env = [NSMutableDictionary dictionary];
+	const ProcessArgumentsEntry *entry = NULL;
+	struct kinfo_proc info;
+	size_t length = sizeof(struct kinfo_proc);
+	int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, process };
+	BOOL haveInfo;
 
 	// make sure this is only executed once for an instance
 	if (command)
 		return;
 	
-	if (major_version >= 8) { // kernel version >= 8.0 (Mac OS X 10.4 - Tiger)
-		// a newer sysctl selector is available -- it includes the number of arguments as an integer at the beginning of the buffer
-		mib[0] = CTL_KERN;
-		mib[1] = KERN_PROCARGS2;
-		mib[2] = process;
-	} else {
-		// use the older sysctl selector -- the argument/environment boundary will be determined heuristically
-		mib[0] = CTL_KERN;
-		mib[1] = KERN_PROCARGS;
-		mib[2] = process;
+	// the arguments are read once for each process, and kept when this instance is evicted from the process cache
+	if (!processArguments)
+		processArguments = ProcessArgumentsCreate();
+	haveInfo = (sysctl(mib, 4, &info, &length, NULL, 0) == 0 && length > 0);
+	if (haveInfo && processArguments) {
+		double startTime = info.kp_proc.p_starttime.tv_sec + (info.kp_proc.p_starttime.tv_usec / 1.0e6);
+		entry = ProcessArgumentsLookup(processArguments, process, startTime, info.kp_proc.p_comm);
 	}
-	
-	size_t length = argument_buffer_size;
-	char *buffer = (char *)malloc(length);;
-	
-	BOOL parserFailure = NO;
-	if (sysctl(mib, 3, buffer, &length, NULL, 0) == 0) {  
-		char *cp;
-		BOOL isFirstArgument = YES;
-		BOOL createAnnotation = NO;
-		
-		int argumentCount;
-		if (major_version >= 8) { // kernel version >= 8.0 (Mac OS X 10.4 - Tiger)
-			memcpy(&argumentCount, buffer, sizeof(argumentCount));
-			cp = buffer + sizeof(argumentCount);
-		} else {
-			cp = buffer;
-			argumentCount = -1;
-		}
 
-		//NSLog(@"AGProcess: doProcArgs: argumentCount = %d", argumentCount);
-
-		// skip the exec_path
-		BOOL execPathFound = NO;
-		for (; cp < buffer + length; cp++) {
-			if (*cp == '\0') {
-				execPathFound = YES;
-				break;
-			}
-		}
-		if (execPathFound) {
-			// skip trailing '\0' characters
-			BOOL argumentStartFound = NO;
-			for (; cp < buffer + length; cp++) {
-				if (*cp != '\0') {
-					// beginning of first argument reached
-					argumentStartFound = YES;
-					break;
-				}
+	if (entry && entry->argumentCount > 0) {
+		const char *cp = entry->arguments;
+		BOOL isCommandFound = NO;
+		NSString *lastItemString = nil;
+		int i;
+		
+		command = [NSString stringWithUTF8String:entry->name];
+		if (entry->annotation)
+			annotation = [NSString stringWithUTF8String:entry->annotation];
+		
+		for (i = 0; i < entry->argumentCount; i++, cp += strlen(cp) + 1) {
+			size_t itemLength = strlen(cp);
+			
+			// the name points into the command argument, LaunchCFMApp and empty arguments come before it
+			if (!isCommandFound) {
+				isCommandFound = (entry->name >= cp && entry->name <= cp + itemLength);
+				continue;
 			}
-			if (argumentStartFound) {
-				char *currentItem = cp;
-				
-				NSString *lastItemString = nil;
-				
-				// get all arguments
-				for (; cp < buffer + length; cp++) {
-					if (*cp == '\0') {
-						if (strlen(currentItem) > 0) {
-							NSString *itemString = [NSString stringWithUTF8String:currentItem];
-							if (itemString) {
-								//NSLog(@"AGProcess: doProcArgs: itemString = %@, lastItemString = %@", itemString, lastItemString);
-
-								NSString *lastPathComponent = [itemString lastPathComponent];
-
-								if (! [lastPathComponent isEqualToString:@"LaunchCFMApp"]) {
-									if (isFirstArgument) {
-										// save command
-										command = lastPathComponent;
-										isFirstArgument = NO;
-										
-										// these are the commands we will annotate
-										if ([command isEqualToString:@"DashboardClient"]) {
-											createAnnotation = YES;
-										} else if ([command isEqualTo:@"Yahoo! Widget Engine"]) {
-											createAnnotation = YES;
-										} else if ([command isEqualTo:@"java"]) {
-											createAnnotation = YES;
-										}
-									} else {
-										// the command argument is sometimes duplicated (for CFM apps?) -- ignore the argument if it is the same as the last one
-										if (! [itemString isEqualToString:lastItemString]) {
-											// add to the argument list
-											[args addObject:itemString];
-										}
-										else
-										{
-											argumentCount--;
-											//NSLog(@"AGProcess: doProcArgs: duplicate, argumentCount = %d", argumentCount);
-											//NSLog(@"AGProcess: doProcArgs: duplicate, itemString = %@, lastItemString = %@", itemString, lastItemString);
-										}
-										
-										// check if we need to annotate
-										if (createAnnotation && (! annotation)) {
-											NSString *pathExtension = [itemString pathExtension];
-											
-											if ([pathExtension isEqualTo:@"wdgt"]) { // for DashboardClient
-												annotation = [lastPathComponent stringByDeletingPathExtension];
-											} else if ([pathExtension isEqualTo:@"widget"]) { // for Konfabulator
-												annotation = [lastPathComponent stringByDeletingPathExtension];
-											} else if ([pathExtension isEqualTo:@"jar"]) { // for java
-												annotation = lastPathComponent;
-											}
-										}
-									}
-								} else {
-									argumentCount--;
-									//NSLog(@"AGProcess: doProcArgs: CFM app, argumentCount = %d", argumentCount);
-									//NSLog(@"AGProcess: doProcArgs: CFM app, lastPathComponent = %@", lastPathComponent);
-								}
-								
-								lastItemString = itemString;
-							} else {
-								NSLog(@"AGProcess: doProcArgs: couldn't convert 0x%lx (0x%lx) [%ld of %ld] = '%s' (%ld) to NSString", (long)currentItem, (long)buffer, (long)(currentItem - buffer), (long)length, currentItem, (long)currentItem);
-							}
-						}
-							
-						currentItem = cp + 1;
-					}
-				}
-			} else {
-				NSLog(@"AGProcess: doProcArgs: start of argument list not found for pid = %d", process);
-				parserFailure = YES;
+			if (itemLength == 0)
+				continue;
+			
+			NSString *itemString = [NSString stringWithUTF8String:cp];
+			if (!itemString) {
+				NSLog(@"AGProcess: doProcArgs: couldn't convert '%s' to NSString for pid = %d", cp, process);
+				continue;
 			}
-		} else {
-			NSLog(@"AGProcess: doProcArgs: exec_path not found for pid = %d", process);
-			parserFailure = YES;
+			// the command argument is sometimes duplicated (for CFM apps?) -- ignore the argument if it is the same as the last one
+			if (![itemString isEqualToString:lastItemString])
+				[args addObject:itemString];
+			lastItemString = itemString;
 		}
-
-		// extract environment variables from the argument list
-		if (argumentCount >= 0) {
-			// we're using the newer sysctl selector, so use the argument count (less one for the command argument)
-			if (argumentCount == 0)
-			{
-				NSLog(@"AGProcess: doProcArgs: new sysctl, argumentCount = %d, count = %ld", argumentCount, (long)[args count]);
-				NSLog(@"AGProcess: doProcArgs: new sysctl, args = %@", [args description]);
-				argumentCount = 1;
-			}
-			int i;
-			for (i = [args count] - 1; i >= (argumentCount - 1); i--) {
-				//NSLog(@"AGProcess: doProcArgs: i = %d", i);
-				NSString *string = [args objectAtIndex:i];
-				//NSLog(@"AGProcess: doProcArgs: string = %@", string);
-				NSUInteger index = [string rangeOfString:@"="].location;
-				if (index != NSNotFound)
-					[env setObject:[string substringFromIndex:index + 1] forKey:[string substringToIndex:index]];
-			}
-			args = [args subarrayWithRange:NSMakeRange(0, i + 1)];
-		} else {
-			// we're using the older sysctl selector, so we just guess by looking for an '=' in the argument
-			//NSLog(@"AGProcess: doProcArgs: new sysctl, argumentCount = %d, count = %d", argumentCount, [args count]);
-			//NSLog(@"AGProcess: doProcArgs: new sysctl, args = %@", [args description]);
-			int i;
-			for (i = [args count] - 1; i >= 0; i--) {
-				NSString *string = [args objectAtIndex:i];
-				NSUInteger index = [string rangeOfString:@"="].location;
-				if (index == NSNotFound)
-					break;
+		
+		for (i = 0; i < entry->environmentCount; i++, cp += strlen(cp) + 1) {
+			NSString *string = [NSString stringWithUTF8String:cp];
+			NSUInteger index = (string ? [string rangeOfString:@"="].location : NSNotFound);
+			if (index != NSNotFound)
 				[env setObject:[string substringFromIndex:index + 1] forKey:[string substringToIndex:index]];
-			}
-			args = [args subarrayWithRange:NSMakeRange(0, i + 1)];
 		}
-	} else {
-		parserFailure = YES;
 	}
 	
-	if (parserFailure) {
+	if (!command) {
 		// probably caused by a zombie or exited process, but could also be bad data in the process arguments buffer
-		// try to get the accounting name to partially recover from the error
-		struct kinfo_proc info;
-		size_t length = sizeof(struct kinfo_proc);
-		int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, process };
-		
-		if (sysctl(mib, 4, &info, &length, NULL, 0) < 0) {
+		// use the accounting name to partially recover from the error
+		if (!haveInfo) {
 			command = [[[NSString alloc] init] autorelease];
 			NSLog(@"AGProcess: doProcArgs: no command");
 		} else {
@@ -771,8 +858,6 @@ static int RandomUnder(int topPlusOne)
 	
 	[command retain];
 	[annotation retain];
-		
-	free(buffer);
 	
 	arguments = [args retain];
 	environment = [env retain];
@@ -868,38 +953,16 @@ static int RandomUnder(int topPlusOne)
 }
 
 + (AGProcess *)processForProcessIdentifier:(pid_t)pid {
-	const NSUInteger processCacheSize = 500;
-	static NSMutableDictionary *processCache = nil;
-	
-	if (processCache == nil) {
-		// a cache to keep track of the last 500 processes (since task_for_pid through taskgated is relatively slow)
-		processCache = [[NSMutableDictionary dictionaryWithCapacity:processCacheSize] retain];
-	}
+	struct timeval startTime;
 	
-	id result = [processCache objectForKey:[NSNumber numberWithInt:pid]];
-	if (result) {
-		if ([result isKindOfClass:[NSNull class]]) {
-			// return nil instead of the null value in the cache
-			result = nil;
-		}
-	}
-	else {
-		result = [[[self alloc] initWithProcessIdentifier:pid] autorelease];
-		if (result) {
-			NSUInteger processCacheCount = [processCache count];
-			if (processCacheCount >= processCacheSize) {
-				id randomKey = [[processCache allKeys] objectAtIndex:RandomUnder(processCacheCount)];
-				[processCache removeObjectForKey:randomKey];
-			}
-			[processCache setObject:result forKey:[NSNumber numberWithInteger:pid]];
-		}
-		else {
-			// no information available for this process, cache a null value to record the fact that we tried
-			[processCache setObject:[NSNull null] forKey:[NSNumber numberWithInteger:pid]];
-		}
-	}
+	if (!AGGetProcessStartTime(pid, &startTime))
+		return nil;
+	return [self processForProcessIdentifier:pid startTime:startTime];
+}
 
-	return result;
++ (void)getCacheHits:(unsigned long *)hits misses:(unsigned long *)misses {
+	if (hits != NULL) *hits = processCacheHits;
+	if (misses != NULL) *misses = processCacheMisses;
 }
 	
 + (NSArray *)processesForProcessGroup:(int)pgid {
@@ -1127,28 +1190,28 @@ static int RandomUnder(int topPlusOne)
 	int state;
 	state = [self kernelState];
 	if (state == AGProcessStateUnknown)
-		if (AGGetMachTaskState(task, &state) != KERN_SUCCESS)
+		if (AGGetProcTaskState(process, &state) != KERN_SUCCESS && AGGetMachTaskState(task, &state) != KERN_SUCCESS)
 			return AGProcessStateUnknown;
 	return state;
 }
 	
 - (integer_t)priority {
 	integer_t priority;
-	if (AGGetMachTaskPriority(task, &priority, NULL) != KERN_SUCCESS)
+	if (AGGetProcTaskPriority(process, &priority) != KERN_SUCCESS && AGGetMachTaskPriority(task, &priority, NULL) != KERN_SUCCESS)
 		return AGProcessValueUnknown;
 	return priority;
 }
 
 - (integer_t)basePriority {
 	integer_t priority;
-	if (AGGetMachTaskPriority(task, NULL, &priority) != KERN_SUCCESS)
+	if (AGGetProcTaskPriority(process, &priority) != KERN_SUCCESS && AGGetMachTaskPriority(task, NULL, &priority) != KERN_SUCCESS)
 		return AGProcessValueUnknown;
 	return priority;
 }
 	
 - (integer_t)threadCount {
 	integer_t count;
-	if (AGGetMachTaskThreadCount(task, &count) != KERN_SUCCESS)
+	if (AGGetProcTaskThreadCount(process, &count) != KERN_SUCCESS && AGGetMachTaskThreadCount(task, &count) != KERN_SUCCESS)
 		return AGProcessValueUnknown;
 	return count;
 } 
@@ -7,6 +7,8 @@
 
 #import <CoreWLAN/CoreWLAN.h>
 
+#import "HistoryRing.h"
+
 
 typedef struct WirelessData
 {
@@ -23,10 +25,8 @@ typedef struct WirelessData
 
 @interface AirportInfo : NSObject
 {
-	int size;
-	int inptr;
-	int outptr;
-	WirelessDataPtr wirelessData;
+	HistoryRing history;
+	HistoryRingIterator iterator;
 	BOOL attached;
 	BOOL isAvailable;
 	
@@ -40,6 +40,10 @@ typedef struct WirelessData
 - (BOOL)getNext:(WirelessDataPtr)ptr;
 - (void)getCurrent:(WirelessDataPtr)ptr;
 - (void)getLast:(WirelessDataPtr)ptr;
+- (const WirelessData *)nextSample;
+- (const WirelessData *)currentSample;
+- (const WirelessData *)lastSample;
+- (const HistoryRing *)history;
 - (int)getSize;
 
 @end
@@ -14,28 +14,27 @@
 	int i, j;
 
 	self = [super init];
-	size = numItems;
-	wirelessData = calloc(numItems, sizeof(WirelessData));
-	if (wirelessData == NULL) {
+	if (! HistoryRingInit(&history, numItems, sizeof(WirelessData))) {
 		NSLog (@"Failed to allocate buffer for WirelessInfo");
 		return (nil);
 	}
 	
-	inptr = 0;
-	outptr = -1;
+	iterator.outptr = -1;
 	
-	for (i = 0; i < size; i++)
+	for (i = 0; i < history.slots; i++)
 	{
-		wirelessData[i].wirelessAvailable = NO;
-		wirelessData[i].wirelessHasPower = NO;
-		wirelessData[i].wirelessLevel = 0.0;
+		WirelessDataPtr sample = HistoryRingSlot(&history, i);
+
+		sample->wirelessAvailable = NO;
+		sample->wirelessHasPower = NO;
+		sample->wirelessLevel = 0.0;
 		
 		for (j = 0; j < 6; j++)
 		{
-			wirelessData[i].wirelessMacAddress[j] = 0;
+			sample->wirelessMacAddress[j] = 0;
 		}
 		
-		wirelessData[i].wirelessName[0] = 0;
+		sample->wirelessName[0] = 0;
 	}
 	
 	isAvailable = NO;
@@ -58,6 +57,7 @@
 - (void)dealloc
 {
 	[interface release];
+	HistoryRingFree(&history);
 	
 	[super dealloc];
 }
@@ -69,18 +69,19 @@
 
 - (void)refresh
 {
+	WirelessDataPtr sample = HistoryRingWriteSlot(&history);
 #if 1
 	if (attached && isAvailable)
 	{
-		wirelessData[inptr].wirelessAvailable = YES;
+		sample->wirelessAvailable = YES;
 
 		BOOL interfaceHasPower = [interface powerOn];
 		NSInteger signal = [interface rssiValue];
 		NSInteger noise = [interface noiseMeasurement];
 		
-		wirelessData[inptr].wirelessHasPower = interfaceHasPower;
-		wirelessData[inptr].wirelessSignal = signal;
-		wirelessData[inptr].wirelessNoise = noise;
+		sample->wirelessHasPower = interfaceHasPower;
+		sample->wirelessSignal = signal;
+		sample->wirelessNoise = noise;
 
 		double signalToNoise = signal - noise;
 		double level = signalToNoise / 50.0f;
@@ -88,7 +89,7 @@
 		{
 			level = 1.0;
 		}
-		wirelessData[inptr].wirelessLevel = level;
+		sample->wirelessLevel = level;
 
 		CWInterfaceMode interfaceMode = [interface interfaceMode];
 		UInt16 clientMode = 0;
@@ -105,7 +106,7 @@
 			default:
 				break;
 		}
-		wirelessData[inptr].wirelessClientMode = clientMode;
+		sample->wirelessClientMode = clientMode;
 
 		if (interfaceHasPower)
 		{
@@ -116,18 +117,18 @@
 			{
 				const char *bssidBytes = [bssid UTF8String];
 				sscanf(bssidBytes, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
-						&wirelessData[inptr].wirelessMacAddress[0],
-						&wirelessData[inptr].wirelessMacAddress[1],
-						&wirelessData[inptr].wirelessMacAddress[2],
-						&wirelessData[inptr].wirelessMacAddress[3],
-						&wirelessData[inptr].wirelessMacAddress[4],
-						&wirelessData[inptr].wirelessMacAddress[5]);
+						&sample->wirelessMacAddress[0],
+						&sample->wirelessMacAddress[1],
+						&sample->wirelessMacAddress[2],
+						&sample->wirelessMacAddress[3],
+						&sample->wirelessMacAddress[4],
+						&sample->wirelessMacAddress[5]);
 			}
 			else
 			{
 				for (j = 0; j < 6; j++)
 				{
-					wirelessData[inptr].wirelessMacAddress[j] = 0;
+					sample->wirelessMacAddress[j] = 0;
 				}
 			}
 
@@ -137,13 +138,13 @@
 				const char *ssidBytes = [ssid UTF8String];
 				for (j = 0; j < 34; j++)
 				{
-					wirelessData[inptr].wirelessName[j] = ssidBytes[j];
+					sample->wirelessName[j] = ssidBytes[j];
 				}
-				wirelessData[inptr].wirelessName[33] = 0;
+				sample->wirelessName[33] = 0;
 			}
 			else
 			{
-				wirelessData[inptr].wirelessName[0] = 0;
+				sample->wirelessName[0] = 0;
 			}
 		}
 		else
@@ -151,61 +152,82 @@
 			int j;
 			for (j = 0; j < 6; j++)
 			{
-				wirelessData[inptr].wirelessMacAddress[j] = 0;
+				sample->wirelessMacAddress[j] = 0;
 			}
 			
-			wirelessData[inptr].wirelessName[0] = 0;
+			sample->wirelessName[0] = 0;
 		}
 	}
 	else
 #endif
 	{
-		wirelessData[inptr].wirelessAvailable = NO;
-		wirelessData[inptr].wirelessLevel = 0.0;
+		sample->wirelessAvailable = NO;
+		sample->wirelessLevel = 0.0;
 	}
 
-//	wirelessData[inptr].wirelessAvailable = YES;
-//	wirelessData[inptr].wirelessLevel = 0.50;
+//	sample->wirelessAvailable = YES;
+//	sample->wirelessLevel = 0.50;
 
-	if (++inptr >= size)
-		inptr = 0;
+	HistoryRingAdvance(&history);
 }
 
 
 - (void)startIterate
 {
-	outptr = inptr;
+	HistoryRingStartIterate(&history, &iterator);
 }
 
 
 - (BOOL)getNext:(WirelessDataPtr)ptr
 {
-	if (outptr == -1)
+	const WirelessData *sample = HistoryRingNext(&iterator);
+
+	if (sample == NULL)
 		return (FALSE);
-	*ptr = wirelessData[outptr++];
-	if (outptr >= size)
-		outptr = 0;
-	if (outptr == inptr)
-		outptr = -1;
+	*ptr = *sample;
 	return (TRUE);
 }
 
 
 - (void)getCurrent:(WirelessDataPtr)ptr
 {
-	*ptr = wirelessData[inptr ? inptr - 1 : size - 1];
+	*ptr = *(const WirelessData *)HistoryRingCurrent(&history);
 }
 
 
 - (void)getLast:(WirelessDataPtr)ptr
 {
-	*ptr = wirelessData[inptr > 1 ? inptr - 2 : size + inptr - 2];
+	*ptr = *(const WirelessData *)HistoryRingLast(&history);
+}
+
+
+- (const WirelessData *)nextSample
+{
+	return (HistoryRingNext(&iterator));
+}
+
+
+- (const WirelessData *)currentSample
+{
+	return (HistoryRingCurrent(&history));
+}
+
+
+- (const WirelessData *)lastSample
+{
+	return (HistoryRingLast(&history));
+}
+
+
+- (const HistoryRing *)history
+{
+	return (&history);
 }
 
 
 - (int)getSize
 {
-	return (size);
+	return (history.size);
 }
 
 
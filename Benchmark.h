@@ -0,0 +1,21 @@
+//
+//	Benchmark.h - Refresh and Drawing Benchmarks
+//
+//	Run with "iPulse -Benchmark YES", add "-CounterTraceReplay fixture.trace" to refresh from a recorded
+//	trace instead of the host. Results go to standard output, one tab-separated line per benchmark:
+//
+//	benchmark	iterations	ns_per_iteration	fixture
+//
+
+#import <Cocoa/Cocoa.h>
+
+#import "MainController.h"
+
+#define BENCHMARK_KEY @"Benchmark"
+#define BENCHMARK_ITERATIONS_KEY @"BenchmarkIterations"
+
+@interface MainController (Benchmark)
+
+- (void)runBenchmarks;
+
+@end
@@ -0,0 +1,229 @@
+//
+//	Benchmark.m - Refresh and Drawing Benchmarks
+//
+
+#import "Benchmark.h"
+
+#include "Phase.h"
+#include "SampleClock.h"
+#include "CounterTrace.h"
+
+#define BENCHMARK_DEFAULT_ITERATIONS 200
+#define BENCHMARK_MATH_ITERATIONS 100000 // the scale and moon math are too fast to time in a few hundred iterations
+
+
+// methods from MainController.m that aren't in the interface
+@interface MainController (BenchmarkDrawing)
+
+- (float)computeScaleForGauge:(int)scaleType withPeak:(float)peak;
+- (float)scaleValueForGauge:(float)value scaleType:(int)scaleType scale:(float)scale;
+- (void)drawImages;
+- (void)drawProcessorGauge;
+- (void)drawNetworkGauge;
+- (void)drawDiskGauge;
+- (void)drawMemoryGauge;
+- (void)drawHistoryGauge;
+
+@end
+
+
+@implementation MainController (Benchmark)
+
+static void printResult(NSString *name, int iterations, double start, NSString *fixture)
+{
+	double elapsed = (SampleClockNow() - start) * 1.0e9;
+
+	printf("%s\t%d\t%.1f\t%s\n", [name UTF8String], iterations, elapsed / iterations, [fixture UTF8String]);
+	fflush(stdout);
+}
+
+- (void)benchmarkRefresh:(id)info named:(NSString *)name iterations:(int)iterations fixture:(NSString *)fixture
+{
+	double start = SampleClockNow();
+	int i;
+
+	for (i = 0; i < iterations; i++)
+	{
+		[info refresh];
+	}
+	printResult([NSString stringWithFormat:@"refresh.%@", name], iterations, start, fixture);
+}
+
+- (void)benchmarkDrawing:(SEL)selector named:(NSString *)name iterations:(int)iterations
+{
+	double start;
+	int i;
+
+	[iconImage lockFocus];
+	start = SampleClockNow();
+	for (i = 0; i < iterations; i++)
+	{
+		[self performSelector:selector];
+	}
+	printResult([NSString stringWithFormat:@"draw.%@", name], iterations, start, @"-");
+	[iconImage unlockFocus];
+}
+
+- (void)benchmarkInfoAtRadius:(float)radius angle:(float)angle named:(NSString *)name iterations:(int)iterations
+{
+	BOOL wasLocked = infoWindowIsLocked;
+	GraphPoint wasLockedPoint = lockedGraphPoint;
+	double start;
+	int i;
+
+	// the info window draws the panel for the locked point
+	infoWindowIsLocked = YES;
+	lockedGraphPoint.radius = radius;
+	lockedGraphPoint.angle = angle;
+
+	[infoView lockFocus];
+	start = SampleClockNow();
+	for (i = 0; i < iterations; i++)
+	{
+		[self drawInfo];
+	}
+	printResult([NSString stringWithFormat:@"info.%@", name], iterations, start, @"-");
+	[infoView unlockFocus];
+
+	infoWindowIsLocked = wasLocked;
+	lockedGraphPoint = wasLockedPoint;
+}
+
+- (void)runBenchmarks
+{
+	// runs every benchmark on the main thread and quits, the sampler thread isn't started in benchmark mode
+
+	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+	int iterations = [defaults integerForKey:BENCHMARK_ITERATIONS_KEY];
+	NSString *fixture = @"live";
+	double start;
+	int i;
+
+	if (iterations <= 0)
+	{
+		iterations = BENCHMARK_DEFAULT_ITERATIONS;
+	}
+	if (CounterTraceGetMode() == CounterTraceReplaying)
+	{
+		fixture = [[defaults stringForKey:COUNTER_TRACE_REPLAY_KEY] lastPathComponent];
+	}
+
+	printf("benchmark\titerations\tns_per_iteration\tfixture\n");
+
+	// data sources
+	[self benchmarkRefresh:processorInfo named:@"processor" iterations:iterations fixture:fixture];
+	[self benchmarkRefresh:memoryInfo named:@"memory" iterations:iterations fixture:fixture];
+	[self benchmarkRefresh:loadInfo named:@"load" iterations:iterations fixture:fixture];
+	[self benchmarkRefresh:networkInfo named:@"network" iterations:iterations fixture:fixture];
+	[self benchmarkRefresh:diskInfo named:@"disk" iterations:iterations fixture:fixture];
+	[self benchmarkRefresh:temperatureInfo named:@"temperature" iterations:iterations fixture:fixture];
+	[self benchmarkRefresh:powerInfo named:@"power" iterations:iterations fixture:@"live"];
+	[self benchmarkRefresh:airportInfo named:@"airport" iterations:iterations fixture:@"live"];
+
+	// history rings, the number of samples walked is the ring size
+	{
+		const CPUData *cpudata;
+		const DiskData *diskdata;
+		double sum = 0.0;
+
+		start = SampleClockNow();
+		for (i = 0; i < iterations * 100; i++)
+		{
+			[processorInfo startIterate];
+			while ((cpudata = [processorInfo nextSample]))
+			{
+				sum += cpudata->userTotal;
+			}
+		}
+		printResult(@"ring.processor", iterations * 100, start, @"-");
+
+		start = SampleClockNow();
+		for (i = 0; i < iterations * 100; i++)
+		{
+			[diskInfo startIterate];
+			while ((diskdata = [diskInfo nextSample]))
+			{
+				sum += diskdata->readBytes;
+			}
+		}
+		printResult(@"ring.disk", iterations * 100, start, @"-");
+
+		if (sum < 0.0)
+		{
+			NSLog(@"Benchmark: %f", sum);
+		}
+	}
+
+	// gauge scaling, automatic scale and logarithmic scale
+	{
+		float sum = 0.0;
+
+		start = SampleClockNow();
+		for (i = 0; i < BENCHMARK_MATH_ITERATIONS; i++)
+		{
+			sum += [self computeScaleForGauge:0 withPeak:(float)(i + 1)];
+		}
+		printResult(@"scale.compute", BENCHMARK_MATH_ITERATIONS, start, @"-");
+
+		start = SampleClockNow();
+		for (i = 0; i < BENCHMARK_MATH_ITERATIONS; i++)
+		{
+			sum += [self scaleValueForGauge:(float)(i + 1) scaleType:0 scale:1000000.0];
+			sum += [self scaleValueForGauge:(float)(i + 1) scaleType:-2 scale:2.0];
+		}
+		printResult(@"scale.value", BENCHMARK_MATH_ITERATIONS, start, @"-");
+
+		if (sum < 0.0)
+		{
+			NSLog(@"Benchmark: %f", sum);
+		}
+	}
+
+	// moon phase, for a day every hour
+	{
+		time_t day = time(NULL);
+		double sum = 0.0;
+		double pphase, mage, dist, angdia, sudist, suangdia;
+
+		start = SampleClockNow();
+		for (i = 0; i < BENCHMARK_MATH_ITERATIONS; i++)
+		{
+			time_t moment = day + ((i % 24) * 60 * 60);
+			struct tm *gmt = gmtime(&moment);
+
+			sum += phase(jtime(gmt), &pphase, &mage, &dist, &angdia, &sudist, &suangdia);
+		}
+		printResult(@"phase", BENCHMARK_MATH_ITERATIONS, start, @"-");
+
+		if (sum < 0.0)
+		{
+			NSLog(@"Benchmark: %f", sum);
+		}
+	}
+
+	// gauges, drawn into the dock icon image
+	now = time(NULL);
+	[self benchmarkDrawing:@selector(drawProcessorGauge) named:@"processor" iterations:iterations];
+	[self benchmarkDrawing:@selector(drawMemoryGauge) named:@"memory" iterations:iterations];
+	[self benchmarkDrawing:@selector(drawNetworkGauge) named:@"network" iterations:iterations];
+	[self benchmarkDrawing:@selector(drawDiskGauge) named:@"disk" iterations:iterations];
+	[self benchmarkDrawing:@selector(drawHistoryGauge) named:@"history" iterations:iterations];
+
+	// a whole frame, the dock icon, the floating window and the menubar
+	start = SampleClockNow();
+	for (i = 0; i < iterations; i++)
+	{
+		[self drawImages];
+	}
+	printResult(@"frame.drawImages", iterations, start, @"-");
+
+	// info panels
+	[self benchmarkInfoAtRadius:0.25 angle:45.0 named:@"processor" iterations:iterations];
+	[self benchmarkInfoAtRadius:0.6 angle:90.0 named:@"memory" iterations:iterations];
+	[self benchmarkInfoAtRadius:0.6 angle:270.0 named:@"disk" iterations:iterations];
+	[self benchmarkInfoAtRadius:0.9 angle:225.0 named:@"network" iterations:iterations];
+
+	[NSApp terminate:self];
+}
+
+@end
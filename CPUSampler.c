@@ -0,0 +1,497 @@
+/*
+ *  CPUSampler.c
+ *
+ *  Per-processor tick sampler that sizes itself at runtime.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <mach/mach_host.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include "CPUSampler.h"
+#include "CounterTrace.h"
+#include "SampleClock.h"
+
+
+int CPUSamplerMaximumProcessorCount(void)
+{
+	int result = 1;
+
+#if defined(__APPLE__)
+	host_basic_info_data_t hostInfo;
+	mach_msg_type_number_t count = HOST_BASIC_INFO_COUNT;
+
+	if (host_info(mach_host_self(), HOST_BASIC_INFO, (host_info_t) &hostInfo, &count) == KERN_SUCCESS)
+	{
+		result = hostInfo.max_cpus;
+	}
+#elif defined(__linux__)
+	long count = sysconf(_SC_NPROCESSORS_CONF);
+
+	if (count > 0)
+	{
+		result = (int) count;
+	}
+#endif
+
+	if (result < 1)
+	{
+		result = 1;
+	}
+	return (result);
+}
+
+
+static void *growArray(void *array, int oldCapacity, int newCapacity, size_t elementSize)
+{
+	void *result = realloc(array, newCapacity * elementSize);
+
+	if (result != NULL)
+	{
+		memset((char *)result + (oldCapacity * elementSize), 0, (newCapacity - oldCapacity) * elementSize);
+	}
+	return (result);
+}
+
+
+int CPUSamplerReserve(CPUSampler *sampler, int capacity)
+{
+	cpu_ticks_t **ticks[] = { &sampler->system, &sampler->user, &sampler->nice, &sampler->idle,
+			&sampler->lastSystem, &sampler->lastUser, &sampler->lastNice, &sampler->lastIdle };
+	double **fractions[] = { &sampler->systemFraction, &sampler->userFraction, &sampler->niceFraction, &sampler->idleFraction };
+	void *array;
+	size_t i;
+
+	if (capacity <= sampler->capacity)
+	{
+		return (1);
+	}
+
+	for (i = 0; i < sizeof(ticks) / sizeof(ticks[0]); i++)
+	{
+		array = growArray(*ticks[i], sampler->capacity, capacity, sizeof(cpu_ticks_t));
+		if (array == NULL)
+		{
+			return (0);
+		}
+		*ticks[i] = array;
+	}
+	for (i = 0; i < sizeof(fractions) / sizeof(fractions[0]); i++)
+	{
+		array = growArray(*fractions[i], sampler->capacity, capacity, sizeof(double));
+		if (array == NULL)
+		{
+			return (0);
+		}
+		*fractions[i] = array;
+	}
+
+	sampler->capacity = capacity;
+	return (1);
+}
+
+
+CPUSampler *CPUSamplerCreate(int capacity)
+{
+	CPUSampler *sampler;
+
+	sampler = calloc(1, sizeof(CPUSampler));
+	if (sampler == NULL)
+	{
+		return (NULL);
+	}
+
+	if (capacity <= 0)
+	{
+		capacity = CPUSamplerMaximumProcessorCount();
+	}
+	if (! CPUSamplerReserve(sampler, capacity))
+	{
+		CPUSamplerDispose(sampler);
+		return (NULL);
+	}
+
+	// the first sample only establishes the baseline for the next interval
+	CPUSamplerRefresh(sampler);
+
+	return (sampler);
+}
+
+
+void CPUSamplerDispose(CPUSampler *sampler)
+{
+	if (sampler != NULL)
+	{
+		free(sampler->system);
+		free(sampler->user);
+		free(sampler->nice);
+		free(sampler->idle);
+		free(sampler->lastSystem);
+		free(sampler->lastUser);
+		free(sampler->lastNice);
+		free(sampler->lastIdle);
+		free(sampler->systemFraction);
+		free(sampler->userFraction);
+		free(sampler->niceFraction);
+		free(sampler->idleFraction);
+		free(sampler->replayRecord);
+		free(sampler);
+	}
+}
+
+
+void CPUSamplerCompute(CPUSampler *sampler)
+{
+	int processorCount = sampler->processorCount;
+	const cpu_ticks_t *system = sampler->system;
+	const cpu_ticks_t *user = sampler->user;
+	const cpu_ticks_t *nice = sampler->nice;
+	const cpu_ticks_t *idle = sampler->idle;
+	const cpu_ticks_t *lastSystem = sampler->lastSystem;
+	const cpu_ticks_t *lastUser = sampler->lastUser;
+	const cpu_ticks_t *lastNice = sampler->lastNice;
+	const cpu_ticks_t *lastIdle = sampler->lastIdle;
+	double *systemFraction = sampler->systemFraction;
+	double *userFraction = sampler->userFraction;
+	double *niceFraction = sampler->niceFraction;
+	double *idleFraction = sampler->idleFraction;
+	double deltaSystem, deltaUser, deltaNice, deltaIdle;
+	double deltaTotal, scale;
+	double systemSum, userSum, niceSum, idleSum, totalSum;
+	int i;
+
+	systemSum = 0.0;
+	userSum = 0.0;
+	niceSum = 0.0;
+	idleSum = 0.0;
+	for (i = 0; i < processorCount; i++)
+	{
+		deltaSystem = (double) (system[i] - lastSystem[i]);
+		deltaUser = (double) (user[i] - lastUser[i]);
+		deltaNice = (double) (nice[i] - lastNice[i]);
+		deltaIdle = (double) (idle[i] - lastIdle[i]);
+		deltaTotal = deltaSystem + deltaUser + deltaNice + deltaIdle;
+
+		// an idle or offline processor has no ticks in the interval and reports zero for every state
+		scale = (deltaTotal > 0.0 ? 1.0 / deltaTotal : 0.0);
+		systemFraction[i] = deltaSystem * scale;
+		userFraction[i] = deltaUser * scale;
+		niceFraction[i] = deltaNice * scale;
+		idleFraction[i] = deltaIdle * scale;
+
+		systemSum += deltaSystem;
+		userSum += deltaUser;
+		niceSum += deltaNice;
+		idleSum += deltaIdle;
+	}
+
+	totalSum = systemSum + userSum + niceSum + idleSum;
+	scale = (totalSum > 0.0 ? 1.0 / totalSum : 0.0);
+	sampler->systemTotal = systemSum * scale;
+	sampler->userTotal = userSum * scale;
+	sampler->niceTotal = niceSum * scale;
+	sampler->idleTotal = idleSum * scale;
+
+	memcpy(sampler->lastSystem, system, processorCount * sizeof(cpu_ticks_t));
+	memcpy(sampler->lastUser, user, processorCount * sizeof(cpu_ticks_t));
+	memcpy(sampler->lastNice, nice, processorCount * sizeof(cpu_ticks_t));
+	memcpy(sampler->lastIdle, idle, processorCount * sizeof(cpu_ticks_t));
+}
+
+
+#if defined(__APPLE__)
+
+static int readTicks(CPUSampler *sampler)
+{
+	kern_return_t error;
+	natural_t processorCount;
+	processor_info_array_t infoArray;
+	mach_msg_type_number_t infoCount;
+	int infoSize;
+	int i;
+
+	error = host_processor_info(mach_host_self(), PROCESSOR_CPU_LOAD_INFO, &processorCount, &infoArray, &infoCount);
+	if (error != KERN_SUCCESS || processorCount == 0)
+	{
+		return (0);
+	}
+	infoSize = infoCount / processorCount;	// actual data size for each processor
+
+	if (! CPUSamplerReserve(sampler, processorCount))
+	{
+		vm_deallocate(mach_task_self(), (vm_address_t)infoArray, infoCount * sizeof(integer_t));
+		return (0);
+	}
+
+	for (i = 0; i < processorCount; i++)
+	{
+		sampler->system[i] = (unsigned int) infoArray[(i * infoSize) + CPU_STATE_SYSTEM];
+		sampler->user[i] = (unsigned int) infoArray[(i * infoSize) + CPU_STATE_USER];
+		sampler->nice[i] = (unsigned int) infoArray[(i * infoSize) + CPU_STATE_NICE];
+		sampler->idle[i] = (unsigned int) infoArray[(i * infoSize) + CPU_STATE_IDLE];
+	}
+	sampler->processorCount = processorCount;
+
+	vm_deallocate(mach_task_self(), (vm_address_t)infoArray, infoCount * sizeof(integer_t));
+	return (1);
+}
+
+#elif defined(__linux__)
+
+static int readTicks(CPUSampler *sampler)
+{
+	FILE *file;
+	char line[512];
+	int processor;
+	int processorCount;
+	cpu_ticks_t user, nice, system, idle, iowait, irq, softirq, steal;
+	int fields;
+
+	file = fopen("/proc/stat", "r");
+	if (file == NULL)
+	{
+		return (0);
+	}
+
+	processorCount = 0;
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		// the aggregate "cpu " line is skipped, the totals are computed from the per-processor lines
+		if (strncmp(line, "cpu", 3) != 0 || line[3] < '0' || line[3] > '9')
+		{
+			continue;
+		}
+
+		iowait = irq = softirq = steal = 0;
+		fields = sscanf(line + 3, "%d %llu %llu %llu %llu %llu %llu %llu %llu", &processor,
+				&user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+		if (fields < 5 || processor < 0)
+		{
+			continue;
+		}
+
+		if (processor >= sampler->capacity)
+		{
+			if (! CPUSamplerReserve(sampler, processor + 1))
+			{
+				fclose(file);
+				return (0);
+			}
+		}
+		// offline processors are missing from /proc/stat, keep their counters unchanged
+		for (; processorCount < processor; processorCount++)
+		{
+			sampler->system[processorCount] = sampler->lastSystem[processorCount];
+			sampler->user[processorCount] = sampler->lastUser[processorCount];
+			sampler->nice[processorCount] = sampler->lastNice[processorCount];
+			sampler->idle[processorCount] = sampler->lastIdle[processorCount];
+		}
+
+		// fold the Linux-only states into the four states the gauges draw
+		sampler->system[processor] = system + irq + softirq + steal;
+		sampler->user[processor] = user;
+		sampler->nice[processor] = nice;
+		sampler->idle[processor] = idle + iowait;
+		processorCount = processor + 1;
+	}
+	fclose(file);
+
+	if (processorCount == 0)
+	{
+		return (0);
+	}
+	sampler->processorCount = processorCount;
+	return (1);
+}
+
+#else
+
+static int readTicks(CPUSampler *sampler)
+{
+	return (0);
+}
+
+#endif
+
+
+// appends the tick counters just read to the counter trace
+static void recordTicks(CPUSampler *sampler)
+{
+	size_t arrayLength = sampler->processorCount * sizeof(cpu_ticks_t);
+	size_t length = 8 + (4 * arrayLength);
+	unsigned char *record = malloc(length);
+
+	if (record == NULL)
+	{
+		return;
+	}
+	((unsigned int *) record)[0] = sampler->processorCount;
+	((unsigned int *) record)[1] = 0;
+	memcpy(record + 8, sampler->system, arrayLength);
+	memcpy(record + 8 + arrayLength, sampler->user, arrayLength);
+	memcpy(record + 8 + (2 * arrayLength), sampler->nice, arrayLength);
+	memcpy(record + 8 + (3 * arrayLength), sampler->idle, arrayLength);
+	CounterTraceRecord(CounterTraceProcessor, record, length, SampleClockNow());
+	free(record);
+}
+
+
+// takes the tick counters from the counter trace instead of the host
+static int replayTicks(CPUSampler *sampler)
+{
+	size_t length, arrayLength;
+	const unsigned char *record;
+	int processorCount;
+
+	length = CounterTraceReplayRecord(CounterTraceProcessor, sampler->replayRecord, sampler->replayCapacity, NULL);
+	if (length > sampler->replayCapacity)
+	{
+		// a trace from a machine with more processors, the record is still the next one
+		unsigned char *grown = realloc(sampler->replayRecord, length);
+
+		if (grown == NULL)
+		{
+			return (0);
+		}
+		sampler->replayRecord = grown;
+		sampler->replayCapacity = length;
+		length = CounterTraceReplayRecord(CounterTraceProcessor, sampler->replayRecord, sampler->replayCapacity, NULL);
+	}
+	sampler->replayEnded = (length == 0);
+	if (sampler->replayEnded)
+	{
+		return (0);
+	}
+
+	record = sampler->replayRecord;
+	if (length < 8)
+	{
+		return (0);
+	}
+	processorCount = ((const unsigned int *) record)[0];
+	arrayLength = processorCount * sizeof(cpu_ticks_t);
+	if (processorCount < 1 || length != 8 + (4 * arrayLength) || ! CPUSamplerReserve(sampler, processorCount))
+	{
+		return (0);
+	}
+	memcpy(sampler->system, record + 8, arrayLength);
+	memcpy(sampler->user, record + 8 + arrayLength, arrayLength);
+	memcpy(sampler->nice, record + 8 + (2 * arrayLength), arrayLength);
+	memcpy(sampler->idle, record + 8 + (3 * arrayLength), arrayLength);
+	sampler->processorCount = processorCount;
+	return (1);
+}
+
+
+int CPUSamplerRefresh(CPUSampler *sampler)
+{
+	if (CounterTraceGetMode() == CounterTraceReplaying)
+	{
+		if (! replayTicks(sampler))
+		{
+			return (0);
+		}
+	}
+	else
+	{
+		sampler->replayEnded = 0;
+		if (! readTicks(sampler))
+		{
+			return (0);
+		}
+		if (CounterTraceGetMode() == CounterTraceRecording)
+		{
+			recordTicks(sampler);
+		}
+	}
+	CPUSamplerCompute(sampler);
+	return (1);
+}
+
+
+#if CPU_SAMPLER_BENCHMARK
+
+/*
+ *  Measures CPUSamplerCompute() with synthetic tick counters for 8 to 1024 processors and
+ *  prints one tab-separated line per processor count:
+ *
+ *	processors	iterations	ns_per_refresh	ns_per_processor
+ *
+ *  The host backend is timed once at the end so the cost of reading the counters can be
+ *  compared with the cost of computing the fractions.
+ */
+
+#include <time.h>
+
+static double benchmarkNow(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((double) now.tv_sec * 1.0e9 + (double) now.tv_nsec);
+}
+
+int main(int argc, char *argv[])
+{
+	static const int processorCounts[] = { 8, 16, 32, 64, 128, 256, 512, 1024 };
+	const int iterations = 20000;
+	CPUSampler *sampler;
+	double start, elapsed;
+	double checksum = 0.0;
+	int c, i, j;
+
+	printf("processors\titerations\tns_per_refresh\tns_per_processor\n");
+	for (c = 0; c < (int) (sizeof(processorCounts) / sizeof(processorCounts[0])); c++)
+	{
+		sampler = calloc(1, sizeof(CPUSampler));
+		if (sampler == NULL || ! CPUSamplerReserve(sampler, processorCounts[c]))
+		{
+			fprintf(stderr, "failed to allocate sampler for %d processors\n", processorCounts[c]);
+			return (1);
+		}
+		sampler->processorCount = processorCounts[c];
+
+		start = benchmarkNow();
+		for (i = 0; i < iterations; i++)
+		{
+			for (j = 0; j < sampler->processorCount; j++)
+			{
+				sampler->system[j] += (i + j) & 3;
+				sampler->user[j] += (i + j) & 7;
+				sampler->nice[j] += (j & 1);
+				sampler->idle[j] += 10 - ((i + j) & 7);
+			}
+			CPUSamplerCompute(sampler);
+			checksum += sampler->userTotal;
+		}
+		elapsed = benchmarkNow() - start;
+
+		printf("%d\t%d\t%.1f\t%.2f\n", processorCounts[c], iterations, elapsed / iterations, elapsed / iterations / processorCounts[c]);
+		CPUSamplerDispose(sampler);
+	}
+
+	sampler = CPUSamplerCreate(0);
+	if (sampler != NULL)
+	{
+		start = benchmarkNow();
+		for (i = 0; i < 1000; i++)
+		{
+			CPUSamplerRefresh(sampler);
+		}
+		elapsed = benchmarkNow() - start;
+		printf("# host\t%d processors\t%.1f ns per refresh\n", sampler->processorCount, elapsed / 1000);
+		CPUSamplerDispose(sampler);
+	}
+
+	fprintf(stderr, "checksum %f\n", checksum);
+	return (0);
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ *  CPUSampler.h
+ *
+ *  Per-processor tick sampler that sizes itself at runtime (no MAX_PROCESSORS limit).
+ *
+ *  Tick counters and the resulting fractions are kept as a struct of arrays (one array per CPU
+ *  state) so the delta loop in CPUSamplerCompute() runs over contiguous memory and vectorizes.
+ *
+ *  Backends: host_processor_info() on Mac OS X, /proc/stat on Linux, or a counter trace being
+ *  replayed (see CounterTrace.h). The Linux backend and the benchmark let the sampler be built and
+ *  measured without Mach:
+ *
+ *	cc -O2 -DCPU_SAMPLER_BENCHMARK -o cpu_sampler_benchmark CPUSampler.c CounterTrace.c
+ */
+
+#ifndef CPU_SAMPLER_H
+#define CPU_SAMPLER_H
+
+typedef unsigned long long cpu_ticks_t;
+
+typedef struct cpusampler
+{
+	int processorCount;	// processors reported by the last sample
+	int capacity;		// processors the arrays can hold
+
+	// current and previous tick counters, indexed by processor
+	cpu_ticks_t *system;
+	cpu_ticks_t *user;
+	cpu_ticks_t *nice;
+	cpu_ticks_t *idle;
+	cpu_ticks_t *lastSystem;
+	cpu_ticks_t *lastUser;
+	cpu_ticks_t *lastNice;
+	cpu_ticks_t *lastIdle;
+
+	// fraction of the last interval spent in each state, indexed by processor
+	double *systemFraction;
+	double *userFraction;
+	double *niceFraction;
+	double *idleFraction;
+
+	// fraction of the last interval for all processors combined
+	double systemTotal;
+	double userTotal;
+	double niceTotal;
+	double idleTotal;
+
+	// replaying a counter trace
+	unsigned char *replayRecord;	// copy of the last processor record
+	size_t replayCapacity;
+	int replayEnded;	// non-zero once the trace has no more processor records
+} CPUSampler;
+
+// returns the largest number of processors the host can report (never less than 1)
+int CPUSamplerMaximumProcessorCount(void);
+
+// creates a sampler that can hold capacity processors (0 uses CPUSamplerMaximumProcessorCount) and takes an initial sample
+CPUSampler *CPUSamplerCreate(int capacity);
+void CPUSamplerDispose(CPUSampler *sampler);
+
+// grows the arrays to hold at least capacity processors, returns 0 if memory could not be allocated
+int CPUSamplerReserve(CPUSampler *sampler, int capacity);
+
+// reads the tick counters from the host and computes new fractions, returns 0 on failure or when a replayed
+// trace has ended, which sets replayEnded -- the fractions then stay those of the last record
+int CPUSamplerRefresh(CPUSampler *sampler);
+
+// computes fractions from the current and last tick counters, then makes the current counters the last ones
+void CPUSamplerCompute(CPUSampler *sampler);
+
+#endif
@@ -0,0 +1,393 @@
+/*
+ *  CounterTrace.c
+ *
+ *  Recording of the raw counters each source reads, and replay of them through the same math.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "CounterTrace.h"
+
+#define FILE_HEADER_SIZE 16
+#define RECORD_HEADER_SIZE 16
+#define PADDED_LENGTH(length) (((length) + 7) & ~((size_t) 7))
+
+typedef struct recordheader
+{
+	uint32_t source;
+	uint32_t length;
+	double timestamp;
+} RecordHeader;
+
+// the sources refresh on the sampler thread, but the data objects also read their first counters on the main thread
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static CounterTraceMode traceMode = CounterTraceOff;
+
+// recording
+static FILE *traceFile = NULL;
+
+// replaying, the whole trace is read into memory and every source walks it with its own cursor
+static unsigned char *traceData = NULL;
+static size_t traceLength = 0;
+static size_t sourceOffset[CounterTraceSourceCount];
+static const RecordHeader *sourceLast[CounterTraceSourceCount];
+
+
+static int startRecording(const char *path)
+{
+	uint32_t header[FILE_HEADER_SIZE / 4] = { COUNTER_TRACE_MAGIC, COUNTER_TRACE_VERSION, FILE_HEADER_SIZE, 0 };
+
+	traceFile = fopen(path, "wb");
+	if (traceFile == NULL)
+	{
+		return (0);
+	}
+	if (fwrite(header, sizeof(header), 1, traceFile) != 1)
+	{
+		fclose(traceFile);
+		traceFile = NULL;
+		return (0);
+	}
+	return (1);
+}
+
+
+static int startReplaying(const char *path)
+{
+	FILE *file;
+	long length;
+	const uint32_t *header;
+	int source;
+
+	file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		return (0);
+	}
+	if (fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < FILE_HEADER_SIZE || fseek(file, 0, SEEK_SET) != 0)
+	{
+		fclose(file);
+		return (0);
+	}
+
+	traceData = malloc(length);
+	if (traceData == NULL || fread(traceData, length, 1, file) != 1)
+	{
+		free(traceData);
+		traceData = NULL;
+		fclose(file);
+		return (0);
+	}
+	fclose(file);
+
+	// a magic that reads backwards is a trace from a machine with the other byte order
+	header = (const uint32_t *) traceData;
+	if (header[0] != COUNTER_TRACE_MAGIC || header[1] != COUNTER_TRACE_VERSION || header[2] < FILE_HEADER_SIZE || header[2] > (uint32_t) length)
+	{
+		free(traceData);
+		traceData = NULL;
+		return (0);
+	}
+
+	traceLength = length;
+	for (source = 0; source < CounterTraceSourceCount; source++)
+	{
+		sourceOffset[source] = header[2];
+		sourceLast[source] = NULL;
+	}
+	return (1);
+}
+
+
+int CounterTraceStart(CounterTraceMode mode, const char *path)
+{
+	int result = 0;
+
+	CounterTraceStop();
+
+	pthread_mutex_lock(&traceLock);
+	if (mode == CounterTraceRecording)
+	{
+		result = startRecording(path);
+	}
+	else if (mode == CounterTraceReplaying)
+	{
+		result = startReplaying(path);
+	}
+	traceMode = (result ? mode : CounterTraceOff);
+	pthread_mutex_unlock(&traceLock);
+
+	return (result);
+}
+
+
+void CounterTraceStop(void)
+{
+	pthread_mutex_lock(&traceLock);
+	if (traceFile != NULL)
+	{
+		fclose(traceFile);
+		traceFile = NULL;
+	}
+	free(traceData);
+	traceData = NULL;
+	traceLength = 0;
+	traceMode = CounterTraceOff;
+	pthread_mutex_unlock(&traceLock);
+}
+
+
+CounterTraceMode CounterTraceGetMode(void)
+{
+	return (traceMode);
+}
+
+
+void CounterTraceRecord(CounterTraceSource source, const void *counters, size_t length, double timestamp)
+{
+	static const unsigned char padding[8] = { 0 };
+	RecordHeader header;
+
+	if (traceMode != CounterTraceRecording)
+	{
+		return;
+	}
+
+	header.source = source;
+	header.length = (uint32_t) length;
+	header.timestamp = timestamp;
+
+	pthread_mutex_lock(&traceLock);
+	if (traceFile != NULL)
+	{
+		fwrite(&header, sizeof(header), 1, traceFile);
+		fwrite(counters, length, 1, traceFile);
+		fwrite(padding, PADDED_LENGTH(length) - length, 1, traceFile);
+
+		// a trace is most useful when something went wrong, so it shouldn't lose the records before a crash
+		fflush(traceFile);
+	}
+	pthread_mutex_unlock(&traceLock);
+}
+
+
+// finds the next record for a source, called with the lock held
+static const RecordHeader *nextRecord(CounterTraceSource source)
+{
+	size_t offset = sourceOffset[source];
+
+	while (offset + RECORD_HEADER_SIZE <= traceLength)
+	{
+		const RecordHeader *header = (const RecordHeader *) (traceData + offset);
+		size_t next = offset + RECORD_HEADER_SIZE + PADDED_LENGTH((size_t) header->length);
+
+		if (next > traceLength)
+		{
+			// the last record was cut short, probably by the recording process exiting
+			break;
+		}
+		offset = next;
+		if (header->source == (uint32_t) source)
+		{
+			sourceOffset[source] = offset;
+			sourceLast[source] = header;
+			return (header);
+		}
+	}
+	sourceOffset[source] = traceLength;
+	return (NULL);
+}
+
+
+size_t CounterTraceReplayRecord(CounterTraceSource source, void *counters, size_t capacity, double *timestamp)
+{
+	const RecordHeader *header = NULL;
+	size_t length = 0;
+
+	// the records are copied with the lock held, CounterTraceStop() frees the trace
+	pthread_mutex_lock(&traceLock);
+	if (traceMode == CounterTraceReplaying)
+	{
+		size_t offset = sourceOffset[source];
+		const RecordHeader *last = sourceLast[source];
+
+		header = nextRecord(source);
+		if (header != NULL)
+		{
+			length = header->length;
+			if (length <= capacity)
+			{
+				memcpy(counters, (const unsigned char *) header + RECORD_HEADER_SIZE, length);
+				if (timestamp != NULL)
+				{
+					*timestamp = header->timestamp;
+				}
+			}
+			else
+			{
+				// the record stays the next one until the caller has room for it
+				sourceOffset[source] = offset;
+				sourceLast[source] = last;
+			}
+		}
+	}
+	pthread_mutex_unlock(&traceLock);
+
+	return (length);
+}
+
+
+int CounterTraceReplay(CounterTraceSource source, void *counters, size_t length, double *timestamp)
+{
+	const RecordHeader *header = NULL;
+	int result = 0;
+
+	pthread_mutex_lock(&traceLock);
+	if (traceMode == CounterTraceReplaying)
+	{
+		header = nextRecord(source);
+		result = (header != NULL);
+		if (header == NULL)
+		{
+			header = sourceLast[source];
+		}
+	}
+	if (header != NULL && header->length == length)
+	{
+		memcpy(counters, (const unsigned char *) header + RECORD_HEADER_SIZE, length);
+		if (timestamp != NULL)
+		{
+			*timestamp = header->timestamp;
+		}
+	}
+	else
+	{
+		result = 0;
+	}
+	pthread_mutex_unlock(&traceLock);
+
+	return (result);
+}
+
+
+#if COUNTER_TRACE_BENCHMARK
+
+/*
+ *  Records live refreshes of the CPU sampler, replays the trace twice and checks that every
+ *  replayed fraction is the recorded one, then prints one tab-separated line per backend:
+ *
+ *	backend	processors	refreshes	ns_per_refresh
+ */
+
+#include <time.h>
+#include <unistd.h>
+
+#include "CPUSampler.h"
+
+static double benchmarkNow(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((double) now.tv_sec * 1.0e9 + (double) now.tv_nsec);
+}
+
+static double fractionChecksum(const CPUSampler *sampler)
+{
+	double sum = sampler->systemTotal + (2.0 * sampler->userTotal) + (3.0 * sampler->niceTotal) + (4.0 * sampler->idleTotal);
+	int i;
+
+	for (i = 0; i < sampler->processorCount; i++)
+	{
+		sum += (i + 1) * (sampler->userFraction[i] + sampler->systemFraction[i]);
+	}
+	return (sum);
+}
+
+static int replay(const char *path, int refreshes, const double *expected, double *elapsed)
+{
+	CPUSampler *sampler;
+	double start;
+	int i;
+
+	if (! CounterTraceStart(CounterTraceReplaying, path))
+	{
+		return (0);
+	}
+	sampler = CPUSamplerCreate(0);
+	start = benchmarkNow();
+	for (i = 0; i < refreshes; i++)
+	{
+		if (! CPUSamplerRefresh(sampler) || fractionChecksum(sampler) != expected[i])
+		{
+			fprintf(stderr, "replayed refresh %d does not match the recording\n", i);
+			return (0);
+		}
+	}
+	*elapsed = benchmarkNow() - start;
+	if (CPUSamplerRefresh(sampler) || ! sampler->replayEnded)
+	{
+		fprintf(stderr, "replay did not end with the recording\n");
+		return (0);
+	}
+	CPUSamplerDispose(sampler);
+	CounterTraceStop();
+	return (1);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = (argc > 1 ? argv[1] : "counter_trace_benchmark.trace");
+	const int refreshes = 2000;
+	double expected[2000];
+	CPUSampler *sampler;
+	double start, elapsed;
+	int i, processorCount;
+
+	if (! CounterTraceStart(CounterTraceRecording, path))
+	{
+		fprintf(stderr, "failed to create %s\n", path);
+		return (1);
+	}
+	sampler = CPUSamplerCreate(0);
+	if (sampler == NULL)
+	{
+		fprintf(stderr, "failed to create sampler\n");
+		return (1);
+	}
+	start = benchmarkNow();
+	for (i = 0; i < refreshes; i++)
+	{
+		if (! CPUSamplerRefresh(sampler))
+		{
+			fprintf(stderr, "live refresh failed\n");
+			return (1);
+		}
+		expected[i] = fractionChecksum(sampler);
+	}
+	elapsed = benchmarkNow() - start;
+	processorCount = sampler->processorCount;
+	CPUSamplerDispose(sampler);
+	CounterTraceStop();
+
+	printf("backend\tprocessors\trefreshes\tns_per_refresh\n");
+	printf("record\t%d\t%d\t%.1f\n", processorCount, refreshes, elapsed / refreshes);
+
+	for (i = 0; i < 2; i++)
+	{
+		if (! replay(path, refreshes, expected, &elapsed))
+		{
+			return (1);
+		}
+		printf("replay\t%d\t%d\t%.1f\n", processorCount, refreshes, elapsed / refreshes);
+	}
+
+	unlink(path);
+	return (0);
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ *  CounterTrace.h
+ *
+ *  Recording of the raw counters each source reads, and replay of them through the same math.
+ *
+ *  While recording, every source appends the counters it read from the host to a binary trace.
+ *  While replaying, the sources take their counters from the trace instead of the host, in the
+ *  order they were recorded, so the deltas, fractions and graphs come out exactly as they did. The
+ *  timestamps used to scale the deltas are replayed too, so the result doesn't depend on how fast
+ *  the trace is played back.
+ *
+ *	offset	size	file header
+ *	0	4	magic ('iPCT' in the byte order of the machine that recorded it)
+ *	4	4	version
+ *	8	4	header size
+ *	12	4	reserved
+ *
+ *	offset	size	record
+ *	0	4	source, see CounterTraceSource
+ *	4	4	payload length in bytes
+ *	8	8	timestamp, SampleClockNow() on the machine that recorded it
+ *	16	...	payload, padded to a multiple of 8 bytes
+ *
+ *  Payloads are the counter structures the sources read (vm_statistics_data_t, struct iftot and
+ *  so on), so a trace is replayed on a machine with the same byte order. The processor payload
+ *  has its own layout that doesn't depend on Mach, so the CPU sampler can replay a trace anywhere.
+ *
+ *  The benchmark records the CPU sampler, checks that two replays match the recording and
+ *  compares a replayed refresh with a live one:
+ *
+ *	cc -O2 -DCOUNTER_TRACE_BENCHMARK -o counter_trace_benchmark CounterTrace.c CPUSampler.c
+ */
+
+#ifndef COUNTER_TRACE_H
+#define COUNTER_TRACE_H
+
+#include <stddef.h>
+
+#define COUNTER_TRACE_MAGIC 0x54435069	// 'iPCT' when read as little-endian bytes
+#define COUNTER_TRACE_VERSION 1
+
+typedef enum
+{
+	CounterTraceOff = 0,
+	CounterTraceRecording,
+	CounterTraceReplaying
+} CounterTraceMode;
+
+typedef enum
+{
+	CounterTraceProcessor = 0,	// uint32 processor count, uint32 padding, then system, user, nice and idle ticks as uint64 arrays
+	CounterTraceMemory,		// vm_statistics_data_t
+	CounterTraceLoad,		// host_load_info_data_t
+	CounterTraceNetwork,		// struct iftot summed over the interfaces
+	CounterTraceDisk,		// read count, read bytes, write count and write bytes as UInt64
+	CounterTraceTemperature,	// TemperatureData after the sensor values are converted
+	CounterTraceSourceCount
+} CounterTraceSource;
+
+// starts recording to path (replacing the file) or replaying from it, returns 0 if the file can't be used
+int CounterTraceStart(CounterTraceMode mode, const char *path);
+void CounterTraceStop(void);
+CounterTraceMode CounterTraceGetMode(void);
+
+// appends the counters a source just read, does nothing unless recording
+void CounterTraceRecord(CounterTraceSource source, const void *counters, size_t length, double timestamp);
+
+// copies the next recorded counters for a source into counters -- when the trace has no more records
+// for the source, the last ones are copied again so the deltas are zero, and 0 is returned
+int CounterTraceReplay(CounterTraceSource source, void *counters, size_t length, double *timestamp);
+
+// copies the next record for a source whose length varies into counters and returns its length, or 0 when
+// there are no more -- a record longer than capacity isn't copied and stays the next one, so the caller can grow
+// counters to the length returned and ask again
+size_t CounterTraceReplayRecord(CounterTraceSource source, void *counters, size_t capacity, double *timestamp);
+
+#endif
@@ -11,6 +11,9 @@
 #import <IOKit/IOKitLib.h>
 #import <IOKit/storage/IOBlockStorageDriver.h>
 
+#import "HistoryRing.h"
+#import "HistoryFile.h"
+
 #define MAX_DISK_COUNT 12
 
 typedef struct diskstats {
@@ -32,29 +35,36 @@ typedef struct diskdata {
 	UInt64 readBytes;
 	UInt64 writeCount;
 	UInt64 writeBytes;
+
+	double timestamp;	// SampleClockNow() when the sample was taken
+	double elapsed;		// seconds since the previous sample, the counts above are scaled to the update interval
 }
 DiskData, *DiskDataPtr;
 
 
 @interface DiskInfo : NSObject
 {
-	int			size;
-	int			inptr;
-	int			outptr;
-	DiskDataPtr		diskdata;
+	HistoryRing history;
+	HistoryRingIterator iterator;
 
 	UInt64 lastReadCount;
 	UInt64 lastReadBytes;
 	UInt64 lastWriteCount;
 	UInt64 lastWriteBytes;
+	double lastTimestamp;
 }
 
 - (DiskInfo *)initWithCapacity:(unsigned)numItems;
 - (void)refresh;
+- (void)restoreFromHistoryFile:(const HistoryFile *)file;
 - (void)startIterate;
 - (BOOL)getNext:(DiskDataPtr)ptr;
 - (void)getCurrent:(DiskDataPtr)ptr;
 - (void)getLast:(DiskDataPtr)ptr;
+- (const DiskData *)nextSample;
+- (const DiskData *)currentSample;
+- (const DiskData *)lastSample;
+- (const HistoryRing *)history;
 - (int)getSize;
 
 @end
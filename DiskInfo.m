@@ -7,6 +7,9 @@
 #import "string.h"
 #import "mach/mach_host.h"
 #import "DiskInfo.h"
+#import "Preferences.h"
+#import "SampleClock.h"
+#import "CounterTrace.h"
 
 void getDiskCounts(io_iterator_t drivelist, UInt64 *readCount, UInt64 *readBytes, UInt64 *writeCount, UInt64 *writeBytes);
 
@@ -17,19 +20,18 @@ void getDiskCounts(io_iterator_t drivelist, UInt64 *readCount, UInt64 *readBytes
 - (id)initWithCapacity:(unsigned)numItems
 {
 	self = [super init];
-	size = numItems;
-	diskdata = calloc(numItems, sizeof(DiskData));
-	if (diskdata == NULL) {
+	if (! HistoryRingInit(&history, numItems, sizeof(DiskData))) {
 		NSLog (@"Failed to allocate buffer for DiskInfo");
 		return (nil);
 	}
-	inptr = 0;
-	outptr = -1;
+	iterator.outptr = -1;
+	lastTimestamp = SampleClockNow();
 	return (self);
 }
 
 - (void)refresh
 {
+	DiskDataPtr sample = HistoryRingWriteSlot(&history);
 	OSErr osErr = noErr;
 	int insertIndex = 0;
 	int insertIndexRO = 0;
@@ -119,26 +121,26 @@ void getDiskCounts(io_iterator_t drivelist, UInt64 *readCount, UInt64 *readBytes
 					if (volumeInfo.blockSize > INT_MAX)
 					{
 						// not a valid block size (because it's probably unknown like with WebDAV)
-						diskdata[inptr].unlocked.blockSize[insertIndex] = 0;
-						diskdata[inptr].unlocked.freeBlocks[insertIndex] = 0;
-						diskdata[inptr].unlocked.availableBlocks[insertIndex] = 0;
+						sample->unlocked.blockSize[insertIndex] = 0;
+						sample->unlocked.freeBlocks[insertIndex] = 0;
+						sample->unlocked.availableBlocks[insertIndex] = 0;
 					}
 					else
 					{
-						diskdata[inptr].unlocked.blockSize[insertIndex] = volumeInfo.blockSize;
-						diskdata[inptr].unlocked.freeBlocks[insertIndex] = volumeInfo.freeBlocks;
-						diskdata[inptr].unlocked.availableBlocks[insertIndex] = volumeInfo.totalBlocks;
+						sample->unlocked.blockSize[insertIndex] = volumeInfo.blockSize;
+						sample->unlocked.freeBlocks[insertIndex] = volumeInfo.freeBlocks;
+						sample->unlocked.availableBlocks[insertIndex] = volumeInfo.totalBlocks;
 					}
-					diskdata[inptr].unlocked.used[insertIndex] = 1.0 - ((double)volumeInfo.freeBlocks / (double)volumeInfo.totalBlocks);
+					sample->unlocked.used[insertIndex] = 1.0 - ((double)volumeInfo.freeBlocks / (double)volumeInfo.totalBlocks);
 
-					diskdata[inptr].unlocked.fsMountName[insertIndex] = volumeName;
+					sample->unlocked.fsMountName[insertIndex] = volumeName;
 					if (typeString != NULL)
 					{
-						strcpy(diskdata[inptr].unlocked.fsTypeName[insertIndex], typeString);
+						strcpy(sample->unlocked.fsTypeName[insertIndex], typeString);
 					}
 					else
 					{
-						sprintf(diskdata[inptr].unlocked.fsTypeName[insertIndex], "0x%04x 0x%04x", volumeInfo.filesystemID, volumeInfo.signature);
+						sprintf(sample->unlocked.fsTypeName[insertIndex], "0x%04x 0x%04x", volumeInfo.filesystemID, volumeInfo.signature);
 					}
 					insertIndex += 1;
 				}
@@ -152,26 +154,26 @@ void getDiskCounts(io_iterator_t drivelist, UInt64 *readCount, UInt64 *readBytes
 					if (volumeInfo.blockSize > INT_MAX)
 					{
 						// not a valid block size (because it's probably unknown like with WebDAV)
-						diskdata[inptr].unlocked.blockSize[insertIndex] = 0;
-						diskdata[inptr].unlocked.freeBlocks[insertIndex] = 0;
-						diskdata[inptr].unlocked.availableBlocks[insertIndex] = 0;
+						sample->unlocked.blockSize[insertIndex] = 0;
+						sample->unlocked.freeBlocks[insertIndex] = 0;
+						sample->unlocked.availableBlocks[insertIndex] = 0;
 					}
 					else
 					{
-						diskdata[inptr].locked.blockSize[insertIndexRO] = volumeInfo.blockSize;
-						diskdata[inptr].locked.freeBlocks[insertIndexRO] = volumeInfo.freeBlocks;
-						diskdata[inptr].locked.availableBlocks[insertIndexRO] = volumeInfo.totalBlocks;
+						sample->locked.blockSize[insertIndexRO] = volumeInfo.blockSize;
+						sample->locked.freeBlocks[insertIndexRO] = volumeInfo.freeBlocks;
+						sample->locked.availableBlocks[insertIndexRO] = volumeInfo.totalBlocks;
 					}
-					diskdata[inptr].locked.used[insertIndexRO] = 1.0 - ((double)volumeInfo.freeBlocks / (double)volumeInfo.totalBlocks);
+					sample->locked.used[insertIndexRO] = 1.0 - ((double)volumeInfo.freeBlocks / (double)volumeInfo.totalBlocks);
 
-					diskdata[inptr].locked.fsMountName[insertIndexRO] = volumeName;
+					sample->locked.fsMountName[insertIndexRO] = volumeName;
 					if (typeString != NULL)
 					{
-						strcpy(diskdata[inptr].locked.fsTypeName[insertIndexRO], typeString);
+						strcpy(sample->locked.fsTypeName[insertIndexRO], typeString);
 					}
 					else
 					{
-						sprintf(diskdata[inptr].locked.fsTypeName[insertIndexRO], "0x%04x 0x%04x", volumeInfo.filesystemID, volumeInfo.signature);
+						sprintf(sample->locked.fsTypeName[insertIndexRO], "0x%04x 0x%04x", volumeInfo.filesystemID, volumeInfo.signature);
 					}
 					insertIndexRO += 1;
 				}
@@ -181,22 +183,38 @@ void getDiskCounts(io_iterator_t drivelist, UInt64 *readCount, UInt64 *readBytes
 		volumeIndex += 1;
 	}
 
-	diskdata[inptr].unlocked.count = insertIndex;
-	diskdata[inptr].locked.count = insertIndexRO;
+	sample->unlocked.count = insertIndex;
+	sample->locked.count = insertIndexRO;
 
 
 	mach_port_t masterPort;
 	io_iterator_t drivelist;
-	UInt64 readCount;
-	UInt64 readBytes;
-	UInt64 writeCount;
-	UInt64 writeBytes;
+	UInt64 counts[4] = { 0, 0, 0, 0 }; // read count, read bytes, write count, write bytes in counter trace order
+	double timestamp = 0.0;
 
-	IOMasterPort(MACH_PORT_NULL, &masterPort);
-	IOServiceGetMatchingServices(masterPort, IOServiceMatching("IOBlockStorageDriver"), &drivelist);
-	getDiskCounts(drivelist, &readCount, &readBytes, &writeCount, &writeBytes);
-	IOObjectRelease(drivelist);
-	mach_port_deallocate(mach_task_self(), masterPort);
+	if (CounterTraceGetMode() == CounterTraceReplaying)
+	{
+		if (! CounterTraceReplay(CounterTraceDisk, counts, sizeof(counts), &timestamp))
+		{
+			// the end of a replayed trace, the history keeps the last samples it replayed
+			return;
+		}
+	}
+	else
+	{
+		IOMasterPort(MACH_PORT_NULL, &masterPort);
+		IOServiceGetMatchingServices(masterPort, IOServiceMatching("IOBlockStorageDriver"), &drivelist);
+		getDiskCounts(drivelist, &counts[0], &counts[1], &counts[2], &counts[3]);
+		IOObjectRelease(drivelist);
+		mach_port_deallocate(mach_task_self(), masterPort);
+		timestamp = SampleClockNow();
+		CounterTraceRecord(CounterTraceDisk, counts, sizeof(counts), timestamp);
+	}
+
+	UInt64 readCount = counts[0];
+	UInt64 readBytes = counts[1];
+	UInt64 writeCount = counts[2];
+	UInt64 writeBytes = counts[3];
 
 	// current counts can be lower than last counts if a disk is unmounted -- if they are, ignore sample
 	SInt64 readCountDelta = readCount - lastReadCount;
@@ -210,55 +228,111 @@ void getDiskCounts(io_iterator_t drivelist, UInt64 *readCount, UInt64 *readBytes
 		writeCountDelta = 0;
 		writeBytesDelta = 0;
 	}
-	diskdata[inptr].readCount = readCountDelta;
-	diskdata[inptr].readBytes = readBytesDelta;
-	diskdata[inptr].writeCount = writeCountDelta;
-	diskdata[inptr].writeBytes = writeBytesDelta;
 
+	// the deltas are scaled to the update interval so rates stay correct when a sample is taken late
+	double interval = [[NSUserDefaults standardUserDefaults] floatForKey:GLOBAL_UPDATE_FREQUENCY_KEY] / 10.0;
+	double scale = SampleClockIntervalScale(timestamp - lastTimestamp, interval);
 	
-	//NSLog(@"read: count = %llu bytes = %llu  write: count = %llu bytes = %llu", diskdata[inptr].readCount, diskdata[inptr].readBytes, diskdata[inptr].writeCount, diskdata[inptr].writeBytes);
+	sample->readCount = SampleClockScaleCount(readCountDelta, scale);
+	sample->readBytes = SampleClockScaleCount(readBytesDelta, scale);
+	sample->writeCount = SampleClockScaleCount(writeCountDelta, scale);
+	sample->writeBytes = SampleClockScaleCount(writeBytesDelta, scale);
+	sample->timestamp = timestamp;
+	sample->elapsed = timestamp - lastTimestamp;
+
+	
+	//NSLog(@"read: count = %llu bytes = %llu  write: count = %llu bytes = %llu", sample->readCount, sample->readBytes, sample->writeCount, sample->writeBytes);
 		
 	lastReadCount = readCount;
 	lastReadBytes = readBytes;
 	lastWriteCount = writeCount;
 	lastWriteBytes = writeBytes;
+	lastTimestamp = timestamp;
 
-	if (++inptr >= size)
-		inptr = 0;
+	HistoryRingAdvance(&history);
 }
 
+- (void)restoreFromHistoryFile:(const HistoryFile *)file
+{
+	// seeds the history with the records from the last run that are still within its reach, before the first refresh -- only
+	// the transfer counts are kept, the volume statistics come from the first refresh
+	int count = HistoryFileCount(file);
+	int index;
+	double interval = [[NSUserDefaults standardUserDefaults] floatForKey:GLOBAL_UPDATE_FREQUENCY_KEY] / 10.0;
+	int first = HistoryFileFirstSince(file, HistoryFileNow() - (int64_t)(history.size * interval * 1000.0));
+	
+	for (index = (first > count - history.size ? first : count - history.size); index < count; index++)
+	{
+		DiskDataPtr sample = HistoryRingWriteSlot(&history);
+		
+		sample->readCount = HistoryFileValueAt(file, index, HistoryFileDiskReadCount);
+		sample->readBytes = HistoryFileValueAt(file, index, HistoryFileDiskReadBytes);
+		sample->writeCount = HistoryFileValueAt(file, index, HistoryFileDiskWriteCount);
+		sample->writeBytes = HistoryFileValueAt(file, index, HistoryFileDiskWriteBytes);
+		sample->timestamp = 0.0;
+		sample->elapsed = 0.0;
+		
+		HistoryRingAdvance(&history);
+	}
+}
+
+
 - (void)startIterate
 {
-	outptr = inptr;
+	HistoryRingStartIterate(&history, &iterator);
 }
 
 
 - (BOOL)getNext:(DiskDataPtr)ptr
 {
-	if (outptr == -1)
+	const DiskData *sample = HistoryRingNext(&iterator);
+
+	if (sample == NULL)
 		return (FALSE);
-	*ptr = diskdata[outptr++];
-	if (outptr >= size)
-		outptr = 0;
-	if (outptr == inptr)
-		outptr = -1;
+	*ptr = *sample;
 	return (TRUE);
 }
 
+
 - (void)getCurrent:(DiskDataPtr)ptr
 {
-	*ptr = diskdata[inptr ? inptr - 1 : size - 1];
+	*ptr = *(const DiskData *)HistoryRingCurrent(&history);
 }
 
+
 - (void)getLast:(DiskDataPtr)ptr
 {
-	*ptr = diskdata[inptr > 1 ? inptr - 2 : size + inptr - 2];
+	*ptr = *(const DiskData *)HistoryRingLast(&history);
+}
+
+
+- (const DiskData *)nextSample
+{
+	return (HistoryRingNext(&iterator));
+}
+
+
+- (const DiskData *)currentSample
+{
+	return (HistoryRingCurrent(&history));
+}
+
+
+- (const DiskData *)lastSample
+{
+	return (HistoryRingLast(&history));
+}
+
+
+- (const HistoryRing *)history
+{
+	return (&history);
 }
 
 
 - (int)getSize
 {
-	return (size);
+	return (history.size);
 }
 
 
@@ -0,0 +1,436 @@
+/*
+ *  HistoryFile.c
+ *
+ *  History that survives a restart, kept in a memory-mapped file with a fixed layout.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "HistoryFile.h"
+
+#define HEADER_MAGIC 0
+#define HEADER_VERSION 4
+#define HEADER_HEADER_SIZE 8
+#define HEADER_RECORD_SIZE 12
+#define HEADER_SLOT_COUNT 16
+#define HEADER_PROCESSOR_COUNT 20
+#define HEADER_GENERATION 24
+#define HEADER_COMMITTED_COUNT 32
+
+#define RECORD_TIMESTAMP 0
+#define RECORD_VALUES 8
+#define RECORD_PROCESSORS (RECORD_VALUES + (HistoryFileValueCount * 8))
+
+#if defined(__BIG_ENDIAN__) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define HISTORY_FILE_SWAP 1
+#else
+#define HISTORY_FILE_SWAP 0
+#endif
+
+
+// the file is little-endian, these only do work on big-endian machines
+
+static inline uint32_t littleEndian32(uint32_t value)
+{
+#if HISTORY_FILE_SWAP
+	return (__builtin_bswap32(value));
+#else
+	return (value);
+#endif
+}
+
+
+static inline uint64_t littleEndian64(uint64_t value)
+{
+#if HISTORY_FILE_SWAP
+	return (__builtin_bswap64(value));
+#else
+	return (value);
+#endif
+}
+
+
+static inline uint32_t load32(const unsigned char *address)
+{
+	return (littleEndian32(*(const uint32_t *) address));
+}
+
+
+static inline void store32(unsigned char *address, uint32_t value)
+{
+	*(uint32_t *) address = littleEndian32(value);
+}
+
+
+static inline uint64_t load64(const unsigned char *address)
+{
+	return (littleEndian64(*(const uint64_t *) address));
+}
+
+
+static inline void store64(unsigned char *address, uint64_t value)
+{
+	*(uint64_t *) address = littleEndian64(value);
+}
+
+
+static inline double loadDouble(const unsigned char *address)
+{
+	uint64_t bits = load64(address);
+	double value;
+
+	memcpy(&value, &bits, sizeof(value));
+	return (value);
+}
+
+
+static inline void storeDouble(unsigned char *address, double value)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	store64(address, bits);
+}
+
+
+static uint32_t recordSizeFor(int processorCount)
+{
+	return (RECORD_PROCESSORS + (processorCount * HistoryFileStateCount * 8));
+}
+
+
+// returns 1 if the header read from the file describes the layout wanted
+static int headerMatches(const unsigned char *header, uint32_t recordSize, uint32_t slotCount, uint32_t processorCount)
+{
+	return (load32(header + HEADER_MAGIC) == HISTORY_FILE_MAGIC
+			&& load32(header + HEADER_VERSION) == HISTORY_FILE_VERSION
+			&& load32(header + HEADER_HEADER_SIZE) == HISTORY_FILE_HEADER_SIZE
+			&& load32(header + HEADER_RECORD_SIZE) == recordSize
+			&& load32(header + HEADER_SLOT_COUNT) == slotCount
+			&& load32(header + HEADER_PROCESSOR_COUNT) == processorCount);
+}
+
+
+static const unsigned char *recordAt(const HistoryFile *file, int index)
+{
+	uint64_t committed = load64(file->mapping + HEADER_COMMITTED_COUNT);
+	uint64_t number = committed - (uint64_t) HistoryFileCount(file) + (uint64_t) index;
+
+	return (file->mapping + HISTORY_FILE_HEADER_SIZE + ((number % file->slotCount) * file->recordSize));
+}
+
+
+HistoryFile *HistoryFileOpen(const char *path, int size, int processorCount)
+{
+	HistoryFile *file;
+	unsigned char header[HEADER_COMMITTED_COUNT + 8];
+	struct stat status;
+	uint32_t recordSize = recordSizeFor(processorCount);
+	uint32_t slotCount = size + 1;
+	size_t length = HISTORY_FILE_HEADER_SIZE + ((size_t) slotCount * recordSize);
+	int create;
+
+	file = calloc(1, sizeof(HistoryFile));
+	if (file == NULL)
+	{
+		return (NULL);
+	}
+
+	file->descriptor = open(path, O_RDWR | O_CREAT, 0644);
+	if (file->descriptor == -1)
+	{
+		free(file);
+		return (NULL);
+	}
+
+	// a file from another version or another machine is replaced rather than converted
+	create = 1;
+	if (fstat(file->descriptor, &status) == 0 && (size_t) status.st_size == length)
+	{
+		if (pread(file->descriptor, header, sizeof(header), 0) == (ssize_t) sizeof(header))
+		{
+			create = ! headerMatches(header, recordSize, slotCount, processorCount);
+		}
+	}
+	if (create)
+	{
+		if (ftruncate(file->descriptor, 0) == -1 || ftruncate(file->descriptor, length) == -1)
+		{
+			close(file->descriptor);
+			free(file);
+			return (NULL);
+		}
+	}
+
+	file->mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, file->descriptor, 0);
+	if (file->mapping == MAP_FAILED)
+	{
+		close(file->descriptor);
+		free(file);
+		return (NULL);
+	}
+	file->length = length;
+	file->recordSize = recordSize;
+	file->slotCount = slotCount;
+	file->processorCount = processorCount;
+	file->record = NULL;
+
+	if (create)
+	{
+		// the magic goes in last, a file that is missing it is created again on the next open
+		store32(file->mapping + HEADER_VERSION, HISTORY_FILE_VERSION);
+		store32(file->mapping + HEADER_HEADER_SIZE, HISTORY_FILE_HEADER_SIZE);
+		store32(file->mapping + HEADER_RECORD_SIZE, recordSize);
+		store32(file->mapping + HEADER_SLOT_COUNT, slotCount);
+		store32(file->mapping + HEADER_PROCESSOR_COUNT, processorCount);
+		store64(file->mapping + HEADER_GENERATION, 0);
+		store64(file->mapping + HEADER_COMMITTED_COUNT, 0);
+		__sync_synchronize();
+		store32(file->mapping + HEADER_MAGIC, HISTORY_FILE_MAGIC);
+		file->wasClean = 1;
+	}
+	else
+	{
+		uint64_t generation = load64(file->mapping + HEADER_GENERATION);
+
+		// an odd generation is a record that was never committed, it's outside the committed records so it's just forgotten
+		file->wasClean = ((generation & 1) == 0);
+		if (! file->wasClean)
+		{
+			store64(file->mapping + HEADER_GENERATION, generation + 1);
+		}
+	}
+
+	return (file);
+}
+
+
+void HistoryFileClose(HistoryFile *file)
+{
+	if (file == NULL)
+	{
+		return;
+	}
+	msync(file->mapping, file->length, MS_ASYNC);
+	munmap(file->mapping, file->length);
+	close(file->descriptor);
+	free(file);
+}
+
+
+void HistoryFileBeginRecord(HistoryFile *file, int64_t timestamp)
+{
+	uint64_t committed = load64(file->mapping + HEADER_COMMITTED_COUNT);
+
+	store64(file->mapping + HEADER_GENERATION, load64(file->mapping + HEADER_GENERATION) + 1);
+	__sync_synchronize();
+
+	// the slot after the newest committed record is never one of the committed records shown
+	file->record = file->mapping + HISTORY_FILE_HEADER_SIZE + ((committed % file->slotCount) * file->recordSize);
+	store64(file->record + RECORD_TIMESTAMP, (uint64_t) timestamp);
+}
+
+
+void HistoryFileSetValue(HistoryFile *file, HistoryFileValue value, double data)
+{
+	storeDouble(file->record + RECORD_VALUES + (value * 8), data);
+}
+
+
+void HistoryFileSetProcessor(HistoryFile *file, int processor, HistoryFileState state, double data)
+{
+	if (processor < (int) file->processorCount)
+	{
+		storeDouble(file->record + RECORD_PROCESSORS + (((processor * HistoryFileStateCount) + state) * 8), data);
+	}
+}
+
+
+void HistoryFileCommitRecord(HistoryFile *file)
+{
+	__sync_synchronize();
+	store64(file->mapping + HEADER_COMMITTED_COUNT, load64(file->mapping + HEADER_COMMITTED_COUNT) + 1);
+	__sync_synchronize();
+	store64(file->mapping + HEADER_GENERATION, load64(file->mapping + HEADER_GENERATION) + 1);
+	file->record = NULL;
+}
+
+
+int HistoryFileCount(const HistoryFile *file)
+{
+	uint64_t committed = load64(file->mapping + HEADER_COMMITTED_COUNT);
+	uint64_t limit = file->slotCount - 1;
+
+	return ((int) (committed < limit ? committed : limit));
+}
+
+
+int64_t HistoryFileTimestampAt(const HistoryFile *file, int index)
+{
+	return ((int64_t) load64(recordAt(file, index) + RECORD_TIMESTAMP));
+}
+
+
+double HistoryFileValueAt(const HistoryFile *file, int index, HistoryFileValue value)
+{
+	return (loadDouble(recordAt(file, index) + RECORD_VALUES + (value * 8)));
+}
+
+
+double HistoryFileProcessorAt(const HistoryFile *file, int index, int processor, HistoryFileState state)
+{
+	if (processor >= (int) file->processorCount)
+	{
+		return (state == HistoryFileStateIdle ? 1.0 : 0.0);
+	}
+	return (loadDouble(recordAt(file, index) + RECORD_PROCESSORS + (((processor * HistoryFileStateCount) + state) * 8)));
+}
+
+
+int HistoryFileFirstSince(const HistoryFile *file, int64_t timestamp)
+{
+	int index = HistoryFileCount(file);
+
+	while (index > 0 && HistoryFileTimestampAt(file, index - 1) >= timestamp)
+	{
+		index--;
+	}
+	return (index);
+}
+
+
+int64_t HistoryFileNow(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (((int64_t) now.tv_sec * 1000) + (now.tv_usec / 1000));
+}
+
+
+#if HISTORY_FILE_BENCHMARK
+
+/*
+ *  Writes a file the size iPulse uses, checks that an uncommitted record is dropped when the file
+ *  is opened again, and prints one tab-separated line per operation:
+ *
+ *	operation	processors	records	ns_per_operation
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+static double benchmarkNow(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((double) now.tv_sec * 1.0e9 + (double) now.tv_nsec);
+}
+
+static void writeRecord(HistoryFile *file, int64_t timestamp, int processors)
+{
+	int value, processor;
+
+	HistoryFileBeginRecord(file, timestamp);
+	for (value = 0; value < HistoryFileValueCount; value++)
+	{
+		HistoryFileSetValue(file, value, (double) timestamp + value);
+	}
+	for (processor = 0; processor < processors; processor++)
+	{
+		HistoryFileSetProcessor(file, processor, HistoryFileStateUser, 0.25);
+		HistoryFileSetProcessor(file, processor, HistoryFileStateSystem, 0.125);
+		HistoryFileSetProcessor(file, processor, HistoryFileStateNice, 0.0);
+		HistoryFileSetProcessor(file, processor, HistoryFileStateIdle, 0.625);
+	}
+	HistoryFileCommitRecord(file);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = (argc > 1 ? argv[1] : "history_file_benchmark.dat");
+	const int size = 3600;
+	const int processors = 16;
+	const int passes = 100;
+	HistoryFile *file;
+	double start, sum = 0.0;
+	int i, pass, count;
+
+	unlink(path);
+	file = HistoryFileOpen(path, size, processors);
+	if (file == NULL)
+	{
+		fprintf(stderr, "failed to open %s\n", path);
+		return (1);
+	}
+
+	printf("operation\tprocessors\trecords\tns_per_operation\n");
+
+	start = benchmarkNow();
+	for (i = 0; i < size * 2; i++)
+	{
+		writeRecord(file, i, processors);
+	}
+	printf("write\t%d\t%d\t%.1f\n", processors, size, (benchmarkNow() - start) / (size * 2));
+
+	// a record that is begun but never committed, like a crash in the middle of a write
+	HistoryFileBeginRecord(file, -1);
+	HistoryFileSetValue(file, HistoryFileLoadAverage, -1.0);
+	HistoryFileClose(file);
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		file = HistoryFileOpen(path, size, processors);
+		if (file == NULL || HistoryFileCount(file) != size)
+		{
+			fprintf(stderr, "reopen failed\n");
+			return (1);
+		}
+		if (pass == 0 && file->wasClean)
+		{
+			fprintf(stderr, "torn record was not detected\n");
+			return (1);
+		}
+		if (pass < passes - 1)
+		{
+			HistoryFileClose(file);
+		}
+	}
+	printf("open\t%d\t%d\t%.1f\n", processors, size, (benchmarkNow() - start) / passes);
+
+	start = benchmarkNow();
+	count = HistoryFileCount(file);
+	for (i = 0; i < count; i++)
+	{
+		if (HistoryFileTimestampAt(file, i) != size + i || HistoryFileValueAt(file, i, HistoryFileLoadAverage) != (double) (size + i + HistoryFileLoadAverage))
+		{
+			fprintf(stderr, "record %d does not match\n", i);
+			return (1);
+		}
+		sum += HistoryFileProcessorAt(file, i, processors - 1, HistoryFileStateIdle);
+	}
+	printf("read\t%d\t%d\t%.1f\n", processors, size, (benchmarkNow() - start) / count);
+
+	// the timestamps run from size to size * 2 - 1, a restore that reaches back to the last 10 only gets those
+	if (HistoryFileFirstSince(file, (size * 2) - 10) != count - 10 || HistoryFileFirstSince(file, size * 2) != count || HistoryFileFirstSince(file, 0) != 0)
+	{
+		fprintf(stderr, "first record since a time does not match\n");
+		return (1);
+	}
+
+	HistoryFileClose(file);
+	unlink(path);
+
+	fprintf(stderr, "checksum %f\n", sum);
+	return (0);
+}
+
+#endif
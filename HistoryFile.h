@@ -0,0 +1,119 @@
+/*
+ *  HistoryFile.h
+ *
+ *  History that survives a restart, kept in a memory-mapped file with a fixed layout.
+ *
+ *  The file is a header followed by a ring of fixed size records, one record per sample. All
+ *  fields are little-endian fixed width integers or IEEE 754 doubles at fixed offsets, so the
+ *  same file works on every architecture. On little-endian machines writing a value is a plain
+ *  store into the mapping and opening the file is a single mmap() with no parsing.
+ *
+ *	offset	size	header field
+ *	0	4	magic ('iPHF')
+ *	4	4	version
+ *	8	4	header size (HISTORY_FILE_HEADER_SIZE)
+ *	12	4	record size
+ *	16	4	slot count
+ *	20	4	processor count
+ *	24	8	generation, odd while a record is being written
+ *	32	8	committed count, records completely written since the file was created
+ *
+ *	offset	size	record field
+ *	0	8	timestamp, milliseconds since 1970
+ *	8	8 * n	values, see HistoryFileValue
+ *	...	32 * p	system, user, nice and idle fraction for each processor
+ *
+ *  A record is written into the slot after the newest committed record, then the committed count
+ *  is stored and the generation becomes even again. The ring has one slot more than the history
+ *  it shows, so a record torn by a crash is never one of the committed records. An odd generation
+ *  when the file is opened only tells that the last run didn't finish its last record.
+ *
+ *  The benchmark checks that a torn record is dropped and reports write, open and read times:
+ *
+ *	cc -O2 -DHISTORY_FILE_BENCHMARK -o history_file_benchmark HistoryFile.c
+ */
+
+#ifndef HISTORY_FILE_H
+#define HISTORY_FILE_H
+
+#include <stdint.h>
+
+#define HISTORY_FILE_MAGIC 0x46485069	// 'iPHF' when read as little-endian bytes
+#define HISTORY_FILE_VERSION 1
+#define HISTORY_FILE_HEADER_SIZE 4096	// one page, so the records are page aligned
+
+typedef enum
+{
+	HistoryFileProcessorSystem = 0,	// fractions of all processors
+	HistoryFileProcessorUser,
+	HistoryFileProcessorNice,
+	HistoryFileProcessorIdle,
+	HistoryFileMemoryWired,		// page counts
+	HistoryFileMemoryActive,
+	HistoryFileMemoryInactive,
+	HistoryFileMemoryFree,
+	HistoryFileMemoryPageins,	// pages since the previous record
+	HistoryFileMemoryPageouts,
+	HistoryFileNetworkPacketsIn,	// counts since the previous record, scaled to the update interval
+	HistoryFileNetworkBytesIn,
+	HistoryFileNetworkPacketsOut,
+	HistoryFileNetworkBytesOut,
+	HistoryFileDiskReadCount,
+	HistoryFileDiskReadBytes,
+	HistoryFileDiskWriteCount,
+	HistoryFileDiskWriteBytes,
+	HistoryFileLoadAverage,
+	HistoryFileLoadMachFactor,
+	HistoryFileTemperatureCount,
+	HistoryFileTemperature0,
+	HistoryFileTemperature1,
+	HistoryFileValueCount		// values in version 1, new values are only added with a new version
+} HistoryFileValue;
+
+typedef enum
+{
+	HistoryFileStateSystem = 0,
+	HistoryFileStateUser,
+	HistoryFileStateNice,
+	HistoryFileStateIdle,
+	HistoryFileStateCount
+} HistoryFileState;
+
+typedef struct historyfile
+{
+	int descriptor;
+	unsigned char *mapping;
+	size_t length;
+
+	uint32_t recordSize;
+	uint32_t slotCount;
+	uint32_t processorCount;
+
+	unsigned char *record;	// record being written, NULL outside HistoryFileBeginRecord() and HistoryFileCommitRecord()
+	int wasClean;		// the generation was even when the file was opened
+} HistoryFile;
+
+// maps the file at path, creating it (or replacing one with a different layout) for size records of processorCount processors
+HistoryFile *HistoryFileOpen(const char *path, int size, int processorCount);
+void HistoryFileClose(HistoryFile *file);
+
+// writing a record: begin, set the values, then commit
+void HistoryFileBeginRecord(HistoryFile *file, int64_t timestamp);
+void HistoryFileSetValue(HistoryFile *file, HistoryFileValue value, double data);
+void HistoryFileSetProcessor(HistoryFile *file, int processor, HistoryFileState state, double data);
+void HistoryFileCommitRecord(HistoryFile *file);
+
+// reading committed records, index 0 is the oldest and HistoryFileCount() - 1 the newest
+int HistoryFileCount(const HistoryFile *file);
+int64_t HistoryFileTimestampAt(const HistoryFile *file, int index);
+double HistoryFileValueAt(const HistoryFile *file, int index, HistoryFileValue value);
+double HistoryFileProcessorAt(const HistoryFile *file, int index, int processor, HistoryFileState state);
+
+// returns the index of the oldest of the newest records stamped at or after timestamp, or HistoryFileCount() when the
+// newest record is older -- restoring from there keeps records of a run long ago out of a history that only reaches back so far
+int HistoryFileFirstSince(const HistoryFile *file, int64_t timestamp);
+
+// returns the current wall clock time in the units used for record timestamps
+int64_t HistoryFileNow(void);
+
+#endif
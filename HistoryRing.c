@@ -0,0 +1,201 @@
+/*
+ *  HistoryRing.c
+ *
+ *  Fixed size ring of samples shared by the Info classes.
+ */
+
+#include <stdlib.h>
+
+#include "HistoryRing.h"
+
+
+int HistoryRingInit(HistoryRing *ring, int size, size_t elementSize)
+{
+	ring->data = calloc(size + 1, elementSize);
+	if (ring->data == NULL)
+	{
+		ring->size = 0;
+		ring->slots = 0;
+		return (0);
+	}
+	ring->elementSize = elementSize;
+	ring->size = size;
+	ring->slots = size + 1;
+	ring->inptr = 0;
+	return (1);
+}
+
+
+void HistoryRingFree(HistoryRing *ring)
+{
+	free(ring->data);
+	ring->data = NULL;
+	ring->size = 0;
+	ring->slots = 0;
+	ring->inptr = 0;
+}
+
+
+#if HISTORY_RING_BENCHMARK
+
+/*
+ *  Iterates a full history of samples shaped like DiskData (about 13 KB each) and LoadData
+ *  (16 bytes) three ways and prints one tab-separated line per sample type and method:
+ *
+ *	sample	bytes	size	method	ns_per_pass
+ *
+ *  "copy" is the getNext: loop that copies every sample out, "iterate" uses HistoryRingNext()
+ *  and "spans" walks the two runs from HistoryRingSpans().
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct benchmarkdiskstats
+{
+	int count;
+	double used[12];
+	unsigned int blockSize[12];
+	unsigned int freeBlocks[12];
+	unsigned int availableBlocks[12];
+	char fsTypeName[12][16];
+	unsigned short fsMountName[12][256];
+} BenchmarkDiskStats;
+
+typedef struct benchmarkdiskdata
+{
+	BenchmarkDiskStats unlocked;
+	BenchmarkDiskStats locked;
+	unsigned long long readCount;
+	unsigned long long readBytes;
+	unsigned long long writeCount;
+	unsigned long long writeBytes;
+} BenchmarkDiskData;
+
+typedef struct benchmarkloaddata
+{
+	double average;
+	double machFactor;
+} BenchmarkLoadData;
+
+static double benchmarkNow(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((double) now.tv_sec * 1.0e9 + (double) now.tv_nsec);
+}
+
+// the copying loop the Info classes used before, kept out of line like an Objective-C message
+__attribute__((noinline)) static int copyNext(HistoryRingIterator *iterator, void *sample)
+{
+	const void *next = HistoryRingNext(iterator);
+
+	if (next == NULL)
+		return (0);
+	memcpy(sample, next, iterator->ring->elementSize);
+	return (1);
+}
+
+static void printResult(const char *name, size_t bytes, int size, const char *method, double elapsed, int passes)
+{
+	printf("%s\t%zu\t%d\t%s\t%.1f\n", name, bytes, size, method, elapsed / passes);
+}
+
+int main(int argc, char *argv[])
+{
+	const int size = 128;
+	const int passes = 2000;
+	HistoryRing diskRing, loadRing;
+	HistoryRingIterator iterator;
+	BenchmarkDiskData diskSample;
+	BenchmarkLoadData loadSample;
+	const BenchmarkDiskData *disk;
+	const BenchmarkLoadData *load;
+	const void *first, *second;
+	int firstCount, secondCount;
+	double start, sum = 0.0;
+	int i, pass;
+
+	if (! HistoryRingInit(&diskRing, size, sizeof(BenchmarkDiskData)) || ! HistoryRingInit(&loadRing, size, sizeof(BenchmarkLoadData)))
+	{
+		fprintf(stderr, "failed to allocate rings\n");
+		return (1);
+	}
+	for (i = 0; i < size + size / 3; i++)
+	{
+		((BenchmarkDiskData *) HistoryRingWriteSlot(&diskRing))->unlocked.used[0] = i;
+		HistoryRingAdvance(&diskRing);
+		((BenchmarkLoadData *) HistoryRingWriteSlot(&loadRing))->average = i;
+		HistoryRingAdvance(&loadRing);
+	}
+
+	printf("sample\tbytes\tsize\tmethod\tns_per_pass\n");
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		HistoryRingStartIterate(&diskRing, &iterator);
+		while (copyNext(&iterator, &diskSample))
+			sum += diskSample.unlocked.used[0];
+	}
+	printResult("DiskData", sizeof(BenchmarkDiskData), size, "copy", benchmarkNow() - start, passes);
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		HistoryRingStartIterate(&diskRing, &iterator);
+		while ((disk = HistoryRingNext(&iterator)) != NULL)
+			sum += disk->unlocked.used[0];
+	}
+	printResult("DiskData", sizeof(BenchmarkDiskData), size, "iterate", benchmarkNow() - start, passes);
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		HistoryRingSpans(&diskRing, &first, &firstCount, &second, &secondCount);
+		for (i = 0; i < firstCount; i++)
+			sum += ((const BenchmarkDiskData *) first)[i].unlocked.used[0];
+		for (i = 0; i < secondCount; i++)
+			sum += ((const BenchmarkDiskData *) second)[i].unlocked.used[0];
+	}
+	printResult("DiskData", sizeof(BenchmarkDiskData), size, "spans", benchmarkNow() - start, passes);
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		HistoryRingStartIterate(&loadRing, &iterator);
+		while (copyNext(&iterator, &loadSample))
+			sum += loadSample.average;
+	}
+	printResult("LoadData", sizeof(BenchmarkLoadData), size, "copy", benchmarkNow() - start, passes);
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		HistoryRingStartIterate(&loadRing, &iterator);
+		while ((load = HistoryRingNext(&iterator)) != NULL)
+			sum += load->average;
+	}
+	printResult("LoadData", sizeof(BenchmarkLoadData), size, "iterate", benchmarkNow() - start, passes);
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		HistoryRingSpans(&loadRing, &first, &firstCount, &second, &secondCount);
+		for (i = 0; i < firstCount; i++)
+			sum += ((const BenchmarkLoadData *) first)[i].average;
+		for (i = 0; i < secondCount; i++)
+			sum += ((const BenchmarkLoadData *) second)[i].average;
+	}
+	printResult("LoadData", sizeof(BenchmarkLoadData), size, "spans", benchmarkNow() - start, passes);
+
+	HistoryRingFree(&diskRing);
+	HistoryRingFree(&loadRing);
+
+	fprintf(stderr, "checksum %f\n", sum);
+	return (0);
+}
+
+#endif
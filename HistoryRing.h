@@ -0,0 +1,184 @@
+/*
+ *  HistoryRing.h
+ *
+ *  Fixed size ring of samples shared by the Info classes.
+ *
+ *  Every slot always holds a sample (the ring starts out zero filled, or filled by the owner),
+ *  so iteration covers all size samples from the oldest to the newest. Samples are read in
+ *  place: HistoryRingNext(), HistoryRingCurrent() and HistoryRingLast() return pointers into
+ *  the ring and HistoryRingSpans() returns the history as at most two contiguous runs, so a
+ *  gauge never copies a sample out to draw it.
+ *
+ *  One thread may add samples while another reads them. The ring has one slot more than its
+ *  size and the sample being written is never part of the history, so a reader that captured
+ *  the history with HistoryRingStartIterate() or HistoryRingSpans() sees consistent samples
+ *  only until the writer publishes a new sample: the next HistoryRingWriteSlot() is the oldest
+ *  sample the reader captured. A pointer returned by the ring stays valid for the same period.
+ *
+ *  A reader that may be slower than that, or that needs the samples of several rings from the
+ *  same tick, checks a HistoryRingSequence the writer makes odd while it adds samples to any of
+ *  its rings. The reader notes the sequence before it reads, reads in place, and reads again if
+ *  HistoryRingSequenceRetry() finds the sequence was odd or has changed since.
+ *
+ *  The benchmark compares in place iteration with the copying getNext: loop the Info classes
+ *  used before:
+ *
+ *	cc -O2 -DHISTORY_RING_BENCHMARK -o history_ring_benchmark HistoryRing.c
+ */
+
+#ifndef HISTORY_RING_H
+#define HISTORY_RING_H
+
+#include <stddef.h>
+
+typedef struct historyring
+{
+	char *data;		// slots * elementSize bytes
+	size_t elementSize;
+	int size;		// number of samples in the history
+	int slots;		// size + 1, the extra slot is the one being written
+	int inptr;		// slot for the next sample, published by HistoryRingAdvance()
+} HistoryRing;
+
+typedef struct historyringiterator
+{
+	const HistoryRing *ring;
+	int outptr;		// next slot to return, -1 when the iteration is done
+	int endptr;		// write slot when the iteration started
+} HistoryRingIterator;
+
+typedef struct historyringsequence
+{
+	unsigned int sequence;	// odd while the writer adds samples
+} HistoryRingSequence;
+
+// allocates a zero filled ring of size samples, returns 0 if memory could not be allocated
+int HistoryRingInit(HistoryRing *ring, int size, size_t elementSize);
+void HistoryRingFree(HistoryRing *ring);
+
+// returns the sample in slot (not the age of the sample), used by owners to fill all slots of the ring
+static inline void *HistoryRingSlot(const HistoryRing *ring, int slot)
+{
+	return (ring->data + ((size_t) slot * ring->elementSize));
+}
+
+// returns the slot that the next sample is written to, the sample becomes current after HistoryRingAdvance()
+static inline void *HistoryRingWriteSlot(const HistoryRing *ring)
+{
+	return (HistoryRingSlot(ring, ring->inptr));
+}
+
+// publishes the sample in the write slot, the store is ordered after the writes to the sample
+static inline void HistoryRingAdvance(HistoryRing *ring)
+{
+	int next = ring->inptr + 1;
+
+	if (next >= ring->slots)
+		next = 0;
+	__atomic_store_n(&ring->inptr, next, __ATOMIC_RELEASE);
+}
+
+// returns the write slot as published to readers
+static inline int HistoryRingPublishedSlot(const HistoryRing *ring)
+{
+	return (__atomic_load_n(&ring->inptr, __ATOMIC_ACQUIRE));
+}
+
+// returns the newest sample
+static inline const void *HistoryRingCurrent(const HistoryRing *ring)
+{
+	int inptr = HistoryRingPublishedSlot(ring);
+
+	return (HistoryRingSlot(ring, inptr ? inptr - 1 : ring->slots - 1));
+}
+
+// returns the sample before the newest one
+static inline const void *HistoryRingLast(const HistoryRing *ring)
+{
+	int inptr = HistoryRingPublishedSlot(ring);
+
+	return (HistoryRingSlot(ring, inptr > 1 ? inptr - 2 : ring->slots + inptr - 2));
+}
+
+// returns the sample at index, where 0 is the oldest and size - 1 is the newest
+static inline const void *HistoryRingAt(const HistoryRing *ring, int index)
+{
+	int slot = HistoryRingPublishedSlot(ring) + 1 + index;
+
+	if (slot >= ring->slots)
+		slot -= ring->slots;
+	return (HistoryRingSlot(ring, slot));
+}
+
+// returns the history from oldest to newest as two contiguous runs (the second one may be empty)
+static inline void HistoryRingSpans(const HistoryRing *ring, const void **first, int *firstCount, const void **second, int *secondCount)
+{
+	int inptr = HistoryRingPublishedSlot(ring);
+	int oldest = (inptr + 1 < ring->slots ? inptr + 1 : 0);
+
+	*first = HistoryRingSlot(ring, oldest);
+	*second = ring->data;
+	if (oldest > inptr)
+	{
+		*firstCount = ring->slots - oldest;
+		*secondCount = inptr;
+	}
+	else
+	{
+		*firstCount = ring->size;
+		*secondCount = 0;
+	}
+}
+
+static inline void HistoryRingStartIterate(const HistoryRing *ring, HistoryRingIterator *iterator)
+{
+	int inptr = HistoryRingPublishedSlot(ring);
+
+	iterator->ring = ring;
+	iterator->endptr = inptr;
+	iterator->outptr = (inptr + 1 < ring->slots ? inptr + 1 : 0);
+}
+
+// returns the next sample from oldest to newest, or NULL when every sample has been returned
+static inline const void *HistoryRingNext(HistoryRingIterator *iterator)
+{
+	const HistoryRing *ring = iterator->ring;
+	const void *result;
+
+	if (iterator->outptr == -1)
+		return (NULL);
+	result = HistoryRingSlot(ring, iterator->outptr++);
+	if (iterator->outptr >= ring->slots)
+		iterator->outptr = 0;
+	if (iterator->outptr == iterator->endptr)
+		iterator->outptr = -1;
+	return (result);
+}
+
+// starts adding samples to the rings the sequence covers, readers retry until HistoryRingSequenceEnd()
+static inline void HistoryRingSequenceBegin(HistoryRingSequence *sequence)
+{
+	__atomic_store_n(&sequence->sequence, sequence->sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+// publishes every sample added since HistoryRingSequenceBegin() at once
+static inline void HistoryRingSequenceEnd(HistoryRingSequence *sequence)
+{
+	__atomic_store_n(&sequence->sequence, sequence->sequence + 1, __ATOMIC_RELEASE);
+}
+
+// returns the sequence to pass to HistoryRingSequenceRetry() once the samples have been read
+static inline unsigned int HistoryRingSequenceRead(const HistoryRingSequence *sequence)
+{
+	return (__atomic_load_n(&sequence->sequence, __ATOMIC_ACQUIRE));
+}
+
+// returns non-zero if the samples read since HistoryRingSequenceRead() returned start may be torn or from different ticks
+static inline int HistoryRingSequenceRetry(const HistoryRingSequence *sequence, unsigned int start)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return ((start & 1) != 0 || __atomic_load_n(&sequence->sequence, __ATOMIC_RELAXED) != start);
+}
+
+#endif
@@ -0,0 +1,279 @@
+/*
+ *  LatencyHistogram.c
+ *
+ *  Latency distribution of one stage of iPulse itself, in the style of HdrHistogram.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "LatencyHistogram.h"
+
+#define SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+#define LARGEST_VALUE ((((uint64_t) 1) << LATENCY_HISTOGRAM_MAXIMUM_BITS) - 1)
+
+
+static int highestBit(uint64_t value)
+{
+	int bit = 0;
+
+	while (value >>= 1)
+	{
+		bit++;
+	}
+	return (bit);
+}
+
+
+static int bucketForValue(uint64_t value)
+{
+	int shift;
+
+	if (value < 2 * SUB_BUCKETS)
+	{
+		return ((int) value);
+	}
+	if (value > LARGEST_VALUE)
+	{
+		value = LARGEST_VALUE;
+	}
+	shift = highestBit(value) - LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+	return ((shift << LATENCY_HISTOGRAM_SUB_BUCKET_BITS) + (int) (value >> shift));
+}
+
+
+// the largest value counted in a bucket
+static uint64_t valueForBucket(int bucket)
+{
+	int shift;
+	uint64_t lowest;
+
+	if (bucket < 2 * SUB_BUCKETS)
+	{
+		return ((uint64_t) bucket);
+	}
+	shift = (bucket >> LATENCY_HISTOGRAM_SUB_BUCKET_BITS) - 1;
+	lowest = ((uint64_t) (bucket - (shift << LATENCY_HISTOGRAM_SUB_BUCKET_BITS))) << shift;
+	return (lowest + (((uint64_t) 1) << shift) - 1);
+}
+
+
+LatencyHistogram *LatencyHistogramCreate(void)
+{
+	return (calloc(1, sizeof(LatencyHistogram)));
+}
+
+
+void LatencyHistogramDispose(LatencyHistogram *histogram)
+{
+	free(histogram);
+}
+
+
+void LatencyHistogramReset(LatencyHistogram *histogram)
+{
+	memset(histogram, 0, sizeof(LatencyHistogram));
+}
+
+
+// the counters are only written by the recording thread, so a relaxed load and store is an increment, and
+// the atomic stores keep a reader on another thread from seeing half of a 64-bit count
+#define LOAD_COUNTER(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#define STORE_COUNTER(counter, value) __atomic_store_n(&(counter), (value), __ATOMIC_RELAXED)
+
+
+void LatencyHistogramRecord(LatencyHistogram *histogram, double seconds)
+{
+	uint64_t value = (seconds > 0.0 ? (uint64_t) ((seconds * 1.0e9) + 0.5) : 0);
+	int bucket = bucketForValue(value);
+
+	STORE_COUNTER(histogram->buckets[bucket], LOAD_COUNTER(histogram->buckets[bucket]) + 1);
+	STORE_COUNTER(histogram->sum, LOAD_COUNTER(histogram->sum) + value);
+	if (value > LOAD_COUNTER(histogram->maximum))
+	{
+		STORE_COUNTER(histogram->maximum, value);
+	}
+	STORE_COUNTER(histogram->count, LOAD_COUNTER(histogram->count) + 1);
+}
+
+
+double LatencyHistogramPercentile(const LatencyHistogram *histogram, double percentile)
+{
+	uint64_t count = LOAD_COUNTER(histogram->count);
+	uint64_t wanted, seen = 0;
+	uint64_t value, maximum;
+	int bucket;
+
+	if (count == 0)
+	{
+		return (0.0);
+	}
+	if (percentile > 100.0)
+	{
+		percentile = 100.0;
+	}
+	wanted = (uint64_t) ((percentile / 100.0) * (double) count + 0.5);
+	if (wanted < 1)
+	{
+		wanted = 1;
+	}
+
+	for (bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; bucket++)
+	{
+		seen += LOAD_COUNTER(histogram->buckets[bucket]);
+		if (seen >= wanted)
+		{
+			break;
+		}
+	}
+	if (bucket == LATENCY_HISTOGRAM_BUCKETS)
+	{
+		// the reader got ahead of a recording in progress
+		bucket = LATENCY_HISTOGRAM_BUCKETS - 1;
+	}
+
+	// the top of the bucket, but never more than the largest duration seen
+	value = valueForBucket(bucket);
+	maximum = LOAD_COUNTER(histogram->maximum);
+	if (value > maximum)
+	{
+		value = maximum;
+	}
+	return ((double) value / 1.0e9);
+}
+
+
+double LatencyHistogramMean(const LatencyHistogram *histogram)
+{
+	uint64_t count = LOAD_COUNTER(histogram->count);
+
+	if (count == 0)
+	{
+		return (0.0);
+	}
+	return (((double) LOAD_COUNTER(histogram->sum) / (double) count) / 1.0e9);
+}
+
+
+double LatencyHistogramMaximum(const LatencyHistogram *histogram)
+{
+	return ((double) LOAD_COUNTER(histogram->maximum) / 1.0e9);
+}
+
+
+void LatencyHistogramPrintHeader(FILE *file)
+{
+	fprintf(file, "stage\tcount\tmean_ms\tp50_ms\tp90_ms\tp99_ms\tp999_ms\tmax_ms\n");
+}
+
+
+void LatencyHistogramPrint(const LatencyHistogram *histogram, const char *name, FILE *file)
+{
+	fprintf(file, "%s\t%llu\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\n", name, (unsigned long long) LOAD_COUNTER(histogram->count),
+			LatencyHistogramMean(histogram) * 1000.0,
+			LatencyHistogramPercentile(histogram, 50.0) * 1000.0,
+			LatencyHistogramPercentile(histogram, 90.0) * 1000.0,
+			LatencyHistogramPercentile(histogram, 99.0) * 1000.0,
+			LatencyHistogramPercentile(histogram, 99.9) * 1000.0,
+			LatencyHistogramMaximum(histogram) * 1000.0);
+}
+
+
+#if LATENCY_HISTOGRAM_BENCHMARK
+
+/*
+ *  Records a million durations spread over six decades, checks every percentile against a
+ *  sorted copy and prints the cost of each operation:
+ *
+ *	operation	count	ns_per_operation	worst_error
+ */
+
+#include <math.h>
+#include <time.h>
+
+static double benchmarkNow(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((double) now.tv_sec * 1.0e9 + (double) now.tv_nsec);
+}
+
+static int compareDurations(const void *a, const void *b)
+{
+	double left = *(const double *) a;
+	double right = *(const double *) b;
+
+	return ((left > right) - (left < right));
+}
+
+int main(int argc, char *argv[])
+{
+	const int count = 1000000;
+	const double percentiles[] = { 1.0, 10.0, 50.0, 90.0, 99.0, 99.9, 100.0 };
+	LatencyHistogram *histogram;
+	double *durations;
+	double start, error, worstError = 0.0, sum = 0.0;
+	unsigned int seed = 1;
+	int i, p;
+
+	histogram = LatencyHistogramCreate();
+	durations = malloc(count * sizeof(double));
+	if (histogram == NULL || durations == NULL)
+	{
+		fprintf(stderr, "failed to allocate\n");
+		return (1);
+	}
+
+	// from a microsecond to a second, evenly on a log scale
+	for (i = 0; i < count; i++)
+	{
+		seed = (seed * 1103515245) + 12345;
+		durations[i] = 1.0e-6 * pow(10.0, (double) ((seed >> 8) % 6000000) / 1000000.0);
+	}
+
+	start = benchmarkNow();
+	for (i = 0; i < count; i++)
+	{
+		LatencyHistogramRecord(histogram, durations[i]);
+	}
+	printf("operation\tcount\tns_per_operation\tworst_error\n");
+	printf("record\t%d\t%.1f\t-\n", count, (benchmarkNow() - start) / count);
+
+	qsort(durations, count, sizeof(double), compareDurations);
+	for (p = 0; p < (int) (sizeof(percentiles) / sizeof(percentiles[0])); p++)
+	{
+		int rank = (int) ((percentiles[p] / 100.0) * count + 0.5);
+		double expected = durations[(rank > 0 ? rank : 1) - 1];
+
+		error = (LatencyHistogramPercentile(histogram, percentiles[p]) - expected) / expected;
+		if (error < 0.0)
+		{
+			error = -error;
+		}
+		if (error > 1.0 / 16.0)
+		{
+			fprintf(stderr, "percentile %.1f is %g, expected %g\n", percentiles[p], LatencyHistogramPercentile(histogram, percentiles[p]), expected);
+			return (1);
+		}
+		if (error > worstError)
+		{
+			worstError = error;
+		}
+	}
+
+	start = benchmarkNow();
+	for (i = 0; i < 100000; i++)
+	{
+		sum += LatencyHistogramPercentile(histogram, percentiles[i % 7]);
+	}
+	printf("percentile\t%d\t%.1f\t%.4f\n", 100000, (benchmarkNow() - start) / 100000, worstError);
+
+	LatencyHistogramDispose(histogram);
+	free(durations);
+
+	fprintf(stderr, "checksum %f\n", sum);
+	return (0);
+}
+
+#endif
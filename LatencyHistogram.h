@@ -0,0 +1,56 @@
+/*
+ *  LatencyHistogram.h
+ *
+ *  Latency distribution of one stage of iPulse itself, in the style of HdrHistogram.
+ *
+ *  Durations are counted in nanoseconds in log-linear buckets: the values below 32 ns have a
+ *  bucket each, and every power of two above that is split into 16 buckets, so a percentile is
+ *  never off by more than 1/16 of its value. Recording is one index computation and an
+ *  increment, without allocation or locking, and the buckets cover up to 2^40 ns (about 18
+ *  minutes) in less than 2.5 KB.
+ *
+ *  A histogram is recorded on one thread only. Another thread may read it at the same time: every
+ *  count is loaded and stored atomically, so none is ever torn, and the counts a reader sees are
+ *  at most a recording apart from each other, which is all a display needs.
+ *
+ *  The benchmark checks the percentiles against a sorted copy of the durations and times
+ *  recording:
+ *
+ *	cc -O2 -DLATENCY_HISTOGRAM_BENCHMARK -o latency_histogram_benchmark LatencyHistogram.c -lm
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 4
+#define LATENCY_HISTOGRAM_MAXIMUM_BITS 40
+#define LATENCY_HISTOGRAM_BUCKETS (((LATENCY_HISTOGRAM_MAXIMUM_BITS - LATENCY_HISTOGRAM_SUB_BUCKET_BITS) + 1) << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+
+typedef struct latencyhistogram
+{
+	uint64_t count;
+	uint64_t sum;		// nanoseconds
+	uint64_t maximum;	// nanoseconds
+	uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+} LatencyHistogram;
+
+LatencyHistogram *LatencyHistogramCreate(void);
+void LatencyHistogramDispose(LatencyHistogram *histogram);
+void LatencyHistogramReset(LatencyHistogram *histogram);
+
+// counts a duration in seconds
+void LatencyHistogramRecord(LatencyHistogram *histogram, double seconds);
+
+// returns the duration in seconds that percentile (0 to 100) of the recordings didn't exceed, 0 when there are none
+double LatencyHistogramPercentile(const LatencyHistogram *histogram, double percentile);
+double LatencyHistogramMean(const LatencyHistogram *histogram);
+double LatencyHistogramMaximum(const LatencyHistogram *histogram);
+
+// writes one tab-separated line: name, count, then the mean, 50th, 90th, 99th, 99.9th percentiles and the maximum in milliseconds
+void LatencyHistogramPrint(const LatencyHistogram *histogram, const char *name, FILE *file);
+void LatencyHistogramPrintHeader(FILE *file);
+
+#endif
@@ -7,6 +7,9 @@
 #import <mach/mach.h>
 #import <mach/mach_types.h>
 
+#import "HistoryRing.h"
+#import "HistoryFile.h"
+
 
 typedef struct loaddata {
 	double	average;
@@ -16,18 +19,21 @@ typedef struct loaddata {
 
 @interface LoadInfo : NSObject
 {
-	int			size;
-	int			inptr;
-	int			outptr;
-	LoadDataPtr		loaddata;
+	HistoryRing history;
+	HistoryRingIterator iterator;
 }
 
 - (LoadInfo *)initWithCapacity:(unsigned)numItems;
 - (void)refresh;
+- (void)restoreFromHistoryFile:(const HistoryFile *)file;
 - (void)startIterate;
 - (BOOL)getNext:(LoadDataPtr)ptr;
 - (void)getCurrent:(LoadDataPtr)ptr;
 - (void)getLast:(LoadDataPtr)ptr;
+- (const LoadData *)nextSample;
+- (const LoadData *)currentSample;
+- (const LoadData *)lastSample;
+- (const HistoryRing *)history;
 - (int)getSize;
 
 @end
@@ -5,85 +5,148 @@
 
 #import "mach/mach_host.h"
 #import "LoadInfo.h"
+#import "CounterTrace.h"
+#import "SampleClock.h"
+
+#define LOAD_RESTORE_SPACING 60000 // milliseconds between the records restored from the history file
 
 
 @implementation LoadInfo
 
 
-static void getLoadStat (host_load_info_t loadstat)
+// returns NO once a replayed trace has no more load records
+static BOOL getLoadStat (host_load_info_t loadstat)
 {
 	mach_msg_type_number_t count = HOST_LOAD_INFO_COUNT;
 	
-	if (host_statistics(mach_host_self(), HOST_LOAD_INFO, (host_info_t) loadstat, &count) != KERN_SUCCESS)
+	if (CounterTraceGetMode() == CounterTraceReplaying)
+	{
+		memset(loadstat, 0, sizeof(*loadstat));
+		return (CounterTraceReplay(CounterTraceLoad, loadstat, sizeof(*loadstat), NULL) != 0);
+	}
+	else if (host_statistics(mach_host_self(), HOST_LOAD_INFO, (host_info_t) loadstat, &count) != KERN_SUCCESS)
 		NSLog (@"Failed to get Load statistics.");
+	else
+		CounterTraceRecord(CounterTraceLoad, loadstat, sizeof(*loadstat), SampleClockNow());
+	return (YES);
 }
 
 
 - (id)initWithCapacity:(unsigned)numItems
 {
 	self = [super init];
-	size = numItems;
-	loaddata = calloc(numItems, sizeof(LoadData));
-	if (loaddata == NULL) {
+	if (! HistoryRingInit(&history, numItems, sizeof(LoadData))) {
 		NSLog (@"Failed to allocate buffer for LoadInfo");
 		return (nil);
 	}
-	inptr = 0;
-	outptr = -1;
+	iterator.outptr = -1;
 	return (self);
 }
 
 
 - (void)refresh
 {
+	LoadDataPtr sample = HistoryRingWriteSlot(&history);
 	host_load_info_data_t	loadstat;
 	
-	getLoadStat (&loadstat);
+	if (! getLoadStat (&loadstat))
+	{
+		// the end of a replayed trace, the history keeps the last samples it replayed
+		return;
+	}
 
-	loaddata[inptr].average = (double)loadstat.avenrun[0] / (double)LOAD_SCALE;
-	loaddata[inptr].machFactor = (double)loadstat.mach_factor[0] / (double)LOAD_SCALE;
+	sample->average = (double)loadstat.avenrun[0] / (double)LOAD_SCALE;
+	sample->machFactor = (double)loadstat.mach_factor[0] / (double)LOAD_SCALE;
 
-	//NSLog(@"average = %6.3f machFactor = %6.3f", loaddata[inptr].average, loaddata[inptr].machFactor);
+	//NSLog(@"average = %6.3f machFactor = %6.3f", sample->average, sample->machFactor);
 
-	if (++inptr >= size)
-		inptr = 0;
+	HistoryRingAdvance(&history);
+}
+
+
+- (void)restoreFromHistoryFile:(const HistoryFile *)file
+{
+	// the history has one sample a minute, the records are picked a minute apart so the history
+	// covers the same time it did in the last run, leaving out the records from further back than its minutes reach
+	int count = HistoryFileCount(file);
+	int64_t lastTimestamp = 0;
+	int index;
+	
+	for (index = HistoryFileFirstSince(file, HistoryFileNow() - ((int64_t)history.size * LOAD_RESTORE_SPACING)); index < count; index++)
+	{
+		int64_t timestamp = HistoryFileTimestampAt(file, index);
+		LoadDataPtr sample;
+		
+		if (index > 0 && timestamp - lastTimestamp < LOAD_RESTORE_SPACING)
+		{
+			continue;
+		}
+		lastTimestamp = timestamp;
+		
+		sample = HistoryRingWriteSlot(&history);
+		sample->average = HistoryFileValueAt(file, index, HistoryFileLoadAverage);
+		sample->machFactor = HistoryFileValueAt(file, index, HistoryFileLoadMachFactor);
+		HistoryRingAdvance(&history);
+	}
 }
 
 
 - (void)startIterate
 {
-	outptr = inptr;
+	HistoryRingStartIterate(&history, &iterator);
 }
 
 
 - (BOOL)getNext:(LoadDataPtr)ptr
 {
-	if (outptr == -1)
+	const LoadData *sample = HistoryRingNext(&iterator);
+
+	if (sample == NULL)
 		return (FALSE);
-	*ptr = loaddata[outptr++];
-	if (outptr >= size)
-		outptr = 0;
-	if (outptr == inptr)
-		outptr = -1;
+	*ptr = *sample;
 	return (TRUE);
 }
 
 
 - (void)getCurrent:(LoadDataPtr)ptr
 {
-	*ptr = loaddata[inptr ? inptr - 1 : size - 1];
+	*ptr = *(const LoadData *)HistoryRingCurrent(&history);
 }
 
 
 - (void)getLast:(LoadDataPtr)ptr
 {
-	*ptr = loaddata[inptr > 1 ? inptr - 2 : size + inptr - 2];
+	*ptr = *(const LoadData *)HistoryRingLast(&history);
+}
+
+
+- (const LoadData *)nextSample
+{
+	return (HistoryRingNext(&iterator));
+}
+
+
+- (const LoadData *)currentSample
+{
+	return (HistoryRingCurrent(&history));
+}
+
+
+- (const LoadData *)lastSample
+{
+	return (HistoryRingLast(&history));
+}
+
+
+- (const HistoryRing *)history
+{
+	return (&history);
 }
 
 
 - (int)getSize
 {
-	return (size);
+	return (history.size);
 }
 
 
@@ -18,6 +18,18 @@
 #import "InfoView.h"
 #import "TranslucentWindow.h"
 
+#include "HistoryRing.h"
+#include "Rollup.h"
+#include "LatencyHistogram.h"
+#include "ProcessSnapshot.h"
+#include "TopRank.h"
+#include "ProcessTable.h"
+#include "ProcessTree.h"
+#include "ProcessNetwork.h"
+#include "ProcessArguments.h"
+#include "ProcessThreads.h"
+#include "ProcessColumns.h"
+
 #define OPTION_INCLUDE_MATRIX_ORBITAL 0
 
 #define OPTION_RESIZE_INFO 0
@@ -25,8 +37,53 @@
 #define OPTION_MOON_TEST 0
 #define OPTION_REPLACE_TOKEN_TEST 0
 
+// arguments for recording and replaying counter traces, e.g. "iPulse -CounterTraceReplay incident.trace -CounterTraceReplaySpeed 100"
+#define COUNTER_TRACE_RECORD_KEY @"CounterTraceRecord"
+#define COUNTER_TRACE_REPLAY_KEY @"CounterTraceReplay"
+#define COUNTER_TRACE_REPLAY_SPEED_KEY @"CounterTraceReplaySpeed"
+
+#define HISTORY_FILE_SIZE 3600 // records kept in the history file, an hour at the default update frequency
+
+// metrics summarized at one second, one minute, one hour and one day
+enum
+{
+	RollupProcessor = 0,	// fraction busy
+	RollupMemory,		// fraction wired and active
+	RollupNetworkIn,	// bytes per update interval
+	RollupNetworkOut,
+	RollupDiskRead,
+	RollupDiskWrite,
+	RollupLoad,
+	RollupTemperature,
+	RollupMetricCount
+};
+
+// stages of iPulse itself that are timed, the refreshes are in the order the sampler thread adds the data objects
+enum
+{
+	LatencyProcessor = 0,
+	LatencyMemory,
+	LatencyNetwork,
+	LatencyDisk,
+	LatencyPower,
+	LatencyAirport,
+	LatencyTemperature,
+	LatencyLoad,
+	LatencySampling,	// one wakeup of the sampler thread, the refreshes and archiving the samples
+	LatencyDrawImages,
+	LatencyUpdateIconAndWindow,
+	LatencyUpdateInfo,
+	LatencyStageCount
+};
+
 #define DISK_LIST_SIZE 14
 
+#define PROCESS_RANK_SIZE 10 // rows in the process lists of the info panels
+#define DISK_PROCESS_RANK_SIZE 3 // rows in each of the disk reader and writer lists
+#define NETWORK_PROCESS_RANK_SIZE 3 // rows in each of the network receiver and sender lists
+#define THREAD_RANK_SIZE 3 // rows in the list of the busiest threads of the processes shown
+#define THREAD_NAME_LENGTH 12 // characters of a thread name that fit in its column
+
 #define PROCESS_LIST_SIZE 13
 struct processEntry {
 	int pid;
@@ -35,14 +92,12 @@ struct processEntry {
 	BOOL isCurrent;
 };
 
-#define SWAPPING_LIST_SIZE 2048
-struct swappingEntry  {
-	int pid;
-	int lastPageins;
-	int pageins;
-	int lastFaults;
-	int faults;
-	BOOL isCurrent;
+// counters kept in the paging table
+enum
+{
+	PagingCounterPageins = 0,
+	PagingCounterFaults,
+	PagingCounterCount
 };
 
 @interface MainController : NSObject
@@ -80,14 +135,25 @@ struct swappingEntry  {
 
 	NSStatusItem *statusItem; // menubar status item
 	
-	NSTimer *refreshTimer; // timer for graph refreshs
+	NSThread *samplerThread; // thread that refreshes the data objects
+	volatile double samplerInterval; // seconds between samples, set on the main thread
+	volatile BOOL samplerShouldExit; // set on the main thread to stop the sampler thread
+	volatile int32_t samplerDisplayPending; // non-zero while a sample is waiting to be displayed
+	NSConditionLock *samplerState; // SamplerRunning until the sampler thread is asked to exit and has exited
+	HistoryRingSequence sampleSequence; // odd while the sampler thread adds samples to the data objects
+	HistoryFile *historyFile; // samples kept across launches, written by the sampler thread
+	RollupSeries *rollups[RollupMetricCount]; // added to by the sampler thread, read by the main thread
+	NSLock *rollupLock;
+	LatencyHistogram *latency[LatencyStageCount]; // each stage is recorded by the thread that runs it
+	double selfUsageClock; // when the CPU time used by iPulse was last read
+	double selfUsageTime;
+	float selfUsage; // fraction of a processor used by iPulse
 	NSTimer *registrationTimer; // timer for registration checks
 	NSTimer *curtainTimer; // timer for opening curtain
 	NSTimer *fadeTimer; // timer for fading info window
 	NSTimer *delayTimer; // timer for delaying display of info window
 
 	int lastHour; // last hour displayed in graph
-	int lastMinute; // last minute displayed in graph
 
 	int curtain; // curtain increment
 	
@@ -110,7 +176,20 @@ struct swappingEntry  {
 	time_t timePeakWriteBytes;
 	
 	struct processEntry processList[PROCESS_LIST_SIZE]; // process monitoring lists
-	struct swappingEntry swappingList[SWAPPING_LIST_SIZE];
+	ProcessTable *pagingTable; // pageins and faults of every process, for the deltas in the swapping panel
+	double pagingTableTimestamp; // timestamp of the process snapshot in the paging table
+	ProcessSnapshot *processSnapshot; // processes shared by the info panels, refreshed once per display
+	unsigned long displayCount; // displays of the samples so far
+	unsigned long processSnapshotDisplay; // display the process snapshot was taken for
+	ProcessTree *processTree; // parents and application rollups of the process snapshot
+	double processTreeTimestamp; // timestamp of the snapshot the tree was built from
+	ProcessNetwork *processNetwork; // sockets of the processes, for their network rates
+	double processNetworkTimestamp; // timestamp of the snapshot the rates were set in
+	BOOL processNetworkUnavailable; // the socket counters can't be read on this host
+	ProcessArguments *processArguments; // command names of the processes shown, read once per process
+	double processArgumentsTimestamp; // timestamp of the snapshot the exited processes were forgotten for
+	ProcessThreads *processThreads; // threads of the processes shown in the processor panel
+	double processThreadsTimestamp; // timestamp of the snapshot the threads were read for
 	int selfPid;
 
 	BOOL alternativeActivity;
@@ -39,6 +39,46 @@
 // for process information
 #import "AGProcess.h"
 
+// for the sampler thread
+#import <libkern/OSAtomic.h>
+#include "SampleClock.h"
+#include "SampleScheduler.h"
+
+#define SAMPLER_RESOLUTION 0.1 // seconds per scheduler tick, the update frequency preference is in tenths of a second
+#define TEMPERATURE_SAMPLE_INTERVAL 15.0
+#define LOAD_SAMPLE_INTERVAL 60.0
+#define SAMPLER_STATISTICS_INTERVAL 300.0
+
+// conditions of samplerState
+enum
+{
+	SamplerRunning = 0,
+	SamplerExitRequested,
+	SamplerExited
+};
+
+// for self-instrumentation, "kill -USR1" writes the latency of every stage to LATENCY_DUMP_PATH
+#include <signal.h>
+#define LATENCY_DUMP_PATH @"Library/Logs/iPulse Latency.txt"
+#define SELF_USAGE_INTERVAL 2.0 // seconds the CPU usage of iPulse is averaged over
+
+static volatile sig_atomic_t latencyDumpRequested = 0;
+
+static const char *latencyStageNames[LatencyStageCount] =
+{
+	"refresh.processor", "refresh.memory", "refresh.network", "refresh.disk", "refresh.power", "refresh.airport", "refresh.temperature", "refresh.load",
+	"sampling", "drawImages", "updateIconAndWindow", "updateInfo"
+};
+
+static void requestLatencyDump(int signal)
+{
+	// only a flag can be set safely in a signal handler, the main thread writes the file after its next display
+	latencyDumpRequested = 1;
+}
+
+#include "CounterTrace.h"
+#import "Benchmark.h"
+
 // for hotkey library
 #import "KeyCombo.h"
 #import "KeyComboPanel.h"
@@ -103,19 +143,170 @@ BOOL hasColor(NSColor *color)
 	return ([color alphaComponent] > 0.0);
 }
 
-- (NSArray *)collectProcesses
+- (ProcessSnapshot *)collectProcesses
 {
-	NSArray *result = nil;
+	// every panel drawn for the same display shares one snapshot of the processes
 
-	if (haveAuthorizedTaskPort) {
-		result = [AGProcess allProcesses];
+	if (! processSnapshot)
+	{
+		processSnapshot = ProcessSnapshotCreate();
+		if (! processSnapshot)
+		{
+			NSLog(@"MainController: collectProcesses: failed to allocate process snapshot");
+			return (NULL);
+		}
 	}
-	else {
-		// without an authorized task port, everything is going to fail, so just return and empty array
-		result = [NSArray array];
+
+	// without an authorized task port, everything is going to fail, so the snapshot stays empty
+	if (haveAuthorizedTaskPort && (processSnapshotDisplay != displayCount || processSnapshot->timestamp == 0.0))
+	{
+		processSnapshotDisplay = displayCount;
+		ProcessSnapshotRefresh(processSnapshot);
 	}
-	
-	return result;
+
+	return (processSnapshot);
+}
+
+- (NSString *)commandForProcessEntry:(const ProcessSnapshotEntry *)entry
+{
+	// the annotated command needs the arguments, so it's only looked up for the processes that are shown,
+	// and the arguments of each process are only read the first time it is shown
+	NSString *command = nil;
+
+	if (! processArguments)
+	{
+		processArguments = ProcessArgumentsCreate();
+		if (! processArguments)
+		{
+			NSLog(@"MainController: commandForProcessEntry: failed to allocate process arguments");
+		}
+	}
+	if (processArguments)
+	{
+		const ProcessArgumentsEntry *arguments;
+
+		if (processSnapshot && processSnapshot->timestamp != processArgumentsTimestamp)
+		{
+			ProcessArgumentsRetain(processArguments, processSnapshot);
+			processArgumentsTimestamp = processSnapshot->timestamp;
+		}
+		arguments = ProcessArgumentsLookup(processArguments, entry->pid, entry->startTime, entry->command);
+		if (arguments)
+		{
+			NSString *annotation = (arguments->annotation ? [NSString stringWithUTF8String:arguments->annotation] : nil);
+
+			command = [NSString stringWithUTF8String:arguments->name];
+			if (command && annotation)
+			{
+				command = [NSString stringWithFormat:@"%@ (%@)", command, annotation];
+			}
+		}
+	}
+
+	if (! command)
+	{
+		command = [NSString stringWithUTF8String:entry->command];
+	}
+	return (command);
+}
+
+- (ProcessTree *)collectProcessTree:(ProcessSnapshot *)snapshot
+{
+	// the tree is built once for each snapshot and shared by the panels
+
+	if (! processTree)
+	{
+		processTree = ProcessTreeCreate();
+		if (! processTree)
+		{
+			NSLog(@"MainController: collectProcessTree: failed to allocate process tree");
+			return (NULL);
+		}
+	}
+
+	if (snapshot && snapshot->timestamp != processTreeTimestamp)
+	{
+		if (! ProcessTreeBuild(processTree, snapshot))
+		{
+			NSLog(@"MainController: collectProcessTree: failed to build process tree");
+			return (NULL);
+		}
+		processTreeTimestamp = snapshot->timestamp;
+	}
+
+	return (processTree);
+}
+
+- (BOOL)collectProcessNetwork:(ProcessSnapshot *)snapshot
+{
+	// the rates are set once for each snapshot, a new snapshot starts without them
+
+	if (! snapshot || processNetworkUnavailable)
+	{
+		return (NO);
+	}
+
+	if (! processNetwork)
+	{
+		processNetwork = ProcessNetworkCreate();
+		if (! processNetwork)
+		{
+			// always on Mac OS X, the lists are left empty
+			processNetworkUnavailable = YES;
+			return (NO);
+		}
+	}
+
+	if (snapshot->timestamp != processNetworkTimestamp)
+	{
+		if (! ProcessNetworkUpdate(processNetwork, snapshot))
+		{
+			NSLog(@"MainController: collectProcessNetwork: failed to read the sockets");
+			return (NO);
+		}
+		processNetworkTimestamp = snapshot->timestamp;
+	}
+
+	return (YES);
+}
+
+- (ProcessThreads *)collectProcessThreads:(ProcessSnapshot *)snapshot pids:(const pid_t *)pids count:(int)count
+{
+	// the threads are only walked for the processes given, once for each snapshot
+
+	if (! processThreads)
+	{
+		processThreads = ProcessThreadsCreate();
+		if (! processThreads)
+		{
+			NSLog(@"MainController: collectProcessThreads: failed to allocate process threads");
+			return (NULL);
+		}
+	}
+
+	if (snapshot && snapshot->timestamp != processThreadsTimestamp)
+	{
+		if (! ProcessThreadsUpdate(processThreads, snapshot, pids, count))
+		{
+			NSLog(@"MainController: collectProcessThreads: failed to read the threads");
+			return (NULL);
+		}
+		processThreadsTimestamp = snapshot->timestamp;
+	}
+
+	return (processThreads);
+}
+
+- (NSString *)commandForApplication:(int)index inTree:(const ProcessTree *)tree snapshot:(const ProcessSnapshot *)snapshot
+{
+	NSString *command = [self commandForProcessEntry:&snapshot->entries[index]];
+	int helpers = tree->nodes[index].applicationTotal.count - 1;
+
+	if (helpers > 0)
+	{
+		command = [NSString stringWithFormat:NSLocalizedString(@"ApplicationWithHelpers", nil), command, helpers];
+	}
+	return (command);
 }
 
 #pragma mark -
@@ -1522,8 +1713,9 @@ typedef enum
 	{
 		int x;
 		
-		double average[MAX_PROCESSORS];
-		for (int i = 0; i < MAX_PROCESSORS; i++) {
+		int processorCapacity = [processorInfo getProcessorCapacity];
+		double average[processorCapacity];
+		for (int i = 0; i < processorCapacity; i++) {
 			average[i] = 0.0;
 		}
 
@@ -1630,34 +1822,6 @@ typedef enum
 	return (result);
 }
 
-NSInteger cpuSort(id process1, id process2, void *context)
-{
-	double cpu1 = [process1 percentCPUUsage];
-	double cpu2 = [process2 percentCPUUsage];
-	
-	if (cpu1 == AGProcessValueUnknown)
-	{
-		cpu1 = -1.0;
-	}
-	if (cpu2 == AGProcessValueUnknown)
-	{
-		cpu2 = -1.0;
-	}
-	
-	if (cpu1 < cpu2)
-	{
-		return NSOrderedDescending;
-	}
-	else if (cpu1 > cpu2)
-	{
-		return NSOrderedAscending;
-	}
-	else
-	{
-		return NSOrderedSame;
-	}
-}
-
 int processListSort(const void *value1, const void *value2)
 {
 	struct processEntry *entry1 = (struct processEntry *)value1;
@@ -1677,6 +1841,96 @@ int processListSort(const void *value1, const void *value2)
 	}
 }
 
+- (NSString *)stringForProcessState:(ProcessSnapshotState)state
+{
+	// the letters ps uses
+	switch (state)
+	{
+	case ProcessSnapshotStateRunnable:
+		return (@"R");
+	case ProcessSnapshotStateUninterruptible:
+		return (@"U");
+	case ProcessSnapshotStateSleeping:
+		return (@"S");
+	case ProcessSnapshotStateIdle:
+		return (@"I");
+	case ProcessSnapshotStateSuspended:
+		return (@"T");
+	case ProcessSnapshotStateZombie:
+	case ProcessSnapshotStateExited:
+		return (@"Z");
+	default:
+		return (@"?");
+	}
+}
+
+- (NSString *)threadList:(ProcessSnapshot *)snapshot forPids:(const pid_t *)pids count:(int)count
+{
+	NSMutableString *threadList = [NSMutableString stringWithString:@""];
+	ProcessThreads *threads = [self collectProcessThreads:snapshot pids:pids count:count];
+	const ProcessThreadList *lists[PROCESS_THREADS_MAX_PROCESSES];
+	int offsets[PROCESS_THREADS_MAX_PROCESSES];
+	int listCount = 0, offset = 0;
+	int i, k;
+
+	if (! threads)
+	{
+		return (threadList);
+	}
+
+	// the threads of all the lists are ranked together, an item's index is its list's offset plus its index in the list
+	TopRankItem rankItems[THREAD_RANK_SIZE];
+	TopRank rank;
+	TopRankInit(&rank, rankItems, THREAD_RANK_SIZE);
+	for (i = 0; i < count && listCount < PROCESS_THREADS_MAX_PROCESSES; i++)
+	{
+		const ProcessThreadList *list = ProcessThreadsFind(threads, pids[i]);
+		
+		if (list)
+		{
+			for (k = 0; k < list->count; k++)
+			{
+				if (list->threads[k].cpuUsage > 0.0)
+				{
+					TopRankOffer(&rank, list->threads[k].cpuUsage, offset + k);
+				}
+			}
+			lists[listCount] = list;
+			offsets[listCount] = offset;
+			listCount++;
+			offset += list->count;
+		}
+	}
+	int rankCount = TopRankFinish(&rank);
+
+	for (i = 0; i < rankCount; i++)
+	{
+		int index = rankItems[i].index;
+		int listIndex = listCount - 1;
+		while (offsets[listIndex] > index)
+		{
+			listIndex--;
+		}
+		const ProcessThread *thread = &lists[listIndex]->threads[index - offsets[listIndex]];
+		const ProcessSnapshotEntry *entry = ProcessSnapshotFind(snapshot, lists[listIndex]->pid);
+		
+		NSString *name = (thread->name[0] != '\0' ? [NSString stringWithUTF8String:thread->name] : nil);
+		if (! name)
+		{
+			name = [NSString stringWithFormat:@"%llu", thread->tid];
+		}
+		else if ([name length] > THREAD_NAME_LENGTH)
+		{
+			name = [name substringToIndex:THREAD_NAME_LENGTH];
+		}
+		
+		[threadList appendString:[NSString stringWithFormat:@"\t%@\t%d\t%@\t%@\t%@\n",
+			[self stringForPercentage:thread->cpuUsage], thread->priority, [self stringForProcessState:thread->state], name,
+			(entry ? [self commandForProcessEntry:entry] : @"")]];
+	}
+	return (threadList);
+}
+
 - (void)drawProcessorInfo:(GraphPoint)atPoint withIndex:(int)index
 {
 	if (atPoint.radius < 0.5)
@@ -1686,8 +1940,9 @@ int processListSort(const void *value1, const void *value2)
 
 		int x;
 
-		double average[MAX_PROCESSORS];
-		for (int i = 0; i < MAX_PROCESSORS; i++) {
+		int processorCapacity = [processorInfo getProcessorCapacity];
+		double average[processorCapacity];
+		for (int i = 0; i < processorCapacity; i++) {
 			average[i] = 0.0;
 		}
 
@@ -1808,13 +2063,13 @@ int processListSort(const void *value1, const void *value2)
 
 		// load statistics
 		{
-			int x;
-			LoadData loaddata;
+			RollupBucket summary;
 			
 			double currentLoad = 0.0;
 			double maxLoad = 0.0;
-			double minLoad = 99999.0;
+			double minLoad = 0.0;
 			double avgLoad = 0.0;	
+			double weekLoad = 0.0;
 			
 			// get current load
 			{
@@ -1827,75 +2082,51 @@ int processListSort(const void *value1, const void *value2)
 				}
 			}
 
-			[loadInfo startIterate];
-			for (x = 0; [loadInfo getNext:&loaddata]; x++)
+			// the last hour and the last week come from the rollups, not a scan of the samples
+			[rollupLock lock];
+			if (RollupSeriesSummarize(rollups[RollupLoad], now - (60 * 60), now, &summary))
 			{
-				if (loaddata.average > maxLoad)
-				{
-					maxLoad = loaddata.average;
-				}
-				if (loaddata.average > 0.0)
-				{
-					if (loaddata.average < minLoad)
-					{
-						minLoad = loaddata.average;
-					}
-				}
-				
-				if (x == 0)
-				{
-					avgLoad = loaddata.average;
-				}
-				else
-				{
-					if (loaddata.average > 0.0)
-					{
-						avgLoad = (avgLoad + loaddata.average) / 2.0;
-					}
-				}
+				maxLoad = summary.maximum;
+				minLoad = summary.minimum;
+				avgLoad = summary.sum / summary.count;
 			}
+			if (RollupSeriesSummarize(rollups[RollupLoad], now - (7 * 24 * 60 * 60), now, &summary))
+			{
+				weekLoad = summary.sum / summary.count;
+			}
+			[rollupLock unlock];
 
 			[self replaceToken:@"[lc]" inString:outputString withString:[NSString stringWithFormat:@"%.2f", currentLoad]];
 			[self replaceToken:@"[lh]" inString:outputString withString:[NSString stringWithFormat:@"%.2f", maxLoad]];
 			[self replaceToken:@"[ll]" inString:outputString withString:[NSString stringWithFormat:@"%.2f", minLoad]];
 			[self replaceToken:@"[la]" inString:outputString withString:[NSString stringWithFormat:@"%.2f", avgLoad]];
+			[self replaceToken:@"[lw]" inString:outputString withString:[NSString stringWithFormat:@"%.2f", weekLoad]];
 		}
 		
 		NSMutableString *applicationList = [NSMutableString stringWithString:@""];
+		NSMutableString *applicationGroup = [NSMutableString stringWithString:@""];
+		NSString *threadList = @"";
 		{
-			NSArray *processes = [self collectProcesses];
+			ProcessSnapshot *snapshot = [self collectProcesses];
 			
-			// overall process statistics
+			// overall process statistics, one pass over the state column
 			{
-				int totalCount = 0;
-				int unknownCount = 0;
-				int runnableCount = 0;
-				int sleepingCount = 0;
-				int otherCount = 0;
+				ProcessColumnsTotals totals;
 				
-				NSEnumerator *processEnumerator = [processes objectEnumerator];
-				AGProcess *process;
-				while (process = [processEnumerator nextObject])
+				if (snapshot)
 				{
-					totalCount++;
-					
-					int state = [process state];
-					switch (state)
-					{
-					case AGProcessStateUnknown:
-						unknownCount++;
-						break;
-					case AGProcessStateRunnable:
-						runnableCount++;
-						break;
-					case AGProcessStateSleeping:
-						sleepingCount++;
-						break;
-					default:
-						otherCount++;
-						break;
-					}
+					ProcessColumnsSum(snapshot->columns, 0, &totals);
 				}
+				else
+				{
+					memset(&totals, 0, sizeof(totals));
+				}
+				
+				int totalCount = totals.count;
+				int unknownCount = totals.stateCounts[ProcessSnapshotStateUnknown];
+				int runnableCount = totals.stateCounts[ProcessSnapshotStateRunnable];
+				int sleepingCount = totals.stateCounts[ProcessSnapshotStateSleeping];
+				int otherCount = totalCount - (unknownCount + runnableCount + sleepingCount);
 
 				[self replaceToken:@"[pt]" inString:outputString withString:[NSString stringWithFormat:@"%d", totalCount]];				
 				[self replaceToken:@"[pr]" inString:outputString withString:[NSString stringWithFormat:@"%d", runnableCount]];				
@@ -1904,8 +2135,6 @@ int processListSort(const void *value1, const void *value2)
 				[self replaceToken:@"[pu]" inString:outputString withString:[NSString stringWithFormat:@"%d", unknownCount]];				
 			}
 			
-			NSArray *sortedProcesses = [processes sortedArrayUsingFunction:cpuSort context:NULL];
-			
 			// setup process list
 			{
 				int i;
@@ -1921,25 +2150,19 @@ int processListSort(const void *value1, const void *value2)
 			{
 				checkPid = YES;
 			}
-			NSEnumerator *processEnumerator = [sortedProcesses objectEnumerator];
-			int count = 0;
-			BOOL done = NO;
-			AGProcess *process;
-			while (! done && (process = [processEnumerator nextObject]))
-			{
-				double cpu = [process percentCPUUsage];
-				int pid = [process processIdentifier];
 
-				BOOL pidOK = YES;
-				if (checkPid)
-				{
-					if (pid == selfPid)
-					{
-						pidOK = NO;
-					}
-				}
+			// only the busiest processes are ranked, over the usage column
+			TopRankItem rankItems[PROCESS_RANK_SIZE];
+			int processIndex;
+			int rankCount = (snapshot ? ProcessColumnsRank(snapshot->columns, ProcessColumnsKeyCPUUsage,
+				PROCESS_COLUMNS_KERNEL | (checkPid ? PROCESS_COLUMNS_SELF : 0), rankItems, PROCESS_RANK_SIZE) : 0);
+			
+			for (processIndex = 0; processIndex < rankCount; processIndex++)
+			{
+				double cpu = snapshot->entries[rankItems[processIndex].index].cpuUsage;
+				double average = snapshot->entries[rankItems[processIndex].index].averageUsage;
+				int pid = snapshot->entries[rankItems[processIndex].index].pid;
 
-				if (cpu != AGProcessValueUnknown && cpu > 0.0 && pid !=0 && pidOK)
 				{
 					BOOL found = NO;
 					float minAverage = processList[9].average;
@@ -1951,7 +2174,7 @@ int processListSort(const void *value1, const void *value2)
 					{
 						if (processList[i].pid == pid)
 						{
-							processList[i].average = (processList[i].average + cpu) / 2.0;
+							processList[i].average = average;
 							processList[i].current = cpu;
 							processList[i].isCurrent = YES;
 							found = YES;
@@ -1971,16 +2194,10 @@ int processListSort(const void *value1, const void *value2)
 						}
 					
 						processList[minIndex].pid = pid;
-						processList[minIndex].average = cpu;
+						processList[minIndex].average = average;
 						processList[minIndex].current = cpu;
 						processList[minIndex].isCurrent = YES;
 					}
-					
-					count++;
-					if (count == 10)
-					{
-						done = YES;
-					}
 				}
 			}
 
@@ -1992,15 +2209,13 @@ int processListSort(const void *value1, const void *value2)
 					int pid = processList[i].pid;
 					if (pid != 0 && ! processList[i].isCurrent)
 					{
-						AGProcess *updateProcess = [AGProcess processForProcessIdentifier:pid];
-						if (updateProcess != nil)
+						const ProcessSnapshotEntry *updateEntry = (snapshot ? ProcessSnapshotFind(snapshot, pid) : NULL);
+						if (updateEntry != NULL)
 						{
-							double cpu = [updateProcess percentCPUUsage];
-	
-							if (cpu != AGProcessValueUnknown)
+							if (updateEntry->known)
 							{
-								processList[i].average = (processList[i].average + cpu) / 2.0;
-								processList[i].current = cpu;
+								processList[i].average = updateEntry->averageUsage;
+								processList[i].current = updateEntry->cpuUsage;
 								processList[i].isCurrent = YES;
 							}
 							else
@@ -2032,25 +2247,51 @@ int processListSort(const void *value1, const void *value2)
 			// output process list
 			{
 				int processListDisplaySize = PROCESS_LIST_SIZE + 1 - (processorsDisplayed + temperaturesDisplayed);
+				pid_t shownPids[PROCESS_LIST_SIZE];
+				int shownCount = 0;
 				
 				int i;
 				for (i = 0; i < processListDisplaySize; i++)
 				{
 					int pid = processList[i].pid;
 					
-					if (pid != 0)
+					const ProcessSnapshotEntry *outputEntry = (snapshot && pid != 0 ? ProcessSnapshotFind(snapshot, pid) : NULL);
+					
+					if (outputEntry != NULL)
 					{
-						AGProcess *outputProcess = [AGProcess processForProcessIdentifier:pid];
 						double cpu = processList[i].current;
 						double avg = processList[i].average;
 						
 						[applicationList appendString:[NSString stringWithFormat:@"\t%@\t%@\t%d\t%@\n",
-							[self stringForPercentage:avg], [self stringForPercentage:cpu], pid, [outputProcess annotatedCommand]]];
+							[self stringForPercentage:avg], [self stringForPercentage:cpu], pid, [self commandForProcessEntry:outputEntry]]];
+						shownPids[shownCount++] = pid;
 					}
 				}
+				
+				// only the threads of the processes shown are walked
+				if (snapshot)
+				{
+					threadList = [self threadList:snapshot forPids:shownPids count:shownCount];
+				}
+			}
+			
+			// output the busiest application, with the processes it started
+			{
+				ProcessTree *tree = (snapshot ? [self collectProcessTree:snapshot] : NULL);
+				int application = (tree ? ProcessTreeBusiestApplication(tree, snapshot) : -1);
+				
+				if (application >= 0)
+				{
+					const ProcessTreeRollup *total = &tree->nodes[application].applicationTotal;
+					
+					[applicationGroup appendString:[NSString stringWithFormat:@"\t%@\t%@\t\t%@\n",
+						[self stringForPercentage:total->averageUsage], [self stringForPercentage:total->cpuUsage], [self commandForApplication:application inTree:tree snapshot:snapshot]]];
+				}
 			}
 		}
 		[self replaceToken:@"[al]" inString:outputString withString:applicationList];
+		[self replaceToken:@"[pa]" inString:outputString withString:applicationGroup];
+		[self replaceToken:@"[at]" inString:outputString withString:threadList];
 
 		{
 			NSRect infoFrame = [infoView frame];
@@ -2615,11 +2856,13 @@ int processListSort(const void *value1, const void *value2)
 	if ([defaults boolForKey:HISTORY_SHOW_GAUGE_KEY])
 	{
 		int x;
-		LoadData loaddata;
+		RollupBucket bucket;
 
 		struct tm *nowTime = localtime(&now);
 		const double sliceMinuteAngle = 360.0 / 60.0;
 		double minuteAngle = 90.0 - ((double)nowTime->tm_min * sliceMinuteAngle);
+		const double sliceHourAngle = 360.0 / (7.0 * 24.0);
+		double hourAngle = 90.0 - ((double)((nowTime->tm_wday * 24) + nowTime->tm_hour) * sliceHourAngle);
 	
 		double radius = (GRAPH_SIZE/2.0) - (GRAPH_SIZE/32.0);
 	
@@ -2632,29 +2875,34 @@ int processListSort(const void *value1, const void *value2)
 		float minLoad = [[defaults objectForKey:HISTORY_LOAD_MINIMUM_KEY] floatValue];;
 		float maxLoad = [[defaults objectForKey:HISTORY_LOAD_MAXIMUM_KEY] floatValue];;
 
-		[loadInfo startIterate];
-		for (x = 1; [loadInfo getNext:&loaddata]; x++)
+		[rollupLock lock];
+
+		// the last hour, one dot per minute
+		for (x = 1; x <= 60; x++)
 		{
 			float fadeAngle = minuteAngle - (x * sliceMinuteAngle);
-			float loadFraction = (loaddata.average - minLoad) / (maxLoad - minLoad);
-			//NSLog(@"minLoad = %6.2f, maxLoad = %6.2f, sample = %6.2f loadFraction = %6.2f", minLoad, maxLoad, loaddata.average, loadFraction);
-
-			if (loadFraction > 1.0)
-			{
-				loadFraction = 1.0;
-			}
-			if (loadFraction < 0.0)
-			{
-				loadFraction = 0.0;
-			}
 
 			timePoint = [self pointAtCenter:processorPoint atAngle:fadeAngle atRadius:radius];
 	
 			if (x < 60)
 			{
 				// display a normal load dot
-				[[loadColor colorWithAlphaComponent:loadFraction] set];
-				[self drawValue:(GRAPH_SIZE / 48.0) atPoint:timePoint];
+				if (RollupSeriesBucket(rollups[RollupLoad], RollupMinute, now, 60 - x, &bucket))
+				{
+					float loadFraction = ((bucket.sum / bucket.count) - minLoad) / (maxLoad - minLoad);
+
+					if (loadFraction > 1.0)
+					{
+						loadFraction = 1.0;
+					}
+					if (loadFraction < 0.0)
+					{
+						loadFraction = 0.0;
+					}
+
+					[[loadColor colorWithAlphaComponent:loadFraction] set];
+					[self drawValue:(GRAPH_SIZE / 48.0) atPoint:timePoint];
+				}
 			}
 			else
 			{
@@ -2668,6 +2916,31 @@ int processListSort(const void *value1, const void *value2)
 				}
 			}
 		}
+
+		// the last week, a band inside the dots with one segment per hour
+		for (x = 0; x < 7 * 24; x++)
+		{
+			if (RollupSeriesBucket(rollups[RollupLoad], RollupHour, now, x, &bucket))
+			{
+				float startAngle = hourAngle + (x * sliceHourAngle);
+				float loadFraction = ((bucket.sum / bucket.count) - minLoad) / (maxLoad - minLoad);
+
+				if (loadFraction > 1.0)
+				{
+					loadFraction = 1.0;
+				}
+				if (loadFraction < 0.0)
+				{
+					loadFraction = 0.0;
+				}
+
+				[[loadColor colorWithAlphaComponent:loadFraction] set];
+				[self drawValueAngleFrom:(radius - (GRAPH_SIZE / 16.0)) to:(radius - (GRAPH_SIZE / 16.0) + (GRAPH_SIZE / 64.0)) atPoint:processorPoint
+						startAngle:startAngle endAngle:(startAngle - sliceHourAngle) clockwise:YES];
+			}
+		}
+
+		[rollupLock unlock];
 	}
 }
 
@@ -2777,34 +3050,6 @@ int processListSort(const void *value1, const void *value2)
 	return (result);
 }
 
-NSInteger memorySort(id process1, id process2, void *context)
-{
-	vm_size_t mem1 = [process1 residentMemorySize];
-	vm_size_t mem2 = [process2 residentMemorySize];
-	
-	if (mem1 == AGProcessValueUnknown)
-	{
-		mem1 = 0;
-	}
-	if (mem2 == AGProcessValueUnknown)
-	{
-		mem2 = 0;
-	}
-	
-	if (mem1 < mem2)
-	{
-		return NSOrderedDescending;
-	}
-	else if (mem1 > mem2)
-	{
-		return NSOrderedAscending;
-	}
-	else
-	{
-		return NSOrderedSame;
-	}
-}
-
 - (void)drawMemoryInfo:(GraphPoint)atPoint withIndex:(int)index
 {
 	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
@@ -2885,50 +3130,54 @@ NSInteger memorySort(id process1, id process2, void *context)
 
 
 	NSMutableString *memoryList = [NSMutableString stringWithString:@""];
+	NSMutableString *memoryGroup = [NSMutableString stringWithString:@""];
 	{
-		NSArray *processes = [self collectProcesses];
-
-		NSArray *sortedProcesses = [processes sortedArrayUsingFunction:memorySort context:NULL];
+		ProcessSnapshot *snapshot = [self collectProcesses];
+		double physicalMemory = (vmdata.activeCount + vmdata.inactiveCount + vmdata.wiredCount + vmdata.freeCount) * 4096.0;
 		
 		BOOL checkPid = NO;
 		if (! [defaults boolForKey:GLOBAL_SHOW_SELF_KEY])
 		{
 			checkPid = YES;
 		}
-		NSEnumerator *processEnumerator = [sortedProcesses objectEnumerator];
-		int count = 0;
-		BOOL done = NO;
-		AGProcess *process;
-		while (! done && (process = [processEnumerator nextObject]))
+
+		// only the largest processes are ranked, over the resident size column
+		TopRankItem rankItems[PROCESS_RANK_SIZE];
+		int processIndex;
+		int rankCount = (snapshot ? ProcessColumnsRank(snapshot->columns, ProcessColumnsKeyResidentSize,
+			(checkPid ? PROCESS_COLUMNS_SELF : 0), rankItems, PROCESS_RANK_SIZE) : 0);
+		
+		for (processIndex = 0; processIndex < rankCount; processIndex++)
 		{
-			double memoryUsage = [process percentMemoryUsage];
-			int pid = [process processIdentifier];
+			const ProcessSnapshotEntry *entry = &snapshot->entries[rankItems[processIndex].index];
+			double memoryUsage = (physicalMemory > 0.0 ? (double)entry->residentSize / physicalMemory : 0.0);
 
-			BOOL pidOK = YES;
-			if (checkPid)
 			{
-				if (pid == selfPid)
-				{
-					pidOK = NO;
-				}
-			}
+				// the private size walks every region of the task, so it's only measured for the processes shown, and only when it's due
+				ProcessSnapshotUpdateDetail(snapshot, rankItems[processIndex].index);
+				float virtualSize = (entry->detailKnown ? (float)entry->privateSize : (float)entry->virtualSize);
+				float residentSize = (float)entry->residentSize;
 
-			if (memoryUsage != AGProcessValueUnknown && memoryUsage > 0.0 && pidOK)
+				[memoryList appendString:[NSString stringWithFormat:@"\t%@\t%@\t%@\t%@\n", [self stringForValue:residentSize withBytes:YES], [self stringForPercentage:memoryUsage withPercent:NO], [self stringForValue:virtualSize withBytes:YES], [self commandForProcessEntry:entry]]];
+			}
+		}
+		
+		// output the largest application, with the processes it started
+		{
+			ProcessTree *tree = (snapshot ? [self collectProcessTree:snapshot] : NULL);
+			int application = (tree ? ProcessTreeLargestApplication(tree, snapshot) : -1);
+			
+			if (application >= 0)
 			{
-				float virtualSize = (float)[process virtualMemorySize];
-				float residentSize = (float)[process residentMemorySize];
-
-				[memoryList appendString:[NSString stringWithFormat:@"\t%@\t%@\t%@\t%@\n", [self stringForValue:residentSize withBytes:YES], [self stringForPercentage:memoryUsage withPercent:NO], [self stringForValue:virtualSize withBytes:YES], [process annotatedCommand]]];
-
-				count++;
-				if (count == 10)
-				{
-					done = YES;
-				}
+				float residentSize = (float)tree->nodes[application].applicationTotal.residentSize;
+				double memoryUsage = (physicalMemory > 0.0 ? residentSize / physicalMemory : 0.0);
+				
+				[memoryGroup appendString:[NSString stringWithFormat:@"\t%@\t%@\t\t%@\n", [self stringForValue:residentSize withBytes:YES], [self stringForPercentage:memoryUsage withPercent:NO], [self commandForApplication:application inTree:tree snapshot:snapshot]]];
 			}
 		}
 	}
 	[self replaceToken:@"[ml]" inString:outputString withString:memoryList];
+	[self replaceToken:@"[mg]" inString:outputString withString:memoryGroup];
 	
 	{
 		NSRect infoFrame = [infoView frame];
@@ -3065,77 +3314,6 @@ NSInteger memorySort(id process1, id process2, void *context)
 	return (result);
 }
 
-NSInteger swappingSort(id process1, id process2, void *context)
-{
-	int pid1 = [process1 processIdentifier];
-	int pid2 = [process2 processIdentifier];
-	
-	if (pid1 == AGProcessValueUnknown)
-	{
-		pid1 = INT_MAX;
-	}
-	if (pid2 == AGProcessValueUnknown)
-	{
-		pid2 = INT_MAX;
-	}
-	
-	if (pid1 > pid2)
-	{
-		return NSOrderedDescending;
-	}
-	else if (pid1 < pid2)
-	{
-		return NSOrderedAscending;
-	}
-	else
-	{
-		return NSOrderedSame;
-	}
-}
-
-int swappingListSortByRank(const void *value1, const void *value2)
-{
-	struct swappingEntry *entry1 = (struct swappingEntry *)value1;
-	struct swappingEntry *entry2 = (struct swappingEntry *)value2;
-
-	int rank1 = ((entry1->pageins - entry1->lastPageins) * 10000) +  (entry1->faults - entry1->lastFaults);
-	int rank2 = ((entry2->pageins - entry2->lastPageins) * 10000) +  (entry2->faults - entry2->lastFaults);;
-	
-	if (rank1 < rank2)
-	{
-		return (1);
-	}
-	else if (rank1 > rank2)
-	{
-		return (-1);
-	}
-	else
-	{	
-		return (0);
-	}
-}
-
-int swappingListSortByPid(const void *value1, const void *value2)
-{
-	struct swappingEntry *entry1 = (struct swappingEntry *)value1;
-	struct swappingEntry *entry2 = (struct swappingEntry *)value2;
-
-	if (entry1->pid > entry2->pid)
-	{
-		return (1);
-	}
-	else if (entry1->pid < entry2->pid)
-	{
-		return (-1);
-	}
-	else
-	{	
-		return (0);
-	}
-}
-
-
-
 - (void)drawSwappingInfo:(GraphPoint)atPoint withIndex:(int)index
 {
 	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
@@ -3235,78 +3413,42 @@ int swappingListSortByPid(const void *value1, const void *value2)
 	
 	NSMutableString *pagingList = [NSMutableString stringWithString:@""];
 	{
-		NSArray *processes = [self collectProcesses];
-		AGProcess *process;
-
-		NSArray *sortedProcesses = [processes sortedArrayUsingFunction:swappingSort context:NULL];
+		ProcessSnapshot *snapshot = [self collectProcesses];
+		int processCount = (snapshot ? snapshot->count : 0);
 
-		// setup swapping list
+		if (! pagingTable)
 		{
-			int i;
-			for (i = 0; i < SWAPPING_LIST_SIZE; i++)
-			{
-				swappingList[i].isCurrent = NO;
-			}
-		}
-		
-		// update swapping list
-		NSEnumerator *processEnumerator = [sortedProcesses objectEnumerator];
-		int swappingListIndex = 0;
-		int insertIndex = SWAPPING_LIST_SIZE - 1;
-		while (process = [processEnumerator nextObject])
-		{
-			int swappingListPid = swappingList[swappingListIndex].pid;
-			int processPid = [process processIdentifier];
-			
-			while (swappingListPid < processPid)
-			{
-				swappingListIndex += 1;
-				swappingListPid = swappingList[swappingListIndex].pid;
-			}
-			
-			if (swappingListPid == processPid)
-			{
-				swappingList[swappingListIndex].lastPageins = swappingList[swappingListIndex].pageins;
-				swappingList[swappingListIndex].pageins = [process pageins];
-				swappingList[swappingListIndex].lastFaults = swappingList[swappingListIndex].faults;
-				swappingList[swappingListIndex].faults = [process faults];
-				swappingList[swappingListIndex].isCurrent = YES;
-			}
-			else
+			pagingTable = ProcessTableCreate();
+			if (! pagingTable)
 			{
-				swappingList[insertIndex].pid = processPid;
-				swappingList[insertIndex].lastPageins = [process pageins];
-				swappingList[insertIndex].pageins = [process pageins];
-				swappingList[insertIndex].lastFaults = [process faults];
-				swappingList[insertIndex].faults = [process faults];
-				swappingList[insertIndex].isCurrent = YES;
-				
-				insertIndex -= 1;
+				NSLog(@"MainController: drawSwappingInfo: failed to allocate paging table");
 			}
 		}
-		
-		// cleanup swapping list
+
+		// the deltas are between two snapshots, so drawing the same snapshot again doesn't reset them
+		if (pagingTable && snapshot && snapshot->timestamp != pagingTableTimestamp)
 		{
-			int i;
-			for (i = 0; i < SWAPPING_LIST_SIZE; i++)
+			pagingTableTimestamp = snapshot->timestamp;
+			
+			ProcessTableBeginGeneration(pagingTable);
+			int processIndex;
+			for (processIndex = 0; processIndex < processCount; processIndex++)
 			{
-				if (! swappingList[i].isCurrent)
+				const ProcessSnapshotEntry *process = &snapshot->entries[processIndex];
+				if (process->known)
 				{
-					swappingList[i].pid = INT_MAX;
-					swappingList[i].lastPageins = 0;
-					swappingList[i].pageins = 0;
-					swappingList[i].lastFaults = 0;
-					swappingList[i].faults = 0;
+					unsigned long long counters[PagingCounterCount];
+					
+					counters[PagingCounterPageins] = process->pageins;
+					counters[PagingCounterFaults] = process->faults;
+					ProcessTableSet(pagingTable, process->pid, process->startTime, counters, PagingCounterCount);
 				}
 			}
+			ProcessTableExpire(pagingTable);
 		}
 		
-		// sort swapping list by rank
-		{
-			qsort(&swappingList[0], SWAPPING_LIST_SIZE, sizeof(struct swappingEntry), swappingListSortByRank);
-		}
-		
-		// output process list
+		// output the processes paging the most
+		if (pagingTable)
 		{
 			BOOL checkPid = NO;
 			if (! [defaults boolForKey:GLOBAL_SHOW_SELF_KEY])
@@ -3314,52 +3456,37 @@ int swappingListSortByPid(const void *value1, const void *value2)
 				checkPid = YES;
 			}
 
-			BOOL done = NO;
-			int i = 0;
-			int count = 0;
-			while (! done)
+			TopRankItem rankItems[PROCESS_RANK_SIZE];
+			TopRank rank;
+			int i;
+			TopRankInit(&rank, rankItems, PROCESS_RANK_SIZE);
+			for (i = 0; i < pagingTable->capacity; i++)
 			{
-				int pid = swappingList[i].pid;
+				const ProcessTableEntry *entry = &pagingTable->slots[i];
 				
-				BOOL pidOK = YES;
-				if (checkPid)
+				if (ProcessTableSlotIsUsed(pagingTable, i) && ! (checkPid && entry->pid == selfPid))
 				{
-					if (pid == selfPid)
+					unsigned long long pageinDelta = entry->counters[PagingCounterPageins] - entry->lastCounters[PagingCounterPageins];
+					unsigned long long faultDelta = entry->counters[PagingCounterFaults] - entry->lastCounters[PagingCounterFaults];
+					
+					if (pageinDelta != 0 || faultDelta != 0)
 					{
-						pidOK = NO;
+						TopRankOffer(&rank, ((double)pageinDelta * 10000.0) + (double)faultDelta, i);
 					}
 				}
+			}
+			int rankCount = TopRankFinish(&rank);
 
-				if (pid != INT_MAX && pidOK)
-				{
-					AGProcess *outputProcess = [AGProcess processForProcessIdentifier:pid];
-					int pageinDelta = swappingList[i].pageins - swappingList[i].lastPageins;
-					int faultDelta = swappingList[i].faults - swappingList[i].lastFaults;
+			for (i = 0; i < rankCount; i++)
+			{
+				const ProcessTableEntry *entry = &pagingTable->slots[rankItems[i].index];
+				const ProcessSnapshotEntry *outputEntry = (snapshot ? ProcessSnapshotFind(snapshot, entry->pid) : NULL);
+				unsigned long long pageinDelta = entry->counters[PagingCounterPageins] - entry->lastCounters[PagingCounterPageins];
+				unsigned long long faultDelta = entry->counters[PagingCounterFaults] - entry->lastCounters[PagingCounterFaults];
 
-					if (pageinDelta == 0 && faultDelta == 0)
-					{
-						done = YES;
-					}
-					else
-					{
-						[pagingList appendString:[NSString stringWithFormat:@"\t%d\t%d\t%@\n", pageinDelta, faultDelta, [outputProcess annotatedCommand]]];
-						count += 1;
-					}
-				}
-				
-				i ++;
-				
-				if (count == 10 || i == SWAPPING_LIST_SIZE)
-				{
-					done = YES;
-				}
+				[pagingList appendString:[NSString stringWithFormat:@"\t%llu\t%llu\t%@\n", pageinDelta, faultDelta, (outputEntry ? [self commandForProcessEntry:outputEntry] : @"")]]];
 			}
 		}
-
-		// sort swapping list by pid
-		{
-			qsort(&swappingList[0], SWAPPING_LIST_SIZE, sizeof(struct swappingEntry), swappingListSortByPid);
-		}
 	}
 	[self replaceToken:@"[pl]" inString:outputString withString:pagingList];
 	
@@ -3446,12 +3573,12 @@ int swappingListSortByPid(const void *value1, const void *value2)
 		NSColor *diskWarningColor = [Preferences colorAlphaFromString:[defaults stringForKey:DISK_WARNING_COLOR_KEY]];
 		NSColor *diskBackgroundColor = [Preferences colorAlphaFromString:[defaults stringForKey:DISK_BACKGROUND_COLOR_KEY]];
 		
-		DiskData diskdata;
+		const DiskData *diskdata;
 	
 		NSPoint processorPoint = NSMakePoint(GRAPH_SIZE/2.0, GRAPH_SIZE/2.0);
 	
 		// draw static disk data
-		[diskInfo getCurrent:&diskdata];
+		diskdata = [diskInfo currentSample];
 
 		if ([defaults boolForKey:DISK_SUM_ALL_KEY])
 		{
@@ -3465,12 +3592,12 @@ int swappingListSortByPid(const void *value1, const void *value2)
 			
 			float used;
 
-			if (diskdata.unlocked.count > 0)
+			if (diskdata->unlocked.count > 0)
 			{
-				for (i = 0; i < diskdata.unlocked.count; i++)
+				for (i = 0; i < diskdata->unlocked.count; i++)
 				{
-					totalFreeBlocks += diskdata.unlocked.freeBlocks[i];
-					totalAvailableBlocks += diskdata.unlocked.availableBlocks[i];
+					totalFreeBlocks += diskdata->unlocked.freeBlocks[i];
+					totalAvailableBlocks += diskdata->unlocked.availableBlocks[i];
 				}
 				
 				used = 1.0 - ((float)totalFreeBlocks /  (float)totalAvailableBlocks);
@@ -3501,17 +3628,17 @@ int swappingListSortByPid(const void *value1, const void *value2)
 			// show each disk in a separate gauge
 			
 			int i;
-			float sliceAngle = 180.0 / diskdata.unlocked.count;
+			float sliceAngle = 180.0 / diskdata->unlocked.count;
 			float currentAngle = 360.0;
 			float endAngle;
 	
-			for (i = 0; i < diskdata.unlocked.count; i++)
+			for (i = 0; i < diskdata->unlocked.count; i++)
 			{
 				[diskBackgroundColor set];
 				endAngle = currentAngle - sliceAngle;
 				[self drawValueAngleFrom:(GRAPH_SIZE/4.0 + GRAPH_SIZE/8.0) to:(GRAPH_SIZE/4.0) atPoint:processorPoint startAngle:currentAngle endAngle:endAngle clockwise:YES];
 	
-				if (diskdata.unlocked.used[i] < 0.90)
+				if (diskdata->unlocked.used[i] < 0.90)
 				{
 					[diskUsedColor set];
 				}
@@ -3530,7 +3657,7 @@ int swappingListSortByPid(const void *value1, const void *value2)
 					[self drawLineFrom:innerPoint to:outerPoint width:1.0];
 				}
 				
-				endAngle = currentAngle - (diskdata.unlocked.used[i] * sliceAngle);
+				endAngle = currentAngle - (diskdata->unlocked.used[i] * sliceAngle);
 				[self drawValueAngleFrom:(GRAPH_SIZE/4.0 + GRAPH_SIZE/8.0) to:(GRAPH_SIZE/4.0) atPoint:processorPoint startAngle:currentAngle endAngle:endAngle clockwise:YES];
 	
 				currentAngle -= sliceAngle;
@@ -3548,7 +3675,7 @@ int swappingListSortByPid(const void *value1, const void *value2)
 
 		int x;
 		float y;
-		DiskData diskdata;
+		const DiskData *diskdata;
 	
 		NSPoint processorPoint = NSMakePoint(GRAPH_SIZE/2.0, GRAPH_SIZE/2.0);
 	
@@ -3573,11 +3700,11 @@ int swappingListSortByPid(const void *value1, const void *value2)
 		float maxWrite = 0.0;
 		
 		[diskInfo startIterate];
-		for (x = 0; [diskInfo getNext:&diskdata]; x++)
+		for (x = 0; (diskdata = [diskInfo nextSample]); x++)
 		{
 			transparencyRead = ((float)(x + 1) / (float)SAMPLE_SIZE) * alphaRead;
 
-			y = [self scaleValueForGauge:(diskdata.readBytes / interval) scaleType:scaleType scale:scaleRead] * 90.0;
+			y = [self scaleValueForGauge:(diskdata->readBytes / interval) scaleType:scaleType scale:scaleRead] * 90.0;
 			[[diskReadColor colorWithAlphaComponent:transparencyRead] set];
 			[self drawValueAngleFrom:innerRadius to:outerRadius atPoint:processorPoint startAngle:180.0 endAngle:(180.0 + y) clockwise:NO];
 			
@@ -3588,7 +3715,7 @@ int swappingListSortByPid(const void *value1, const void *value2)
 	
 			transparencyWrite = ((float)(x + 1) / (float)SAMPLE_SIZE) * alphaWrite;
 
-			y = [self scaleValueForGauge:(diskdata.writeBytes / interval) scaleType:scaleType scale:scaleWrite] * 90.0;
+			y = [self scaleValueForGauge:(diskdata->writeBytes / interval) scaleType:scaleType scale:scaleWrite] * 90.0;
 			[[diskWriteColor colorWithAlphaComponent:transparencyWrite] set];
 			[self drawValueAngleFrom:innerRadius to:outerRadius atPoint:processorPoint startAngle:360.0 endAngle:(360.0 - y) clockwise:YES];
 
@@ -3716,16 +3843,19 @@ int swappingListSortByPid(const void *value1, const void *value2)
 				[self drawLineFrom:innerPoint to:outerPoint width:2.0];
 			}
 		}
-		if (now - timePeakReadBytes > holdTime || diskdata.readBytes > peakReadBytes)
+
+		// the history loop ends with diskdata at NULL, the peaks hold the newest sample
+		diskdata = [diskInfo currentSample];
+		if (now - timePeakReadBytes > holdTime || diskdata->readBytes > peakReadBytes)
 		{
 			// set new peak if time has elapsed or if there is a new high value
-			peakReadBytes = diskdata.readBytes;
+			peakReadBytes = diskdata->readBytes;
 			timePeakReadBytes = now;
 		}
-		if (now - timePeakWriteBytes > holdTime || diskdata.writeBytes > peakWriteBytes)
+		if (now - timePeakWriteBytes > holdTime || diskdata->writeBytes > peakWriteBytes)
 		{
 			// set new peak if time has elapsed or if there is a new high value
-			peakWriteBytes = diskdata.writeBytes;
+			peakWriteBytes = diskdata->writeBytes;
 			timePeakWriteBytes = now;
 		}
 	}
@@ -3740,7 +3870,7 @@ int swappingListSortByPid(const void *value1, const void *value2)
 		NSColor *writesDarkColor = [diskWriteColor blendedColorWithFraction:0.5 ofColor:[NSColor blackColor]];
 
 		float y;
-		DiskData diskdata;
+		const DiskData *diskdata;
 	
 		float interval = [defaults floatForKey:GLOBAL_UPDATE_FREQUENCY_KEY] / 10.0;
 
@@ -3750,12 +3880,12 @@ int swappingListSortByPid(const void *value1, const void *value2)
 		float readsAlpha = [diskReadColor alphaComponent] * 1.5;
 		float writesAlpha = [diskWriteColor alphaComponent] * 1.5;
 
-		[diskInfo getCurrent:&diskdata];
+		diskdata = [diskInfo currentSample];
 		{
-			if (diskdata.readCount > 0)
+			if (diskdata->readCount > 0)
 			{
 				y = GRAPH_SIZE / 16.0;
-				if (diskdata.readCount < (100.0 / interval))
+				if (diskdata->readCount < (100.0 / interval))
 				{
 					[[readsDarkColor colorWithAlphaComponent:readsAlpha] set];
 				}
@@ -3772,10 +3902,10 @@ int swappingListSortByPid(const void *value1, const void *value2)
 					[self drawPointer:y atPoint:diskReadPoint];
 				}
 			}
-			if (diskdata.writeCount > 0)
+			if (diskdata->writeCount > 0)
 			{
 				y = GRAPH_SIZE / 16.0;
-				if (diskdata.writeCount < (100.0 / interval))
+				if (diskdata->writeCount < (100.0 / interval))
 				{
 					[[writesDarkColor colorWithAlphaComponent:writesAlpha] set];
 				}
@@ -3804,7 +3934,7 @@ int swappingListSortByPid(const void *value1, const void *value2)
 	{
 		NSPoint processorPoint = NSMakePoint(GRAPH_SIZE/2.0, GRAPH_SIZE/2.0);
 	
-		DiskData diskdata;
+		const DiskData *diskdata;
 
 		if ([defaults boolForKey:DISK_SUM_ALL_KEY])
 		{
@@ -3813,12 +3943,12 @@ int swappingListSortByPid(const void *value1, const void *value2)
 			unsigned long totalFreeBlocks = 0;
 			unsigned long totalAvailableBlocks = 0;
 
-			[diskInfo getCurrent:&diskdata];
+			diskdata = [diskInfo currentSample];
 	
-			for (x = 0; x < diskdata.unlocked.count; x++)
+			for (x = 0; x < diskdata->unlocked.count; x++)
 			{
-				totalFreeBlocks += diskdata.unlocked.freeBlocks[x];
-				totalAvailableBlocks += diskdata.unlocked.availableBlocks[x];
+				totalFreeBlocks += diskdata->unlocked.freeBlocks[x];
+				totalAvailableBlocks += diskdata->unlocked.availableBlocks[x];
 			}
 
 			NSString *string = [NSString stringWithFormat:@"%.0f", (1.0 - ((double)totalFreeBlocks / (double)totalAvailableBlocks)) * 100.0];
@@ -3833,18 +3963,18 @@ int swappingListSortByPid(const void *value1, const void *value2)
 			float sliceAngle;
 			float currentAngle;
 	
-			[diskInfo getCurrent:&diskdata];
+			diskdata = [diskInfo currentSample];
 	
-			sliceAngle = 180.0 / diskdata.unlocked.count;
+			sliceAngle = 180.0 / diskdata->unlocked.count;
 			currentAngle = 360.0;
 	
-			for (x = 0; x < diskdata.unlocked.count; x++)
+			for (x = 0; x < diskdata->unlocked.count; x++)
 			{
 				NSPoint drawPoint;
 				
-				float textAngle = currentAngle - (diskdata.unlocked.used[x] * sliceAngle / 2.0);
+				float textAngle = currentAngle - (diskdata->unlocked.used[x] * sliceAngle / 2.0);
 	
-				NSString *string = [NSString stringWithFormat:@"%.0f", diskdata.unlocked.used[x] * 100.0];
+				NSString *string = [NSString stringWithFormat:@"%.0f", diskdata->unlocked.used[x] * 100.0];
 	
 				drawPoint = [self pointAtCenter:processorPoint atAngle:textAngle atRadius:(GRAPH_SIZE/4.0 + GRAPH_SIZE/16.0)];
 				[self drawText:string atPoint:drawPoint];
@@ -3874,19 +4004,19 @@ int swappingListSortByPid(const void *value1, const void *value2)
 			}
 			else
 			{
-				DiskData diskdata;
+				const DiskData *diskdata;
 				int x;
 		
 				float sliceAngle;
 				float currentAngle;
 				float endAngle;
 		
-				[diskInfo getCurrent:&diskdata];
+				diskdata = [diskInfo currentSample];
 		
-				sliceAngle = 180.0 / diskdata.unlocked.count;
+				sliceAngle = 180.0 / diskdata->unlocked.count;
 				currentAngle = 360.0;
 		
-				for (x = 0; x < diskdata.unlocked.count; x++)
+				for (x = 0; x < diskdata->unlocked.count; x++)
 				{
 					endAngle = currentAngle - sliceAngle;
 		
@@ -3905,11 +4035,76 @@ int swappingListSortByPid(const void *value1, const void *value2)
 	return (result);
 }
 
+- (NSString *)diskProcessList:(ProcessSnapshot *)snapshot byWrites:(BOOL)byWrites
+{
+	NSMutableString *processList = [NSMutableString stringWithString:@""];
+	int processCount = (snapshot ? snapshot->count : 0);
+	BOOL checkPid = ! [[NSUserDefaults standardUserDefaults] boolForKey:GLOBAL_SHOW_SELF_KEY];
+
+	// only the busiest few are ranked, whatever the number of processes
+	TopRankItem rankItems[DISK_PROCESS_RANK_SIZE];
+	TopRank rank;
+	int processIndex;
+	TopRankInit(&rank, rankItems, DISK_PROCESS_RANK_SIZE);
+	for (processIndex = 0; processIndex < processCount; processIndex++)
+	{
+		const ProcessSnapshotEntry *entry = &snapshot->entries[processIndex];
+		double rate = (byWrites ? entry->writeRate : entry->readRate);
+		
+		if (entry->ioKnown && rate > 0.0 && ! (checkPid && entry->pid == selfPid))
+		{
+			TopRankOffer(&rank, rate, processIndex);
+		}
+	}
+	int rankCount = TopRankFinish(&rank);
+	
+	for (processIndex = 0; processIndex < rankCount; processIndex++)
+	{
+		const ProcessSnapshotEntry *entry = &snapshot->entries[rankItems[processIndex].index];
+		
+		[processList appendString:[NSString stringWithFormat:@"\t%@\t%@\t%d\t%@\n",
+			[self stringForValue:entry->readRate], [self stringForValue:entry->writeRate], entry->pid, [self commandForProcessEntry:entry]]];
+	}
+	return (processList);
+}
+
+- (NSString *)networkProcessList:(ProcessSnapshot *)snapshot bySent:(BOOL)bySent
+{
+	NSMutableString *processList = [NSMutableString stringWithString:@""];
+	int processCount = ([self collectProcessNetwork:snapshot] ? snapshot->count : 0);
+	BOOL checkPid = ! [[NSUserDefaults standardUserDefaults] boolForKey:GLOBAL_SHOW_SELF_KEY];
+
+	TopRankItem rankItems[NETWORK_PROCESS_RANK_SIZE];
+	TopRank rank;
+	int processIndex;
+	TopRankInit(&rank, rankItems, NETWORK_PROCESS_RANK_SIZE);
+	for (processIndex = 0; processIndex < processCount; processIndex++)
+	{
+		const ProcessSnapshotEntry *entry = &snapshot->entries[processIndex];
+		double rate = (bySent ? entry->sentRate : entry->receivedRate);
+		
+		if (rate > 0.0 && ! (checkPid && entry->pid == selfPid))
+		{
+			TopRankOffer(&rank, rate, processIndex);
+		}
+	}
+	int rankCount = TopRankFinish(&rank);
+	
+	for (processIndex = 0; processIndex < rankCount; processIndex++)
+	{
+		const ProcessSnapshotEntry *entry = &snapshot->entries[rankItems[processIndex].index];
+		
+		[processList appendString:[NSString stringWithFormat:@"\t%@\t%@\t%d\t%@\n",
+			[self stringForValue:entry->receivedRate], [self stringForValue:entry->sentRate], entry->pid, [self commandForProcessEntry:entry]]];
+	}
+	return (processList);
+}
+
 - (void)drawDiskInfo:(GraphPoint)atPoint withIndex:(int)index
 {
 	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
 
-	DiskData diskdata;
+	const DiskData *diskdata;
 
 	NSString *marker = NSLocalizedString(@">", nil);
 	NSString *blank = @"";	
@@ -3927,10 +4122,10 @@ int swappingListSortByPid(const void *value1, const void *value2)
 	
 	[self replaceFormatting:output inString:outputString];
 
-	[diskInfo getCurrent:&diskdata];
+	diskdata = [diskInfo currentSample];
 	int disksDisplayed = 0;
 	NSMutableString *diskList = [NSMutableString stringWithString:@""];
-	for (int i = 0; i < diskdata.unlocked.count; i++)
+	for (int i = 0; i < diskdata->unlocked.count; i++)
 	{
 		NSString *indicator;
 		if ([defaults boolForKey:DISK_SUM_ALL_KEY] || ! [defaults boolForKey:DISK_SHOW_GAUGE_KEY])
@@ -3949,27 +4144,27 @@ int swappingListSortByPid(const void *value1, const void *value2)
 			}
 		}
 		
-		unsigned long usedBlocks = diskdata.unlocked.availableBlocks[i] - diskdata.unlocked.freeBlocks[i];
-		double usedBytes = (double)usedBlocks * (double)diskdata.unlocked.blockSize[i];
-		double freeBytes = (double)diskdata.unlocked.freeBlocks[i] * (double)diskdata.unlocked.blockSize[i];
-		double availableBytes = (double)diskdata.unlocked.availableBlocks[i] * (double)diskdata.unlocked.blockSize[i];
+		unsigned long usedBlocks = diskdata->unlocked.availableBlocks[i] - diskdata->unlocked.freeBlocks[i];
+		double usedBytes = (double)usedBlocks * (double)diskdata->unlocked.blockSize[i];
+		double freeBytes = (double)diskdata->unlocked.freeBlocks[i] * (double)diskdata->unlocked.blockSize[i];
+		double availableBytes = (double)diskdata->unlocked.availableBlocks[i] * (double)diskdata->unlocked.blockSize[i];
 
 		NSString *mountName = nil;
-		NSUInteger length = diskdata.unlocked.fsMountName[i].length;
+		NSUInteger length = diskdata->unlocked.fsMountName[i].length;
 		if (length > 12) {
-			mountName = [[NSString stringWithCharacters:diskdata.unlocked.fsMountName[i].unicode length:11] stringByAppendingString:@"…"];
+			mountName = [[NSString stringWithCharacters:diskdata->unlocked.fsMountName[i].unicode length:11] stringByAppendingString:@"…"];
 		}
 		else {
-			mountName = [NSString stringWithCharacters:diskdata.unlocked.fsMountName[i].unicode length:length];
+			mountName = [NSString stringWithCharacters:diskdata->unlocked.fsMountName[i].unicode length:length];
 		}
 
 		[diskList appendString:[NSString stringWithFormat:@"%@\t%@\t%@\t%@\t%@\t%@\t%@\n",
 									 indicator,
 									 [self stringForValue:usedBytes],
-									 [self stringForPercentage:diskdata.unlocked.used[i] withPercent:NO],
+									 [self stringForPercentage:diskdata->unlocked.used[i] withPercent:NO],
 									 [self stringForValue:freeBytes withBytes:YES withDecimal:NO],
 									 [self stringForValue:availableBytes withBytes:YES withDecimal:NO],
-									 [NSString stringWithUTF8String:diskdata.unlocked.fsTypeName[i]],
+									 [NSString stringWithUTF8String:diskdata->unlocked.fsTypeName[i]],
 									 mountName]];
 		disksDisplayed += 1;
 	}
@@ -3994,24 +4189,32 @@ int swappingListSortByPid(const void *value1, const void *value2)
 	
 	int lockedListDisplaySize = DISK_LIST_SIZE - 1 - disksDisplayed;
 
-	[diskInfo getCurrent:&diskdata];
+	diskdata = [diskInfo currentSample];
 	NSMutableString *lockedDiskList = [NSMutableString stringWithString:@""];
-	int displayCount = diskdata.locked.count;
+	int displayCount = diskdata->locked.count;
 	if (displayCount > lockedListDisplaySize) {
 		displayCount = lockedListDisplaySize;
 	}
 	for (int i = 0; i < displayCount; i++)
 	{
-		double availableBytes = (double)diskdata.locked.availableBlocks[i] * (double)diskdata.locked.blockSize[i];
-		NSString *mountName = [NSString stringWithCharacters:diskdata.locked.fsMountName[i].unicode length:diskdata.locked.fsMountName[i].length];
+		double availableBytes = (double)diskdata->locked.availableBlocks[i] * (double)diskdata->locked.blockSize[i];
+		NSString *mountName = [NSString stringWithCharacters:diskdata->locked.fsMountName[i].unicode length:diskdata->locked.fsMountName[i].length];
 		
 		[lockedDiskList appendString:[NSString stringWithFormat:@"%@\t%@\t%@\n",
 				[self stringForValue:availableBytes],
-				[NSString stringWithUTF8String:diskdata.locked.fsTypeName[i]],
+				[NSString stringWithUTF8String:diskdata->locked.fsTypeName[i]],
 				mountName]];
 	}
 	[self replaceToken:@"[rl]" inString:outputString withString:lockedDiskList];
 	
+	// display the processes writing and reading the most
+	{
+		ProcessSnapshot *snapshot = [self collectProcesses];
+		
+		[self replaceToken:@"[dpw]" inString:outputString withString:[self diskProcessList:snapshot byWrites:YES]];
+		[self replaceToken:@"[dpr]" inString:outputString withString:[self diskProcessList:snapshot byWrites:NO]];
+	}
+	
 	// display dynamic disk data
 	{
 		NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
@@ -4020,10 +4223,10 @@ int swappingListSortByPid(const void *value1, const void *value2)
 	
 		float peakRead = (peakReadBytes / interval);
 		float peakWrite = (peakWriteBytes / interval);
-		float readBytes = (diskdata.readBytes / interval);
-		int readCount = diskdata.readCount;
-		float writeBytes = (diskdata.writeBytes / interval);
-		int writeCount = diskdata.writeCount;
+		float readBytes = (diskdata->readBytes / interval);
+		int readCount = diskdata->readCount;
+		float writeBytes = (diskdata->writeBytes / interval);
+		int writeCount = diskdata->writeCount;
 		
 		float readSum = 0.0;
 		int readCounter = 0;
@@ -4033,12 +4236,12 @@ int swappingListSortByPid(const void *value1, const void *value2)
 		float writeAverage;
 
 		[diskInfo startIterate];
-		for (int i = 0; [diskInfo getNext:&diskdata]; i++)
+		for (int i = 0; (diskdata = [diskInfo nextSample]); i++)
 		{
-			readSum += diskdata.readBytes;
+			readSum += diskdata->readBytes;
 			readCounter += 1;
 
-			writeSum += diskdata.writeBytes;
+			writeSum += diskdata->writeBytes;
 			writeCounter += 1;
 		}
 		readAverage = (readSum / (float) readCounter) / interval;
@@ -4111,7 +4314,7 @@ int swappingListSortByPid(const void *value1, const void *value2)
 
 	int x;
 	float ry, wy;
-	DiskData diskdata;
+	const DiskData *diskdata;
 	
 	float interval = [defaults floatForKey:GLOBAL_UPDATE_FREQUENCY_KEY] / 10.0;
 
@@ -4132,13 +4335,13 @@ int swappingListSortByPid(const void *value1, const void *value2)
 		BOOL alertOut = NO;
 		
 		[diskInfo startIterate];
-		for (x = 0; [diskInfo getNext:&diskdata]; x++)
+		for (x = 0; (diskdata = [diskInfo nextSample]); x++)
 		{
 			transparencyIn = ((float)(x + 1) / (float)SAMPLE_SIZE) * alphaIn;
 			transparencyOut = ((float)(x + 1) / (float)SAMPLE_SIZE) * alphaOut;
 
-			ry = [self scaleValueForGauge:(diskdata.readBytes / interval) scaleType:scaleType scale:scaleRead];
-			wy = [self scaleValueForGauge:(diskdata.writeBytes / interval) scaleType:scaleType scale:scaleWrite];
+			ry = [self scaleValueForGauge:(diskdata->readBytes / interval) scaleType:scaleType scale:scaleRead];
+			wy = [self scaleValueForGauge:(diskdata->writeBytes / interval) scaleType:scaleType scale:scaleWrite];
 
 			if (x == (SAMPLE_SIZE - 1) && ry >= statusAlertThreshold)
 			{
@@ -4163,10 +4366,10 @@ int swappingListSortByPid(const void *value1, const void *value2)
 	}
 	else
 	{
-		[diskInfo getCurrent:&diskdata];
+		diskdata = [diskInfo currentSample];
 
-		ry = [self scaleValueForGauge:(diskdata.readBytes / interval) scaleType:scaleType scale:scaleRead];
-		wy = [self scaleValueForGauge:(diskdata.writeBytes / interval) scaleType:scaleType scale:scaleWrite];
+		ry = [self scaleValueForGauge:(diskdata->readBytes / interval) scaleType:scaleType scale:scaleRead];
+		wy = [self scaleValueForGauge:(diskdata->writeBytes / interval) scaleType:scaleType scale:scaleWrite];
 
 		if (ry > 0.0)
 		{
@@ -4640,6 +4843,16 @@ int swappingListSortByPid(const void *value1, const void *value2)
 	[self replaceToken:@"[nrba]" inString:outputString withString:[self stringForValue:(inPerSecond * 8) powerOf10:YES withBytes:NO]];
 	[self replaceToken:@"[nsba]" inString:outputString withString:[self stringForValue:(outPerSecond * 8) powerOf10:YES withBytes:NO]];
 
+	// display the processes receiving and sending the most, only in a custom layout: the stock ones leave them
+	// out because the socket counters can't be read on Mac OS X, where the tokens are replaced by nothing
+	if ([outputString rangeOfString:@"[npr]" options:NSLiteralSearch].length > 0 || [outputString rangeOfString:@"[nps]" options:NSLiteralSearch].length > 0)
+	{
+		ProcessSnapshot *snapshot = [self collectProcesses];
+		
+		[self replaceToken:@"[npr]" inString:outputString withString:[self networkProcessList:snapshot bySent:NO]];
+		[self replaceToken:@"[nps]" inString:outputString withString:[self networkProcessList:snapshot bySent:YES]];
+	}
+
 	if (gethostname(hostname, 1024) < 0)
 	{
 		perror("gethostname failed");
@@ -5871,6 +6084,90 @@ int dayInWeek(int day, int month, int year)
 
 #pragma mark -
 
+- (NSString *)stringForLatency:(const LatencyHistogram *)histogram
+{
+	return ([NSString stringWithFormat:@"%.2f / %.2f ms", LatencyHistogramPercentile(histogram, 50.0) * 1000.0, LatencyHistogramPercentile(histogram, 99.0) * 1000.0]);
+}
+
+- (void)updateSelfUsage
+{
+	// averages the CPU time used by iPulse over a few seconds, so the usage isn't only that of drawing this panel
+
+	struct rusage usage;
+	double clock = SampleClockNow();
+	double time;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return;
+	}
+	time = (double)usage.ru_utime.tv_sec + ((double)usage.ru_utime.tv_usec / 1000000.0)
+			+ (double)usage.ru_stime.tv_sec + ((double)usage.ru_stime.tv_usec / 1000000.0);
+
+	if (selfUsageClock == 0.0)
+	{
+		// the average since launch until there's an interval to measure
+		selfUsageClock = clock;
+		selfUsageTime = time;
+		if (now > startTime)
+		{
+			selfUsage = time / (double)(now - startTime);
+		}
+	}
+	else if (clock - selfUsageClock >= SELF_USAGE_INTERVAL)
+	{
+		selfUsage = (time - selfUsageTime) / (clock - selfUsageClock);
+		selfUsageClock = clock;
+		selfUsageTime = time;
+	}
+}
+
+- (unsigned long long)selfResidentSize
+{
+	struct task_basic_info info;
+	mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+
+	if (task_info(mach_task_self(), TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+	{
+		return (0);
+	}
+	return (info.resident_size);
+}
+
+- (void)dumpLatency
+{
+	// writes the latency of every stage as tab-separated lines, requested with "kill -USR1"
+
+	NSString *path = [NSHomeDirectory() stringByAppendingPathComponent:LATENCY_DUMP_PATH];
+	FILE *file = fopen([path fileSystemRepresentation], "w");
+	int stage;
+
+	if (! file)
+	{
+		NSLog(@"MainController: dumpLatency: could not write %@", path);
+		return;
+	}
+
+	[self updateSelfUsage];
+	unsigned long processCacheHits, processCacheMisses;
+	[AGProcess getCacheHits:&processCacheHits misses:&processCacheMisses];
+
+	fprintf(file, "# cpu %.1f%% resident %llu bytes\n", selfUsage * 100.0, [self selfResidentSize]);
+	fprintf(file, "# process cache hits %lu misses %lu\n", processCacheHits, processCacheMisses);
+	if (processArguments)
+	{
+		fprintf(file, "# argument cache hits %lu misses %lu arena %lu bytes\n", processArguments->hits, processArguments->misses, (unsigned long) processArguments->arenaSize);
+	}
+	LatencyHistogramPrintHeader(file);
+	for (stage = 0; stage < LatencyStageCount; stage++)
+	{
+		LatencyHistogramPrint(latency[stage], latencyStageNames[stage], file);
+	}
+	fclose(file);
+
+	NSLog(@"MainController: dumpLatency: wrote %@", path);
+}
+
 - (void)drawGeneralInfo:(GraphPoint)atPoint withIndex:(int)index
 {
 	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
@@ -5938,6 +6235,29 @@ int dayInWeek(int day, int month, int year)
 	NSString *platform = @"Intel";
 #endif
 	[self replaceToken:@"[os]" inString:outputString withString:[NSString stringWithFormat:@"%@%d.%d.%d (%@)", NSLocalizedString(@"Version", nil), majorVersion, minorVersion, updateVersion, platform]];
+
+	// the cost of iPulse itself
+	[self updateSelfUsage];
+	[self replaceToken:@"[sc]" inString:outputString withString:[self stringForPercentage:selfUsage withPercent:YES]];
+	[self replaceToken:@"[sm]" inString:outputString withString:[self stringForValue:(float)[self selfResidentSize]]];
+	[self replaceToken:@"[ts]" inString:outputString withString:[self stringForLatency:latency[LatencySampling]]];
+	[self replaceToken:@"[ti]" inString:outputString withString:[self stringForLatency:latency[LatencyUpdateIconAndWindow]]];
+	[self replaceToken:@"[tf]" inString:outputString withString:[self stringForLatency:latency[LatencyDrawImages]]];
+	[self replaceToken:@"[tw]" inString:outputString withString:[self stringForLatency:latency[LatencyUpdateInfo]]];
+	{
+		// the data object with the slowest refreshes
+		int stage, slowest = LatencyProcessor;
+
+		for (stage = LatencyProcessor; stage < LatencySampling; stage++)
+		{
+			if (LatencyHistogramPercentile(latency[stage], 99.0) > LatencyHistogramPercentile(latency[slowest], 99.0))
+			{
+				slowest = stage;
+			}
+		}
+		[self replaceToken:@"[tr]" inString:outputString withString:[NSString stringWithFormat:@"%s %@", latencyStageNames[slowest] + strlen("refresh."),
+				[self stringForLatency:latency[slowest]]]];
+	}
 	
 	{
 		NSRect infoFrame = [infoView frame];
@@ -6756,7 +7076,7 @@ void buildValueOutput(float inputBytes, char *outputString)
 
 			{
 				float readLevel, writeLevel;
-				DiskData diskdata;
+				const DiskData *diskdata;
 			
 				float interval = [defaults floatForKey:GLOBAL_UPDATE_FREQUENCY_KEY] / 10.0;
 
@@ -6766,15 +7086,15 @@ void buildValueOutput(float inputBytes, char *outputString)
 				float peakWrite = (peakWriteBytes / interval);
 				float scaleWrite = [self computeScaleForGauge:scaleType withPeak:peakWrite];
 				
-				[diskInfo getCurrent:&diskdata];
+				diskdata = [diskInfo currentSample];
 				{
-					readLevel = [self scaleValueForGauge:(diskdata.readBytes / interval) scaleType:scaleType scale:scaleRead];
+					readLevel = [self scaleValueForGauge:(diskdata->readBytes / interval) scaleType:scaleType scale:scaleRead];
 
-					writeLevel = [self scaleValueForGauge:(diskdata.writeBytes / interval) scaleType:scaleType scale:scaleWrite];
+					writeLevel = [self scaleValueForGauge:(diskdata->writeBytes / interval) scaleType:scaleType scale:scaleWrite];
 				}
 
-				//float readBytes = (diskdata.readBytes / interval);
-				//float writeBytes = (diskdata.writeBytes / interval);
+				//float readBytes = (diskdata->readBytes / interval);
+				//float writeBytes = (diskdata->writeBytes / interval);
 				float readSum = 0.0;
 				int readCounter = 0;
 				float readAverage;
@@ -6784,12 +7104,12 @@ void buildValueOutput(float inputBytes, char *outputString)
 
 				int x;
 				[diskInfo startIterate];
-				for (x = 0; [diskInfo getNext:&diskdata]; x++)
+				for (x = 0; (diskdata = [diskInfo nextSample]); x++)
 				{
-					readSum += diskdata.readBytes;
+					readSum += diskdata->readBytes;
 					readCounter += 1;
 
-					writeSum += diskdata.writeBytes;
+					writeSum += diskdata->writeBytes;
 					writeCounter += 1;
 				}
 				readAverage = (readSum / (float) readCounter) / interval;
@@ -7227,7 +7547,9 @@ void powerCallback(void *refCon, io_service_t service, natural_t messageType, vo
 	//float version = [self systemVersion];
 	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
 
+	double start = SampleClockNow();
 	[self drawImages];
+	LatencyHistogramRecord(latency[LatencyDrawImages], SampleClockNow() - start);
 	
 	if ([defaults boolForKey:GLOBAL_SHOW_STATUS_KEY])
 	{
@@ -7313,49 +7635,290 @@ void powerCallback(void *refCon, io_service_t service, natural_t messageType, vo
 	}
 }
 
-- (void)refreshAndDisplay
+// sampler thread callbacks, the context is the data object to refresh
+
+static void refreshInfo(void *context)
 {
-	// get new samples as necessary, refresh the dock and window icons, and redisplay the info window
+	[(id)context refresh];
+}
 
-	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+static void refreshPowerInfo(void *context)
+{
+	PowerInfo *powerInfo = (PowerInfo *)context;
 
-	now = time(NULL); // all time based measurements pivot around this call for time()
-	struct tm *nowTime = localtime(&now);
+	if ([powerInfo isAvailable] && [[NSUserDefaults standardUserDefaults] boolForKey:MOBILITY_BATTERY_SHOW_GAUGE_KEY])
+	{
+		[powerInfo refresh];
+	}
+}
 
-	[processorInfo refresh];
-	[memoryInfo refresh];
-	[diskInfo refresh];
-	[networkInfo refresh];
+static void refreshAirportInfo(void *context)
+{
+	AirportInfo *airportInfo = (AirportInfo *)context;
 
-	if ([powerInfo isAvailable] && [defaults boolForKey:MOBILITY_BATTERY_SHOW_GAUGE_KEY])
+	if ([airportInfo isAvailable] && [[NSUserDefaults standardUserDefaults] boolForKey:MOBILITY_WIRELESS_SHOW_GAUGE_KEY])
 	{
-		[powerInfo refresh];
+		[airportInfo refresh];
+	}
+}
+
+static void logSchedulerStatistics(void *context)
+{
+#if DEBUG
+	SampleScheduler *scheduler = (SampleScheduler *)context;
+	SampleSourceStatistics statistics;
+	int source;
+
+	for (source = 0; source < scheduler->sourceCount; source++)
+	{
+		SampleSchedulerGetStatistics(scheduler, source, &statistics);
+		NSLog(@"sampler: %-12s runs = %6lu missed = %4lu jitter = %6.1f ms average, %6.1f ms maximum", scheduler->sources[source].name,
+				statistics.runs, statistics.missed, statistics.averageJitter * 1000.0, statistics.maximumJitter * 1000.0);
+	}
+#endif
+}
+
+- (void)restoreRollupsFromHistoryFile
+{
+	// runs before the sampler thread starts, the rollups get the same values archiveSamples gave them in the last run
+
+	int count = HistoryFileCount(historyFile);
+	int index;
+
+	for (index = 0; index < count; index++)
+	{
+		double time = (double)HistoryFileTimestampAt(historyFile, index) / 1000.0;
+		double memoryTotal = HistoryFileValueAt(historyFile, index, HistoryFileMemoryWired) + HistoryFileValueAt(historyFile, index, HistoryFileMemoryActive)
+				+ HistoryFileValueAt(historyFile, index, HistoryFileMemoryInactive) + HistoryFileValueAt(historyFile, index, HistoryFileMemoryFree);
+
+		RollupSeriesAdd(rollups[RollupProcessor], time, HistoryFileValueAt(historyFile, index, HistoryFileProcessorUser)
+				+ HistoryFileValueAt(historyFile, index, HistoryFileProcessorSystem) + HistoryFileValueAt(historyFile, index, HistoryFileProcessorNice));
+		if (memoryTotal > 0.0)
+		{
+			RollupSeriesAdd(rollups[RollupMemory], time, (HistoryFileValueAt(historyFile, index, HistoryFileMemoryWired)
+					+ HistoryFileValueAt(historyFile, index, HistoryFileMemoryActive)) / memoryTotal);
+		}
+		RollupSeriesAdd(rollups[RollupNetworkIn], time, HistoryFileValueAt(historyFile, index, HistoryFileNetworkBytesIn));
+		RollupSeriesAdd(rollups[RollupNetworkOut], time, HistoryFileValueAt(historyFile, index, HistoryFileNetworkBytesOut));
+		RollupSeriesAdd(rollups[RollupDiskRead], time, HistoryFileValueAt(historyFile, index, HistoryFileDiskReadBytes));
+		RollupSeriesAdd(rollups[RollupDiskWrite], time, HistoryFileValueAt(historyFile, index, HistoryFileDiskWriteBytes));
+		RollupSeriesAdd(rollups[RollupLoad], time, HistoryFileValueAt(historyFile, index, HistoryFileLoadAverage));
+		if (HistoryFileValueAt(historyFile, index, HistoryFileTemperatureCount) > 0.0)
+		{
+			RollupSeriesAdd(rollups[RollupTemperature], time, HistoryFileValueAt(historyFile, index, HistoryFileTemperature0));
+		}
+	}
+}
+
+- (void)archiveSamples
+{
+	// runs on the sampler thread after the sources that follow the update frequency have been refreshed
+
+	const CPUData *cpudata = [processorInfo currentSample];
+	const VMData *vmdata = [memoryInfo currentSample];
+	const NetData *netdata = [networkInfo currentSample];
+	const DiskData *diskdata = [diskInfo currentSample];
+	const LoadData *loaddata = [loadInfo currentSample];
+	const TemperatureData *temperaturedata = [temperatureInfo currentSample];
+	int64_t timestamp = HistoryFileNow();
+
+	if (historyFile)
+	{
+		int processor;
+
+		HistoryFileBeginRecord(historyFile, timestamp);
+		HistoryFileSetValue(historyFile, HistoryFileProcessorSystem, cpudata->systemTotal);
+		HistoryFileSetValue(historyFile, HistoryFileProcessorUser, cpudata->userTotal);
+		HistoryFileSetValue(historyFile, HistoryFileProcessorNice, cpudata->niceTotal);
+		HistoryFileSetValue(historyFile, HistoryFileProcessorIdle, cpudata->idleTotal);
+		for (processor = 0; processor < cpudata->processorCount; processor++)
+		{
+			HistoryFileSetProcessor(historyFile, processor, HistoryFileStateSystem, cpudata->system[processor]);
+			HistoryFileSetProcessor(historyFile, processor, HistoryFileStateUser, cpudata->user[processor]);
+			HistoryFileSetProcessor(historyFile, processor, HistoryFileStateNice, cpudata->nice[processor]);
+			HistoryFileSetProcessor(historyFile, processor, HistoryFileStateIdle, cpudata->idle[processor]);
+		}
+		HistoryFileSetValue(historyFile, HistoryFileMemoryWired, vmdata->wiredCount);
+		HistoryFileSetValue(historyFile, HistoryFileMemoryActive, vmdata->activeCount);
+		HistoryFileSetValue(historyFile, HistoryFileMemoryInactive, vmdata->inactiveCount);
+		HistoryFileSetValue(historyFile, HistoryFileMemoryFree, vmdata->freeCount);
+		HistoryFileSetValue(historyFile, HistoryFileMemoryPageins, vmdata->pageins);
+		HistoryFileSetValue(historyFile, HistoryFileMemoryPageouts, vmdata->pageouts);
+		HistoryFileSetValue(historyFile, HistoryFileNetworkPacketsIn, netdata->packetsIn);
+		HistoryFileSetValue(historyFile, HistoryFileNetworkBytesIn, netdata->packetsInBytes);
+		HistoryFileSetValue(historyFile, HistoryFileNetworkPacketsOut, netdata->packetsOut);
+		HistoryFileSetValue(historyFile, HistoryFileNetworkBytesOut, netdata->packetsOutBytes);
+		HistoryFileSetValue(historyFile, HistoryFileDiskReadCount, diskdata->readCount);
+		HistoryFileSetValue(historyFile, HistoryFileDiskReadBytes, diskdata->readBytes);
+		HistoryFileSetValue(historyFile, HistoryFileDiskWriteCount, diskdata->writeCount);
+		HistoryFileSetValue(historyFile, HistoryFileDiskWriteBytes, diskdata->writeBytes);
+		HistoryFileSetValue(historyFile, HistoryFileLoadAverage, loaddata->average);
+		HistoryFileSetValue(historyFile, HistoryFileLoadMachFactor, loaddata->machFactor);
+		HistoryFileSetValue(historyFile, HistoryFileTemperatureCount, temperaturedata->temperatureCount);
+		HistoryFileSetValue(historyFile, HistoryFileTemperature0, temperaturedata->temperatureLevel[0]);
+		HistoryFileSetValue(historyFile, HistoryFileTemperature1, temperaturedata->temperatureLevel[1]);
+		HistoryFileCommitRecord(historyFile);
+	}
+
+	[rollupLock lock];
+	{
+		double time = (double)timestamp / 1000.0;
+
+		RollupSeriesAdd(rollups[RollupProcessor], time, cpudata->userTotal + cpudata->systemTotal + cpudata->niceTotal);
+		RollupSeriesAdd(rollups[RollupMemory], time, vmdata->wired + vmdata->active);
+		RollupSeriesAdd(rollups[RollupNetworkIn], time, netdata->packetsInBytes);
+		RollupSeriesAdd(rollups[RollupNetworkOut], time, netdata->packetsOutBytes);
+		RollupSeriesAdd(rollups[RollupDiskRead], time, diskdata->readBytes);
+		RollupSeriesAdd(rollups[RollupDiskWrite], time, diskdata->writeBytes);
+		RollupSeriesAdd(rollups[RollupLoad], time, loaddata->average);
+		if (temperaturedata->temperatureCount > 0)
+		{
+			RollupSeriesAdd(rollups[RollupTemperature], time, temperaturedata->temperatureLevel[0]);
+		}
 	}
+	[rollupLock unlock];
+}
+
+- (void)samplerThread:(id)object
+{
+	// each data object is sampled on its own schedule by the sampler thread, the data objects publish each sample to the main thread
 	
-	if ([airportInfo isAvailable] && [defaults boolForKey:MOBILITY_WIRELESS_SHOW_GAUGE_KEY])
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+	// a trace can be replayed faster than real time, the samples are the same because the recorded timestamps are used
+	double speed = [[NSUserDefaults standardUserDefaults] floatForKey:COUNTER_TRACE_REPLAY_SPEED_KEY];
+	if (CounterTraceGetMode() != CounterTraceReplaying || speed <= 0.0)
 	{
-		[airportInfo refresh];
+		speed = 1.0;
 	}
+	double clockStart = SampleClockNow();
+
+	SampleScheduler *scheduler = SampleSchedulerCreate(SAMPLER_RESOLUTION, clockStart);
+	double interval = samplerInterval;
+	int updateSources[6];
+	int updateSourceCount = 0;
+	SampleSourceStatistics statistics;
+	unsigned long archivedRuns = 0;
+	unsigned long sourceRuns[LatencySampling] = { 0 };
+	double wakeup;
+	int i;
+
+	// sources that follow the update frequency preference
+	updateSources[updateSourceCount++] = SampleSchedulerAddSource(scheduler, "processor", interval, SampleCostLight, refreshInfo, processorInfo);
+	updateSources[updateSourceCount++] = SampleSchedulerAddSource(scheduler, "memory", interval, SampleCostLight, refreshInfo, memoryInfo);
+	updateSources[updateSourceCount++] = SampleSchedulerAddSource(scheduler, "network", interval, SampleCostLight, refreshInfo, networkInfo);
+	updateSources[updateSourceCount++] = SampleSchedulerAddSource(scheduler, "disk", interval, SampleCostHeavy, refreshInfo, diskInfo);
+	updateSources[updateSourceCount++] = SampleSchedulerAddSource(scheduler, "power", interval, SampleCostHeavy, refreshPowerInfo, powerInfo);
+	updateSources[updateSourceCount++] = SampleSchedulerAddSource(scheduler, "airport", interval, SampleCostHeavy, refreshAirportInfo, airportInfo);
 
-	// check temperature every 15 seconds
-	if (nowTime->tm_sec % 15 == 0)
+	// sources with a fixed interval
+	SampleSchedulerAddSource(scheduler, "temperature", TEMPERATURE_SAMPLE_INTERVAL, SampleCostHeavy, refreshInfo, temperatureInfo);
+	SampleSchedulerAddSource(scheduler, "load", LOAD_SAMPLE_INTERVAL, SampleCostLight, refreshInfo, loadInfo);
+	SampleSchedulerAddSource(scheduler, "statistics", SAMPLER_STATISTICS_INTERVAL, SampleCostLight, logSchedulerStatistics, scheduler);
+
+	[pool release];
+
+	while (! samplerShouldExit)
 	{
-		[temperatureInfo refresh];
+		pool = [[NSAutoreleasePool alloc] init];
+
+		if (interval != samplerInterval)
+		{
+			interval = samplerInterval;
+			for (i = 0; i < updateSourceCount; i++)
+			{
+				SampleSchedulerSetInterval(scheduler, updateSources[i], interval);
+			}
+		}
+
+		// the samples of every data object refreshed in this run are published at once, the main thread draws them again if it read them meanwhile
+		wakeup = SampleClockNow();
+		HistoryRingSequenceBegin(&sampleSequence);
+		if (SampleSchedulerRun(scheduler, clockStart + ((wakeup - clockStart) * speed)) > 0)
+		{
+			// the data objects are added in the order of the latency stages
+			for (i = 0; i < LatencySampling; i++)
+			{
+				SampleSchedulerGetStatistics(scheduler, i, &statistics);
+				if (statistics.runs != sourceRuns[i])
+				{
+					sourceRuns[i] = statistics.runs;
+					LatencyHistogramRecord(latency[i], statistics.lastDuration);
+				}
+			}
+
+			// only the runs where the sources that follow the update frequency were refreshed are archived
+			SampleSchedulerGetStatistics(scheduler, updateSources[0], &statistics);
+			if (statistics.runs != archivedRuns)
+			{
+				archivedRuns = statistics.runs;
+				[self archiveSamples];
+			}
+			HistoryRingSequenceEnd(&sampleSequence);
+			LatencyHistogramRecord(latency[LatencySampling], SampleClockNow() - wakeup);
+
+			// only one display can be waiting -- if the main thread is busy, it draws the newest samples when it gets to it
+			if (OSAtomicCompareAndSwap32Barrier(0, 1, &samplerDisplayPending))
+			{
+				[self performSelectorOnMainThread:@selector(displaySamples) withObject:nil waitUntilDone:NO];
+			}
+		}
+		else
+		{
+			HistoryRingSequenceEnd(&sampleSequence);
+		}
+
+		[pool release];
+
+		// one sleep until the next source is due or the main thread asks to exit, a deadline that was missed is handled by the scheduler on the next run
+		double delay = ((SampleSchedulerNextWakeup(scheduler) - clockStart) / speed) - (SampleClockNow() - clockStart);
+		if (delay > 0.0)
+		{
+			if ([samplerState lockWhenCondition:SamplerExitRequested beforeDate:[NSDate dateWithTimeIntervalSinceNow:delay]])
+			{
+				[samplerState unlock];
+			}
+		}
 	}
-		
-	// refresh only on one minute intervals
-	if (nowTime->tm_min != lastMinute)
+
+	SampleSchedulerDispose(scheduler);
+
+	// applicationWillTerminate: waits for this before the data objects go away
+	[samplerState lock];
+	[samplerState unlockWithCondition:SamplerExited];
+}
+
+- (void)displaySamples
+{
+	// refresh the dock and window icons, and redisplay the info window using the samples published by the sampler thread
+
+	OSAtomicCompareAndSwap32Barrier(1, 0, &samplerDisplayPending);
+
+	// the samples are read in place, while the sampler thread is adding some the display is left to the one it requests when it's done
+	unsigned int sequence = HistoryRingSequenceRead(&sampleSequence);
+	if (sequence & 1)
 	{
-		//[powerInfo refresh];
-		[loadInfo refresh];
-		lastMinute = nowTime->tm_min;
+		return;
 	}
 
+	displayCount += 1;
+	now = time(NULL); // all time based measurements pivot around this call for time()
+
+	double start = SampleClockNow();
 	[self updateIconAndWindow];
+	LatencyHistogramRecord(latency[LatencyUpdateIconAndWindow], SampleClockNow() - start);
 
 	if ([infoWindow isVisible])
 	{
+		start = SampleClockNow();
 		[self updateInfo];
+		LatencyHistogramRecord(latency[LatencyUpdateInfo], SampleClockNow() - start);
+	}
+
+	if (latencyDumpRequested)
+	{
+		latencyDumpRequested = 0;
+		[self dumpLatency];
 	}
 
 #if OPTION_INCLUDE_MATRIX_ORBITAL	
@@ -7364,6 +7927,12 @@ void powerCallback(void *refCon, io_service_t service, natural_t messageType, vo
 		[self updateMatrixOrbital];
 	}
 #endif
+
+	// samples added during the display may have been drawn torn or from different runs, they are drawn again
+	if (HistoryRingSequenceRetry(&sampleSequence, sequence) && OSAtomicCompareAndSwap32Barrier(0, 1, &samplerDisplayPending))
+	{
+		[self performSelector:@selector(displaySamples) withObject:nil afterDelay:0.0];
+	}
 }
 
 #pragma mark -
@@ -7416,19 +7985,18 @@ void powerCallback(void *refCon, io_service_t service, natural_t messageType, vo
 {
 	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
 
-	double newInterval = [defaults floatForKey:GLOBAL_UPDATE_FREQUENCY_KEY] / 10.0;
+	// the sampler thread picks up a new interval after its next wakeup
+	samplerInterval = [defaults floatForKey:GLOBAL_UPDATE_FREQUENCY_KEY] / 10.0;
 	
-	if (refreshTimer)
+	// the benchmarks refresh the data objects themselves
+	if (! samplerThread && ! [defaults boolForKey:BENCHMARK_KEY])
 	{
-		if (fabs([refreshTimer timeInterval] - newInterval) < 0.001)
-		{
-			return; // interval has not changed
-		}
-		[refreshTimer invalidate];
-		[refreshTimer release];
+		samplerShouldExit = NO;
+		samplerDisplayPending = 0;
+		samplerState = [[NSConditionLock alloc] initWithCondition:SamplerRunning];
+		samplerThread = [[NSThread alloc] initWithTarget:self selector:@selector(samplerThread:) object:nil];
+		[samplerThread start];
 	}
-	refreshTimer = [NSTimer scheduledTimerWithTimeInterval:newInterval target:self selector:@selector(refreshAndDisplay) userInfo:nil repeats:YES];
-	[refreshTimer retain];
 }
 
 
@@ -7482,7 +8050,6 @@ void powerCallback(void *refCon, io_service_t service, natural_t messageType, vo
 
 	NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
 
-	lastMinute = nowTime->tm_min;
 	lastHour = nowTime->tm_hour;
 
 	// application icon in dock has not been updated
@@ -7506,6 +8073,27 @@ void powerCallback(void *refCon, io_service_t service, natural_t messageType, vo
 		[NSApp terminate:self];
 	}
 	
+	// a counter trace has to be started before the data objects read their first counters
+	{
+		NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+		NSString *tracePath;
+
+		if ((tracePath = [defaults stringForKey:COUNTER_TRACE_REPLAY_KEY]) != nil)
+		{
+			if (! CounterTraceStart(CounterTraceReplaying, [tracePath fileSystemRepresentation]))
+			{
+				NSLog(@"MainController: applicationDidFinishLaunching: could not replay counter trace %@", tracePath);
+			}
+		}
+		else if ((tracePath = [defaults stringForKey:COUNTER_TRACE_RECORD_KEY]) != nil)
+		{
+			if (! CounterTraceStart(CounterTraceRecording, [tracePath fileSystemRepresentation]))
+			{
+				NSLog(@"MainController: applicationDidFinishLaunching: could not record counter trace %@", tracePath);
+			}
+		}
+	}
+
 	// allocate the data objects
 	preferences = [[Preferences alloc] init];
 	memoryInfo = [[MemoryInfo alloc] initWithCapacity:SAMPLE_SIZE];
@@ -7517,6 +8105,62 @@ void powerCallback(void *refCon, io_service_t service, natural_t messageType, vo
 	airportInfo = [[AirportInfo alloc] initWithCapacity:SAMPLE_SIZE];
 	loadInfo = [[LoadInfo alloc] initWithCapacity:60];
 	
+	// summaries of every metric, from one second to one day
+	{
+		int metric;
+
+		rollupLock = [[NSLock alloc] init];
+		for (metric = 0; metric < RollupMetricCount; metric++)
+		{
+			rollups[metric] = RollupSeriesCreate();
+			if (! rollups[metric])
+			{
+				NSLog(@"MainController: applicationDidFinishLaunching: failed to allocate rollups");
+				[NSApp terminate:self];
+			}
+		}
+	}
+
+	// latency of each stage of a sample, shown in the General panel and written out on SIGUSR1
+	{
+		int stage;
+
+		for (stage = 0; stage < LatencyStageCount; stage++)
+		{
+			latency[stage] = LatencyHistogramCreate();
+			if (! latency[stage])
+			{
+				NSLog(@"MainController: applicationDidFinishLaunching: failed to allocate latency histograms");
+				[NSApp terminate:self];
+			}
+		}
+		signal(SIGUSR1, requestLatencyDump);
+	}
+
+	// map the history from the last run so the graphs start where they left off -- a replayed trace isn't history
+	if (CounterTraceGetMode() != CounterTraceReplaying)
+	{
+		NSString *historyPath = [NSHomeDirectory() stringByAppendingPathComponent:@"Library/Application Support/iPulse"];
+		
+		[[NSFileManager defaultManager] createDirectoryAtPath:historyPath withIntermediateDirectories:YES attributes:nil error:NULL];
+		historyPath = [historyPath stringByAppendingPathComponent:@"History.dat"];
+		historyFile = HistoryFileOpen([historyPath fileSystemRepresentation], HISTORY_FILE_SIZE, [processorInfo getProcessorCapacity]);
+		if (historyFile)
+		{
+			[processorInfo restoreFromHistoryFile:historyFile];
+			[memoryInfo restoreFromHistoryFile:historyFile];
+			[networkInfo restoreFromHistoryFile:historyFile];
+			[diskInfo restoreFromHistoryFile:historyFile];
+			[loadInfo restoreFromHistoryFile:historyFile];
+			[temperatureInfo restoreFromHistoryFile:historyFile];
+			[self restoreRollupsFromHistoryFile];
+		}
+		else
+		{
+			NSLog(@"MainController: applicationDidFinishLaunching: could not open history file %@", historyPath);
+		}
+	}
+
 
 	// setup toolbar selection mechanism
 	[preferences setDoToolbarSelection:YES];
@@ -7697,20 +8341,6 @@ void powerCallback(void *refCon, io_service_t service, natural_t messageType, vo
 		}
 	}
 	
-	// initialize swapping list
-	{
-		int i;
-		for (i = 0; i < SWAPPING_LIST_SIZE; i++)
-		{
-			swappingList[i].pid = INT_MAX;
-			swappingList[i].pageins = 0;
-			swappingList[i].lastPageins = 0;
-			swappingList[i].faults = 0;
-			swappingList[i].lastFaults = 0;
-			swappingList[i].isCurrent = NO;
-		}
-	}
-		
 	selfPid = getpid();
 	
 	// setup application wide global variables
@@ -7772,6 +8402,11 @@ void powerCallback(void *refCon, io_service_t service, natural_t messageType, vo
 #endif
 
 	infoWindowIsLocked = NO;
+
+	if ([[NSUserDefaults standardUserDefaults] boolForKey:BENCHMARK_KEY])
+	{
+		[self performSelector:@selector(runBenchmarks) withObject:nil afterDelay:0.0];
+	}
 }
 
 - (void)applicationDidBecomeActive:(NSNotification *)notification
@@ -7781,10 +8416,23 @@ void powerCallback(void *refCon, io_service_t service, natural_t messageType, vo
 
 - (void)applicationWillTerminate:(NSNotification *)aNotification 
 {
-	if (refreshTimer) {
-		[refreshTimer invalidate];
-		[refreshTimer release];
-		refreshTimer = nil;
+	if (samplerThread) {
+		// wake the sampler thread and wait for it to finish its run, it may be writing to a ring or the history file
+		[samplerState lock];
+		samplerShouldExit = YES;
+		[samplerState unlockWithCondition:SamplerExitRequested];
+		[samplerState lockWhenCondition:SamplerExited];
+		[samplerState unlock];
+
+		[samplerState release];
+		samplerState = nil;
+		[samplerThread release];
+		samplerThread = nil;
+	}
+
+	if (historyFile) {
+		HistoryFileClose(historyFile);
+		historyFile = NULL;
 	}
 	
 	// if you try to release the status item, you get a crash on exit -- go figure
@@ -7,6 +7,9 @@
 #import <mach/mach.h>
 #import <mach/mach_types.h>
 
+#import "HistoryRing.h"
+#import "HistoryFile.h"
+
 
 typedef struct vmdata {
 	double wired;
@@ -24,19 +27,22 @@ typedef struct vmdata {
 
 @interface MemoryInfo : NSObject
 {
-	int size;
-	int inptr;
-	int outptr;
-	VMDataPtr vmdata;
+	HistoryRing history;
+	HistoryRingIterator iterator;
 	vm_statistics_data_t lastvmstat;
 }
 
 - (MemoryInfo *)initWithCapacity:(unsigned)numItems;
 - (void)refresh;
+- (void)restoreFromHistoryFile:(const HistoryFile *)file;
 - (void)startIterate;
 - (BOOL)getNext:(VMDataPtr)ptr;
 - (void)getCurrent:(VMDataPtr)ptr;
 - (void)getLast:(VMDataPtr)ptr;
+- (const VMData *)nextSample;
+- (const VMData *)currentSample;
+- (const VMData *)lastSample;
+- (const HistoryRing *)history;
 - (int)getSize;
 
 @end
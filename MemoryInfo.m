@@ -5,31 +5,40 @@
 
 #import "mach/mach_host.h"
 #import "MemoryInfo.h"
+#import "Preferences.h"
+#import "CounterTrace.h"
+#import "SampleClock.h"
 
 
 @implementation MemoryInfo
 
 
-static void getVMStat (vm_statistics_t vmstat)
+// returns NO once a replayed trace has no more memory records
+static BOOL getVMStat (vm_statistics_t vmstat)
 {
 	mach_msg_type_number_t count = HOST_VM_INFO_COUNT;
 	
-	if (host_statistics(mach_host_self(), HOST_VM_INFO, (host_info_t) vmstat, &count) != KERN_SUCCESS)
+	if (CounterTraceGetMode() == CounterTraceReplaying)
+	{
+		memset(vmstat, 0, sizeof(*vmstat));
+		return (CounterTraceReplay(CounterTraceMemory, vmstat, sizeof(*vmstat), NULL) != 0);
+	}
+	else if (host_statistics(mach_host_self(), HOST_VM_INFO, (host_info_t) vmstat, &count) != KERN_SUCCESS)
 		NSLog (@"Failed to get VM statistics.");
+	else
+		CounterTraceRecord(CounterTraceMemory, vmstat, sizeof(*vmstat), SampleClockNow());
+	return (YES);
 }
 
 
 - (id)initWithCapacity:(unsigned)numItems
 {
 	self = [super init];
-	size = numItems;
-	vmdata = calloc(numItems, sizeof(VMData));
-	if (vmdata == NULL) {
+	if (! HistoryRingInit(&history, numItems, sizeof(VMData))) {
 		NSLog (@"Failed to allocate buffer for MemoryInfo");
 		return (nil);
 	}
-	inptr = 0;
-	outptr = -1;
+	iterator.outptr = -1;
 	getVMStat (&lastvmstat);
 	return (self);
 }
@@ -37,61 +46,120 @@ static void getVMStat (vm_statistics_t vmstat)
 
 - (void)refresh
 {
+	VMDataPtr sample = HistoryRingWriteSlot(&history);
 	vm_statistics_data_t	vmstat;
 	double			total;
 	
-	getVMStat (&vmstat);
+	if (! getVMStat (&vmstat))
+	{
+		// the end of a replayed trace, the history keeps the last samples it replayed
+		return;
+	}
 	total = vmstat.wire_count + vmstat.active_count + vmstat.inactive_count + vmstat.free_count;
-	vmdata[inptr].wired = vmstat.wire_count / total;
-	vmdata[inptr].active = vmstat.active_count / total;
-	vmdata[inptr].inactive = vmstat.inactive_count / total;
-	vmdata[inptr].free = vmstat.free_count / total;
-	vmdata[inptr].pageins =  vmstat.pageins - lastvmstat.pageins;
-	vmdata[inptr].pageouts = vmstat.pageouts - lastvmstat.pageouts;
-	vmdata[inptr].wiredCount = vmstat.wire_count;
-	vmdata[inptr].activeCount = vmstat.active_count;
-	vmdata[inptr].inactiveCount = vmstat.inactive_count;
-	vmdata[inptr].freeCount = vmstat.free_count;
+	sample->wired = vmstat.wire_count / total;
+	sample->active = vmstat.active_count / total;
+	sample->inactive = vmstat.inactive_count / total;
+	sample->free = vmstat.free_count / total;
+	sample->pageins =  vmstat.pageins - lastvmstat.pageins;
+	sample->pageouts = vmstat.pageouts - lastvmstat.pageouts;
+	sample->wiredCount = vmstat.wire_count;
+	sample->activeCount = vmstat.active_count;
+	sample->inactiveCount = vmstat.inactive_count;
+	sample->freeCount = vmstat.free_count;
 	lastvmstat = vmstat;
-	if (++inptr >= size)
-		inptr = 0;
+	HistoryRingAdvance(&history);
+}
+
+
+- (void)restoreFromHistoryFile:(const HistoryFile *)file
+{
+	// seeds the history with the records from the last run that are still within its reach, before the first refresh
+	int count = HistoryFileCount(file);
+	int index;
+	double interval = [[NSUserDefaults standardUserDefaults] floatForKey:GLOBAL_UPDATE_FREQUENCY_KEY] / 10.0;
+	int first = HistoryFileFirstSince(file, HistoryFileNow() - (int64_t)(history.size * interval * 1000.0));
+	
+	for (index = (first > count - history.size ? first : count - history.size); index < count; index++)
+	{
+		VMDataPtr sample = HistoryRingWriteSlot(&history);
+		double total;
+		
+		sample->wiredCount = HistoryFileValueAt(file, index, HistoryFileMemoryWired);
+		sample->activeCount = HistoryFileValueAt(file, index, HistoryFileMemoryActive);
+		sample->inactiveCount = HistoryFileValueAt(file, index, HistoryFileMemoryInactive);
+		sample->freeCount = HistoryFileValueAt(file, index, HistoryFileMemoryFree);
+		total = sample->wiredCount + sample->activeCount + sample->inactiveCount + sample->freeCount;
+		if (total > 0.0)
+		{
+			sample->wired = sample->wiredCount / total;
+			sample->active = sample->activeCount / total;
+			sample->inactive = sample->inactiveCount / total;
+			sample->free = sample->freeCount / total;
+		}
+		sample->pageins = HistoryFileValueAt(file, index, HistoryFileMemoryPageins);
+		sample->pageouts = HistoryFileValueAt(file, index, HistoryFileMemoryPageouts);
+		
+		HistoryRingAdvance(&history);
+	}
 }
 
 
 - (void)startIterate
 {
-	outptr = inptr;
+	HistoryRingStartIterate(&history, &iterator);
 }
 
 
 - (BOOL)getNext:(VMDataPtr)ptr
 {
-	if (outptr == -1)
+	const VMData *sample = HistoryRingNext(&iterator);
+
+	if (sample == NULL)
 		return (FALSE);
-	*ptr = vmdata[outptr++];
-	if (outptr >= size)
-		outptr = 0;
-	if (outptr == inptr)
-		outptr = -1;
+	*ptr = *sample;
 	return (TRUE);
 }
 
 
 - (void)getCurrent:(VMDataPtr)ptr
 {
-	*ptr = vmdata[inptr ? inptr - 1 : size - 1];
+	*ptr = *(const VMData *)HistoryRingCurrent(&history);
 }
 
 
 - (void)getLast:(VMDataPtr)ptr
 {
-	*ptr = vmdata[inptr > 1 ? inptr - 2 : size + inptr - 2];
+	*ptr = *(const VMData *)HistoryRingLast(&history);
+}
+
+
+- (const VMData *)nextSample
+{
+	return (HistoryRingNext(&iterator));
+}
+
+
+- (const VMData *)currentSample
+{
+	return (HistoryRingCurrent(&history));
+}
+
+
+- (const VMData *)lastSample
+{
+	return (HistoryRingLast(&history));
+}
+
+
+- (const HistoryRing *)history
+{
+	return (&history);
 }
 
 
 - (int)getSize
 {
-	return (size);
+	return (history.size);
 }
 
 
@@ -18,6 +18,9 @@
 #import "netinet/tcp_timer.h"
 #import "netinet/tcp_var.h"
 
+#import "HistoryRing.h"
+#import "HistoryFile.h"
+
 struct	iftot {
 	u_int64_t	ift_ip;			/* input packets */
 	u_int64_t	ift_ie;			/* input errors */
@@ -41,25 +44,31 @@ typedef struct netdata {
 	u_int64_t packetsOutBytes;
 	u_int64_t packetsOutBytesTotal;
 	u_int64_t packetsCollision;
+	double timestamp;	// SampleClockNow() when the sample was taken
+	double elapsed;		// seconds since the previous sample, the deltas above are scaled to the update interval
 }	NetData, *NetDataPtr;
 
 
 @interface NetworkInfo : NSObject
 {
-	int size;
-	int inptr;
-	int outptr;
-	NetDataPtr netdata;
+	HistoryRing history;
+	HistoryRingIterator iterator;
 
 	struct iftot lastTotalStats;
+	double lastTimestamp;
 }
 
 - (NetworkInfo *)initWithCapacity:(unsigned)numItems;
 - (void)refresh;
+- (void)restoreFromHistoryFile:(const HistoryFile *)file;
 - (void)startIterate;
 - (BOOL)getNext:(NetDataPtr)ptr;
 - (void)getCurrent:(NetDataPtr)ptr;
 - (void)getLast:(NetDataPtr)ptr;
+- (const NetData *)nextSample;
+- (const NetData *)currentSample;
+- (const NetData *)lastSample;
+- (const HistoryRing *)history;
 - (int)getSize;
 
 @end
@@ -4,6 +4,9 @@
 
 
 #import "NetworkInfo.h"
+#import "Preferences.h"
+#import "SampleClock.h"
+#import "CounterTrace.h"
 
 #include <net/if.h>
 #include <net/if_var.h>
@@ -119,19 +122,34 @@ static BOOL getTotalStats(struct iftot *sum)
 	return(YES);
 }
 
+// reads the interface totals and the time they were read, from the counter trace when one is being replayed --
+// returns NO once the replayed trace has no more network records
+static BOOL readTotalStats(struct iftot *sum, double *timestamp)
+{
+	if (CounterTraceGetMode() == CounterTraceReplaying)
+	{
+		memset(sum, 0, sizeof(struct iftot));
+		*timestamp = 0.0;
+		return (CounterTraceReplay(CounterTraceNetwork, sum, sizeof(struct iftot), timestamp) != 0);
+	}
+
+	memset(sum, 0, sizeof(struct iftot));
+	getTotalStats(sum);
+	*timestamp = SampleClockNow();
+	CounterTraceRecord(CounterTraceNetwork, sum, sizeof(struct iftot), *timestamp);
+	return (YES);
+}
+
 - (NetworkInfo *)initWithCapacity:(unsigned)numItems
 {
 	self = [super init];
-	size = numItems;
-	netdata = calloc(numItems, sizeof(NetData));
-	if (netdata == NULL) {
+	if (! HistoryRingInit(&history, numItems, sizeof(NetData))) {
 		NSLog (@"Failed to allocate buffer for NetworkInfo");
 		return (nil);
 	}
-	inptr = 0;
-	outptr = -1;
+	iterator.outptr = -1;
 
-	getTotalStats(&lastTotalStats);
+	readTotalStats(&lastTotalStats, &lastTimestamp);
 
 	return (self);
 }
@@ -139,76 +157,135 @@ static BOOL getTotalStats(struct iftot *sum)
 
 - (void)refresh
 {
+	NetDataPtr sample = HistoryRingWriteSlot(&history);
 	//NSLog(@"NetworkInfo: using total stats");
 	struct iftot totalStats;
-	getTotalStats(&totalStats);
+	double timestamp;
+	if (! readTotalStats(&totalStats, &timestamp))
+	{
+		// the end of a replayed trace, the history keeps the last samples it replayed
+		return;
+	}
+
+	// the deltas are scaled to the update interval so rates stay correct when a sample is taken late
+	double interval = [[NSUserDefaults standardUserDefaults] floatForKey:GLOBAL_UPDATE_FREQUENCY_KEY] / 10.0;
+	double scale = SampleClockIntervalScale(timestamp - lastTimestamp, interval);
 
 	// Note: the total stats can be less than the last total stats if an interface (and is corresponding counters) goes away -- this is most likely
 	// to happen with a PPP connection (used by VPN)
 	
-	netdata[inptr].packetsIn = ((totalStats.ift_ip > lastTotalStats.ift_ip) ? (totalStats.ift_ip - lastTotalStats.ift_ip) : 0);
-	netdata[inptr].packetsInTotal = totalStats.ift_ip;
-	netdata[inptr].packetsInError = ((totalStats.ift_ie > lastTotalStats.ift_ie) ? (totalStats.ift_ie - lastTotalStats.ift_ie) : 0);
-	netdata[inptr].packetsInBytes = ((totalStats.ift_ib > lastTotalStats.ift_ib) ? (totalStats.ift_ib - lastTotalStats.ift_ib) : 0);
-	netdata[inptr].packetsInBytesTotal = totalStats.ift_ib;
-	//NSLog(@"NetworkInfo: **** totalStats.ift_ip = %10lld, lastTotalStats.ift_ip = %10lld, packetsIn = %4lld ****", totalStats.ift_ip, lastTotalStats.ift_ip, netdata[inptr].packetsIn);
-
-	netdata[inptr].packetsOut = ((totalStats.ift_op > lastTotalStats.ift_op) ? (totalStats.ift_op - lastTotalStats.ift_op) : 0);
-	netdata[inptr].packetsOutTotal = totalStats.ift_op;
-	netdata[inptr].packetsOutError = ((totalStats.ift_oe > lastTotalStats.ift_oe) ? (totalStats.ift_oe - lastTotalStats.ift_oe) : 0);
-	netdata[inptr].packetsOutBytes = ((totalStats.ift_ob > lastTotalStats.ift_ob) ? (totalStats.ift_ob - lastTotalStats.ift_ob) : 0);
-	netdata[inptr].packetsOutBytesTotal = totalStats.ift_ob;
-	//NSLog(@"NetworkInfo: **** totalStats.ift_op = %10lld, lastTotalStats.ift_op = %10lld, packetsOut = %4lld ****", totalStats.ift_op, lastTotalStats.ift_op, netdata[inptr].packetsOut);
-
-	netdata[inptr].packetsCollision = ((totalStats.ift_co > lastTotalStats.ift_co) ? (totalStats.ift_co - lastTotalStats.ift_co) : 0);
+	sample->packetsIn = SampleClockScaleCount(((totalStats.ift_ip > lastTotalStats.ift_ip) ? (totalStats.ift_ip - lastTotalStats.ift_ip) : 0), scale);
+	sample->packetsInTotal = totalStats.ift_ip;
+	sample->packetsInError = SampleClockScaleCount(((totalStats.ift_ie > lastTotalStats.ift_ie) ? (totalStats.ift_ie - lastTotalStats.ift_ie) : 0), scale);
+	sample->packetsInBytes = SampleClockScaleCount(((totalStats.ift_ib > lastTotalStats.ift_ib) ? (totalStats.ift_ib - lastTotalStats.ift_ib) : 0), scale);
+	sample->packetsInBytesTotal = totalStats.ift_ib;
+	//NSLog(@"NetworkInfo: **** totalStats.ift_ip = %10lld, lastTotalStats.ift_ip = %10lld, packetsIn = %4lld ****", totalStats.ift_ip, lastTotalStats.ift_ip, sample->packetsIn);
+
+	sample->packetsOut = SampleClockScaleCount(((totalStats.ift_op > lastTotalStats.ift_op) ? (totalStats.ift_op - lastTotalStats.ift_op) : 0), scale);
+	sample->packetsOutTotal = totalStats.ift_op;
+	sample->packetsOutError = SampleClockScaleCount(((totalStats.ift_oe > lastTotalStats.ift_oe) ? (totalStats.ift_oe - lastTotalStats.ift_oe) : 0), scale);
+	sample->packetsOutBytes = SampleClockScaleCount(((totalStats.ift_ob > lastTotalStats.ift_ob) ? (totalStats.ift_ob - lastTotalStats.ift_ob) : 0), scale);
+	sample->packetsOutBytesTotal = totalStats.ift_ob;
+	//NSLog(@"NetworkInfo: **** totalStats.ift_op = %10lld, lastTotalStats.ift_op = %10lld, packetsOut = %4lld ****", totalStats.ift_op, lastTotalStats.ift_op, sample->packetsOut);
+
+	sample->packetsCollision = SampleClockScaleCount(((totalStats.ift_co > lastTotalStats.ift_co) ? (totalStats.ift_co - lastTotalStats.ift_co) : 0), scale);
 
 #if DEBUG_STATS
-	if ((netdata[inptr].packetsInBytes > 10000000) || (netdata[inptr].packetsOutBytes > 10000000)) {
+	if ((sample->packetsInBytes > 10000000) || (sample->packetsOutBytes > 10000000)) {
 		NSLog(@"DANGER WILL ROBINSON"); // Clearly these stats are wrong, but I don't understand why: I can't find any signed integers being used as unsigned.
 	}
 #endif
 	
+	sample->timestamp = timestamp;
+	sample->elapsed = timestamp - lastTimestamp;
+
 	lastTotalStats = totalStats;
+	lastTimestamp = timestamp;
+
+	HistoryRingAdvance(&history);
+}
 
-	if (++inptr >= size)
-		inptr = 0;
+
+- (void)restoreFromHistoryFile:(const HistoryFile *)file
+{
+	// seeds the history with the records from the last run that are still within its reach, before the first refresh -- the
+	// totals and timestamps belong to the last run and are left at zero
+	int count = HistoryFileCount(file);
+	int index;
+	double interval = [[NSUserDefaults standardUserDefaults] floatForKey:GLOBAL_UPDATE_FREQUENCY_KEY] / 10.0;
+	int first = HistoryFileFirstSince(file, HistoryFileNow() - (int64_t)(history.size * interval * 1000.0));
+	
+	for (index = (first > count - history.size ? first : count - history.size); index < count; index++)
+	{
+		NetDataPtr sample = HistoryRingWriteSlot(&history);
+		
+		memset(sample, 0, sizeof(NetData));
+		sample->packetsIn = HistoryFileValueAt(file, index, HistoryFileNetworkPacketsIn);
+		sample->packetsInBytes = HistoryFileValueAt(file, index, HistoryFileNetworkBytesIn);
+		sample->packetsOut = HistoryFileValueAt(file, index, HistoryFileNetworkPacketsOut);
+		sample->packetsOutBytes = HistoryFileValueAt(file, index, HistoryFileNetworkBytesOut);
+		
+		HistoryRingAdvance(&history);
+	}
 }
 
 
 - (void)startIterate
 {
-	outptr = inptr;
+	HistoryRingStartIterate(&history, &iterator);
 }
 
 
 - (BOOL)getNext:(NetDataPtr)ptr
 {
-	if (outptr == -1)
+	const NetData *sample = HistoryRingNext(&iterator);
+
+	if (sample == NULL)
 		return (FALSE);
-	*ptr = netdata[outptr++];
-	if (outptr >= size)
-		outptr = 0;
-	if (outptr == inptr)
-		outptr = -1;
+	*ptr = *sample;
 	return (TRUE);
 }
 
 
 - (void)getCurrent:(NetDataPtr)ptr
 {
-	*ptr = netdata[inptr ? inptr - 1 : size - 1];
+	*ptr = *(const NetData *)HistoryRingCurrent(&history);
 }
 
 
 - (void)getLast:(NetDataPtr)ptr
 {
-	*ptr = netdata[inptr > 1 ? inptr - 2 : size + inptr - 2];
+	*ptr = *(const NetData *)HistoryRingLast(&history);
+}
+
+
+- (const NetData *)nextSample
+{
+	return (HistoryRingNext(&iterator));
+}
+
+
+- (const NetData *)currentSample
+{
+	return (HistoryRingCurrent(&history));
+}
+
+
+- (const NetData *)lastSample
+{
+	return (HistoryRingLast(&history));
+}
+
+
+- (const HistoryRing *)history
+{
+	return (&history);
 }
 
 
 - (int)getSize
 {
-	return (size);
+	return (history.size);
 }
 
 @end
@@ -7,6 +7,8 @@
 #import <mach/mach.h>
 #import <mach/mach_types.h>
 
+#import "HistoryRing.h"
+
 ///#define MAX_PROCESSORS 2
 
 typedef struct BatteryData
@@ -24,10 +26,8 @@ typedef struct BatteryData
 
 @interface PowerInfo : NSObject
 {
-	int size;
-	int inptr;
-	int outptr;
-	BatteryDataPtr batteryData;
+	HistoryRing history;
+	HistoryRingIterator iterator;
 	
 	int last;
 	int interval;
@@ -42,6 +42,10 @@ typedef struct BatteryData
 - (BOOL)getNext:(BatteryDataPtr)ptr;
 - (void)getCurrent:(BatteryDataPtr)ptr;
 - (void)getLast:(BatteryDataPtr)ptr;
+- (const BatteryData *)nextSample;
+- (const BatteryData *)currentSample;
+- (const BatteryData *)lastSample;
+- (const HistoryRing *)history;
 - (int)getSize;
 
 @end
@@ -23,23 +23,22 @@
 	int i;
 	
 	self = [super init];
-	size = numItems;
-	batteryData = calloc(numItems, sizeof(BatteryData));
-	if (batteryData == NULL)
+	if (! HistoryRingInit(&history, numItems, sizeof(BatteryData)))
 	{
 		NSLog (@"Failed to allocate buffer for PowerInfo");
 		return (nil);
 	}
 	
-	inptr = 0;
-	outptr = -1;
+	iterator.outptr = -1;
 	
-	for (i = 0; i < size; i++)
+	for (i = 0; i < history.slots; i++)
 	{
-		batteryData[i].batteryPresent = NO;
-		batteryData[i].batteryCharging = NO;
-		batteryData[i].batteryChargerConnected = NO;
-		batteryData[i].batteryLevel = 0.0;
+		BatteryDataPtr sample = HistoryRingSlot(&history, i);
+
+		sample->batteryPresent = NO;
+		sample->batteryCharging = NO;
+		sample->batteryChargerConnected = NO;
+		sample->batteryLevel = 0.0;
 	}
 
 	last = 0;
@@ -100,19 +99,20 @@
 
 - (void)refresh
 {
+	BatteryDataPtr sample = HistoryRingWriteSlot(&history);
 	kern_return_t kernResult; 
 	CFArrayRef tmp = NULL;
 	mach_port_t masterPort;
     
 	
-	batteryData[inptr].batteryPresent = NO;
-	batteryData[inptr].batteryCharging = NO;
-	batteryData[inptr].batteryChargerConnected = NO;
-	batteryData[inptr].batteryLevel = 0.0;
-	batteryData[inptr].batteryAmperage = 0;
-	batteryData[inptr].batteryVoltage = 0;
-	batteryData[inptr].batteryMinutesRemaining = 0;
-	batteryData[inptr].batteryMinutesIsValid = NO;
+	sample->batteryPresent = NO;
+	sample->batteryCharging = NO;
+	sample->batteryChargerConnected = NO;
+	sample->batteryLevel = 0.0;
+	sample->batteryAmperage = 0;
+	sample->batteryVoltage = 0;
+	sample->batteryMinutesRemaining = 0;
+	sample->batteryMinutesIsValid = NO;
 
 #if 1
 	kernResult = IOMasterPort(MACH_PORT_NULL, &masterPort);
@@ -131,7 +131,7 @@
 		CFIndex count = CFArrayGetCount(tmp);
 		CFIndex i;
 		
-		batteryData[inptr].batteryPresent = YES;
+		sample->batteryPresent = YES;
 
 		//NSLog(@"Battery count = %d", count);
 		for (i = 0; i < count; i++)
@@ -184,11 +184,11 @@
 			}
 			if (flags & kIOBatteryCharge)
 			{
-				batteryData[inptr].batteryCharging = YES;
+				sample->batteryCharging = YES;
 			}
 			if (flags & kIOBatteryChargerConnect)
 			{
-				batteryData[inptr].batteryChargerConnected = YES;
+				sample->batteryChargerConnected = YES;
 			}
 
 			//charge = ((float) current / (float) capacity) * 100.0;
@@ -198,9 +198,9 @@
 			//	charge, amperage, voltage, wattage, lastWattage - wattage);
 			//lastWattage = wattage;
 			
-			batteryData[inptr].batteryLevel = (float) current / (float) capacity;
-			batteryData[inptr].batteryAmperage = amperage;
-			batteryData[inptr].batteryVoltage = voltage;
+			sample->batteryLevel = (float) current / (float) capacity;
+			sample->batteryAmperage = amperage;
+			sample->batteryVoltage = voltage;
 			
 			//NSLog(@"battery delta = %d, interval = %d", current - last, interval);
 			if (current - last != 0)
@@ -280,7 +280,7 @@
 						// battery power source is present
 						//powerSourcePresent = YES;
 
-						batteryData[inptr].batteryPresent = YES;
+						sample->batteryPresent = YES;
 
 						NSLog(@"powerSource kIOPSInternalType present");
 						
@@ -294,7 +294,7 @@
 								// power source is charging
 								NSLog(@"powerSource charging");
 
-								batteryData[inptr].batteryCharging = YES;
+								sample->batteryCharging = YES;
 
 								CFNumberRef timeToFull = CFDictionaryGetValue(powerSource, CFSTR(kIOPSTimeToFullChargeKey));
 								CFNumberGetValue(timeToFull, kCFNumberIntType, &temp);
@@ -374,56 +374,77 @@
 			}
 			CFRelease(powerSources);
 
-			batteryData[inptr].batteryChargerConnected = chargerConnected;
+			sample->batteryChargerConnected = chargerConnected;
 			
-			batteryData[inptr].batteryLevel = (float) current / (float) capacity;
-			batteryData[inptr].batteryAmperage = amperage;
-			batteryData[inptr].batteryVoltage = voltage;
+			sample->batteryLevel = (float) current / (float) capacity;
+			sample->batteryAmperage = amperage;
+			sample->batteryVoltage = voltage;
 		}
 		
 		CFRelease(powerSourcesInfo);
 	}
 #endif
 
-	if (++inptr >= size)
-		inptr = 0;
+	HistoryRingAdvance(&history);
 }
 
 
 - (void)startIterate
 {
-	outptr = inptr;
+	HistoryRingStartIterate(&history, &iterator);
 }
 
 
 - (BOOL)getNext:(BatteryDataPtr)ptr
 {
-	if (outptr == -1)
+	const BatteryData *sample = HistoryRingNext(&iterator);
+
+	if (sample == NULL)
 		return (FALSE);
-	*ptr = batteryData[outptr++];
-	if (outptr >= size)
-		outptr = 0;
-	if (outptr == inptr)
-		outptr = -1;
+	*ptr = *sample;
 	return (TRUE);
 }
 
 
 - (void)getCurrent:(BatteryDataPtr)ptr
 {
-	*ptr = batteryData[inptr ? inptr - 1 : size - 1];
+	*ptr = *(const BatteryData *)HistoryRingCurrent(&history);
 }
 
 
 - (void)getLast:(BatteryDataPtr)ptr
 {
-	*ptr = batteryData[inptr > 1 ? inptr - 2 : size + inptr - 2];
+	*ptr = *(const BatteryData *)HistoryRingLast(&history);
+}
+
+
+- (const BatteryData *)nextSample
+{
+	return (HistoryRingNext(&iterator));
+}
+
+
+- (const BatteryData *)currentSample
+{
+	return (HistoryRingCurrent(&history));
+}
+
+
+- (const BatteryData *)lastSample
+{
+	return (HistoryRingLast(&history));
+}
+
+
+- (const HistoryRing *)history
+{
+	return (&history);
 }
 
 
 - (int)getSize
 {
-	return (size);
+	return (history.size);
 }
 
 
@@ -7,6 +7,8 @@
  */
 
 #include "Process.h"
+#include "SharedObjects.h"
+#include "ProcessArguments.h"
 
 
 #include <mach/mach.h>
@@ -109,6 +111,9 @@ int total_threads;
 mach_port_t host_priv_port;
 //mach_port_t host_port;
 
+SharedObjects *shared_objects;
+ProcessArguments *process_arguments;
+
 unsigned long long total_fw_private;
 
 int do_proc0_vm = 1; // TODO: determine if this is really a good idea or not (equivalent to top -k, reports PID 0)
@@ -141,26 +146,56 @@ void grab_task(task)
 	        state_breakdown[0]++;
 		return;
 	}
-	if (total_procs == nproc) {
-		nproc *= 2;
-		kbase = (struct kinfo_proc *) realloc(kbase,
-						      nproc*sizeof(struct kinfo_proc));
-		bzero(&kbase[total_procs], total_procs*sizeof(struct kinfo_proc));
-		proc  = (struct proc_info *) realloc(proc,
-						     nproc*sizeof(struct proc_info));
-		bzero(&proc[total_procs], total_procs*sizeof(struct proc_info));
-		oldproc  = (struct proc_info *) realloc(oldproc,
-							nproc*sizeof(struct proc_info));
-		bzero(&oldproc[total_procs], total_procs*sizeof(struct proc_info));
-		pref  = (struct proc_info **) realloc(pref,
-						      nproc*sizeof(struct proc_info *));
-		bzero(&pref[total_procs], total_procs*sizeof(struct proc_info *));
-	}
+	if (total_procs == nproc)	/* reserve_procs() failed */
+		return;
 	kbase[total_procs] = ki;
 	total_procs++;
 }
 
 
+/*
+ *	Make room for count processes. The tables only grow, by doubling, so
+ *	after the first few scans they are never reallocated. Returns 0 if
+ *	memory could not be allocated, the tables keep their old size.
+ */
+int reserve_procs(count)
+	int	count;
+{
+	struct kinfo_proc	*new_kbase;
+	struct proc_info	*new_proc, *new_oldproc;
+	struct proc_info	**new_pref;
+	int			new_nproc;
+
+	if (count <= nproc)
+		return(1);
+	new_nproc = (nproc > 0) ? nproc : 128;
+	while (new_nproc < count)
+		new_nproc *= 2;
+
+	if ((new_kbase = (struct kinfo_proc *) realloc(kbase,
+			new_nproc*sizeof(struct kinfo_proc))) == NULL)
+		return(0);
+	kbase = new_kbase;
+	if ((new_proc = (struct proc_info *) realloc(proc,
+			new_nproc*sizeof(struct proc_info))) == NULL)
+		return(0);
+	proc = new_proc;
+	if ((new_oldproc = (struct proc_info *) realloc(oldproc,
+			new_nproc*sizeof(struct proc_info))) == NULL)
+		return(0);
+	oldproc = new_oldproc;
+	if ((new_pref = (struct proc_info **) realloc(pref,
+			new_nproc*sizeof(struct proc_info *))) == NULL)
+		return(0);
+	pref = new_pref;
+
+	bzero(&proc[nproc], (new_nproc - nproc)*sizeof(struct proc_info));
+	bzero(&oldproc[nproc], (new_nproc - nproc)*sizeof(struct proc_info));
+	nproc = new_nproc;
+	return(1);
+}
+
+
 void read_proc_table()
 {
 
@@ -199,6 +234,8 @@ void read_proc_table()
 			mach_error("processor_set_tasks", ret);
 			exit(0);
 		}
+		/* one reserve for every task of the set, grab_task() never grows the tables */
+		(void) reserve_procs(total_procs + tcount);
 		for (j = 0; j < tcount; j++) {
 			grab_task(tasks[j]);
 			// don't delete our own task port
@@ -217,71 +254,19 @@ void read_proc_table()
 
 
 
-struct object_info {
-        int 	            id;
-        int                 pid;
-        int                 share_type;
-        int                 resident_page_count;
-        int                 ref_count;
-        int                 task_ref_count;
-        int                 size;
-        struct object_info  *next;
-};
-
-#define OBJECT_TABLE_SIZE	537
-#define OT_HASH(object) (((unsigned)object)%OBJECT_TABLE_SIZE)
-
-struct object_info      *shared_hash_table[OBJECT_TABLE_SIZE];
-
-struct object_info *of_free_list = 0;
-
-
-void
-shared_hash_enter(int obj_id, int share_type, int resident_page_count, int ref_count, int size, int pid)
-{
-        register struct object_info **bucket;
-        register struct object_info *of;
-
-	of = shared_hash_table[OT_HASH(obj_id/OBJECT_TABLE_SIZE)];
-	while (of) {
-	        if (of->id == obj_id) {
-		        of->size += size;
-		        of->task_ref_count++;
-			of->pid = pid;
-			return;
-		}
-		of = of->next;
-	}
-	bucket = &shared_hash_table[OT_HASH(obj_id/OBJECT_TABLE_SIZE)];
-
-	if (of = of_free_list)
-	        of_free_list = of->next;
-	else
-	        of = (struct object_info *) malloc(sizeof(*of));
-
-	of->resident_page_count = resident_page_count;
-	of->id = obj_id;
-	of->share_type = share_type;
-	of->ref_count = ref_count;
-	of->task_ref_count = 1;
-	of->pid = pid;
-	of->size = size;
-
-	of->next = *bucket;
-	*bucket = of;
-}
-
-
 void
 pmem_doit(task_port_t task, int pid, int *shared, int *private, int *aliased, int *obj_count, int *vprivate, vm_size_t *vsize, unsigned long long *fw_private)
 {
 	vm_address_t	address = 0;
 	kern_return_t	err = 0;
-	register int    i;
 	int             split = 0;
+	SharedObjectUsage usage;
 
 	*obj_count = *aliased = *shared = *private = *vprivate = 0;
 
+	/* the objects this task maps are listed as they are found, so only they are attributed below */
+	SharedObjectsBeginProcess(shared_objects, pid);
+
 	while (1) {
 		mach_port_t		object_name;
 		vm_region_top_info_data_t info;
@@ -329,8 +314,8 @@ pmem_doit(task_port_t task, int pid, int *shared, int *private, int *aliased, in
 		        if (info.ref_count == 1)
     			        info.share_mode = SM_PRIVATE;
 			if (pid && info.share_mode == SM_COW)
-                                shared_hash_enter(info.obj_id, SM_COW, info.shared_pages_resident,
-						  info.ref_count, size, pid);
+                                (void) SharedObjectsEnter(shared_objects, info.obj_id, SharedObjectCopyOnWrite,
+						  info.shared_pages_resident, info.ref_count, size);
 			if (info.share_mode == SM_PRIVATE)
 			        *private += info.shared_pages_resident * vm_page_size;
 		        *private  += info.private_pages_resident * vm_page_size;
@@ -343,133 +328,55 @@ pmem_doit(task_port_t task, int pid, int *shared, int *private, int *aliased, in
 
 		case SM_SHARED:
 			if (pid)
-                                shared_hash_enter(info.obj_id, SM_SHARED, info.shared_pages_resident,
-						  info.ref_count, size, pid);
+                                (void) SharedObjectsEnter(shared_objects, info.obj_id, SharedObjectShared,
+						  info.shared_pages_resident, info.ref_count, size);
 		        break;
 		}
         }
-        for (i = 0; i < OBJECT_TABLE_SIZE; i++) {
-	        register struct object_info *sl;
+	SharedObjectsEndProcess(shared_objects, &usage);
+	*shared   += usage.shared;
+	*aliased  += usage.aliased;
+	*vprivate += usage.aliasedSize;
 
-	        sl = shared_hash_table[i];
-		
-	        while (sl) {
-		        if (sl->pid == pid) {
-			        if (sl->share_type == SM_SHARED) {
-				        if (sl->ref_count == sl->task_ref_count) {
-					        sl->share_type = SM_PRIVATE_ALIASED;
-				
-						*aliased  += sl->resident_page_count * vm_page_size;
-						*vprivate += sl->size;
-					}
-				}
-				if (sl->share_type != SM_PRIVATE_ALIASED)
-				        *shared += sl->resident_page_count * vm_page_size;
-			}
-			sl->task_ref_count = 0;
-
-			sl = sl->next;
-		}
-	}
 	if (split)
 	        *vsize -= (SHARED_TEXT_REGION_SIZE + SHARED_DATA_REGION_SIZE);
 }
 
 
-int
-get_real_command_name(int pid, char *cbuf, int csize)
+/*
+ *	Arguments of the process, read once and kept until it exits or exec's.
+ */
+static const ProcessArgumentsEntry *
+lookup_arguments(struct kinfo_proc *kp)
 {
-        /*
-	 *      Get command and arguments.
-	 */
-	volatile int   *ip, *savedip;
-	volatile char  *cp;
-	char            c;
-	char           *end_argc;
-	int             mib[4];
-	char           *arguments;
-	int             arguments_size = 4096;
-	volatile unsigned int *valuep;
-	unsigned int    value;
-	int             blahlen=0, skiplen=0;
+	double start_time;
 
-	/*
-	 * A sysctl() is made to find out the full path that the command
-	 * was called with.
-	 */
-	mib[0] = CTL_KERN;
-	mib[1] = KERN_PROCARGS;
-	mib[2] = pid;
-	mib[3] = 0;
+	if (process_arguments == NULL && (process_arguments = ProcessArgumentsCreate()) == NULL)
+	        return(NULL);
+	start_time = kp->kp_proc.p_starttime.tv_sec + (kp->kp_proc.p_starttime.tv_usec / 1.0e6);
+	return(ProcessArgumentsLookup(process_arguments, kp->kp_proc.p_pid, start_time, kp->kp_proc.p_comm));
+}
 
-	arguments = (char *) malloc(arguments_size);
-	if (sysctl(mib, 3, arguments, (size_t *)&arguments_size, NULL, 0) < 0) {
-	        free(arguments);
-		return(0);
-	}
-	end_argc = &arguments[arguments_size];
-
-	ip = (int *)end_argc;
-	ip -= 2;                /* last arg word and .long 0 */
-	while (*--ip) {
-	        if (ip == (int *)arguments) {
-		        free(arguments);
-			return(0);
-		}
-	}        
-	savedip = ip;
-	savedip++;
-	cp = (char *)savedip;
-	while (*--ip) {
-	        if (ip == (int *)arguments) {
-		        free(arguments);
-			return(0);
-		}
-	}        
-	ip++;
-        valuep = (unsigned int *)ip;
-        value = *valuep;
-
-        if ((value & 0xbfff0000) == 0xbfff0000) {
-	        ip++; ip++;
-		valuep = ip;
-		blahlen = strlen((char *)ip);
-		skiplen = (blahlen +3 ) /4 ;
-		valuep += skiplen;
-		cp = (char *)valuep;
-		while (!*cp)
-		        cp++;
-		savedip = (int *)cp;
-        }
-        for (cp = (char *)savedip; cp < (end_argc-1); cp++) {
-	        c = *cp & 0177;
 
-		if (c == 0)
-		        break;
-        }
-        *cp = 0;
-
-	if (cp > (char *)savedip)
-	        cp--;
+int
+get_real_command_name(struct kinfo_proc *kp, char *cbuf, int csize)
+{
+        /*
+	 *      Get the command, without LaunchCFMApp.
+	 */
+	const ProcessArgumentsEntry *entry = lookup_arguments(kp);
 
-	while (cp > (char *)savedip) {
-	        if (*cp == '/') {
-		        cp++;
-		        break;
-		}
-		cp--;
-	}
-        if (cp[0] == '-' || cp[0] == '?' || cp[0] <= ' ') {
+	if (entry == NULL || entry->argumentCount == 0)
+	        return(0);
+        if (entry->name[0] == '-' || entry->name[0] == '?' || entry->name[0] <= ' ') {
 	        /*
 		 *  Not enough information
 		 */
-	        free(arguments);
 		return(0);
         }
-	(void) strncpy(cbuf, (char *)cp, csize);
+	(void) strncpy(cbuf, entry->name, csize);
 	cbuf[csize] = '\0';
 
-	free(arguments);
 	return(1);
 }
 
@@ -620,7 +527,7 @@ void get_proc_info(kpb, pi)
 		}
 	}
 	if ( strncmp (kpb->kp_proc.p_comm, "LaunchCFMA", 10) ||
-	     !get_real_command_name(pi->pid, pi->command, sizeof(kpb->kp_proc.p_comm)-1)) {
+	     !get_real_command_name(kpb, pi->command, sizeof(kpb->kp_proc.p_comm)-1)) {
 	        (void) strncpy(pi->command, kpb->kp_proc.p_comm,
 			       sizeof(kpb->kp_proc.p_comm)-1);
 		pi->command[sizeof(kpb->kp_proc.p_comm)-1] = '\0';
@@ -659,6 +566,13 @@ void filter_proc(void)
 
 	host_priv_port = mach_host_self(); // get_host_priv();
 
+	/* the shared objects of the last scan are forgotten, their memory is kept for this one */
+	if (shared_objects == NULL && (shared_objects = SharedObjectsCreate(vm_page_size)) == NULL) {
+		printf("Insufficient memory.\n");
+		exit(0);
+	}
+	SharedObjectsBeginScan(shared_objects);
+
 	/* read all of the process information */
 	read_proc_table();
 
@@ -895,134 +809,54 @@ void filter_proc(void)
 // get command and arguments.
 int getcommand(struct kinfo_proc *kp, char **command_name)
 {
-	int		command_length;
-	char * cmdpath;
-	volatile int 	*ip, *savedip;
-	volatile char	*cp;
-	int		nbad;
-	char		c;
-	char		*end_argc;
-	int 		mib[4];
-        char *		arguments;
-	size_t 		arguments_size = 4096;
-        int len=0;
-        volatile unsigned int *valuep;
-        unsigned int value;
-        int blahlen=0, skiplen=0;
-//        extern int eflg;
-	int eflg = 0;
-
-
-
-	/* A sysctl() is made to find out the full path that the command
-	   was called with.
-	*/
+	const ProcessArgumentsEntry *entry = lookup_arguments(kp);
+	const char	*argument;
+	char		*cmdpath, *cp;
+	size_t		len;
+	int		i;
 
-	mib[0] = CTL_KERN;
-	mib[1] = KERN_PROCARGS;
-	mib[2] = kp->kp_proc.p_pid;
-	mib[3] = 0;
+	if (entry == NULL || entry->argumentCount == 0) {
+	    /*
+	     *	No arguments - short command name only
+	     */
+	    cmdpath = (char *)malloc(MAXCOMLEN + 5);
+	    (void) strcpy(cmdpath, " (");
+	    (void) strncat(cmdpath, kp->kp_proc.p_comm, MAXCOMLEN+1);
+	    (void) strcat(cmdpath, ")");
+	    *command_name = cmdpath;
+	    return(1);
+	}
 
-	arguments = (char *) malloc(arguments_size);
-	if (sysctl(mib, 3, arguments, &arguments_size, NULL, 0) < 0) {
-	  goto retucomm;
+	len = MAXCOMLEN + 5;
+	argument = entry->arguments;
+	for (i = 0; i < entry->argumentCount; i++) {
+	    len += strlen(argument) + 1;
+	    argument += strlen(argument) + 1;
 	}
-    	end_argc = &arguments[arguments_size];
-
-
-	ip = (int *)end_argc;
-	ip -= 2;		/* last arg word and .long 0 */
-	while (*--ip)
-	    if (ip == (int *)arguments)
-		goto retucomm;
-
-        savedip = ip;
-        savedip++;
-        cp = (char *)savedip;
-	while (*--ip)
-	    if (ip == (int *)arguments)
-		goto retucomm;
-        ip++;
-        
-        valuep = (unsigned int *)ip;
-        value = *valuep;
-        if ((value & 0xbfff0000) == 0xbfff0000) {
-                ip++;ip++;
-		valuep = ip;
-               blahlen = strlen(ip);
-                skiplen = (blahlen +3 ) /4 ;
-                valuep += skiplen;
-                cp = (char *)valuep;
-                while (!*cp) {
-                    cp++;
-                }
-                savedip = cp;
-        }
-        
-	nbad = 0;
-
-	for (cp = (char *)savedip; cp < (end_argc-1); cp++) {
-	    c = *cp & 0177;
-	    if (c == 0)
-		*cp = ' ';
-	    else if (c < ' ' || c > 0176) {
-		if (++nbad >= 5*(eflg+1)) {
-		    *cp++ = ' ';
-		    break;
-		}
-		*cp = '?';
-	    }
-	    else if (eflg == 0 && c == '=') {
-		while (*--cp != ' ')
-		    if (cp <= (char *)ip)
-			break;
-		break;
-	    }
+	cmdpath = (char *)malloc(len);
+
+	/* the arguments separated by spaces, with anything unprintable shown as '?' */
+	cp = cmdpath;
+	argument = entry->arguments;
+	for (i = 0; i < entry->argumentCount; i++) {
+	    if (i > 0)
+		*cp++ = ' ';
+	    for (; *argument; argument++)
+		*cp++ = ((*argument & 0177) < ' ' || (*argument & 0177) > 0176) ? '?' : *argument;
+	    argument++;
 	}
 	*cp = 0;
-#if 0
-	while (*--cp == ' ')
-	    *cp = 0;
-#endif
-	cp = (char *)savedip;
-	command_length = end_argc - cp;	/* <= MAX_COMMAND_SIZE */
 
-	if (cp[0] == '-' || cp[0] == '?' || cp[0] <= ' ') {
+	if (cmdpath[0] == '-' || cmdpath[0] == '?' || cmdpath[0] <= ' ') {
 	    /*
 	     *	Not enough information - add short command name
 	     */
-             len = ((unsigned)command_length + MAXCOMLEN + 5);
-	    cmdpath = (char *)malloc(len);
-	    (void) strncpy(cmdpath, cp, command_length);
 	    (void) strcat(cmdpath, " (");
 	    (void) strncat(cmdpath, kp->kp_proc.p_comm, MAXCOMLEN+1);
 	    (void) strcat(cmdpath, ")");
-	   *command_name = cmdpath;
-//            *cmdlen = len;
-            free(arguments);
-            return(1);
 	}
-	else {
-                
-	    cmdpath = (char *)malloc((unsigned)command_length + 1);
-	    (void) strncpy(cmdpath, cp, command_length);
-	    cmdpath[command_length] = '\0';
-	   *command_name = cmdpath;
-//            *cmdlen = command_length;
-            free(arguments);
-            return(1);
-	}
-
-    retucomm:
-        len = (MAXCOMLEN + 5);
-	cmdpath = (char *)malloc(len);
-	(void) strcpy(cmdpath, " (");
-	(void) strncat(cmdpath, kp->kp_proc.p_comm, MAXCOMLEN+1);
-	(void) strcat(cmdpath, ")");
-//	*cmdlen = len;
-	   *command_name = cmdpath;
-          free(arguments);
-        return(1);
+	*command_name = cmdpath;
+	return(1);
 }
 
 void getcommand2(struct kinfo_proc *kp, char **command_name)
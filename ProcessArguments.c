@@ -0,0 +1,791 @@
+/*
+ *  ProcessArguments.c
+ *
+ *  Command names and arguments of processes, read from the kernel once per process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ProcessArguments.h"
+
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define PROCESS_ARGUMENTS_BLOCK_SIZE 65536
+#define PROCESS_ARGUMENTS_MAX_BUFFER_SIZE 1048576	// bytes of arguments read from /proc, the rest is left out
+
+typedef struct processargumentsblock
+{
+	struct processargumentsblock *next;
+	size_t size;
+	size_t used;
+	char data[];
+} ProcessArgumentsBlock;
+
+
+static unsigned int hashPid(pid_t pid)
+{
+	unsigned int hash = (unsigned int) pid * 2654435761u;
+
+	return (hash ^ (hash >> 15));
+}
+
+
+// returns the slot holding the process, or the empty slot where it would go
+static int findSlot(const ProcessArguments *arguments, pid_t pid)
+{
+	unsigned int mask = arguments->capacity - 1;
+	unsigned int index = hashPid(pid) & mask;
+
+	while (arguments->entries[index].pid != 0 && arguments->entries[index].pid != pid)
+	{
+		index = (index + 1) & mask;
+	}
+	return (index);
+}
+
+
+static int growTable(ProcessArguments *arguments)
+{
+	ProcessArgumentsEntry *oldEntries = arguments->entries;
+	int oldCapacity = arguments->capacity;
+	int newCapacity = (oldCapacity > 0 ? oldCapacity * 2 : 256);
+	int i;
+
+	arguments->entries = calloc(newCapacity, sizeof(ProcessArgumentsEntry));
+	if (arguments->entries == NULL)
+	{
+		arguments->entries = oldEntries;
+		return (0);
+	}
+	arguments->capacity = newCapacity;
+	for (i = 0; i < oldCapacity; i++)
+	{
+		if (oldEntries[i].pid != 0)
+		{
+			arguments->entries[findSlot(arguments, oldEntries[i].pid)] = oldEntries[i];
+		}
+	}
+	free(oldEntries);
+	return (1);
+}
+
+
+// empties a slot and moves back the entries after it that would no longer be found
+static void removeSlot(ProcessArguments *arguments, int index)
+{
+	unsigned int mask = arguments->capacity - 1;
+	unsigned int hole = index;
+	unsigned int next = index;
+
+	arguments->liveSize -= arguments->entries[index].size;
+	for (;;)
+	{
+		unsigned int home;
+
+		next = (next + 1) & mask;
+		if (arguments->entries[next].pid == 0)
+		{
+			break;
+		}
+		home = hashPid(arguments->entries[next].pid) & mask;
+
+		// the entry stays when its home slot is after the hole, cyclically up to where it is
+		if (hole <= next ? (hole < home && home <= next) : (hole < home || home <= next))
+		{
+			continue;
+		}
+		arguments->entries[hole] = arguments->entries[next];
+		hole = next;
+	}
+	arguments->entries[hole].pid = 0;
+	arguments->count -= 1;
+}
+
+
+static void freeBlocks(ProcessArgumentsBlock *block)
+{
+	while (block != NULL)
+	{
+		ProcessArgumentsBlock *next = block->next;
+
+		free(block);
+		block = next;
+	}
+}
+
+
+// returns memory from the arena, which only grows until it is compacted
+static char *allocate(ProcessArguments *arguments, size_t size)
+{
+	ProcessArgumentsBlock *block = arguments->blocks;
+
+	if (block == NULL || block->used + size > block->size)
+	{
+		size_t blockSize = (size > PROCESS_ARGUMENTS_BLOCK_SIZE ? size : PROCESS_ARGUMENTS_BLOCK_SIZE);
+
+		block = malloc(sizeof(ProcessArgumentsBlock) + blockSize);
+		if (block == NULL)
+		{
+			return (NULL);
+		}
+		block->next = arguments->blocks;
+		block->size = blockSize;
+		block->used = 0;
+		arguments->blocks = block;
+	}
+	block->used += size;
+	arguments->arenaSize += size;
+	return (block->data + block->used - size);
+}
+
+
+static void moveEntry(ProcessArgumentsEntry *entry, char *strings)
+{
+	memcpy(strings, entry->strings, entry->size);
+	entry->shortName = strings + (entry->shortName - entry->strings);
+	entry->name = strings + (entry->name - entry->strings);
+	if (entry->annotation != NULL)
+	{
+		entry->annotation = strings + (entry->annotation - entry->strings);
+	}
+	entry->arguments = strings + (entry->arguments - entry->strings);
+	entry->environment = strings + (entry->environment - entry->strings);
+	entry->strings = strings;
+}
+
+
+// copies the strings of the entries to a single block when most of the arena is garbage
+static void compactArena(ProcessArguments *arguments)
+{
+	ProcessArgumentsBlock *oldBlocks = arguments->blocks;
+	size_t oldArenaSize = arguments->arenaSize;
+	int i;
+
+	if (arguments->arenaSize <= PROCESS_ARGUMENTS_BLOCK_SIZE || arguments->arenaSize <= 2 * arguments->liveSize)
+	{
+		return;
+	}
+
+	arguments->blocks = NULL;
+	arguments->arenaSize = 0;
+	if (arguments->liveSize > 0 && allocate(arguments, arguments->liveSize) == NULL)
+	{
+		// the garbage is kept until there is memory for the copy
+		arguments->blocks = oldBlocks;
+		arguments->arenaSize = oldArenaSize;
+		return;
+	}
+	if (arguments->blocks != NULL)
+	{
+		arguments->blocks->used = 0;
+		for (i = 0; i < arguments->capacity; i++)
+		{
+			if (arguments->entries[i].pid != 0)
+			{
+				moveEntry(&arguments->entries[i], arguments->blocks->data + arguments->blocks->used);
+				arguments->blocks->used += arguments->entries[i].size;
+			}
+		}
+	}
+	freeBlocks(oldBlocks);
+}
+
+
+#if defined(__APPLE__)
+
+static int growBuffer(ProcessArguments *arguments)
+{
+	if (arguments->buffer == NULL)
+	{
+		int mib[2] = { CTL_KERN, KERN_ARGMAX };
+		int argumentMax;
+		size_t size = sizeof(argumentMax);
+
+		if (sysctl(mib, 2, &argumentMax, &size, NULL, 0) < 0 || argumentMax <= 0)
+		{
+			argumentMax = 4096;
+		}
+		arguments->buffer = malloc(argumentMax);
+		if (arguments->buffer == NULL)
+		{
+			return (0);
+		}
+		arguments->bufferSize = argumentMax;
+	}
+	return (1);
+}
+
+// reads the arguments and environment into the buffer, one string after the other, returns how many strings or -1
+static int readArguments(ProcessArguments *arguments, pid_t pid, int *argumentCount, size_t *length)
+{
+	int mib[3] = { CTL_KERN, KERN_PROCARGS2, pid };
+	size_t size;
+	char *cp, *end, *output;
+	int stringCount = 0;
+
+	if (! growBuffer(arguments))
+	{
+		return (-1);
+	}
+	size = arguments->bufferSize;
+	if (sysctl(mib, 3, arguments->buffer, &size, NULL, 0) < 0 || size < sizeof(int))
+	{
+		// exited, a zombie or another user's
+		return (-1);
+	}
+
+	// the argument count, the path that was exec'ed and the padding after it come first
+	memcpy(argumentCount, arguments->buffer, sizeof(int));
+	cp = arguments->buffer + sizeof(int);
+	end = arguments->buffer + size;
+	while (cp < end && *cp != '\0')
+	{
+		cp++;
+	}
+	while (cp < end && *cp == '\0')
+	{
+		cp++;
+	}
+
+	// the strings are moved down over what was skipped, only the empty ones after the arguments are padding
+	output = arguments->buffer;
+	while (cp < end)
+	{
+		char *start = cp;
+
+		while (cp < end && *cp != '\0')
+		{
+			cp++;
+		}
+		if (cp == end)
+		{
+			break;
+		}
+		cp++;
+		if (cp - start > 1 || stringCount < *argumentCount)
+		{
+			memmove(output, start, cp - start);
+			output += cp - start;
+			stringCount++;
+		}
+	}
+	if (*argumentCount > stringCount)
+	{
+		*argumentCount = stringCount;
+	}
+	*length = output - arguments->buffer;
+	return (stringCount > 0 ? stringCount : -1);
+}
+
+#elif defined(__linux__)
+
+static const char *procRoot = "/proc";
+
+// reads the arguments into the buffer, one string after the other, returns how many strings or -1
+static int readArguments(ProcessArguments *arguments, pid_t pid, int *argumentCount, size_t *length)
+{
+	char path[64];
+	size_t size = 0;
+	ssize_t count;
+	int stringCount = 0;
+	size_t i;
+	int descriptor;
+
+	snprintf(path, sizeof(path), "%s/%ld/cmdline", procRoot, (long) pid);
+	descriptor = open(path, O_RDONLY);
+	if (descriptor < 0)
+	{
+		return (-1);
+	}
+	for (;;)
+	{
+		// a byte is kept for the '\0' a process may have overwritten with setproctitle()
+		if (size + 1 >= arguments->bufferSize)
+		{
+			size_t newSize = (arguments->bufferSize > 0 ? arguments->bufferSize * 2 : 4096);
+			char *newBuffer;
+
+			if (newSize > PROCESS_ARGUMENTS_MAX_BUFFER_SIZE)
+			{
+				break;
+			}
+			newBuffer = realloc(arguments->buffer, newSize);
+			if (newBuffer == NULL)
+			{
+				break;
+			}
+			arguments->buffer = newBuffer;
+			arguments->bufferSize = newSize;
+		}
+		count = read(descriptor, arguments->buffer + size, arguments->bufferSize - size - 1);
+		if (count <= 0)
+		{
+			break;
+		}
+		size += count;
+	}
+	close(descriptor);
+
+	// kernel threads and zombies have none
+	if (size == 0)
+	{
+		return (-1);
+	}
+	if (arguments->buffer[size - 1] != '\0')
+	{
+		arguments->buffer[size++] = '\0';
+	}
+	for (i = 0; i < size; i++)
+	{
+		if (arguments->buffer[i] == '\0')
+		{
+			stringCount++;
+		}
+	}
+	*argumentCount = stringCount;
+	*length = size;
+	return (stringCount);
+}
+
+#else
+
+static int readArguments(ProcessArguments *arguments, pid_t pid, int *argumentCount, size_t *length)
+{
+	return (-1);
+}
+
+#endif
+
+
+static const char *lastPathComponent(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+
+	return (slash != NULL && slash[1] != '\0' ? slash + 1 : path);
+}
+
+
+// finds the command among the arguments, and the widget or jar it runs, as AGProcess did
+static const char *findName(const char *strings, int argumentCount, const char **annotation, size_t *annotationLength)
+{
+	const char *name = NULL;
+	const char *string = strings;
+	int annotate = 0;
+	int i;
+
+	*annotation = NULL;
+	for (i = 0; i < argumentCount && *annotation == NULL; i++, string += strlen(string) + 1)
+	{
+		const char *component = lastPathComponent(string);
+		const char *extension;
+
+		// Classic applications were run by LaunchCFMApp
+		if (*string == '\0' || strcmp(component, "LaunchCFMApp") == 0)
+		{
+			continue;
+		}
+		if (name == NULL)
+		{
+			name = component;
+			annotate = (strcmp(name, "DashboardClient") == 0 || strcmp(name, "Yahoo! Widget Engine") == 0 || strcmp(name, "java") == 0);
+			continue;
+		}
+		if (! annotate || (extension = strrchr(component, '.')) == NULL)
+		{
+			continue;
+		}
+		if (strcmp(extension, ".wdgt") == 0 || strcmp(extension, ".widget") == 0)
+		{
+			*annotation = component;
+			*annotationLength = extension - component;
+		}
+		else if (strcmp(extension, ".jar") == 0)
+		{
+			*annotation = component;
+			*annotationLength = strlen(component);
+		}
+	}
+	return (name);
+}
+
+
+// reads the arguments of a process into an empty entry, returns 0 if memory could not be allocated
+static int readEntry(ProcessArguments *arguments, ProcessArgumentsEntry *entry, pid_t pid, double startTime, const char *shortName)
+{
+	int argumentCount = 0;
+	size_t length = 0;
+	int stringCount = readArguments(arguments, pid, &argumentCount, &length);
+	const char *name = NULL;
+	const char *annotation = NULL;
+	size_t annotationLength = 0;
+	size_t shortNameLength = strlen(shortName);
+	size_t size;
+	char *strings;
+	int i;
+
+	if (stringCount < 0)
+	{
+		stringCount = 0;
+		argumentCount = 0;
+		length = 0;
+	}
+	else
+	{
+		name = findName(arguments->buffer, argumentCount, &annotation, &annotationLength);
+	}
+
+	compactArena(arguments);
+	size = shortNameLength + 1 + (annotation != NULL ? annotationLength + 1 : 0) + length;
+	strings = allocate(arguments, size);
+	if (strings == NULL)
+	{
+		return (0);
+	}
+
+	entry->pid = pid;
+	entry->startTime = startTime;
+	entry->strings = strings;
+	entry->size = size;
+
+	memcpy(strings, shortName, shortNameLength + 1);
+	entry->shortName = strings;
+	strings += shortNameLength + 1;
+	entry->annotation = NULL;
+	if (annotation != NULL)
+	{
+		memcpy(strings, annotation, annotationLength);
+		strings[annotationLength] = '\0';
+		entry->annotation = strings;
+		strings += annotationLength + 1;
+	}
+	memcpy(strings, arguments->buffer, length);
+	entry->arguments = strings;
+	entry->argumentCount = argumentCount;
+	entry->name = (name != NULL ? strings + (name - arguments->buffer) : entry->shortName);
+
+	entry->environment = strings;
+	for (i = 0; i < argumentCount; i++)
+	{
+		entry->environment += strlen(entry->environment) + 1;
+	}
+	entry->environmentCount = stringCount - argumentCount;
+
+	arguments->liveSize += size;
+	return (1);
+}
+
+
+ProcessArguments *ProcessArgumentsCreate(void)
+{
+	return (calloc(1, sizeof(ProcessArguments)));
+}
+
+
+void ProcessArgumentsDispose(ProcessArguments *arguments)
+{
+	if (arguments == NULL)
+	{
+		return;
+	}
+	freeBlocks(arguments->blocks);
+	free(arguments->entries);
+	free(arguments->buffer);
+	free(arguments);
+}
+
+
+const ProcessArgumentsEntry *ProcessArgumentsLookup(ProcessArguments *arguments, pid_t pid, double startTime, const char *shortName)
+{
+	ProcessArgumentsEntry *entry;
+	int index;
+
+	if (shortName == NULL)
+	{
+		shortName = "";
+	}
+	if ((arguments->count + 1) * 2 > arguments->capacity && ! growTable(arguments))
+	{
+		return (NULL);
+	}
+
+	index = findSlot(arguments, pid);
+	entry = &arguments->entries[index];
+	if (entry->pid == pid)
+	{
+		if (entry->startTime == startTime && strcmp(entry->shortName, shortName) == 0)
+		{
+			arguments->hits++;
+			return (entry);
+		}
+
+		// a new process with the same pid, or one that exec'ed, replaces the old one
+		arguments->liveSize -= entry->size;
+	}
+	else
+	{
+		arguments->count += 1;
+	}
+	entry->size = 0;
+
+	arguments->misses++;
+	if (! readEntry(arguments, entry, pid, startTime, shortName))
+	{
+		entry->pid = pid;
+		removeSlot(arguments, index);
+		return (NULL);
+	}
+	return (entry);
+}
+
+
+void ProcessArgumentsRetain(ProcessArguments *arguments, const ProcessSnapshot *snapshot)
+{
+	int i;
+
+	for (i = 0; i < arguments->capacity; i++)
+	{
+		// the slot is checked again after a removal, an entry may have moved into it
+		while (arguments->entries[i].pid != 0)
+		{
+			const ProcessArgumentsEntry *entry = &arguments->entries[i];
+			const ProcessSnapshotEntry *process = ProcessSnapshotFind(snapshot, entry->pid);
+
+			if (process != NULL && process->startTime == entry->startTime && strcmp(process->command, entry->shortName) == 0)
+			{
+				break;
+			}
+			removeSlot(arguments, i);
+		}
+	}
+	compactArena(arguments);
+}
+
+
+#if PROCESS_ARGUMENTS_BENCHMARK
+
+/*
+ *  Generates a /proc with 2,000 processes and looks up the 30 shown by a panel on each of 1,000
+ *  refreshes, where the panel shows mostly the same processes and 20 processes are replaced by
+ *  new ones every time. The lookups are timed reading the arguments every time, as AGProcess did
+ *  for a new instance, then with the cache. The live processes are then looked up twice. Prints
+ *  one tab-separated line for each:
+ *
+ *	lookup	processes	lookups	hit_rate	ns_per_lookup	arena_bytes
+ */
+
+#include <sys/stat.h>
+
+#include "SampleClock.h"
+
+#define BENCHMARK_PROCESSES 2000
+#define BENCHMARK_REFRESHES 1000
+#define BENCHMARK_SHOWN 30
+#define BENCHMARK_REPLACED 20
+
+static double benchmarkNow(void)
+{
+	return (SampleClockNow() * 1.0e9);
+}
+
+#if defined(__linux__)
+
+static int generateTree(const char *root)
+{
+	char path[512];
+	FILE *file;
+	int pid;
+
+	if (mkdir(root, 0755) != 0)
+	{
+		return (0);
+	}
+	for (pid = 1; pid <= BENCHMARK_PROCESSES; pid++)
+	{
+		snprintf(path, sizeof(path), "%s/%d", root, pid);
+		if (mkdir(path, 0755) != 0)
+		{
+			return (0);
+		}
+		snprintf(path, sizeof(path), "%s/%d/cmdline", root, pid);
+		file = fopen(path, "w");
+		if (file == NULL)
+		{
+			return (0);
+		}
+		// every tenth process runs a jar, the others have a long option list
+		if (pid % 10 == 0)
+		{
+			fprintf(file, "/usr/bin/java%c-Xmx512m%c-jar%c/opt/services/service-%d.jar%c", 0, 0, 0, pid, 0);
+		}
+		else
+		{
+			fprintf(file, "/usr/sbin/daemon%c--config=/etc/daemon/daemon-%d.conf%c--log-level=info%c--pid-file=/run/daemon-%d.pid%c", 0, pid, 0, 0, pid, 0);
+		}
+		fclose(file);
+	}
+	return (1);
+}
+
+static void removeTree(const char *root)
+{
+	char path[512];
+	int pid;
+
+	for (pid = 1; pid <= BENCHMARK_PROCESSES; pid++)
+	{
+		snprintf(path, sizeof(path), "%s/%d/cmdline", root, pid);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s/%d", root, pid);
+		rmdir(path);
+	}
+	rmdir(root);
+}
+
+static int benchmarkGenerated(void)
+{
+	ProcessArguments *arguments = ProcessArgumentsCreate();
+	ProcessSnapshot snapshot;
+	const ProcessArgumentsEntry *entry;
+	double start, uncachedTime = 0.0, cachedTime = 0.0;
+	unsigned int seed = 1;
+	long lookups = 0;
+	int refresh, i;
+
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.entries = calloc(BENCHMARK_PROCESSES, sizeof(ProcessSnapshotEntry));
+	snapshot.count = BENCHMARK_PROCESSES;
+	snapshot.capacity = BENCHMARK_PROCESSES;
+	for (i = 0; i < BENCHMARK_PROCESSES; i++)
+	{
+		snapshot.entries[i].pid = i + 1;
+		snapshot.entries[i].startTime = 1.0;
+		strcpy(snapshot.entries[i].command, ((i + 1) % 10 == 0 ? "java" : "daemon"));
+	}
+
+	for (refresh = 0; refresh < BENCHMARK_REFRESHES; refresh++)
+	{
+		// a pid that is reused gets a new start time
+		for (i = 0; i < BENCHMARK_REPLACED; i++)
+		{
+			seed = (seed * 1103515245) + 12345;
+			snapshot.entries[(seed >> 8) % BENCHMARK_PROCESSES].startTime += 1.0;
+		}
+		ProcessArgumentsRetain(arguments, &snapshot);
+
+		// the panel shows the same processes, moving one place every ten refreshes
+		for (i = 0; i < BENCHMARK_SHOWN; i++)
+		{
+			const ProcessSnapshotEntry *process = &snapshot.entries[(i * 61 + refresh / 10) % BENCHMARK_PROCESSES];
+			int argumentCount;
+			size_t length;
+
+			start = benchmarkNow();
+			if (readArguments(arguments, process->pid, &argumentCount, &length) < 0)
+			{
+				fprintf(stderr, "failed to read the arguments of %d\n", process->pid);
+				return (0);
+			}
+			uncachedTime += benchmarkNow() - start;
+
+			start = benchmarkNow();
+			entry = ProcessArgumentsLookup(arguments, process->pid, process->startTime, process->command);
+			cachedTime += benchmarkNow() - start;
+			if (entry == NULL || entry->argumentCount != 4 || strcmp(entry->name, process->command) != 0)
+			{
+				fprintf(stderr, "process %d was not read correctly\n", process->pid);
+				return (0);
+			}
+			lookups++;
+		}
+	}
+
+	entry = ProcessArgumentsLookup(arguments, 1000, snapshot.entries[999].startTime, "java");
+	if (entry == NULL || entry->annotation == NULL || strcmp(entry->annotation, "service-1000.jar") != 0)
+	{
+		fprintf(stderr, "process 1000 has no annotation\n");
+		return (0);
+	}
+
+	printf("uncached\t%d\t%ld\t%.3f\t%.0f\t%d\n", BENCHMARK_PROCESSES, lookups, 0.0, uncachedTime / lookups, 0);
+	printf("cached\t%d\t%ld\t%.3f\t%.0f\t%lu\n", BENCHMARK_PROCESSES, lookups,
+			(double) arguments->hits / (arguments->hits + arguments->misses), cachedTime / lookups, (unsigned long) arguments->arenaSize);
+	free(snapshot.entries);
+	ProcessArgumentsDispose(arguments);
+	return (1);
+}
+
+#endif
+
+int main(int argc, char *argv[])
+{
+	ProcessArguments *arguments;
+	ProcessSnapshot *snapshot;
+	double start, elapsed;
+	int pass, i;
+
+	printf("lookup\tprocesses\tlookups\thit_rate\tns_per_lookup\tarena_bytes\n");
+
+#if defined(__linux__)
+	{
+		char root[64];
+		int generated;
+
+		snprintf(root, sizeof(root), "/tmp/process_arguments_benchmark.%ld", (long) getpid());
+		if (! generateTree(root))
+		{
+			fprintf(stderr, "failed to generate %s\n", root);
+			removeTree(root);
+			return (1);
+		}
+		procRoot = root;
+		generated = benchmarkGenerated();
+		procRoot = "/proc";
+		removeTree(root);
+		if (! generated)
+		{
+			return (1);
+		}
+	}
+#endif
+
+	// every live process, the second pass is answered by the cache
+	arguments = ProcessArgumentsCreate();
+	snapshot = ProcessSnapshotCreate();
+	if (! ProcessSnapshotRefresh(snapshot))
+	{
+		fprintf(stderr, "the processes of this host can't be listed\n");
+		return (1);
+	}
+	for (pass = 0; pass < 2; pass++)
+	{
+		unsigned long hits = arguments->hits;
+
+		start = benchmarkNow();
+		for (i = 0; i < snapshot->count; i++)
+		{
+			const ProcessSnapshotEntry *process = &snapshot->entries[i];
+
+			if (ProcessArgumentsLookup(arguments, process->pid, process->startTime, process->command) == NULL)
+			{
+				fprintf(stderr, "out of memory\n");
+				return (1);
+			}
+		}
+		elapsed = benchmarkNow() - start;
+		printf("%s\t%d\t%d\t%.3f\t%.0f\t%lu\n", (pass == 0 ? "live_cold" : "live_warm"), snapshot->count, snapshot->count,
+				(snapshot->count > 0 ? (double) (arguments->hits - hits) / snapshot->count : 0.0), (snapshot->count > 0 ? elapsed / snapshot->count : 0.0),
+				(unsigned long) arguments->arenaSize);
+	}
+	ProcessArgumentsDispose(arguments);
+	ProcessSnapshotDispose(snapshot);
+	return (0);
+}
+
+#endif
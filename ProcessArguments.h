@@ -0,0 +1,78 @@
+/*
+ *  ProcessArguments.h
+ *
+ *  Command names and arguments of processes, read from the kernel once per process.
+ *
+ *  The arguments of a process are read with sysctl(KERN_PROCARGS2) on Mac OS X and from
+ *  /proc/[pid]/cmdline on Linux, the first time they are looked up. They are kept, with the
+ *  command name and annotation made from them, until the process exits, so the panels that show
+ *  the same processes on every refresh don't read them again. Processes are keyed by pid, start
+ *  time and the short name the kernel has for them: a reused pid has another start time, and a
+ *  process that exec'ed has another short name, so neither gets the arguments it had before.
+ *
+ *  The strings of every process are interned in an arena of large blocks, one allocation per
+ *  process and none once the arena has grown, with a single buffer reused by every read of the
+ *  kernel. When more than half of the arena belongs to processes that were forgotten, the live
+ *  strings are copied to new blocks and the old ones are freed.
+ *
+ *  ProcessArgumentsRetain() forgets the processes that aren't in a snapshot. Without one, a
+ *  process is forgotten when its pid is looked up for another process, so the cache never has
+ *  more than one process per pid.
+ *
+ *  The benchmark looks up the processes of a generated /proc as the panels do, with a few
+ *  processes starting and exiting on every refresh, then looks up every live process:
+ *
+ *	cc -O2 -DPROCESS_ARGUMENTS_BENCHMARK -o process_arguments_benchmark ProcessArguments.c ProcessSnapshot.c ProcessRegistry.c WorkPool.c ProcessColumns.c TopRank.c -lm -lpthread
+ */
+
+#ifndef PROCESS_ARGUMENTS_H
+#define PROCESS_ARGUMENTS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "ProcessSnapshot.h"
+
+typedef struct processargumentsentry
+{
+	pid_t pid;			// 0 marks an empty slot
+	double startTime;		// as in ProcessSnapshotEntry
+	const char *shortName;		// the kernel's name when the arguments were read
+	const char *name;		// last path component of the command, the short name when the arguments can't be read
+	const char *annotation;		// widget or jar run by the command, NULL when there's none
+	int argumentCount;		// including the command, 0 when the arguments can't be read
+	const char *arguments;		// argumentCount strings, each ended by '\0'
+	int environmentCount;
+	const char *environment;	// "NAME=value" strings after the arguments, none on Linux
+	char *strings;			// arena memory holding all of the above
+	size_t size;
+} ProcessArgumentsEntry;
+
+typedef struct processarguments
+{
+	int count;
+	int capacity;			// slots, a power of 2
+	ProcessArgumentsEntry *entries;
+
+	struct processargumentsblock *blocks;	// the arena, the block being filled first
+	size_t arenaSize;		// bytes handed out by the arena
+	size_t liveSize;		// bytes of those held by entries
+
+	char *buffer;			// arguments as read from the kernel
+	size_t bufferSize;
+
+	unsigned long hits;		// lookups answered without reading the kernel
+	unsigned long misses;
+} ProcessArguments;
+
+ProcessArguments *ProcessArgumentsCreate(void);
+void ProcessArgumentsDispose(ProcessArguments *arguments);
+
+// returns the arguments of a process, reading them if they aren't known, or NULL if memory could not be allocated
+// the entry and its strings stay valid until the next call with the same arguments cache
+const ProcessArgumentsEntry *ProcessArgumentsLookup(ProcessArguments *arguments, pid_t pid, double startTime, const char *shortName);
+
+// forgets the processes that aren't in the snapshot, or have exec'ed since they were read
+void ProcessArgumentsRetain(ProcessArguments *arguments, const ProcessSnapshot *snapshot);
+
+#endif
@@ -0,0 +1,453 @@
+/*
+ *  ProcessColumns.c
+ *
+ *  Columnar copy of a process snapshot, for the scans the panels make over every process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ProcessColumns.h"
+
+#define COLUMN_ALIGNMENT 64	// each column starts on its own cache line
+
+
+static size_t alignColumn(size_t offset)
+{
+	return ((offset + COLUMN_ALIGNMENT - 1) & ~((size_t) COLUMN_ALIGNMENT - 1));
+}
+
+
+static int reserveColumns(ProcessColumns *columns, int count)
+{
+	size_t pidsOffset, flagsOffset, statesOffset, cpuUsagesOffset, cpuTimesOffset, residentSizesOffset, faultsOffset, commandsOffset;
+	size_t size;
+	char *block;
+	int capacity;
+
+	if (count <= columns->capacity)
+	{
+		return (1);
+	}
+	capacity = (columns->capacity > 0 ? columns->capacity : 256);
+	while (capacity < count)
+	{
+		capacity *= 2;
+	}
+
+	// the widest columns first, so every column is aligned for its type
+	cpuTimesOffset = 0;
+	residentSizesOffset = alignColumn(cpuTimesOffset + capacity * sizeof(double));
+	faultsOffset = alignColumn(residentSizesOffset + capacity * sizeof(unsigned long long));
+	pidsOffset = alignColumn(faultsOffset + capacity * sizeof(unsigned long long));
+	cpuUsagesOffset = alignColumn(pidsOffset + capacity * sizeof(pid_t));
+	commandsOffset = alignColumn(cpuUsagesOffset + capacity * sizeof(float));
+	flagsOffset = alignColumn(commandsOffset + capacity * sizeof(unsigned int));
+	statesOffset = alignColumn(flagsOffset + capacity * sizeof(unsigned char));
+	size = alignColumn(statesOffset + capacity * sizeof(unsigned char));
+
+	// every load fills the columns again, so the old ones aren't copied
+	block = malloc(size);
+	if (block == NULL)
+	{
+		return (0);
+	}
+	free(columns->block);
+	columns->block = block;
+	columns->capacity = capacity;
+	columns->cpuTimes = (double *) (block + cpuTimesOffset);
+	columns->residentSizes = (unsigned long long *) (block + residentSizesOffset);
+	columns->faults = (unsigned long long *) (block + faultsOffset);
+	columns->pids = (pid_t *) (block + pidsOffset);
+	columns->cpuUsages = (float *) (block + cpuUsagesOffset);
+	columns->commands = (unsigned int *) (block + commandsOffset);
+	columns->flags = (unsigned char *) (block + flagsOffset);
+	columns->states = (unsigned char *) (block + statesOffset);
+	return (1);
+}
+
+
+static int reserveStrings(ProcessColumns *columns, size_t size)
+{
+	char *strings;
+	size_t capacity;
+
+	if (size <= columns->stringsCapacity)
+	{
+		return (1);
+	}
+	capacity = (columns->stringsCapacity > 0 ? columns->stringsCapacity : 4096);
+	while (capacity < size)
+	{
+		capacity *= 2;
+	}
+	strings = realloc(columns->strings, capacity);
+	if (strings == NULL)
+	{
+		return (0);
+	}
+	columns->strings = strings;
+	columns->stringsCapacity = capacity;
+	return (1);
+}
+
+
+ProcessColumns *ProcessColumnsCreate(void)
+{
+	ProcessColumns *columns = calloc(1, sizeof(ProcessColumns));
+
+	if (columns != NULL)
+	{
+		columns->selfPid = getpid();
+	}
+	return (columns);
+}
+
+
+void ProcessColumnsDispose(ProcessColumns *columns)
+{
+	if (columns == NULL)
+	{
+		return;
+	}
+	free(columns->block);
+	free(columns->strings);
+	free(columns);
+}
+
+
+int ProcessColumnsReset(ProcessColumns *columns, int count)
+{
+	columns->count = 0;
+	columns->stringsSize = 0;
+	return (reserveColumns(columns, count));
+}
+
+
+int ProcessColumnsAppend(ProcessColumns *columns, const ProcessSnapshotEntry *entry)
+{
+	size_t length = strlen(entry->command) + 1;
+	unsigned char flags = 0;
+	int i = columns->count;
+
+	if (i >= columns->capacity || ! reserveStrings(columns, columns->stringsSize + length))
+	{
+		return (0);
+	}
+	memcpy(columns->strings + columns->stringsSize, entry->command, length);
+	columns->commands[i] = (unsigned int) columns->stringsSize;
+	columns->stringsSize += length;
+
+	if (! entry->known)
+	{
+		flags |= PROCESS_COLUMNS_UNKNOWN;
+	}
+	if (entry->pid == 0)
+	{
+		flags |= PROCESS_COLUMNS_KERNEL;
+	}
+	if (entry->pid == columns->selfPid)
+	{
+		flags |= PROCESS_COLUMNS_SELF;
+	}
+	columns->pids[i] = entry->pid;
+	columns->flags[i] = flags;
+	if (entry->known)
+	{
+		columns->states[i] = (unsigned char) entry->state;
+		columns->cpuUsages[i] = (float) entry->cpuUsage;
+		columns->cpuTimes[i] = entry->userTime + entry->systemTime;
+		columns->residentSizes[i] = entry->residentSize;
+		columns->faults[i] = entry->faults;
+	}
+	else
+	{
+		columns->states[i] = ProcessSnapshotStateUnknown;
+		columns->cpuUsages[i] = 0.0f;
+		columns->cpuTimes[i] = 0.0;
+		columns->residentSizes[i] = 0;
+		columns->faults[i] = 0;
+	}
+	columns->count = i + 1;
+	return (1);
+}
+
+
+int ProcessColumnsLoad(ProcessColumns *columns, const ProcessSnapshot *snapshot)
+{
+	int i;
+
+	if (! ProcessColumnsReset(columns, snapshot->count))
+	{
+		return (0);
+	}
+	for (i = 0; i < snapshot->count; i++)
+	{
+		if (! ProcessColumnsAppend(columns, &snapshot->entries[i]))
+		{
+			columns->count = 0;
+			return (0);
+		}
+	}
+	return (1);
+}
+
+
+void ProcessColumnsSum(const ProcessColumns *columns, unsigned int excludedFlags, ProcessColumnsTotals *totals)
+{
+	const unsigned char *flags = columns->flags;
+	int i;
+
+	memset(totals, 0, sizeof(ProcessColumnsTotals));
+	excludedFlags |= PROCESS_COLUMNS_UNKNOWN;
+	for (i = 0; i < columns->count; i++)
+	{
+		if ((flags[i] & excludedFlags) == 0)
+		{
+			totals->count += 1;
+			totals->stateCounts[columns->states[i]] += 1;
+			totals->cpuUsage += columns->cpuUsages[i];
+			totals->cpuTime += columns->cpuTimes[i];
+			totals->residentSize += columns->residentSizes[i];
+			totals->faults += columns->faults[i];
+		}
+	}
+}
+
+
+int ProcessColumnsRank(const ProcessColumns *columns, ProcessColumnsKey key, unsigned int excludedFlags, TopRankItem *items, int limit)
+{
+	const unsigned char *flags = columns->flags;
+	TopRank rank;
+	int i;
+
+	// most processes are idle, so the key is tested before the flags
+	excludedFlags |= PROCESS_COLUMNS_UNKNOWN;
+	TopRankInit(&rank, items, limit);
+	if (key == ProcessColumnsKeyCPUUsage)
+	{
+		const float *cpuUsages = columns->cpuUsages;
+
+		for (i = 0; i < columns->count; i++)
+		{
+			if (cpuUsages[i] > 0.0f && (flags[i] & excludedFlags) == 0)
+			{
+				TopRankOffer(&rank, cpuUsages[i], i);
+			}
+		}
+	}
+	else
+	{
+		const unsigned long long *residentSizes = columns->residentSizes;
+
+		for (i = 0; i < columns->count; i++)
+		{
+			if (residentSizes[i] > 0 && (flags[i] & excludedFlags) == 0)
+			{
+				TopRankOffer(&rank, (double) residentSizes[i], i);
+			}
+		}
+	}
+	return (TopRankFinish(&rank));
+}
+
+
+int ProcessColumnsSelectCommand(const ProcessColumns *columns, const char *command, int *indexes)
+{
+	int count = 0;
+	int i;
+
+	// the names are in the arena in the order of the processes, so this reads it once from start to end
+	for (i = 0; i < columns->count; i++)
+	{
+		if (strcmp(columns->strings + columns->commands[i], command) == 0)
+		{
+			indexes[count++] = i;
+		}
+	}
+	return (count);
+}
+
+
+#if PROCESS_COLUMNS_BENCHMARK
+
+/*
+ *  Generates snapshots of 10,000 and 50,000 processes, checks that the columns count and rank
+ *  them like the snapshot, and prints one tab-separated line per layout:
+ *
+ *	processes	layout	passes	ns_per_pass	ns_per_process
+ *
+ *  A pass counts the states of the processes and ranks them by CPU usage and by resident size,
+ *  as the processor and memory panels do. The load line is the cost of copying a snapshot into
+ *  the columns in a pass of its own; a refresh pays less, the entries it copies are in the cache.
+ */
+
+#include "SampleClock.h"
+
+#define BENCHMARK_RANK_SIZE 10
+
+static double benchmarkNow(void)
+{
+	return (SampleClockNow() * 1.0e9);
+}
+
+static void generateSnapshot(ProcessSnapshot *snapshot, int count)
+{
+	int i;
+
+	memset(snapshot, 0, sizeof(ProcessSnapshot));
+	snapshot->entries = calloc(count, sizeof(ProcessSnapshotEntry));
+	snapshot->count = count;
+	snapshot->capacity = count;
+	for (i = 0; i < count; i++)
+	{
+		ProcessSnapshotEntry *entry = &snapshot->entries[i];
+		unsigned int hash = (unsigned int) i * 2654435761U;
+
+		entry->pid = i + 1;
+		snprintf(entry->command, sizeof(entry->command), "%s", (i % 7 == 0 ? "worker" : "daemon"));
+		entry->known = (i % 20 != 0);
+		entry->state = (ProcessSnapshotState) (1 + (hash >> 8) % 5);
+		entry->userTime = (hash % 100000) / 100.0;
+		entry->systemTime = (hash % 1000) / 100.0;
+		// one process in ten is busy, no two usages or resident sizes are the same
+		entry->cpuUsage = (i % 10 == 0 ? (((i / 10) * 40503) & 0xffff) / 65536.0 : 0.0);
+		entry->residentSize = 4096ULL * (hash % 100000) * 64 + i;
+		entry->faults = hash % 1000000;
+	}
+}
+
+// counts and ranks the processes over the snapshot, as the panels did before the columns
+static int snapshotPass(const ProcessSnapshot *snapshot, int *stateCounts, TopRankItem *cpuItems, TopRankItem *residentItems)
+{
+	TopRank cpuRank, residentRank;
+	int i;
+
+	memset(stateCounts, 0, PROCESS_COLUMNS_STATE_COUNT * sizeof(int));
+	for (i = 0; i < snapshot->count; i++)
+	{
+		if (snapshot->entries[i].known)
+		{
+			stateCounts[snapshot->entries[i].state] += 1;
+		}
+	}
+	TopRankInit(&cpuRank, cpuItems, BENCHMARK_RANK_SIZE);
+	for (i = 0; i < snapshot->count; i++)
+	{
+		const ProcessSnapshotEntry *entry = &snapshot->entries[i];
+
+		if (entry->known && entry->cpuUsage > 0.0 && entry->pid != 0)
+		{
+			TopRankOffer(&cpuRank, entry->cpuUsage, i);
+		}
+	}
+	TopRankInit(&residentRank, residentItems, BENCHMARK_RANK_SIZE);
+	for (i = 0; i < snapshot->count; i++)
+	{
+		const ProcessSnapshotEntry *entry = &snapshot->entries[i];
+
+		if (entry->known && entry->residentSize > 0)
+		{
+			TopRankOffer(&residentRank, (double) entry->residentSize, i);
+		}
+	}
+	return (TopRankFinish(&cpuRank) + TopRankFinish(&residentRank));
+}
+
+static int columnsPass(const ProcessColumns *columns, int *stateCounts, TopRankItem *cpuItems, TopRankItem *residentItems)
+{
+	ProcessColumnsTotals totals;
+
+	ProcessColumnsSum(columns, 0, &totals);
+	memcpy(stateCounts, totals.stateCounts, sizeof(totals.stateCounts));
+	return (ProcessColumnsRank(columns, ProcessColumnsKeyCPUUsage, PROCESS_COLUMNS_KERNEL, cpuItems, BENCHMARK_RANK_SIZE)
+			+ ProcessColumnsRank(columns, ProcessColumnsKeyResidentSize, 0, residentItems, BENCHMARK_RANK_SIZE));
+}
+
+static int benchmarkCount(int count)
+{
+	ProcessSnapshot snapshot;
+	ProcessColumns *columns = ProcessColumnsCreate();
+	int snapshotCounts[PROCESS_COLUMNS_STATE_COUNT], columnsCounts[PROCESS_COLUMNS_STATE_COUNT];
+	TopRankItem snapshotCPU[BENCHMARK_RANK_SIZE], snapshotResident[BENCHMARK_RANK_SIZE];
+	TopRankItem columnsCPU[BENCHMARK_RANK_SIZE], columnsResident[BENCHMARK_RANK_SIZE];
+	int indexes[50000];
+	const int passes = (count > 20000 ? 100 : 500);
+	double start, snapshotTime, columnsTime, loadTime;
+	long checksum = 0;
+	int pass, i;
+
+	generateSnapshot(&snapshot, count);
+	if (columns == NULL || ! ProcessColumnsLoad(columns, &snapshot))
+	{
+		fprintf(stderr, "failed to load %d processes\n", count);
+		return (0);
+	}
+
+	// the columns must give the same answers as the snapshot
+	snapshotPass(&snapshot, snapshotCounts, snapshotCPU, snapshotResident);
+	columnsPass(columns, columnsCounts, columnsCPU, columnsResident);
+	if (memcmp(snapshotCounts, columnsCounts, sizeof(snapshotCounts)) != 0)
+	{
+		fprintf(stderr, "the states of %d processes were counted differently\n", count);
+		return (0);
+	}
+	for (i = 0; i < BENCHMARK_RANK_SIZE; i++)
+	{
+		if (snapshotCPU[i].index != columnsCPU[i].index || snapshotResident[i].index != columnsResident[i].index)
+		{
+			fprintf(stderr, "the %d processes were ranked differently at row %d\n", count, i);
+			return (0);
+		}
+	}
+	if (ProcessColumnsSelectCommand(columns, "worker", indexes) != (count + 6) / 7
+			|| strcmp(ProcessColumnsCommand(columns, indexes[1]), "worker") != 0 || columns->pids[indexes[1]] != 8)
+	{
+		fprintf(stderr, "the workers of %d processes were not selected\n", count);
+		return (0);
+	}
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		checksum += snapshotPass(&snapshot, snapshotCounts, snapshotCPU, snapshotResident);
+	}
+	snapshotTime = (benchmarkNow() - start) / passes;
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		checksum += columnsPass(columns, columnsCounts, columnsCPU, columnsResident);
+	}
+	columnsTime = (benchmarkNow() - start) / passes;
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		checksum += ProcessColumnsLoad(columns, &snapshot);
+	}
+	loadTime = (benchmarkNow() - start) / passes;
+
+	printf("%d\tsnapshot\t%d\t%.0f\t%.2f\n", count, passes, snapshotTime, snapshotTime / count);
+	printf("%d\tcolumns\t%d\t%.0f\t%.2f\n", count, passes, columnsTime, columnsTime / count);
+	printf("%d\tload\t%d\t%.0f\t%.2f\n", count, passes, loadTime, loadTime / count);
+	fprintf(stderr, "%d checksum %ld\n", count, checksum);
+
+	ProcessColumnsDispose(columns);
+	free(snapshot.entries);
+	return (1);
+}
+
+int main(int argc, char *argv[])
+{
+	printf("processes\tlayout\tpasses\tns_per_pass\tns_per_process\n");
+	if (! benchmarkCount(10000) || ! benchmarkCount(50000))
+	{
+		return (1);
+	}
+	return (0);
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ *  ProcessColumns.h
+ *
+ *  Columnar copy of a process snapshot, for the scans the panels make over every process.
+ *
+ *  A ProcessSnapshotEntry is a few hundred bytes, so ranking or counting the processes by one
+ *  statistic reads several cache lines per process to use a few bytes of them. The columns hold
+ *  the statistics the scans need in dense parallel arrays instead, one per statistic, so a scan
+ *  only reads the arrays it uses, sequentially, and a 50,000 process table fits in a few hundred
+ *  kilobytes per column. The command names are copied into one arena, the column only holds
+ *  the offset of each name.
+ *
+ *  A ProcessSnapshot fills its columns as it computes the CPU usage of each entry, the last pass
+ *  of a refresh, while the entry is still in the cache, and the panels drawn from the snapshot
+ *  share them. Index i of every column is entry i of the snapshot, so the indexes a scan returns
+ *  can be used to look up everything else in the snapshot. ProcessColumnsLoad() copies a
+ *  snapshot that was filled some other way.
+ *
+ *  The benchmark generates 10,000 and 50,000 processes, then counts their states and ranks
+ *  them by CPU usage and by resident size over the snapshot and over the columns:
+ *
+ *	cc -O2 -DPROCESS_COLUMNS_BENCHMARK -o process_columns_benchmark ProcessColumns.c TopRank.c
+ */
+
+#ifndef PROCESS_COLUMNS_H
+#define PROCESS_COLUMNS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "ProcessSnapshot.h"
+#include "TopRank.h"
+
+#define PROCESS_COLUMNS_STATE_COUNT (ProcessSnapshotStateExited + 1)
+
+// flags of a process, a scan skips the processes with any of the flags it excludes
+#define PROCESS_COLUMNS_UNKNOWN 0x01	// its statistics couldn't be read, every scan skips it
+#define PROCESS_COLUMNS_KERNEL 0x02	// pid 0
+#define PROCESS_COLUMNS_SELF 0x04	// the process doing the scan
+
+typedef enum
+{
+	ProcessColumnsKeyCPUUsage = 0,
+	ProcessColumnsKeyResidentSize
+} ProcessColumnsKey;
+
+typedef struct processcolumns
+{
+	int count;
+	int capacity;
+	void *block;			// every column, in one allocation
+	pid_t selfPid;			// the process flagged PROCESS_COLUMNS_SELF
+
+	pid_t *pids;
+	unsigned char *flags;
+	unsigned char *states;		// ProcessSnapshotState
+	float *cpuUsages;		// fraction of one processor since the previous snapshot
+	double *cpuTimes;		// user and system time, seconds
+	unsigned long long *residentSizes;	// bytes
+	unsigned long long *faults;
+	unsigned int *commands;		// offsets of the command names in strings
+
+	char *strings;			// command names, each ended by '\0'
+	size_t stringsSize;
+	size_t stringsCapacity;
+} ProcessColumns;
+
+typedef struct processcolumnstotals
+{
+	int count;			// processes included
+	int stateCounts[PROCESS_COLUMNS_STATE_COUNT];
+	double cpuUsage;
+	double cpuTime;
+	unsigned long long residentSize;
+	unsigned long long faults;
+} ProcessColumnsTotals;
+
+ProcessColumns *ProcessColumnsCreate(void);
+void ProcessColumnsDispose(ProcessColumns *columns);
+
+// empties the columns and makes room for count processes, returns 0 if memory could not be allocated
+int ProcessColumnsReset(ProcessColumns *columns, int count);
+
+// adds an entry after the others, returns 0 if there is no room for it
+int ProcessColumnsAppend(ProcessColumns *columns, const ProcessSnapshotEntry *entry);
+
+// copies the processes of the snapshot, returns 0 if memory could not be allocated
+int ProcessColumnsLoad(ProcessColumns *columns, const ProcessSnapshot *snapshot);
+
+// adds up the processes without any of the excluded flags
+void ProcessColumnsSum(const ProcessColumns *columns, unsigned int excludedFlags, ProcessColumnsTotals *totals);
+
+// ranks the processes without any of the excluded flags whose key is above 0, returns how many were kept
+int ProcessColumnsRank(const ProcessColumns *columns, ProcessColumnsKey key, unsigned int excludedFlags, TopRankItem *items, int limit);
+
+// stores the indexes of the processes named command in indexes, which has room for every process, and returns how many there are
+int ProcessColumnsSelectCommand(const ProcessColumns *columns, const char *command, int *indexes);
+
+#define ProcessColumnsCommand(columns, index) ((columns)->strings + (columns)->commands[(index)])
+
+#endif
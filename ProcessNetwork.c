@@ -0,0 +1,616 @@
+/*
+ *  ProcessNetwork.c
+ *
+ *  Bytes sent and received by each process, from the byte counters of its TCP sockets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ProcessNetwork.h"
+#include "SampleClock.h"
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <errno.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/tcp.h>
+#endif
+
+
+static unsigned int hashInode(unsigned int inode)
+{
+	unsigned int hash = inode * 2654435761u;
+
+	return (hash ^ (hash >> 16));
+}
+
+
+// returns the slot holding the socket, or the empty slot where it would go
+static int findSlot(const ProcessNetwork *network, unsigned int inode)
+{
+	unsigned int mask = network->capacity - 1;
+	unsigned int index = hashInode(inode) & mask;
+
+	while (network->sockets[index].inode != 0 && network->sockets[index].inode != inode)
+	{
+		index = (index + 1) & mask;
+	}
+	return (index);
+}
+
+
+static int growTable(ProcessNetwork *network)
+{
+	ProcessNetworkSocket *oldSockets = network->sockets;
+	int oldCapacity = network->capacity;
+	int newCapacity = (oldCapacity > 0 ? oldCapacity * 2 : 1024);
+	int i;
+
+	network->sockets = calloc(newCapacity, sizeof(ProcessNetworkSocket));
+	if (network->sockets == NULL)
+	{
+		network->sockets = oldSockets;
+		return (0);
+	}
+	network->capacity = newCapacity;
+	for (i = 0; i < oldCapacity; i++)
+	{
+		if (oldSockets[i].inode != 0)
+		{
+			network->sockets[findSlot(network, oldSockets[i].inode)] = oldSockets[i];
+		}
+	}
+	free(oldSockets);
+	return (1);
+}
+
+
+// empties a slot and moves back the sockets after it that would no longer be found
+static void removeSlot(ProcessNetwork *network, int index)
+{
+	unsigned int mask = network->capacity - 1;
+	unsigned int hole = index;
+	unsigned int next = index;
+
+	for (;;)
+	{
+		unsigned int home;
+
+		next = (next + 1) & mask;
+		if (network->sockets[next].inode == 0)
+		{
+			break;
+		}
+		home = hashInode(network->sockets[next].inode) & mask;
+
+		// the socket stays when its home slot is after the hole, cyclically up to where it is
+		if (hole <= next ? (hole < home && home <= next) : (hole < home || home <= next))
+		{
+			continue;
+		}
+		network->sockets[hole] = network->sockets[next];
+		hole = next;
+	}
+	network->sockets[hole].inode = 0;
+	network->count -= 1;
+}
+
+
+static void beginUpdate(ProcessNetwork *network)
+{
+	network->generation += 1;
+	if (network->generation == 0)
+	{
+		network->generation = 1;
+	}
+	network->unknownCount = 0;
+	network->lookupCount = 0;
+}
+
+
+// records the counters of a socket in the dump, returns 0 if memory could not be allocated
+static int enterSocket(ProcessNetwork *network, unsigned int inode, uid_t uid, unsigned long long sentBytes, unsigned long long receivedBytes)
+{
+	ProcessNetworkSocket *socket;
+
+	if (inode == 0)
+	{
+		return (1);
+	}
+	if ((network->count + 1) * 2 > network->capacity && ! growTable(network))
+	{
+		return (0);
+	}
+
+	socket = &network->sockets[findSlot(network, inode)];
+	if (socket->inode == 0)
+	{
+		// counted from now on, what it moved before isn't known to have been in this interval
+		memset(socket, 0, sizeof(ProcessNetworkSocket));
+		socket->inode = inode;
+		socket->uid = uid;
+		network->count += 1;
+	}
+	else if (socket->generation != network->generation)
+	{
+		// a counter that went down belongs to a new socket that reused the inode
+		socket->sentDelta = (sentBytes >= socket->sentBytes ? sentBytes - socket->sentBytes : 0);
+		socket->receivedDelta = (receivedBytes >= socket->receivedBytes ? receivedBytes - socket->receivedBytes : 0);
+	}
+	socket->sentBytes = sentBytes;
+	socket->receivedBytes = receivedBytes;
+	if (socket->generation != network->generation && socket->owner == 0)
+	{
+		network->unknownCount += 1;
+	}
+	socket->generation = network->generation;
+	return (1);
+}
+
+
+// adds the changes of the sockets to their owners, and forgets the sockets that were closed
+static void finishUpdate(ProcessNetwork *network, ProcessSnapshot *snapshot)
+{
+	double now = SampleClockNow();
+	double elapsed = (network->timestamp > 0.0 ? now - network->timestamp : 0.0);
+	int i;
+
+	for (i = 0; i < network->capacity; i++)
+	{
+		ProcessNetworkSocket *socket = &network->sockets[i];
+
+		// the slot is checked again after a removal, a socket may have moved into it
+		while (socket->inode != 0 && socket->generation != network->generation)
+		{
+			removeSlot(network, i);
+		}
+		if (socket->inode == 0 || (socket->sentDelta == 0 && socket->receivedDelta == 0))
+		{
+			continue;
+		}
+		if (socket->owner > 0 && elapsed > 0.0)
+		{
+			ProcessSnapshotEntry *entry = (ProcessSnapshotEntry *) ProcessSnapshotFind(snapshot, socket->owner);
+
+			if (entry != NULL)
+			{
+				entry->sentRate += (double) socket->sentDelta / elapsed;
+				entry->receivedRate += (double) socket->receivedDelta / elapsed;
+			}
+		}
+		// a removal can move a socket that was already added back into a later slot
+		socket->sentDelta = 0;
+		socket->receivedDelta = 0;
+	}
+	network->timestamp = now;
+}
+
+
+#if defined(__linux__)
+
+static int openSockets(void)
+{
+	return (socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG));
+}
+
+
+// dumps the TCP sockets of one address family, returns 0 if the dump failed
+static int dumpSockets(ProcessNetwork *network, int family)
+{
+	struct
+	{
+		struct nlmsghdr header;
+		struct inet_diag_req_v2 request;
+	} message;
+	char buffer[32768] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+	memset(&message, 0, sizeof(message));
+	message.header.nlmsg_len = sizeof(message);
+	message.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+	message.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	message.request.sdiag_family = family;
+	message.request.sdiag_protocol = IPPROTO_TCP;
+	message.request.idiag_ext = (1 << (INET_DIAG_INFO - 1));
+	message.request.idiag_states = ~0U;
+	if (send(network->descriptor, &message, sizeof(message), 0) < 0)
+	{
+		return (0);
+	}
+
+	for (;;)
+	{
+		struct nlmsghdr *header;
+		ssize_t length = recv(network->descriptor, buffer, sizeof(buffer), 0);
+
+		if (length < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return (0);
+		}
+
+		for (header = (struct nlmsghdr *) buffer; NLMSG_OK(header, (unsigned int) length); header = NLMSG_NEXT(header, length))
+		{
+			struct inet_diag_msg *diag;
+			struct rtattr *attribute;
+			unsigned int attributeLength;
+			unsigned long long sentBytes = 0, receivedBytes = 0;
+
+			if (header->nlmsg_type == NLMSG_DONE)
+			{
+				return (1);
+			}
+			if (header->nlmsg_type == NLMSG_ERROR)
+			{
+				return (0);
+			}
+
+			diag = (struct inet_diag_msg *) NLMSG_DATA(header);
+			attribute = (struct rtattr *) (diag + 1);
+			attributeLength = header->nlmsg_len - NLMSG_LENGTH(sizeof(*diag));
+			for (; RTA_OK(attribute, attributeLength); attribute = RTA_NEXT(attribute, attributeLength))
+			{
+				const struct tcp_info *info = (const struct tcp_info *) RTA_DATA(attribute);
+
+				// the byte counters were added to the end of tcp_info in Linux 4.1 and 4.2
+				if (attribute->rta_type == INET_DIAG_INFO
+						&& RTA_PAYLOAD(attribute) >= offsetof(struct tcp_info, tcpi_bytes_received) + sizeof(info->tcpi_bytes_received))
+				{
+					sentBytes = info->tcpi_bytes_acked;
+					receivedBytes = info->tcpi_bytes_received;
+				}
+			}
+			if (! enterSocket(network, diag->idiag_inode, diag->idiag_uid, sentBytes, receivedBytes))
+			{
+				return (0);
+			}
+		}
+	}
+}
+
+
+static int readSockets(ProcessNetwork *network)
+{
+	return (dumpSockets(network, AF_INET) && dumpSockets(network, AF_INET6));
+}
+
+
+// reads the sockets of a process from its fd links, and gives it the unknown ones, returns how many it got
+static int claimSockets(ProcessNetwork *network, pid_t pid)
+{
+	char path[64];
+	DIR *directory;
+	struct dirent *item;
+	int claimed = 0;
+
+	snprintf(path, sizeof(path), "/proc/%ld/fd", (long) pid);
+	directory = opendir(path);
+	if (directory == NULL)
+	{
+		// exited, or another user's
+		return (0);
+	}
+	network->lookupCount += 1;
+
+	while ((item = readdir(directory)) != NULL)
+	{
+		char target[64];
+		ssize_t length;
+		unsigned int inode;
+
+		if (item->d_name[0] == '.')
+		{
+			continue;
+		}
+		length = readlinkat(dirfd(directory), item->d_name, target, sizeof(target) - 1);
+		if (length <= 0)
+		{
+			continue;
+		}
+		target[length] = '\0';
+		if (sscanf(target, "socket:[%u]", &inode) == 1)
+		{
+			ProcessNetworkSocket *socket = &network->sockets[findSlot(network, inode)];
+
+			if (socket->inode == inode && socket->owner == 0)
+			{
+				socket->owner = pid;
+				claimed++;
+			}
+		}
+	}
+
+	closedir(directory);
+	return (claimed);
+}
+
+
+// finds the owners of the new sockets among the processes of the users that created them
+static void resolveOwners(ProcessNetwork *network, const ProcessSnapshot *snapshot)
+{
+	uid_t uids[16];
+	int uidCount = 0;
+	int allUsers = 0;
+	int i;
+
+	if (network->unknownCount == 0)
+	{
+		return;
+	}
+
+	for (i = 0; i < network->capacity; i++)
+	{
+		const ProcessNetworkSocket *socket = &network->sockets[i];
+		int u;
+
+		if (socket->inode == 0 || socket->owner != 0 || socket->generation != network->generation)
+		{
+			continue;
+		}
+		for (u = 0; u < uidCount && uids[u] != socket->uid; u++)
+		{
+		}
+		if (u == uidCount)
+		{
+			if (uidCount == sizeof(uids) / sizeof(uids[0]))
+			{
+				allUsers = 1;
+				break;
+			}
+			uids[uidCount++] = socket->uid;
+		}
+	}
+
+	// a new socket most likely belongs to a new process, and pids are handed out in increasing order
+	for (i = snapshot->count - 1; i >= 0 && network->unknownCount > 0; i--)
+	{
+		const ProcessSnapshotEntry *entry = &snapshot->entries[i];
+		int u;
+
+		for (u = 0; u < uidCount && uids[u] != entry->uid; u++)
+		{
+		}
+		if (allUsers || u < uidCount)
+		{
+			network->unknownCount -= claimSockets(network, entry->pid);
+		}
+	}
+
+	// the rest can't be attributed, they aren't looked for again
+	for (i = 0; i < network->capacity && network->unknownCount > 0; i++)
+	{
+		ProcessNetworkSocket *socket = &network->sockets[i];
+
+		if (socket->inode != 0 && socket->owner == 0 && socket->generation == network->generation)
+		{
+			socket->owner = -1;
+			network->unknownCount -= 1;
+		}
+	}
+}
+
+#else
+
+// Linux only, nettop's counters come from the private NetworkStatistics framework
+static int openSockets(void)
+{
+	return (-1);
+}
+
+static int readSockets(ProcessNetwork *network)
+{
+	(void) network;
+	return (0);
+}
+
+static void resolveOwners(ProcessNetwork *network, const ProcessSnapshot *snapshot)
+{
+	(void) network;
+	(void) snapshot;
+}
+
+#endif
+
+
+ProcessNetwork *ProcessNetworkCreate(void)
+{
+	ProcessNetwork *network;
+	int descriptor = openSockets();
+
+	if (descriptor < 0)
+	{
+		return (NULL);
+	}
+	network = calloc(1, sizeof(ProcessNetwork));
+	if (network == NULL)
+	{
+		close(descriptor);
+		return (NULL);
+	}
+	network->descriptor = descriptor;
+	return (network);
+}
+
+
+void ProcessNetworkDispose(ProcessNetwork *network)
+{
+	if (network == NULL)
+	{
+		return;
+	}
+	if (network->descriptor >= 0)
+	{
+		close(network->descriptor);
+	}
+	free(network->sockets);
+	free(network);
+}
+
+
+int ProcessNetworkUpdate(ProcessNetwork *network, ProcessSnapshot *snapshot)
+{
+	beginUpdate(network);
+	if (! readSockets(network))
+	{
+		// the sockets that were read keep their counters, the next update starts from them
+		network->timestamp = 0.0;
+		return (0);
+	}
+	resolveOwners(network, snapshot);
+	finishUpdate(network, snapshot);
+	return (1);
+}
+
+
+#if PROCESS_NETWORK_BENCHMARK
+
+/*
+ *  Updates a table of 50,000 sockets owned by 5,000 processes, with 1% of the sockets closed and
+ *  replaced by new ones every update, checks the rates given to the processes, then updates from
+ *  the live host twice, the first time finding the owner of every socket. Prints one
+ *  tab-separated line for each:
+ *
+ *	table	sockets	updates	ns_per_update	ns_per_socket	fd_lookups
+ */
+
+#define BENCHMARK_PROCESSES 5000
+#define BENCHMARK_SOCKETS 50000
+
+static double benchmarkNow(void)
+{
+	return (SampleClockNow() * 1.0e9);
+}
+
+int main(int argc, char *argv[])
+{
+	static unsigned int inodes[BENCHMARK_SOCKETS];
+	ProcessNetwork network;
+	ProcessSnapshot *snapshot = ProcessSnapshotCreate();
+	const int updates = 200;
+	unsigned int nextInode = 1;
+	unsigned int seed = 1;
+	double start, elapsed = 0.0, sentRate = 0.0;
+	int update, i;
+
+	memset(&network, 0, sizeof(network));
+	network.descriptor = -1;
+	snapshot->entries = calloc(BENCHMARK_PROCESSES, sizeof(ProcessSnapshotEntry));
+	snapshot->capacity = BENCHMARK_PROCESSES;
+	snapshot->count = BENCHMARK_PROCESSES;
+	for (i = 0; i < BENCHMARK_PROCESSES; i++)
+	{
+		snapshot->entries[i].pid = i + 1;
+	}
+	for (i = 0; i < BENCHMARK_SOCKETS; i++)
+	{
+		inodes[i] = nextInode++;
+	}
+
+	for (update = 0; update < updates; update++)
+	{
+		// a few sockets are closed and new ones opened, in the order the kernel hands out inodes
+		for (i = 0; i < BENCHMARK_SOCKETS / 100; i++)
+		{
+			seed = (seed * 1103515245) + 12345;
+			inodes[(seed >> 8) % BENCHMARK_SOCKETS] = nextInode++;
+		}
+		for (i = 0; i < BENCHMARK_PROCESSES; i++)
+		{
+			snapshot->entries[i].sentRate = 0.0;
+			snapshot->entries[i].receivedRate = 0.0;
+		}
+
+		start = benchmarkNow();
+		beginUpdate(&network);
+		for (i = 0; i < BENCHMARK_SOCKETS; i++)
+		{
+			// every socket sends 1,000 bytes and receives 2,000 bytes per update
+			if (! enterSocket(&network, inodes[i], 0, (unsigned long long) update * 1000, (unsigned long long) update * 2000))
+			{
+				fprintf(stderr, "out of memory\n");
+				return (1);
+			}
+		}
+		// the owners that resolveOwners() would find in /proc/[pid]/fd
+		for (i = 0; i < network.capacity && network.unknownCount > 0; i++)
+		{
+			if (network.sockets[i].inode != 0 && network.sockets[i].owner == 0)
+			{
+				network.sockets[i].owner = 1 + (network.sockets[i].inode % BENCHMARK_PROCESSES);
+				network.unknownCount -= 1;
+			}
+		}
+		finishUpdate(&network, snapshot);
+		elapsed += benchmarkNow() - start;
+
+		if (network.count != BENCHMARK_SOCKETS)
+		{
+			fprintf(stderr, "update %d has %d sockets, expected %d\n", update, network.count, BENCHMARK_SOCKETS);
+			return (1);
+		}
+	}
+
+	// the sockets that were already open in the previous update sent 1,000 bytes each
+	for (i = 0; i < BENCHMARK_PROCESSES; i++)
+	{
+		sentRate += snapshot->entries[i].sentRate;
+		if (snapshot->entries[i].receivedRate != 2.0 * snapshot->entries[i].sentRate)
+		{
+			fprintf(stderr, "process %d received %.0f and sent %.0f bytes per second\n", i + 1, snapshot->entries[i].receivedRate, snapshot->entries[i].sentRate);
+			return (1);
+		}
+	}
+	if (sentRate <= 0.0)
+	{
+		fprintf(stderr, "no process sent anything\n");
+		return (1);
+	}
+
+	printf("table\tsockets\tupdates\tns_per_update\tns_per_socket\tfd_lookups\n");
+	printf("generated\t%d\t%d\t%.0f\t%.1f\t%d\n", BENCHMARK_SOCKETS, updates, elapsed / updates, elapsed / updates / BENCHMARK_SOCKETS, 0);
+	free(network.sockets);
+	free(snapshot->entries);
+	snapshot->entries = NULL;
+	snapshot->count = 0;
+	snapshot->capacity = 0;
+
+	// the live host, the second update only looks for the owners of the sockets opened in between
+	{
+		ProcessNetwork *live = ProcessNetworkCreate();
+		const char *names[2] = { "cold", "warm" };
+
+		if (live == NULL || ! ProcessSnapshotRefresh(snapshot))
+		{
+			fprintf(stderr, "the sockets of this host can't be read\n");
+			return (0);
+		}
+		for (update = 0; update < 2; update++)
+		{
+			start = benchmarkNow();
+			if (! ProcessNetworkUpdate(live, snapshot))
+			{
+				fprintf(stderr, "the sockets of this host can't be read\n");
+				break;
+			}
+			elapsed = benchmarkNow() - start;
+			printf("%s\t%d\t1\t%.0f\t%.1f\t%d\n", names[update], live->count, elapsed, (live->count > 0 ? elapsed / live->count : 0.0), live->lookupCount);
+		}
+		ProcessNetworkDispose(live);
+	}
+
+	ProcessSnapshotDispose(snapshot);
+	return (0);
+}
+
+#endif
@@ -0,0 +1,466 @@
+/*
+ *  ProcessRegistry.c
+ *
+ *  List of the running processes kept up to date by process events.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ProcessRegistry.h"
+
+#if defined(__APPLE__)
+#include <sys/event.h>
+#include <sys/time.h>
+#elif defined(__linux__)
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#endif
+
+#define PROCESS_REGISTRY_EVENTS 64
+
+
+static int comparePids(const void *value1, const void *value2)
+{
+	pid_t pid1 = *(const pid_t *) value1;
+	pid_t pid2 = *(const pid_t *) value2;
+
+	return ((pid1 > pid2) - (pid1 < pid2));
+}
+
+
+// returns the index of pid, or the index where it would be inserted
+static int searchPids(const pid_t *pids, int count, pid_t pid, int *found)
+{
+	int low = 0, high = count;
+
+	while (low < high)
+	{
+		int middle = (low + high) / 2;
+
+		if (pids[middle] < pid)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	*found = (low < count && pids[low] == pid);
+	return (low);
+}
+
+
+static int reservePids(pid_t **pids, int *capacity, int count)
+{
+	pid_t *grown;
+	int newCapacity;
+
+	if (count <= *capacity)
+	{
+		return (1);
+	}
+	newCapacity = (*capacity > 0 ? *capacity : 256);
+	while (newCapacity < count)
+	{
+		newCapacity *= 2;
+	}
+	grown = realloc(*pids, newCapacity * sizeof(pid_t));
+	if (grown == NULL)
+	{
+		return (0);
+	}
+	*pids = grown;
+	*capacity = newCapacity;
+	return (1);
+}
+
+
+#if defined(__APPLE__) || defined(__linux__)
+
+static void addPid(ProcessRegistry *registry, pid_t pid)
+{
+	int found;
+	int index = searchPids(registry->pids, registry->count, pid, &found);
+
+	if (found)
+	{
+		return;
+	}
+	if (! reservePids(&registry->pids, &registry->capacity, registry->count + 1))
+	{
+		// the process would be missing, so the list can't be trusted
+		registry->complete = 0;
+		return;
+	}
+	memmove(&registry->pids[index + 1], &registry->pids[index], (registry->count - index) * sizeof(pid_t));
+	registry->pids[index] = pid;
+	registry->count += 1;
+}
+
+
+static void removePid(ProcessRegistry *registry, pid_t pid)
+{
+	int found;
+	int index = searchPids(registry->pids, registry->count, pid, &found);
+
+	if (found)
+	{
+		memmove(&registry->pids[index], &registry->pids[index + 1], (registry->count - index - 1) * sizeof(pid_t));
+		registry->count -= 1;
+	}
+}
+
+
+static void addChanged(ProcessRegistry *registry, pid_t pid)
+{
+	if (! reservePids(&registry->changed, &registry->changedCapacity, registry->changedCount + 1))
+	{
+		registry->complete = 0;
+		return;
+	}
+	registry->changed[registry->changedCount++] = pid;
+}
+
+#endif
+
+
+#if defined(__APPLE__)
+
+static int openEvents(void)
+{
+	return (kqueue());
+}
+
+
+// watches a process that wasn't in the list, returns 0 if this user can't watch it
+static int watchProcess(ProcessRegistry *registry, pid_t pid)
+{
+	struct kevent change;
+
+	EV_SET(&change, pid, EVFILT_PROC, EV_ADD | EV_CLEAR, NOTE_EXIT | NOTE_FORK | NOTE_EXEC, 0, NULL);
+	return (kevent(registry->descriptor, &change, 1, NULL, 0, NULL) == 0);
+}
+
+
+static void readEvents(ProcessRegistry *registry)
+{
+	struct kevent events[PROCESS_REGISTRY_EVENTS];
+	struct timespec timeout = { 0, 0 };
+	int count, i;
+
+	do
+	{
+		count = kevent(registry->descriptor, NULL, 0, events, PROCESS_REGISTRY_EVENTS, &timeout);
+		if (count < 0)
+		{
+			if (errno != EINTR)
+			{
+				registry->complete = 0;
+			}
+			return;
+		}
+		for (i = 0; i < count; i++)
+		{
+			pid_t pid = (pid_t) events[i].ident;
+
+			if (events[i].flags & EV_ERROR)
+			{
+				registry->complete = 0;
+				continue;
+			}
+			if (events[i].fflags & NOTE_FORK)
+			{
+				// the pid of the child isn't told, only a full listing will find it
+				registry->complete = 0;
+			}
+			if (events[i].fflags & NOTE_EXEC)
+			{
+				addChanged(registry, pid);
+			}
+			if (events[i].fflags & NOTE_EXIT)
+			{
+				// the kernel drops the filter of a process that exits
+				removePid(registry, pid);
+			}
+		}
+	}
+	while (count == PROCESS_REGISTRY_EVENTS);
+}
+
+#elif defined(__linux__)
+
+static int openEvents(void)
+{
+	struct sockaddr_nl address;
+	struct __attribute__((packed))
+	{
+		struct nlmsghdr header;
+		struct cn_msg message;
+		enum proc_cn_mcast_op operation;
+	} request;
+	int descriptor;
+
+	// the kernel only sends process events to listeners with CAP_NET_ADMIN
+	if (geteuid() != 0)
+	{
+		return (-1);
+	}
+	descriptor = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+	if (descriptor < 0)
+	{
+		return (-1);
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.nl_family = AF_NETLINK;
+	address.nl_groups = CN_IDX_PROC;
+	if (bind(descriptor, (struct sockaddr *) &address, sizeof(address)) < 0)
+	{
+		close(descriptor);
+		return (-1);
+	}
+
+	memset(&request, 0, sizeof(request));
+	request.header.nlmsg_len = sizeof(request);
+	request.header.nlmsg_type = NLMSG_DONE;
+	request.message.id.idx = CN_IDX_PROC;
+	request.message.id.val = CN_VAL_PROC;
+	request.message.len = sizeof(enum proc_cn_mcast_op);
+	request.operation = PROC_CN_MCAST_LISTEN;
+	if (send(descriptor, &request, sizeof(request), 0) < 0)
+	{
+		close(descriptor);
+		return (-1);
+	}
+	return (descriptor);
+}
+
+
+static void readEvents(ProcessRegistry *registry)
+{
+	char buffer[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+	for (;;)
+	{
+		struct nlmsghdr *header;
+		ssize_t length = recv(registry->descriptor, buffer, sizeof(buffer), 0);
+
+		if (length < 0)
+		{
+			if (errno == ENOBUFS)
+			{
+				// the socket overflowed and events were lost
+				registry->complete = 0;
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			{
+				registry->complete = 0;
+			}
+			return;
+		}
+
+		for (header = (struct nlmsghdr *) buffer; NLMSG_OK(header, (unsigned int) length); header = NLMSG_NEXT(header, length))
+		{
+			struct cn_msg *message = (struct cn_msg *) NLMSG_DATA(header);
+			struct proc_event event;
+
+			if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_OVERRUN)
+			{
+				registry->complete = 0;
+				continue;
+			}
+			if (message->len < offsetof(struct proc_event, event_data))
+			{
+				continue;
+			}
+			// the event follows the 20 bytes of the message header, it is copied out to be aligned
+			memset(&event, 0, sizeof(event));
+			memcpy(&event, message->data, (message->len < sizeof(event) ? message->len : sizeof(event)));
+			switch (event.what)
+			{
+			case PROC_EVENT_FORK:
+				// threads are reported as forks too
+				if (event.event_data.fork.child_pid == event.event_data.fork.child_tgid)
+				{
+					addPid(registry, event.event_data.fork.child_tgid);
+				}
+				break;
+			case PROC_EVENT_EXEC:
+				addPid(registry, event.event_data.exec.process_tgid);
+				addChanged(registry, event.event_data.exec.process_tgid);
+				break;
+			case PROC_EVENT_EXIT:
+				if (event.event_data.exit.process_pid == event.event_data.exit.process_tgid)
+				{
+					removePid(registry, event.event_data.exit.process_tgid);
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+#else
+
+static int openEvents(void)
+{
+	return (-1);
+}
+
+static void readEvents(ProcessRegistry *registry)
+{
+	(void) registry;
+}
+
+#endif
+
+
+ProcessRegistry *ProcessRegistryCreate(void)
+{
+	ProcessRegistry *registry;
+	int descriptor = openEvents();
+
+	if (descriptor < 0)
+	{
+		return (NULL);
+	}
+	registry = calloc(1, sizeof(ProcessRegistry));
+	if (registry == NULL)
+	{
+		close(descriptor);
+		return (NULL);
+	}
+	registry->descriptor = descriptor;
+#if defined(__APPLE__)
+	registry->listingInterval = PROCESS_REGISTRY_LISTING_INTERVAL;
+#endif
+	return (registry);
+}
+
+
+void ProcessRegistryDispose(ProcessRegistry *registry)
+{
+	if (registry == NULL)
+	{
+		return;
+	}
+	if (registry->descriptor >= 0)
+	{
+		close(registry->descriptor);
+	}
+	free(registry->pids);
+	free(registry->changed);
+	free(registry->unwatched);
+	free(registry);
+}
+
+
+void ProcessRegistryReset(ProcessRegistry *registry, const pid_t *pids, int count)
+{
+	pid_t *lastPids = registry->pids;
+#if defined(__APPLE__)
+	pid_t *lastUnwatched = registry->unwatched;
+	int lastCount = registry->count;
+	int lastUnwatchedCount = registry->unwatchedCount;
+	int i;
+#endif
+
+	registry->complete = 0;
+	registry->updates = 0;
+	registry->pids = NULL;
+	registry->count = 0;
+	registry->capacity = 0;
+	if (registry->descriptor < 0 || ! reservePids(&registry->pids, &registry->capacity, count))
+	{
+		free(lastPids);
+		return;
+	}
+	memcpy(registry->pids, pids, count * sizeof(pid_t));
+	registry->count = count;
+	qsort(registry->pids, count, sizeof(pid_t), comparePids);
+
+#if defined(__APPLE__)
+	// only the processes that weren't watched in the last list need a filter, the others still have theirs
+	registry->unwatched = NULL;
+	registry->unwatchedCount = 0;
+	registry->unwatchedCapacity = 0;
+	for (i = 0; i < count; i++)
+	{
+		pid_t pid = registry->pids[i];
+		int listed, unwatched;
+
+		searchPids(lastPids, lastCount, pid, &listed);
+		searchPids(lastUnwatched, lastUnwatchedCount, pid, &unwatched);
+		if (listed && ! unwatched)
+		{
+			continue;
+		}
+		// a process of another user, or one that has already exited -- the caller checks it on each refresh
+		if (! watchProcess(registry, pid))
+		{
+			if (! reservePids(&registry->unwatched, &registry->unwatchedCapacity, registry->unwatchedCount + 1))
+			{
+				free(lastUnwatched);
+				free(lastPids);
+				return;
+			}
+			registry->unwatched[registry->unwatchedCount++] = pid;
+		}
+	}
+	free(lastUnwatched);
+#endif
+	free(lastPids);
+
+	registry->complete = 1;
+}
+
+
+int ProcessRegistryUpdate(ProcessRegistry *registry)
+{
+	registry->changedCount = 0;
+	if (registry->descriptor < 0)
+	{
+		return (0);
+	}
+
+	readEvents(registry);
+	if (registry->changedCount > 1)
+	{
+		qsort(registry->changed, registry->changedCount, sizeof(pid_t), comparePids);
+	}
+	registry->updates += 1;
+	if (registry->listingInterval > 0 && registry->updates >= registry->listingInterval)
+	{
+		// time to catch up with the processes no event told about
+		return (0);
+	}
+	return (registry->complete);
+}
+
+
+int ProcessRegistryChanged(const ProcessRegistry *registry, pid_t pid)
+{
+	int found;
+
+	searchPids(registry->changed, registry->changedCount, pid, &found);
+	return (found);
+}
+
+
+int ProcessRegistryWatched(const ProcessRegistry *registry, pid_t pid)
+{
+	int found;
+
+	searchPids(registry->unwatched, registry->unwatchedCount, pid, &found);
+	return (! found);
+}
@@ -0,0 +1,71 @@
+/*
+ *  ProcessRegistry.h
+ *
+ *  List of the running processes kept up to date by process events, so the process snapshot
+ *  doesn't have to list every process on every refresh.
+ *
+ *  After a full listing, ProcessRegistryReset() hands the registry the pids that were found.
+ *  From then on ProcessRegistryUpdate() reads the pending fork, exec and exit events without
+ *  blocking and applies them to its list. It returns 0 when the list can't be trusted and the
+ *  caller must list the processes again.
+ *
+ *  On Linux the events come from the proc connector of netlink, which reports the pid of every
+ *  new process, so only a lost event asks for a full listing. The connector only sends events to
+ *  root, so for other users there is no registry.
+ *
+ *  On Mac OS X each listed process gets a kqueue EVFILT_PROC filter for NOTE_EXIT, NOTE_EXEC and
+ *  NOTE_FORK. The filter can't be added to the processes of other users unless iPulse runs as
+ *  root, and NOTE_FORK only tells which process forked, not the pid of the child. So exits and
+ *  execs of the watched processes are applied as they come, a fork of one of them asks for a
+ *  full listing, and a full listing every PROCESS_REGISTRY_LISTING_INTERVAL updates catches up
+ *  with the processes that can't be watched and their children. ProcessRegistryWatched() tells
+ *  the caller which processes it has to check itself in between.
+ *
+ *  On both, the pids that exec'ed are reported so their commands can be read again. Where there
+ *  is no registry, the snapshot lists the processes on every refresh.
+ */
+
+#ifndef PROCESS_REGISTRY_H
+#define PROCESS_REGISTRY_H
+
+#include <sys/types.h>
+
+#define PROCESS_REGISTRY_LISTING_INTERVAL 5	// updates between the full listings on Mac OS X
+
+typedef struct processregistry
+{
+	int descriptor;		// netlink socket or kqueue
+	int complete;		// non-zero when no event was lost since the last full listing
+	int listingInterval;	// updates between the full listings, 0 when only a lost event asks for one
+	int updates;		// updates since the last full listing
+
+	int count;
+	int capacity;
+	pid_t *pids;		// sorted
+
+	int changedCount;
+	int changedCapacity;
+	pid_t *changed;		// processes that exec'ed in the last update, sorted
+
+	int unwatchedCount;
+	int unwatchedCapacity;
+	pid_t *unwatched;	// processes listed without a filter, their exit isn't reported, sorted
+} ProcessRegistry;
+
+// returns NULL when process events aren't available, on Linux when not running as root
+ProcessRegistry *ProcessRegistryCreate(void);
+void ProcessRegistryDispose(ProcessRegistry *registry);
+
+// replaces the list with the processes of a full listing
+void ProcessRegistryReset(ProcessRegistry *registry, const pid_t *pids, int count);
+
+// applies the pending events, returns 0 if the processes must be listed again
+int ProcessRegistryUpdate(ProcessRegistry *registry);
+
+// returns non-zero if the process exec'ed in the last update
+int ProcessRegistryChanged(const ProcessRegistry *registry, pid_t pid);
+
+// returns non-zero if the exit and exec of the process are reported, always on Linux
+int ProcessRegistryWatched(const ProcessRegistry *registry, pid_t pid);
+
+#endif
@@ -0,0 +1,1396 @@
+/*
+ *  ProcessSnapshot.c
+ *
+ *  Flat table of every process, gathered in one pass and shared by the info panels.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ProcessSnapshot.h"
+#include "ProcessRegistry.h"
+#include "ProcessColumns.h"
+#include "SampleClock.h"
+#include "WorkPool.h"
+
+#if defined(__APPLE__)
+#include <libproc.h>
+#include <mach/mach.h>
+#include <mach/mach_vm.h>
+#include <mach/shared_region.h>
+#include <sys/sysctl.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+
+static int reserveEntries(ProcessSnapshotEntry **entries, int *capacity, int count)
+{
+	ProcessSnapshotEntry *grown;
+	int newCapacity;
+
+	if (count <= *capacity)
+	{
+		return (1);
+	}
+	newCapacity = (*capacity > 0 ? *capacity : 256);
+	while (newCapacity < count)
+	{
+		newCapacity *= 2;
+	}
+	grown = realloc(*entries, newCapacity * sizeof(ProcessSnapshotEntry));
+	if (grown == NULL)
+	{
+		return (0);
+	}
+	*entries = grown;
+	*capacity = newCapacity;
+	return (1);
+}
+
+
+// adds an entry with only the pid set, returns NULL if memory could not be allocated
+static ProcessSnapshotEntry *addEntry(ProcessSnapshot *snapshot, pid_t pid)
+{
+	ProcessSnapshotEntry *entry;
+
+	if (! reserveEntries(&snapshot->entries, &snapshot->capacity, snapshot->count + 1))
+	{
+		return (NULL);
+	}
+	entry = &snapshot->entries[snapshot->count++];
+	memset(entry, 0, sizeof(ProcessSnapshotEntry));
+	entry->pid = pid;
+	entry->lastTime = -1.0;
+	entry->lastAverage = -1.0;
+	return (entry);
+}
+
+
+static int compareEntries(const void *value1, const void *value2)
+{
+	const ProcessSnapshotEntry *entry1 = (const ProcessSnapshotEntry *) value1;
+	const ProcessSnapshotEntry *entry2 = (const ProcessSnapshotEntry *) value2;
+
+	return ((entry1->pid > entry2->pid) - (entry1->pid < entry2->pid));
+}
+
+
+#if defined(__APPLE__)
+
+static void releaseTask(ProcessSnapshotEntry *entry)
+{
+	if (entry->task != 0)
+	{
+		mach_port_deallocate(mach_task_self(), entry->task);
+		entry->task = 0;
+	}
+}
+
+
+static int eventsAvailable(void)
+{
+	return (1);
+}
+
+
+static void setIdentity(ProcessSnapshotEntry *entry, const struct kinfo_proc *process)
+{
+	entry->parentPid = process->kp_eproc.e_ppid;
+	entry->uid = process->kp_eproc.e_ucred.cr_uid;
+	entry->startTime = process->kp_proc.p_starttime.tv_sec + (process->kp_proc.p_starttime.tv_usec / 1.0e6);
+	strncpy(entry->command, process->kp_proc.p_comm, PROCESS_SNAPSHOT_COMMAND_SIZE - 1);
+	entry->state = (process->kp_proc.p_stat == SZOMB ? ProcessSnapshotStateZombie : ProcessSnapshotStateUnknown);
+}
+
+
+static int listProcesses(ProcessSnapshot *snapshot)
+{
+	int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_ALL, 0 };
+	struct kinfo_proc *processes = NULL;
+	size_t length = 0;
+	int count, i;
+
+	// processes can start between the two calls, so leave some room
+	if (sysctl(mib, 4, NULL, &length, NULL, 0) < 0)
+	{
+		return (0);
+	}
+	length += length / 8;
+	processes = malloc(length);
+	if (processes == NULL)
+	{
+		return (0);
+	}
+	if (sysctl(mib, 4, processes, &length, NULL, 0) < 0)
+	{
+		free(processes);
+		return (0);
+	}
+
+	count = length / sizeof(struct kinfo_proc);
+	for (i = 0; i < count; i++)
+	{
+		ProcessSnapshotEntry *entry = addEntry(snapshot, processes[i].kp_proc.p_pid);
+
+		if (entry == NULL)
+		{
+			free(processes);
+			return (0);
+		}
+		setIdentity(entry, &processes[i]);
+	}
+
+	free(processes);
+	return (1);
+}
+
+
+// lists the processes of the registry, the identity of the watched ones that didn't exec is kept from the previous snapshot
+static int listRegisteredProcesses(ProcessSnapshot *snapshot, const ProcessRegistry *registry)
+{
+	int lastIndex = 0;
+	int i;
+
+	for (i = 0; i < registry->count; i++)
+	{
+		pid_t pid = registry->pids[i];
+		ProcessSnapshotEntry *entry = addEntry(snapshot, pid);
+
+		if (entry == NULL)
+		{
+			return (0);
+		}
+
+		// both lists are sorted by pid
+		while (lastIndex < snapshot->lastCount && snapshot->lastEntries[lastIndex].pid < pid)
+		{
+			lastIndex++;
+		}
+		if (lastIndex < snapshot->lastCount && snapshot->lastEntries[lastIndex].pid == pid
+				&& ProcessRegistryWatched(registry, pid) && ! ProcessRegistryChanged(registry, pid))
+		{
+			const ProcessSnapshotEntry *last = &snapshot->lastEntries[lastIndex];
+
+			entry->parentPid = last->parentPid;
+			entry->uid = last->uid;
+			entry->startTime = last->startTime;
+			memcpy(entry->command, last->command, PROCESS_SNAPSHOT_COMMAND_SIZE);
+		}
+		else
+		{
+			// a process that exec'ed, or one whose exit wouldn't be reported, is looked up again
+			int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, pid };
+			struct kinfo_proc process;
+			size_t length = sizeof(process);
+
+			if (sysctl(mib, 4, &process, &length, NULL, 0) < 0 || length == 0)
+			{
+				// exited since the event was read, or since the last full listing
+				snapshot->count -= 1;
+				continue;
+			}
+			setIdentity(entry, &process);
+		}
+	}
+	return (1);
+}
+
+
+// reads everything the panels use from the task, returns 0 if the task can't be inspected
+static int readTask(ProcessSnapshotEntry *entry)
+{
+	struct task_basic_info basicInfo;
+	struct task_thread_times_info timesInfo;
+	task_events_info_data_t eventsInfo;
+	struct proc_taskinfo taskInfo;
+	mach_msg_type_number_t infoCount;
+	double userTime, systemTime;
+	int taskInfoKnown;
+
+	// three fixed calls on the task port, the threads are never walked
+	infoCount = TASK_BASIC_INFO_COUNT;
+	if (task_info(entry->task, TASK_BASIC_INFO, (task_info_t)&basicInfo, &infoCount) != KERN_SUCCESS)
+	{
+		return (0);
+	}
+	infoCount = TASK_THREAD_TIMES_INFO_COUNT;
+	if (task_info(entry->task, TASK_THREAD_TIMES_INFO, (task_info_t)&timesInfo, &infoCount) != KERN_SUCCESS)
+	{
+		return (0);
+	}
+	infoCount = TASK_EVENTS_INFO_COUNT;
+	if (task_info(entry->task, TASK_EVENTS_INFO, (task_info_t)&eventsInfo, &infoCount) != KERN_SUCCESS)
+	{
+		return (0);
+	}
+	// the counts of threads and running threads and the base priority, which only the process's owner
+	// and root can read: a process of another user reached through the task port goes without them
+	taskInfoKnown = (proc_pidinfo(entry->pid, PROC_PIDTASKINFO, 0, &taskInfo, sizeof(taskInfo)) == sizeof(taskInfo));
+
+	// the basic info holds the time of the threads that have exited, the thread times the live ones
+	userTime = basicInfo.user_time.seconds + (basicInfo.user_time.microseconds / 1.0e6)
+			+ timesInfo.user_time.seconds + (timesInfo.user_time.microseconds / 1.0e6);
+	systemTime = basicInfo.system_time.seconds + (basicInfo.system_time.microseconds / 1.0e6)
+			+ timesInfo.system_time.seconds + (timesInfo.system_time.microseconds / 1.0e6);
+
+	// the state is collapsed from the count of running threads, ProcessThreads has the state of each one;
+	// without the count, a process is runnable when it ran since the previous snapshot
+	if (entry->state != ProcessSnapshotStateZombie)
+	{
+		if (basicInfo.suspend_count > 0)
+		{
+			entry->state = ProcessSnapshotStateSuspended;
+		}
+		else if (taskInfoKnown)
+		{
+			entry->state = (taskInfo.pti_numrunning > 0 ? ProcessSnapshotStateRunnable : ProcessSnapshotStateSleeping);
+		}
+		else if (entry->lastTime < 0.0)
+		{
+			entry->state = ProcessSnapshotStateUnknown;
+		}
+		else if (userTime + systemTime > entry->lastTime)
+		{
+			entry->state = ProcessSnapshotStateRunnable;
+		}
+		else
+		{
+			entry->state = ProcessSnapshotStateSleeping;
+		}
+	}
+	entry->threadCount = (taskInfoKnown ? taskInfo.pti_threadnum : 0);
+	entry->priority = (taskInfoKnown ? taskInfo.pti_priority : 0);
+	entry->userTime = userTime;
+	entry->systemTime = systemTime;
+	entry->residentSize = basicInfo.resident_size;
+	entry->virtualSize = basicInfo.virtual_size;
+	entry->faults = eventsInfo.faults;
+	entry->pageins = eventsInfo.pageins;
+	return (1);
+}
+
+
+// reads the bytes the process read and wrote to storage, returns 0 if it isn't allowed
+static int readIO(ProcessSnapshotEntry *entry)
+{
+	struct rusage_info_v2 usage;
+
+	// proc_pid_rusage() is weak linked, it is missing before Mac OS X 10.9 and the disk I/O stays unknown
+	if (proc_pid_rusage == NULL)
+	{
+		return (0);
+	}
+	if (proc_pid_rusage(entry->pid, RUSAGE_INFO_V2, (rusage_info_t *)&usage) != 0)
+	{
+		return (0);
+	}
+	entry->readBytes = usage.ri_diskio_bytesread;
+	entry->writtenBytes = usage.ri_diskio_byteswritten;
+	return (1);
+}
+
+
+// reads the tasks of a range of entries, on any of the workers
+static void inspectRange(void *context, int first, int last)
+{
+	ProcessSnapshot *snapshot = (ProcessSnapshot *) context;
+	int i;
+
+	for (i = first; i < last; i++)
+	{
+		ProcessSnapshotEntry *entry = &snapshot->entries[i];
+
+		if (entry->state == ProcessSnapshotStateZombie)
+		{
+			releaseTask(entry);
+			continue;
+		}
+
+		if (entry->task == 0 && task_for_pid(mach_task_self(), entry->pid, &entry->task) != KERN_SUCCESS)
+		{
+			entry->task = 0;
+			continue;
+		}
+		entry->known = readTask(entry);
+		if (! entry->known)
+		{
+			// the pid may have been reused since the port was taken, try a new port once
+			releaseTask(entry);
+			if (task_for_pid(mach_task_self(), entry->pid, &entry->task) == KERN_SUCCESS)
+			{
+				entry->known = readTask(entry);
+			}
+			else
+			{
+				entry->task = 0;
+			}
+		}
+		if (entry->known)
+		{
+			entry->ioKnown = readIO(entry);
+		}
+	}
+}
+
+
+static void inspectProcesses(ProcessSnapshot *snapshot)
+{
+	WorkPoolRun(snapshot->pool, snapshot->count, PROCESS_SNAPSHOT_CHUNK_SIZE, inspectRange, snapshot);
+}
+
+
+// finds the region of the frameworks shared by every process of the same architecture
+static int sharedRegion(pid_t pid, mach_vm_address_t *base, mach_vm_size_t *size)
+{
+	int mib[CTL_MAXNAME];
+	size_t mibLength = CTL_MAXNAME;
+	cpu_type_t cpuType = 0;
+	size_t length = sizeof(cpuType);
+
+	if (sysctlnametomib("sysctl.proc_cputype", mib, &mibLength) < 0)
+	{
+		return (0);
+	}
+	mib[mibLength] = pid;
+	if (sysctl(mib, mibLength + 1, &cpuType, &length, NULL, 0) < 0)
+	{
+		return (0);
+	}
+	switch (cpuType)
+	{
+	case CPU_TYPE_POWERPC:
+		*base = SHARED_REGION_BASE_PPC;
+		*size = SHARED_REGION_SIZE_PPC;
+		return (1);
+	case CPU_TYPE_POWERPC64:
+		*base = SHARED_REGION_BASE_PPC64;
+		*size = SHARED_REGION_SIZE_PPC64;
+		return (1);
+	case CPU_TYPE_I386:
+		*base = SHARED_REGION_BASE_I386;
+		*size = SHARED_REGION_SIZE_I386;
+		return (1);
+	case CPU_TYPE_X86_64:
+		*base = SHARED_REGION_BASE_X86_64;
+		*size = SHARED_REGION_SIZE_X86_64;
+		return (1);
+	default:
+		return (0);
+	}
+}
+
+
+// walks every VM region of the task for the memory only it maps, like libtop, returns 0 if the task can't be inspected
+static int readDetail(const ProcessSnapshot *snapshot, const ProcessSnapshotEntry *entry, unsigned long long *privateSize)
+{
+	mach_vm_address_t address, sharedBase = 0;
+	mach_vm_size_t size, sharedSize = 0;
+	vm_size_t pageSize;
+	unsigned long long total = 0;
+	int regionCount = 0;
+
+	if (entry->task == 0)
+	{
+		return (0);
+	}
+	host_page_size(mach_host_self(), &pageSize);
+	sharedRegion(entry->pid, &sharedBase, &sharedSize);
+
+	for (address = MACH_VM_MIN_ADDRESS; ; address += size)
+	{
+		vm_region_top_info_data_t info;
+		mach_msg_type_number_t count = VM_REGION_TOP_INFO_COUNT;
+		mach_port_t objectName;
+
+		if (mach_vm_region(entry->task, &address, &size, VM_REGION_TOP_INFO, (vm_region_info_t)&info, &count, &objectName) != KERN_SUCCESS)
+		{
+			// past the last region
+			break;
+		}
+		regionCount++;
+
+		// the shared frameworks only count where this process has its own copy
+		if (sharedSize > 0 && address >= sharedBase && address <= sharedBase + sharedSize && info.share_mode != SM_PRIVATE)
+		{
+			continue;
+		}
+		if (info.share_mode == SM_COW && info.ref_count == 1)
+		{
+			info.share_mode = SM_PRIVATE;
+		}
+		if (info.share_mode == SM_PRIVATE)
+		{
+			total += size;
+		}
+		else if (info.share_mode == SM_COW)
+		{
+			total += (unsigned long long) info.private_pages_resident * pageSize;
+		}
+	}
+
+	if (regionCount == 0)
+	{
+		return (0);
+	}
+	*privateSize = total;
+	return (1);
+}
+
+#elif defined(__linux__)
+
+// the benchmark points this at a generated tree
+static const char *procRoot = "/proc";
+
+static void releaseTask(ProcessSnapshotEntry *entry)
+{
+	(void) entry;
+}
+
+
+// reads /proc/[pid]/stat into an entry, returns 0 if the process is gone
+static int readStat(ProcessSnapshotEntry *entry, const char *path, double ticksPerSecond, double pageSize)
+{
+	int file;
+	struct stat status;
+	char buffer[1024];
+	const char *start, *end;
+	char state;
+	int parentPid;
+	unsigned long long minorFaults, majorFaults, userTicks, systemTicks, startTicks, virtualSize;
+	int priority;
+	long threadCount;
+	long long residentPages;
+	ssize_t length;
+
+	// one open, fstat and read per process, the owner of the file is the effective user of the process
+	file = open(path, O_RDONLY);
+	if (file < 0)
+	{
+		return (0);
+	}
+	if (fstat(file, &status) == 0)
+	{
+		entry->uid = status.st_uid;
+	}
+	length = read(file, buffer, sizeof(buffer) - 1);
+	close(file);
+	if (length <= 0)
+	{
+		return (0);
+	}
+	buffer[length] = '\0';
+
+	// the command is in parentheses and may contain anything, including parentheses
+	start = strchr(buffer, '(');
+	end = strrchr(buffer, ')');
+	if (start == NULL || end == NULL || end < start)
+	{
+		return (0);
+	}
+	length = end - start - 1;
+	if (length > PROCESS_SNAPSHOT_COMMAND_SIZE - 1)
+	{
+		length = PROCESS_SNAPSHOT_COMMAND_SIZE - 1;
+	}
+	memcpy(entry->command, start + 1, length);
+	entry->command[length] = '\0';
+
+	if (sscanf(end + 2, "%c %d %*d %*d %*d %*d %*u %llu %*u %llu %*u %llu %llu %*d %*d %d %*d %ld %*d %llu %llu %lld",
+			&state, &parentPid, &minorFaults, &majorFaults, &userTicks, &systemTicks, &priority, &threadCount, &startTicks, &virtualSize, &residentPages) != 11)
+	{
+		return (0);
+	}
+
+	switch (state)
+	{
+	case 'R':
+		entry->state = ProcessSnapshotStateRunnable;
+		break;
+	case 'D':
+		entry->state = ProcessSnapshotStateUninterruptible;
+		break;
+	case 'S':
+		entry->state = ProcessSnapshotStateSleeping;
+		break;
+	case 'I':
+		entry->state = ProcessSnapshotStateIdle;
+		break;
+	case 'T':
+	case 't':
+		entry->state = ProcessSnapshotStateSuspended;
+		break;
+	case 'Z':
+		entry->state = ProcessSnapshotStateZombie;
+		break;
+	case 'X':
+		entry->state = ProcessSnapshotStateExited;
+		break;
+	default:
+		entry->state = ProcessSnapshotStateUnknown;
+		break;
+	}
+	entry->parentPid = parentPid;
+	entry->threadCount = (int) threadCount;
+	entry->priority = priority;
+	entry->userTime = (double) userTicks / ticksPerSecond;
+	entry->systemTime = (double) systemTicks / ticksPerSecond;
+	entry->startTime = (double) startTicks / ticksPerSecond;
+	entry->residentSize = (unsigned long long) ((double) residentPages * pageSize);
+	entry->virtualSize = virtualSize;
+	entry->faults = minorFaults + majorFaults;
+	entry->pageins = majorFaults;
+	return (1);
+}
+
+
+// reads the bytes the process read and wrote to storage from /proc/[pid]/io, returns 0 if it isn't allowed
+static int readIO(ProcessSnapshotEntry *entry, const char *path)
+{
+	char buffer[512];
+	const char *line;
+	int file;
+	int fields = 0;
+	ssize_t length;
+
+	// only the owner and root can read it
+	file = open(path, O_RDONLY);
+	if (file < 0)
+	{
+		return (0);
+	}
+	length = read(file, buffer, sizeof(buffer) - 1);
+	close(file);
+	if (length <= 0)
+	{
+		return (0);
+	}
+	buffer[length] = '\0';
+
+	for (line = buffer; line != NULL && *line != '\0'; line = strchr(line, '\n'), line = (line ? line + 1 : NULL))
+	{
+		if (sscanf(line, "read_bytes: %llu", &entry->readBytes) == 1 || sscanf(line, "write_bytes: %llu", &entry->writtenBytes) == 1)
+		{
+			fields++;
+		}
+	}
+	return (fields == 2);
+}
+
+
+// the registry follows the live processes, not a generated tree
+static int eventsAvailable(void)
+{
+	return (strcmp(procRoot, "/proc") == 0);
+}
+
+
+typedef struct readcontext
+{
+	ProcessSnapshot *snapshot;
+	double ticksPerSecond;
+	double pageSize;
+} ReadContext;
+
+
+// reads the statistics of a range of entries, on any of the workers
+static void readRange(void *context, int first, int last)
+{
+	const ReadContext *read = (const ReadContext *) context;
+	char path[512];
+	int i;
+
+	for (i = first; i < last; i++)
+	{
+		ProcessSnapshotEntry *entry = &read->snapshot->entries[i];
+
+		snprintf(path, sizeof(path), "%s/%ld/stat", procRoot, (long) entry->pid);
+		entry->known = readStat(entry, path, read->ticksPerSecond, read->pageSize);
+		if (entry->known)
+		{
+			snprintf(path, sizeof(path), "%s/%ld/io", procRoot, (long) entry->pid);
+			entry->ioKnown = readIO(entry, path);
+		}
+	}
+}
+
+
+// reads the statistics of the listed processes and removes the ones that exited since they were listed
+static void readProcesses(ProcessSnapshot *snapshot)
+{
+	ReadContext context;
+	int count = 0;
+	int i;
+
+	context.snapshot = snapshot;
+	context.ticksPerSecond = (double) sysconf(_SC_CLK_TCK);
+	context.pageSize = (double) sysconf(_SC_PAGESIZE);
+	WorkPoolRun(snapshot->pool, snapshot->count, PROCESS_SNAPSHOT_CHUNK_SIZE, readRange, &context);
+
+	for (i = 0; i < snapshot->count; i++)
+	{
+		if (snapshot->entries[i].known)
+		{
+			if (count != i)
+			{
+				snapshot->entries[count] = snapshot->entries[i];
+			}
+			count++;
+		}
+	}
+	snapshot->count = count;
+}
+
+
+static int listProcesses(ProcessSnapshot *snapshot)
+{
+	DIR *directory;
+	struct dirent *item;
+
+	directory = opendir(procRoot);
+	if (directory == NULL)
+	{
+		return (0);
+	}
+
+	while ((item = readdir(directory)) != NULL)
+	{
+		char *end;
+		long pid = strtol(item->d_name, &end, 10);
+
+		if (*end != '\0' || end == item->d_name || pid <= 0)
+		{
+			continue;
+		}
+
+		if (addEntry(snapshot, (pid_t) pid) == NULL)
+		{
+			closedir(directory);
+			return (0);
+		}
+	}
+
+	closedir(directory);
+	readProcesses(snapshot);
+	return (1);
+}
+
+
+// lists the processes of the registry instead of reading the directory, every stat file is still read
+static int listRegisteredProcesses(ProcessSnapshot *snapshot, const ProcessRegistry *registry)
+{
+	int i;
+
+	for (i = 0; i < registry->count; i++)
+	{
+		if (addEntry(snapshot, registry->pids[i]) == NULL)
+		{
+			return (0);
+		}
+	}
+	readProcesses(snapshot);
+	return (1);
+}
+
+
+static void inspectProcesses(ProcessSnapshot *snapshot)
+{
+	// everything was read with the list
+	(void) snapshot;
+}
+
+
+// reads the totals of /proc/[pid]/smaps_rollup, which the kernel keeps without listing the mappings
+static int readDetail(const ProcessSnapshot *snapshot, const ProcessSnapshotEntry *entry, unsigned long long *privateSize)
+{
+	char path[512];
+	char buffer[2048];
+	const char *line;
+	unsigned long long total = 0;
+	int fields = 0;
+	int file;
+	ssize_t length;
+
+	(void) snapshot;
+	snprintf(path, sizeof(path), "%s/%ld/smaps_rollup", procRoot, (long) entry->pid);
+	file = open(path, O_RDONLY);
+	if (file < 0)
+	{
+		// before Linux 4.14, or a process of another user
+		return (0);
+	}
+	length = read(file, buffer, sizeof(buffer) - 1);
+	close(file);
+	if (length <= 0)
+	{
+		return (0);
+	}
+	buffer[length] = '\0';
+
+	for (line = buffer; line != NULL && *line != '\0'; line = strchr(line, '\n'), line = (line ? line + 1 : NULL))
+	{
+		unsigned long long kilobytes;
+
+		if (sscanf(line, "Private_Clean: %llu", &kilobytes) == 1
+				|| sscanf(line, "Private_Dirty: %llu", &kilobytes) == 1
+				|| sscanf(line, "Swap: %llu", &kilobytes) == 1)
+		{
+			total += kilobytes * 1024;
+			fields++;
+		}
+	}
+
+	if (fields == 0)
+	{
+		return (0);
+	}
+	*privateSize = total;
+	return (1);
+}
+
+#else
+
+static int eventsAvailable(void)
+{
+	return (0);
+}
+
+static void releaseTask(ProcessSnapshotEntry *entry)
+{
+	(void) entry;
+}
+
+static int listProcesses(ProcessSnapshot *snapshot)
+{
+	(void) snapshot;
+	return (0);
+}
+
+static int listRegisteredProcesses(ProcessSnapshot *snapshot, const ProcessRegistry *registry)
+{
+	(void) snapshot;
+	(void) registry;
+	return (0);
+}
+
+static void inspectProcesses(ProcessSnapshot *snapshot)
+{
+	(void) snapshot;
+}
+
+static int readDetail(const ProcessSnapshot *snapshot, const ProcessSnapshotEntry *entry, unsigned long long *privateSize)
+{
+	(void) snapshot;
+	(void) entry;
+	(void) privateSize;
+	return (0);
+}
+
+#endif
+
+
+// sets the CPU usage and disk I/O rates from the changes since the previous snapshot, and the moving average of the usage
+static void updateEntryUsage(ProcessSnapshotEntry *entry, double elapsed, double weight)
+{
+	entry->cpuUsage = 0.0;
+	entry->averageUsage = 0.0;
+	entry->readRate = 0.0;
+	entry->writeRate = 0.0;
+	if (! entry->known || elapsed <= 0.0)
+	{
+		return;
+	}
+	if (entry->ioKnown && entry->lastIoKnown)
+	{
+		// the counters only go down when the pid was reused between the snapshots
+		if (entry->readBytes >= entry->lastReadBytes)
+		{
+			entry->readRate = (double) (entry->readBytes - entry->lastReadBytes) / elapsed;
+		}
+		if (entry->writtenBytes >= entry->lastWrittenBytes)
+		{
+			entry->writeRate = (double) (entry->writtenBytes - entry->lastWrittenBytes) / elapsed;
+		}
+	}
+	if (entry->lastTime < 0.0)
+	{
+		return;
+	}
+	entry->cpuUsage = ((entry->userTime + entry->systemTime) - entry->lastTime) / elapsed;
+	if (entry->cpuUsage < 0.0)
+	{
+		entry->cpuUsage = 0.0;
+	}
+	if (entry->lastAverage < 0.0)
+	{
+		// the first measured interval starts the average
+		entry->averageUsage = entry->cpuUsage;
+	}
+	else
+	{
+		entry->averageUsage = entry->lastAverage + (weight * (entry->cpuUsage - entry->lastAverage));
+	}
+}
+
+
+// computes the rates of every entry and copies it to the columns, the last pass over the entries in a refresh
+static void updateUsage(ProcessSnapshot *snapshot)
+{
+	double weight = 0.0;
+	int columnsKnown;
+	int i;
+
+	// the weight of a new value grows with the interval, so the average decays at the same rate whatever the refresh rate
+	if (snapshot->elapsed > 0.0)
+	{
+		weight = 1.0 - exp(-snapshot->elapsed / PROCESS_SNAPSHOT_AVERAGE_PERIOD);
+	}
+	columnsKnown = ProcessColumnsReset(snapshot->columns, snapshot->count);
+	for (i = 0; i < snapshot->count; i++)
+	{
+		ProcessSnapshotEntry *entry = &snapshot->entries[i];
+
+		updateEntryUsage(entry, snapshot->elapsed, weight);
+		if (columnsKnown)
+		{
+			columnsKnown = ProcessColumnsAppend(snapshot->columns, entry);
+		}
+	}
+	if (! columnsKnown)
+	{
+		// without memory for the columns, the scans find no process rather than the wrong ones
+		snapshot->columns->count = 0;
+	}
+}
+
+
+// carries the task ports, CPU times, disk I/O and memory detail of processes that were in the previous snapshot, and releases the rest
+static void carryOver(ProcessSnapshot *snapshot)
+{
+	int index = 0, lastIndex = 0;
+
+	while (lastIndex < snapshot->lastCount)
+	{
+		ProcessSnapshotEntry *last = &snapshot->lastEntries[lastIndex];
+
+		while (index < snapshot->count && snapshot->entries[index].pid < last->pid)
+		{
+			index++;
+		}
+		if (index < snapshot->count && snapshot->entries[index].pid == last->pid)
+		{
+			ProcessSnapshotEntry *entry = &snapshot->entries[index];
+
+			entry->task = last->task;
+			if (last->detailInterval > 0.0 && last->startTime == entry->startTime)
+			{
+				entry->detailKnown = last->detailKnown;
+				entry->privateSize = last->privateSize;
+				entry->detailResidentSize = last->detailResidentSize;
+				entry->detailTime = last->detailTime;
+				entry->detailInterval = last->detailInterval;
+			}
+			if (last->known)
+			{
+				entry->lastTime = last->userTime + last->systemTime;
+				if (last->lastTime >= 0.0)
+				{
+					entry->lastAverage = last->averageUsage;
+				}
+			}
+			if (last->ioKnown)
+			{
+				entry->lastIoKnown = 1;
+				entry->lastReadBytes = last->readBytes;
+				entry->lastWrittenBytes = last->writtenBytes;
+			}
+		}
+		else
+		{
+			releaseTask(last);
+		}
+		last->task = 0;
+		lastIndex++;
+	}
+	snapshot->lastCount = 0;
+}
+
+
+// hands the registry the processes of a full listing, so the next refreshes can follow the events instead
+static void registerProcesses(ProcessSnapshot *snapshot)
+{
+	pid_t *pids = malloc((snapshot->count > 0 ? snapshot->count : 1) * sizeof(pid_t));
+	int i;
+
+	if (pids == NULL)
+	{
+		return;
+	}
+	for (i = 0; i < snapshot->count; i++)
+	{
+		pids[i] = snapshot->entries[i].pid;
+	}
+	ProcessRegistryReset(snapshot->registry, pids, snapshot->count);
+	free(pids);
+}
+
+
+ProcessSnapshot *ProcessSnapshotCreate(void)
+{
+	ProcessSnapshot *snapshot = calloc(1, sizeof(ProcessSnapshot));
+
+	if (snapshot != NULL)
+	{
+		snapshot->columns = ProcessColumnsCreate();
+		if (snapshot->columns == NULL)
+		{
+			free(snapshot);
+			return (NULL);
+		}
+	}
+	if (snapshot != NULL && eventsAvailable())
+	{
+		// without events, every refresh lists the processes
+		snapshot->registry = ProcessRegistryCreate();
+	}
+	if (snapshot != NULL)
+	{
+		// without the threads, the processes are read on the calling thread
+		ProcessSnapshotSetWorkerCount(snapshot, WorkPoolDefaultWorkerCount(PROCESS_SNAPSHOT_MAX_WORKERS));
+	}
+	return (snapshot);
+}
+
+
+void ProcessSnapshotDispose(ProcessSnapshot *snapshot)
+{
+	int i;
+
+	if (snapshot == NULL)
+	{
+		return;
+	}
+	for (i = 0; i < snapshot->count; i++)
+	{
+		releaseTask(&snapshot->entries[i]);
+	}
+	ProcessRegistryDispose(snapshot->registry);
+	WorkPoolDispose(snapshot->pool);
+	ProcessColumnsDispose(snapshot->columns);
+	free(snapshot->entries);
+	free(snapshot->lastEntries);
+	free(snapshot);
+}
+
+
+int ProcessSnapshotRefresh(ProcessSnapshot *snapshot)
+{
+	ProcessSnapshotEntry *entries;
+	double now = SampleClockNow();
+	int capacity;
+	int listed = 0;
+
+	// the current table becomes the previous one and its memory is reused for the new one
+	entries = snapshot->lastEntries;
+	capacity = snapshot->lastCapacity;
+	snapshot->lastEntries = snapshot->entries;
+	snapshot->lastCapacity = snapshot->capacity;
+	snapshot->lastCount = snapshot->count;
+	snapshot->entries = entries;
+	snapshot->capacity = capacity;
+	snapshot->count = 0;
+
+	if (snapshot->registry != NULL && ProcessRegistryUpdate(snapshot->registry))
+	{
+		listed = listRegisteredProcesses(snapshot, snapshot->registry);
+	}
+	if (! listed)
+	{
+		snapshot->count = 0;
+		listed = listProcesses(snapshot);
+		if (listed && snapshot->registry != NULL)
+		{
+			registerProcesses(snapshot);
+		}
+	}
+	if (! listed)
+	{
+		// keep the previous table so the panels still have something to show
+		entries = snapshot->entries;
+		capacity = snapshot->capacity;
+		snapshot->entries = snapshot->lastEntries;
+		snapshot->capacity = snapshot->lastCapacity;
+		snapshot->count = snapshot->lastCount;
+		snapshot->lastEntries = entries;
+		snapshot->lastCapacity = capacity;
+		snapshot->lastCount = 0;
+		return (0);
+	}
+
+	qsort(snapshot->entries, snapshot->count, sizeof(ProcessSnapshotEntry), compareEntries);
+	carryOver(snapshot);
+
+	snapshot->elapsed = (snapshot->timestamp > 0.0 ? now - snapshot->timestamp : 0.0);
+	snapshot->timestamp = now;
+	inspectProcesses(snapshot);
+	updateUsage(snapshot);
+
+	return (1);
+}
+
+
+int ProcessSnapshotSetWorkerCount(ProcessSnapshot *snapshot, int workerCount)
+{
+	WorkPoolDispose(snapshot->pool);
+	snapshot->pool = NULL;
+	if (workerCount > 1)
+	{
+		snapshot->pool = WorkPoolCreate(workerCount);
+		if (snapshot->pool == NULL)
+		{
+			return (0);
+		}
+	}
+	return (1);
+}
+
+
+const ProcessSnapshotEntry *ProcessSnapshotFind(const ProcessSnapshot *snapshot, pid_t pid)
+{
+	int low = 0, high = snapshot->count - 1;
+
+	while (low <= high)
+	{
+		int middle = (low + high) / 2;
+		pid_t middlePid = snapshot->entries[middle].pid;
+
+		if (middlePid == pid)
+		{
+			return (&snapshot->entries[middle]);
+		}
+		if (middlePid < pid)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+	return (NULL);
+}
+
+
+int ProcessSnapshotUpdateDetail(ProcessSnapshot *snapshot, int index)
+{
+	ProcessSnapshotEntry *entry = &snapshot->entries[index];
+	unsigned long long privateSize;
+
+	if (entry->detailInterval > 0.0)
+	{
+		double residentChange = fabs((double) entry->residentSize - (double) entry->detailResidentSize);
+		int residentChanged = (entry->detailKnown && residentChange > PROCESS_SNAPSHOT_DETAIL_RESIDENT_CHANGE * (double) entry->detailResidentSize);
+
+		if (snapshot->timestamp - entry->detailTime < entry->detailInterval && ! residentChanged)
+		{
+			return (0);
+		}
+	}
+	if (! readDetail(snapshot, entry, &privateSize))
+	{
+		// tried again on the usual schedule, not on every refresh
+		entry->detailTime = snapshot->timestamp;
+		entry->detailInterval = PROCESS_SNAPSHOT_DETAIL_MAX_INTERVAL;
+		return (0);
+	}
+
+	// a process whose memory is changing is measured often, a stable one less and less, a page or two is noise
+	if (! entry->detailKnown || fabs((double) privateSize - (double) entry->privateSize) > (double) entry->privateSize / 64.0)
+	{
+		entry->detailInterval = PROCESS_SNAPSHOT_DETAIL_MIN_INTERVAL;
+	}
+	else if (entry->detailInterval < PROCESS_SNAPSHOT_DETAIL_MAX_INTERVAL)
+	{
+		entry->detailInterval *= 2.0;
+	}
+	entry->detailKnown = 1;
+	entry->privateSize = privateSize;
+	entry->detailResidentSize = entry->residentSize;
+	entry->detailTime = snapshot->timestamp;
+	return (1);
+}
+
+
+#if PROCESS_SNAPSHOT_BENCHMARK
+
+/*
+ *  Generates a /proc with 5,000 processes, checks that a refresh finds them all with their
+ *  statistics, then prints one tab-separated line per tree, and for the live one without the
+ *  process events:
+ *
+ *	tree	processes	refreshes	ns_per_refresh	ns_per_process	ns_per_find
+ *
+ *  then measures the memory detail of every generated process on each of the refreshes, which
+ *  only reads the smaps_rollup files the first time, since they are not due again:
+ *
+ *	detail	processes	refreshes	reads	ns_per_read
+ *
+ *  then refreshes the generated tree with more and more workers, checking that every process is
+ *  found each time:
+ *
+ *	workers	processes	refreshes	ns_per_refresh	speedup
+ */
+
+#include <sys/stat.h>
+
+#define BENCHMARK_PROCESSES 5000
+
+static double benchmarkNow(void)
+{
+	return (SampleClockNow() * 1.0e9);
+}
+
+static int generateTree(const char *root)
+{
+	char path[512];
+	FILE *file;
+	int pid;
+
+	if (mkdir(root, 0755) != 0)
+	{
+		return (0);
+	}
+	for (pid = 1; pid <= BENCHMARK_PROCESSES; pid++)
+	{
+		snprintf(path, sizeof(path), "%s/%d", root, pid);
+		if (mkdir(path, 0755) != 0)
+		{
+			return (0);
+		}
+		snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+		file = fopen(path, "w");
+		if (file == NULL)
+		{
+			return (0);
+		}
+		// the command of every tenth process has a space and a parenthesis, like "(sd-pam)" and "tmux: server"
+		fprintf(file, "%d (%s%d) S %d %d %d 0 -1 4194560 %d 0 %d 0 %d %d 0 0 20 0 %d 0 %d %d %d 0 0 0 0 0 0 0 0 0 0 0 0 0 17 0 0 0 0 0 0\n",
+				pid, (pid % 10 == 0 ? "worker (" : "daemon"), pid, (pid > 1 ? 1 + (pid % 100) : 0), pid, pid,
+				pid * 3, pid % 7, pid * 11, pid * 5, 1 + (pid % 8), pid * 13, pid * 4096, pid % 977);
+		fclose(file);
+		snprintf(path, sizeof(path), "%s/%d/io", root, pid);
+		file = fopen(path, "w");
+		if (file == NULL)
+		{
+			return (0);
+		}
+		fprintf(file, "rchar: %d\nwchar: %d\nsyscr: %d\nsyscw: %d\nread_bytes: %d\nwrite_bytes: %d\ncancelled_write_bytes: 0\n",
+				pid * 40, pid * 20, pid, pid / 2, pid * 8, pid * 4);
+		fclose(file);
+		snprintf(path, sizeof(path), "%s/%d/smaps_rollup", root, pid);
+		file = fopen(path, "w");
+		if (file == NULL)
+		{
+			return (0);
+		}
+		fprintf(file, "55d0c0a3e000-7ffd4a5fe000 ---p 00000000 00:00 0                          [rollup]\n"
+				"Rss:              %6d kB\nPss:              %6d kB\nShared_Clean:     %6d kB\nShared_Dirty:            0 kB\n"
+				"Private_Clean:    %6d kB\nPrivate_Dirty:    %6d kB\nReferenced:       %6d kB\nAnonymous:        %6d kB\n"
+				"Swap:             %6d kB\nSwapPss:          %6d kB\nLocked:                  0 kB\n",
+				(pid % 977) * 4, pid, pid % 500, pid % 100, pid, (pid % 977) * 4, pid, pid % 3, pid % 3);
+		fclose(file);
+	}
+	return (1);
+}
+
+static void removeTree(const char *root)
+{
+	char path[512];
+	int pid;
+
+	for (pid = 1; pid <= BENCHMARK_PROCESSES; pid++)
+	{
+		snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s/%d/io", root, pid);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s/%d/smaps_rollup", root, pid);
+		unlink(path);
+		snprintf(path, sizeof(path), "%s/%d", root, pid);
+		rmdir(path);
+	}
+	rmdir(root);
+}
+
+static void benchmarkTree(const char *name, int refreshes, int events)
+{
+	ProcessSnapshot *snapshot = ProcessSnapshotCreate();
+	double start, refreshTime, findTime;
+	long found = 0;
+	int i;
+
+	if (! events)
+	{
+		ProcessRegistryDispose(snapshot->registry);
+		snapshot->registry = NULL;
+	}
+
+	ProcessSnapshotRefresh(snapshot);
+	start = benchmarkNow();
+	for (i = 0; i < refreshes; i++)
+	{
+		ProcessSnapshotRefresh(snapshot);
+	}
+	refreshTime = (benchmarkNow() - start) / refreshes;
+
+	start = benchmarkNow();
+	for (i = 0; i < 1000000; i++)
+	{
+		found += (ProcessSnapshotFind(snapshot, 1 + (i % BENCHMARK_PROCESSES)) != NULL);
+	}
+	findTime = (benchmarkNow() - start) / 1000000;
+
+	printf("%s\t%d\t%d\t%.0f\t%.1f\t%.1f\n", name, snapshot->count, refreshes, refreshTime,
+			(snapshot->count > 0 ? refreshTime / snapshot->count : 0.0), findTime);
+	fprintf(stderr, "%s found %ld\n", name, found);
+	ProcessSnapshotDispose(snapshot);
+}
+
+// returns 0 if the detail of the generated processes is wrong
+static int benchmarkDetail(int refreshes)
+{
+	ProcessSnapshot *snapshot = ProcessSnapshotCreate();
+	const ProcessSnapshotEntry *entry;
+	double start, detailTime = 0.0;
+	long reads = 0;
+	int refresh, i;
+
+	ProcessRegistryDispose(snapshot->registry);
+	snapshot->registry = NULL;
+	for (refresh = 0; refresh < refreshes; refresh++)
+	{
+		ProcessSnapshotRefresh(snapshot);
+		start = benchmarkNow();
+		for (i = 0; i < snapshot->count; i++)
+		{
+			reads += ProcessSnapshotUpdateDetail(snapshot, i);
+		}
+		detailTime += benchmarkNow() - start;
+	}
+
+	// private clean and dirty plus swap, in kilobytes
+	entry = ProcessSnapshotFind(snapshot, 4000);
+	if (entry == NULL || ! entry->detailKnown || entry->privateSize != (4000 % 100 + 4000 + 4000 % 3) * 1024ULL || reads != BENCHMARK_PROCESSES)
+	{
+		fprintf(stderr, "the detail of process 4000 was not read correctly, %ld reads\n", reads);
+		ProcessSnapshotDispose(snapshot);
+		return (0);
+	}
+
+	printf("detail\tprocesses\trefreshes\treads\tns_per_read\n");
+	printf("generated\t%d\t%d\t%ld\t%.1f\n", snapshot->count, refreshes, reads, detailTime / reads);
+	ProcessSnapshotDispose(snapshot);
+	return (1);
+}
+
+// returns 0 if a refresh with more workers doesn't find every process
+static int benchmarkWorkers(int refreshes)
+{
+	double serialTime = 0.0;
+	int workerCount;
+
+	printf("workers\tprocesses\trefreshes\tns_per_refresh\tspeedup\n");
+	for (workerCount = 1; workerCount <= WORK_POOL_MAX_WORKERS; workerCount *= 2)
+	{
+		ProcessSnapshot *snapshot = ProcessSnapshotCreate();
+		double start, refreshTime;
+		int i;
+
+		ProcessRegistryDispose(snapshot->registry);
+		snapshot->registry = NULL;
+		if (! ProcessSnapshotSetWorkerCount(snapshot, workerCount))
+		{
+			fprintf(stderr, "failed to start %d workers\n", workerCount);
+			ProcessSnapshotDispose(snapshot);
+			return (0);
+		}
+
+		ProcessSnapshotRefresh(snapshot);
+		start = benchmarkNow();
+		for (i = 0; i < refreshes; i++)
+		{
+			ProcessSnapshotRefresh(snapshot);
+		}
+		refreshTime = (benchmarkNow() - start) / refreshes;
+		if (snapshot->count != BENCHMARK_PROCESSES || ProcessSnapshotFind(snapshot, 4000)->faults != 4000 * 3 + 4000 % 7)
+		{
+			fprintf(stderr, "found %d of %d processes with %d workers\n", snapshot->count, BENCHMARK_PROCESSES, workerCount);
+			ProcessSnapshotDispose(snapshot);
+			return (0);
+		}
+		if (workerCount == 1)
+		{
+			serialTime = refreshTime;
+		}
+		printf("%d\t%d\t%d\t%.0f\t%.2f\n", workerCount, snapshot->count, refreshes, refreshTime, serialTime / refreshTime);
+		ProcessSnapshotDispose(snapshot);
+	}
+	return (1);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *root = (argc > 1 ? argv[1] : "process_snapshot_benchmark.proc");
+	ProcessSnapshot *snapshot;
+	const ProcessSnapshotEntry *entry;
+
+	if (! generateTree(root))
+	{
+		fprintf(stderr, "failed to generate %s\n", root);
+		removeTree(root);
+		return (1);
+	}
+
+	procRoot = root;
+	snapshot = ProcessSnapshotCreate();
+	if (! ProcessSnapshotRefresh(snapshot) || snapshot->count != BENCHMARK_PROCESSES)
+	{
+		fprintf(stderr, "found %d of %d processes\n", snapshot->count, BENCHMARK_PROCESSES);
+		removeTree(root);
+		return (1);
+	}
+	entry = ProcessSnapshotFind(snapshot, 4000);
+	if (entry == NULL || strcmp(entry->command, "worker (4000") != 0 || entry->parentPid != 1 || entry->faults != 4000 * 3 + 4000 % 7
+			|| entry->pageins != 4000 % 7 || entry->threadCount != 1 || entry->priority != 20 || entry->virtualSize != 4000 * 4096ULL
+			|| ! entry->ioKnown || entry->readBytes != 4000 * 8 || entry->writtenBytes != 4000 * 4
+			|| snapshot->columns->count != snapshot->count || snapshot->columns->pids[entry - snapshot->entries] != 4000
+			|| snapshot->columns->faults[entry - snapshot->entries] != entry->faults)
+	{
+		fprintf(stderr, "process 4000 was not read correctly\n");
+		removeTree(root);
+		return (1);
+	}
+	ProcessSnapshotDispose(snapshot);
+
+	printf("tree\tprocesses\trefreshes\tns_per_refresh\tns_per_process\tns_per_find\n");
+	benchmarkTree("generated", 20, 0);
+	if (! benchmarkDetail(20) || ! benchmarkWorkers(20))
+	{
+		removeTree(root);
+		return (1);
+	}
+	removeTree(root);
+
+	// with process events when they are available (as root on Linux), and listing every time
+	procRoot = "/proc";
+	benchmarkTree("live", 20, 1);
+	benchmarkTree("listing", 20, 0);
+	return (0);
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ *  ProcessSnapshot.h
+ *
+ *  Flat table of every process, gathered in one pass and shared by the info panels.
+ *
+ *  A refresh lists the processes and reads each one's statistics with as few calls as the host
+ *  allows: on Mac OS X one sysctl(KERN_PROC_ALL) for the list, then TASK_BASIC_INFO,
+ *  TASK_THREAD_TIMES_INFO and TASK_EVENTS_INFO on the task port of each process, whatever its
+ *  number of threads; on Linux one read of /proc/[pid]/stat per process. The panels then rank and
+ *  look up entries in the table instead of asking AGProcess, where every accessor makes its own
+ *  Mach calls.
+ *
+ *  On Mac OS X, proc_pidinfo(PROC_PIDTASKINFO) adds the thread count, the base priority and the
+ *  count of running threads the state is collapsed from, but only for the processes of the same
+ *  user unless iPulse runs as root. The processes of other users that the task port still reaches
+ *  keep their statistics, with a thread count and priority of 0 and a state told from whether they
+ *  ran since the previous snapshot. ProcessThreads has the state and priority of each thread.
+ *
+ *  A ProcessRegistry follows the processes that start and exit, and a refresh only lists them
+ *  all again when the registry can't account for them. On Linux that needs root, and without
+ *  it every refresh lists the processes. On Mac OS X the registry asks for a full listing after
+ *  a fork and every few refreshes, to find the processes of other users it can't watch.
+ *
+ *  The last pass of a refresh, which computes the CPU usage, also copies the statistics the
+ *  panels rank and count the processes by into ProcessColumns, while each entry is in the cache.
+ *
+ *  The processes are listed on the calling thread, then read by a WorkPool: the entries are split
+ *  into one range of pids per worker, and a worker that is done with its range takes chunks of
+ *  PROCESS_SNAPSHOT_CHUNK_SIZE from the others. Every worker only writes the entries it claimed,
+ *  so the results are in the table without a lock or a merge. The processes that exited before
+ *  they were read are then removed in one pass.
+ *
+ *  Entries are sorted by pid. Task ports are kept from one snapshot to the next, since
+ *  task_for_pid() is slow, and released when the process is gone.
+ *
+ *  The CPU usage is the change in cumulative user and system time between two snapshots divided
+ *  by the time between them, so it covers the whole interval instead of the instant the threads
+ *  were looked at. The average is an exponentially weighted moving average with a time constant
+ *  of PROCESS_SNAPSHOT_AVERAGE_PERIOD seconds. Both are 0 until a process has been seen twice.
+ *
+ *  The disk I/O of each process is read in the same pass, with proc_pid_rusage() on Mac OS X and
+ *  /proc/[pid]/io on Linux, and turned into byte rates like the CPU time. Both only report the
+ *  processes of the current user unless it is root.
+ *
+ *  The memory only a process maps takes much more work to measure: every VM region of the task
+ *  on Mac OS X, hundreds of calls for a browser, and /proc/[pid]/smaps_rollup on Linux. It is
+ *  measured only for the processes a panel shows, by ProcessSnapshotUpdateDetail(), and kept
+ *  in the snapshot until it is due again. A process whose private size changed is measured
+ *  again after PROCESS_SNAPSHOT_DETAIL_MIN_INTERVAL seconds, and the interval doubles each time
+ *  the size stays the same, up to PROCESS_SNAPSHOT_DETAIL_MAX_INTERVAL. A change of the resident
+ *  size by more than PROCESS_SNAPSHOT_DETAIL_RESIDENT_CHANGE measures it right away.
+ *
+ *  The benchmark refreshes a generated /proc of 5,000 processes and the live one, measures
+ *  the memory detail of the generated processes on their schedule, and refreshes the generated
+ *  /proc with 1 to 8 workers:
+ *
+ *	cc -O2 -DPROCESS_SNAPSHOT_BENCHMARK -o process_snapshot_benchmark ProcessSnapshot.c ProcessRegistry.c WorkPool.c ProcessColumns.c TopRank.c -lm -lpthread
+ */
+
+#ifndef PROCESS_SNAPSHOT_H
+#define PROCESS_SNAPSHOT_H
+
+#include <sys/types.h>
+
+#define PROCESS_SNAPSHOT_COMMAND_SIZE 32
+#define PROCESS_SNAPSHOT_AVERAGE_PERIOD 5.0	// seconds
+#define PROCESS_SNAPSHOT_DETAIL_MIN_INTERVAL 2.0	// seconds
+#define PROCESS_SNAPSHOT_DETAIL_MAX_INTERVAL 64.0
+#define PROCESS_SNAPSHOT_DETAIL_RESIDENT_CHANGE 0.125	// fraction of the resident size
+#define PROCESS_SNAPSHOT_MAX_WORKERS 4	// threads reading the processes, fewer with fewer processors
+#define PROCESS_SNAPSHOT_CHUNK_SIZE 32	// processes claimed at a time by a worker
+
+// in the same order as AGProcessState
+typedef enum
+{
+	ProcessSnapshotStateUnknown = 0,
+	ProcessSnapshotStateRunnable,
+	ProcessSnapshotStateUninterruptible,
+	ProcessSnapshotStateSleeping,
+	ProcessSnapshotStateIdle,
+	ProcessSnapshotStateSuspended,
+	ProcessSnapshotStateZombie,
+	ProcessSnapshotStateExited
+} ProcessSnapshotState;
+
+typedef struct processsnapshotentry
+{
+	pid_t pid;
+	pid_t parentPid;
+	uid_t uid;
+	double startTime;		// seconds, since 1970 on Mac OS X and since boot on Linux, tells a reused pid apart
+	char command[PROCESS_SNAPSHOT_COMMAND_SIZE];	// short name from the kernel, AGProcess has the annotated one
+
+	// the statistics are only set when known is non-zero, a process can't be inspected without permission
+	int known;
+	ProcessSnapshotState state;
+	int threadCount;		// 0 when unknown
+	int priority;			// base priority on Mac OS X, 31 by default, 0 when unknown; /proc priority on Linux, 20 + nice
+	double userTime;		// seconds
+	double systemTime;
+	double cpuUsage;		// fraction of one processor since the previous snapshot
+	double averageUsage;		// moving average of cpuUsage
+	unsigned long long residentSize;	// bytes
+	unsigned long long virtualSize;
+	unsigned long long faults;
+	unsigned long long pageins;
+
+	int ioKnown;			// non-zero when the disk I/O could be read, never before Mac OS X 10.9
+	unsigned long long readBytes;	// read from storage since the process started
+	unsigned long long writtenBytes;
+	double readRate;		// bytes per second since the previous snapshot
+	double writeRate;
+
+	// set by ProcessNetworkUpdate(), bytes per second of the process's TCP sockets, only on Linux
+	double sentRate;
+	double receivedRate;
+
+	// measured by ProcessSnapshotUpdateDetail(), and kept from one snapshot to the next
+	int detailKnown;
+	unsigned long long privateSize;	// bytes, virtual on Mac OS X, resident and swapped on Linux
+	unsigned long long detailResidentSize;	// residentSize when the detail was measured
+	double detailTime;		// timestamp of the snapshot it was measured in
+	double detailInterval;		// seconds until it is measured again
+
+	double lastTime;		// user and system time in the previous snapshot, negative for a new process
+	double lastAverage;		// averageUsage in the previous snapshot, negative when there wasn't one
+	int lastIoKnown;		// non-zero when the previous snapshot had the disk I/O
+	unsigned long long lastReadBytes;
+	unsigned long long lastWrittenBytes;
+	unsigned int task;		// Mach task port kept between snapshots, 0 when there isn't one
+} ProcessSnapshotEntry;
+
+typedef struct processsnapshot
+{
+	int count;
+	int capacity;
+	ProcessSnapshotEntry *entries;	// sorted by pid
+
+	int lastCount;
+	int lastCapacity;
+	ProcessSnapshotEntry *lastEntries;	// the previous snapshot, for task ports and CPU time deltas
+
+	double timestamp;		// SampleClockNow() of the last refresh
+	double elapsed;			// seconds since the refresh before it
+
+	struct processregistry *registry;	// NULL when process events aren't available
+	struct workpool *pool;		// NULL to read the processes on the calling thread
+	struct processcolumns *columns;	// the entries as dense arrays, for the scans over every process
+} ProcessSnapshot;
+
+ProcessSnapshot *ProcessSnapshotCreate(void);
+void ProcessSnapshotDispose(ProcessSnapshot *snapshot);
+
+// replaces the table with the processes running now, returns 0 if they can't be listed
+int ProcessSnapshotRefresh(ProcessSnapshot *snapshot);
+
+// reads the processes with workerCount threads from the next refresh on, returns 0 if they can't be started
+int ProcessSnapshotSetWorkerCount(ProcessSnapshot *snapshot, int workerCount);
+
+// returns the entry for pid, or NULL if it wasn't running at the last refresh
+const ProcessSnapshotEntry *ProcessSnapshotFind(const ProcessSnapshot *snapshot, pid_t pid);
+
+// measures the private size of an entry if it is due, returns non-zero if it was measured now
+int ProcessSnapshotUpdateDetail(ProcessSnapshot *snapshot, int index);
+
+#endif
@@ -0,0 +1,300 @@
+/*
+ *  ProcessTable.c
+ *
+ *  Per-process counters kept from one snapshot to the next, to show how much they changed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ProcessTable.h"
+
+
+static unsigned int hashProcess(pid_t pid, double startTime)
+{
+	unsigned long long start = (unsigned long long) (startTime * 1000.0);
+	unsigned int hash = (unsigned int) pid * 2654435761u;
+
+	hash ^= (unsigned int) (start ^ (start >> 32)) * 2246822519u;
+	return (hash ^ (hash >> 15));
+}
+
+
+// returns the slot holding the process, or the empty slot where it would go
+static int findSlot(const ProcessTable *table, pid_t pid, double startTime)
+{
+	unsigned int mask = table->capacity - 1;
+	unsigned int index = hashProcess(pid, startTime) & mask;
+
+	while (table->slots[index].generation != 0)
+	{
+		if (table->slots[index].pid == pid && table->slots[index].startTime == startTime)
+		{
+			break;
+		}
+		index = (index + 1) & mask;
+	}
+	return (index);
+}
+
+
+static int growTable(ProcessTable *table)
+{
+	ProcessTableEntry *oldSlots = table->slots;
+	int oldCapacity = table->capacity;
+	int newCapacity = (oldCapacity > 0 ? oldCapacity * 2 : 256);
+	int i;
+
+	table->slots = calloc(newCapacity, sizeof(ProcessTableEntry));
+	if (table->slots == NULL)
+	{
+		table->slots = oldSlots;
+		return (0);
+	}
+	table->capacity = newCapacity;
+	for (i = 0; i < oldCapacity; i++)
+	{
+		if (oldSlots[i].generation != 0)
+		{
+			table->slots[findSlot(table, oldSlots[i].pid, oldSlots[i].startTime)] = oldSlots[i];
+		}
+	}
+	free(oldSlots);
+	return (1);
+}
+
+
+// empties a slot and moves back the entries after it that would no longer be found
+static void removeSlot(ProcessTable *table, int index)
+{
+	unsigned int mask = table->capacity - 1;
+	unsigned int hole = index;
+	unsigned int next = index;
+
+	for (;;)
+	{
+		unsigned int home;
+
+		next = (next + 1) & mask;
+		if (table->slots[next].generation == 0)
+		{
+			break;
+		}
+		home = hashProcess(table->slots[next].pid, table->slots[next].startTime) & mask;
+
+		// the entry stays when its home slot is after the hole, cyclically up to where it is
+		if (hole <= next ? (hole < home && home <= next) : (hole < home || home <= next))
+		{
+			continue;
+		}
+		table->slots[hole] = table->slots[next];
+		hole = next;
+	}
+	table->slots[hole].generation = 0;
+	table->count -= 1;
+}
+
+
+ProcessTable *ProcessTableCreate(void)
+{
+	return (calloc(1, sizeof(ProcessTable)));
+}
+
+
+void ProcessTableDispose(ProcessTable *table)
+{
+	if (table == NULL)
+	{
+		return;
+	}
+	free(table->slots);
+	free(table);
+}
+
+
+void ProcessTableBeginGeneration(ProcessTable *table)
+{
+	table->generation += 1;
+	if (table->generation == 0)
+	{
+		// 0 marks an empty slot, the entries of the generation it wrapped onto have long expired
+		table->generation = 1;
+	}
+}
+
+
+ProcessTableEntry *ProcessTableSet(ProcessTable *table, pid_t pid, double startTime, const unsigned long long *counters, int counterCount)
+{
+	ProcessTableEntry *entry;
+
+	if (counterCount > PROCESS_TABLE_COUNTERS)
+	{
+		counterCount = PROCESS_TABLE_COUNTERS;
+	}
+	if ((table->count + 1) * 2 > table->capacity && ! growTable(table))
+	{
+		return (NULL);
+	}
+
+	entry = &table->slots[findSlot(table, pid, startTime)];
+	if (entry->generation == 0)
+	{
+		memset(entry, 0, sizeof(ProcessTableEntry));
+		entry->pid = pid;
+		entry->startTime = startTime;
+		memcpy(entry->counters, counters, counterCount * sizeof(unsigned long long));
+		memcpy(entry->lastCounters, counters, counterCount * sizeof(unsigned long long));
+		table->count += 1;
+	}
+	else
+	{
+		if (entry->generation != table->generation)
+		{
+			memcpy(entry->lastCounters, entry->counters, sizeof(entry->counters));
+		}
+		memcpy(entry->counters, counters, counterCount * sizeof(unsigned long long));
+	}
+	entry->generation = table->generation;
+	return (entry);
+}
+
+
+void ProcessTableExpire(ProcessTable *table)
+{
+	int i;
+
+	for (i = 0; i < table->capacity; i++)
+	{
+		// the slot is checked again after a removal, an entry may have moved into it
+		while (table->slots[i].generation != 0 && table->slots[i].generation != table->generation)
+		{
+			removeSlot(table, i);
+		}
+	}
+}
+
+
+ProcessTableEntry *ProcessTableFind(const ProcessTable *table, pid_t pid, double startTime)
+{
+	ProcessTableEntry *entry;
+
+	if (table->capacity == 0)
+	{
+		return (NULL);
+	}
+	entry = &table->slots[findSlot(table, pid, startTime)];
+	return (entry->generation != 0 ? entry : NULL);
+}
+
+
+#if PROCESS_TABLE_BENCHMARK
+
+/*
+ *  Updates a table of 5,000 processes where 1% exit and are replaced by new ones with reused pids
+ *  every generation, checks the deltas and the count, and prints one tab-separated line:
+ *
+ *	processes	generations	ns_per_generation	ns_per_process
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#define BENCHMARK_PROCESSES 5000
+
+typedef struct benchmarkprocess
+{
+	pid_t pid;
+	double startTime;
+	unsigned long long pageins;
+	unsigned long long faults;
+} BenchmarkProcess;
+
+static double benchmarkNow(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((double) now.tv_sec * 1.0e9 + (double) now.tv_nsec);
+}
+
+int main(int argc, char *argv[])
+{
+	static BenchmarkProcess processes[BENCHMARK_PROCESSES];
+	ProcessTable *table = ProcessTableCreate();
+	const int generations = 2000;
+	unsigned int seed = 1;
+	double start, elapsed = 0.0;
+	int generation, i;
+
+	for (i = 0; i < BENCHMARK_PROCESSES; i++)
+	{
+		processes[i].pid = i + 1;
+		processes[i].startTime = 1.0;
+	}
+
+	for (generation = 0; generation < generations; generation++)
+	{
+		// a few processes exit and their pids are reused right away
+		for (i = 0; i < BENCHMARK_PROCESSES / 100; i++)
+		{
+			seed = (seed * 1103515245) + 12345;
+			BenchmarkProcess *process = &processes[(seed >> 8) % BENCHMARK_PROCESSES];
+			process->startTime = (double) generation + 2.0;
+			process->pageins = 0;
+			process->faults = 0;
+		}
+		for (i = 0; i < BENCHMARK_PROCESSES; i++)
+		{
+			processes[i].pageins += i % 3;
+			processes[i].faults += i % 7;
+		}
+
+		start = benchmarkNow();
+		ProcessTableBeginGeneration(table);
+		for (i = 0; i < BENCHMARK_PROCESSES; i++)
+		{
+			unsigned long long counters[2];
+
+			counters[0] = processes[i].pageins;
+			counters[1] = processes[i].faults;
+			if (ProcessTableSet(table, processes[i].pid, processes[i].startTime, counters, 2) == NULL)
+			{
+				fprintf(stderr, "out of memory\n");
+				return (1);
+			}
+		}
+		ProcessTableExpire(table);
+		elapsed += benchmarkNow() - start;
+
+		if (table->count != BENCHMARK_PROCESSES)
+		{
+			fprintf(stderr, "generation %d has %d processes, expected %d\n", generation, table->count, BENCHMARK_PROCESSES);
+			return (1);
+		}
+	}
+
+	// a process that has been running since the previous generation has the delta it was given
+	for (i = 0; i < BENCHMARK_PROCESSES; i++)
+	{
+		ProcessTableEntry *entry = ProcessTableFind(table, processes[i].pid, processes[i].startTime);
+
+		if (entry == NULL)
+		{
+			fprintf(stderr, "pid %d is missing\n", processes[i].pid);
+			return (1);
+		}
+		if (processes[i].startTime < (double) generations && entry->counters[1] - entry->lastCounters[1] != (unsigned long long) (i % 7))
+		{
+			fprintf(stderr, "pid %d has a fault delta of %llu, expected %d\n", processes[i].pid, entry->counters[1] - entry->lastCounters[1], i % 7);
+			return (1);
+		}
+	}
+
+	printf("processes\tgenerations\tns_per_generation\tns_per_process\n");
+	printf("%d\t%d\t%.0f\t%.1f\n", BENCHMARK_PROCESSES, generations, elapsed / generations, elapsed / generations / BENCHMARK_PROCESSES);
+
+	ProcessTableDispose(table);
+	return (0);
+}
+
+#endif
@@ -0,0 +1,714 @@
+/*
+ *  ProcessThreads.c
+ *
+ *  Threads of the few processes a panel shows, with the CPU usage, state and priority of each.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ProcessThreads.h"
+#include "SampleClock.h"
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+static int reserveThreads(ProcessThread **threads, int *capacity, int count)
+{
+	ProcessThread *grown;
+	int newCapacity;
+
+	if (count <= *capacity)
+	{
+		return (1);
+	}
+	newCapacity = (*capacity > 0 ? *capacity : 16);
+	while (newCapacity < count)
+	{
+		newCapacity *= 2;
+	}
+	grown = realloc(*threads, newCapacity * sizeof(ProcessThread));
+	if (grown == NULL)
+	{
+		return (0);
+	}
+	*threads = grown;
+	*capacity = newCapacity;
+	return (1);
+}
+
+
+// adds a cleared thread to a list, returns NULL if memory could not be allocated
+static ProcessThread *addThread(ProcessThreadList *list)
+{
+	ProcessThread *thread;
+
+	if (! reserveThreads(&list->threads, &list->capacity, list->count + 1))
+	{
+		return (NULL);
+	}
+	thread = &list->threads[list->count++];
+	memset(thread, 0, sizeof(ProcessThread));
+	return (thread);
+}
+
+
+static int compareThreads(const void *value1, const void *value2)
+{
+	const ProcessThread *thread1 = (const ProcessThread *) value1;
+	const ProcessThread *thread2 = (const ProcessThread *) value2;
+
+	return ((thread1->tid > thread2->tid) - (thread1->tid < thread2->tid));
+}
+
+
+#if defined(__APPLE__)
+
+static ProcessSnapshotState threadState(const thread_extended_info_data_t *info)
+{
+	switch (info->pth_run_state)
+	{
+	case TH_STATE_RUNNING:
+		return (ProcessSnapshotStateRunnable);
+	case TH_STATE_UNINTERRUPTIBLE:
+		return (ProcessSnapshotStateUninterruptible);
+	case TH_STATE_WAITING:
+		return (info->pth_sleep_time > 20 ? ProcessSnapshotStateIdle : ProcessSnapshotStateSleeping);
+	case TH_STATE_STOPPED:
+		return (ProcessSnapshotStateSuspended);
+	case TH_STATE_HALTED:
+		return (ProcessSnapshotStateZombie);
+	default:
+		return (ProcessSnapshotStateUnknown);
+	}
+}
+
+
+// adds the threads of the task to the list, returns 0 if they can't be read and -1 if memory could not be allocated
+static int readThreads(ProcessThreadList *list, const ProcessSnapshotEntry *entry)
+{
+	thread_act_array_t ports;
+	mach_msg_type_number_t portCount;
+	unsigned int i;
+	int result = 1;
+
+	if (entry->task == 0 || task_threads(entry->task, &ports, &portCount) != KERN_SUCCESS)
+	{
+		return (0);
+	}
+
+	// two calls per thread: the extended info has everything but the id that tells threads apart between updates
+	for (i = 0; i < portCount; i++)
+	{
+		thread_identifier_info_data_t identifierInfo;
+		thread_extended_info_data_t extendedInfo;
+		mach_msg_type_number_t infoCount;
+		ProcessThread *thread;
+
+		infoCount = THREAD_IDENTIFIER_INFO_COUNT;
+		if (thread_info(ports[i], THREAD_IDENTIFIER_INFO, (thread_info_t)&identifierInfo, &infoCount) != KERN_SUCCESS)
+		{
+			// the thread exited since it was listed
+			continue;
+		}
+		infoCount = THREAD_EXTENDED_INFO_COUNT;
+		if (thread_info(ports[i], THREAD_EXTENDED_INFO, (thread_info_t)&extendedInfo, &infoCount) != KERN_SUCCESS)
+		{
+			continue;
+		}
+
+		thread = addThread(list);
+		if (thread == NULL)
+		{
+			result = -1;
+			break;
+		}
+		thread->tid = identifierInfo.thread_id;
+		snprintf(thread->name, sizeof(thread->name), "%s", extendedInfo.pth_name);
+		thread->state = threadState(&extendedInfo);
+		thread->priority = extendedInfo.pth_curpri;
+		thread->userTime = extendedInfo.pth_user_time / 1.0e9;
+		thread->systemTime = extendedInfo.pth_system_time / 1.0e9;
+	}
+
+	for (i = 0; i < portCount; i++)
+	{
+		mach_port_deallocate(mach_task_self(), ports[i]);
+	}
+	vm_deallocate(mach_task_self(), (vm_address_t)ports, portCount * sizeof(thread_act_t));
+	return (result);
+}
+
+#elif defined(__linux__)
+
+static const char *procRoot = "/proc";
+
+static ProcessSnapshotState threadState(char state)
+{
+	switch (state)
+	{
+	case 'R':
+		return (ProcessSnapshotStateRunnable);
+	case 'D':
+		return (ProcessSnapshotStateUninterruptible);
+	case 'S':
+		return (ProcessSnapshotStateSleeping);
+	case 'I':
+		return (ProcessSnapshotStateIdle);
+	case 'T':
+	case 't':
+		return (ProcessSnapshotStateSuspended);
+	case 'Z':
+		return (ProcessSnapshotStateZombie);
+	case 'X':
+		return (ProcessSnapshotStateExited);
+	default:
+		return (ProcessSnapshotStateUnknown);
+	}
+}
+
+
+// reads /proc/[pid]/task/[tid]/stat into a thread, returns 0 if the thread is gone
+static int readStat(ProcessThread *thread, const char *path, double ticksPerSecond)
+{
+	int file;
+	char buffer[1024];
+	const char *start, *end;
+	char state;
+	unsigned long long userTicks, systemTicks;
+	int priority;
+	ssize_t length;
+
+	file = open(path, O_RDONLY);
+	if (file < 0)
+	{
+		return (0);
+	}
+	length = read(file, buffer, sizeof(buffer) - 1);
+	close(file);
+	if (length <= 0)
+	{
+		return (0);
+	}
+	buffer[length] = '\0';
+
+	// the name is in parentheses and may contain anything, including parentheses
+	start = strchr(buffer, '(');
+	end = strrchr(buffer, ')');
+	if (start == NULL || end == NULL || end < start)
+	{
+		return (0);
+	}
+	length = end - start - 1;
+	if (length > PROCESS_THREADS_NAME_SIZE - 1)
+	{
+		length = PROCESS_THREADS_NAME_SIZE - 1;
+	}
+	memcpy(thread->name, start + 1, length);
+	thread->name[length] = '\0';
+
+	if (sscanf(end + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %d",
+			&state, &userTicks, &systemTicks, &priority) != 4)
+	{
+		return (0);
+	}
+	thread->state = threadState(state);
+	thread->priority = priority;
+	thread->userTime = (double) userTicks / ticksPerSecond;
+	thread->systemTime = (double) systemTicks / ticksPerSecond;
+	return (1);
+}
+
+
+// adds the threads of the process to the list, returns 0 if they can't be read and -1 if memory could not be allocated
+static int readThreads(ProcessThreadList *list, const ProcessSnapshotEntry *entry)
+{
+	double ticksPerSecond = (double) sysconf(_SC_CLK_TCK);
+	char path[512];
+	DIR *directory;
+	struct dirent *item;
+	int result = 1;
+
+	snprintf(path, sizeof(path), "%s/%ld/task", procRoot, (long) entry->pid);
+	directory = opendir(path);
+	if (directory == NULL)
+	{
+		return (0);
+	}
+	while ((item = readdir(directory)) != NULL)
+	{
+		ProcessThread *thread;
+		char *end;
+		unsigned long long tid = strtoull(item->d_name, &end, 10);
+
+		if (end == item->d_name || *end != '\0')
+		{
+			continue;
+		}
+		thread = addThread(list);
+		if (thread == NULL)
+		{
+			result = -1;
+			break;
+		}
+		thread->tid = tid;
+		snprintf(path, sizeof(path), "%s/%ld/task/%s/stat", procRoot, (long) entry->pid, item->d_name);
+		if (! readStat(thread, path, ticksPerSecond))
+		{
+			// the thread exited since it was listed
+			list->count -= 1;
+		}
+	}
+	closedir(directory);
+	return (result);
+}
+
+#else
+
+static int readThreads(ProcessThreadList *list, const ProcessSnapshotEntry *entry)
+{
+	return (0);
+}
+
+#endif
+
+
+static const ProcessThread *findLastThread(const ProcessThreadList *list, unsigned long long tid)
+{
+	int low = 0, high = list->lastCount - 1;
+
+	while (low <= high)
+	{
+		int middle = (low + high) / 2;
+		unsigned long long middleTid = list->lastThreads[middle].tid;
+
+		if (middleTid == tid)
+		{
+			return (&list->lastThreads[middle]);
+		}
+		if (middleTid < tid)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle - 1;
+		}
+	}
+	return (NULL);
+}
+
+
+// sets the CPU usage of the threads from the change in their time since the previous update
+static void updateUsage(ProcessThreadList *list, double now)
+{
+	double elapsed = now - list->timestamp;
+	int i;
+
+	for (i = 0; i < list->count; i++)
+	{
+		ProcessThread *thread = &list->threads[i];
+		const ProcessThread *last = (list->timestamp > 0.0 ? findLastThread(list, thread->tid) : NULL);
+
+		thread->cpuUsage = 0.0;
+		if (last != NULL && elapsed > 0.0)
+		{
+			double time = (thread->userTime + thread->systemTime) - (last->userTime + last->systemTime);
+
+			if (time > 0.0)
+			{
+				thread->cpuUsage = time / elapsed;
+			}
+		}
+	}
+}
+
+
+static ProcessThreadList *findList(ProcessThreads *threads, pid_t pid)
+{
+	int i;
+
+	for (i = 0; i < PROCESS_THREADS_MAX_PROCESSES; i++)
+	{
+		if (threads->lists[i].pid == pid)
+		{
+			return (&threads->lists[i]);
+		}
+	}
+	return (NULL);
+}
+
+
+ProcessThreads *ProcessThreadsCreate(void)
+{
+	return (calloc(1, sizeof(ProcessThreads)));
+}
+
+
+void ProcessThreadsDispose(ProcessThreads *threads)
+{
+	int i;
+
+	if (threads == NULL)
+	{
+		return;
+	}
+	for (i = 0; i < PROCESS_THREADS_MAX_PROCESSES; i++)
+	{
+		free(threads->lists[i].threads);
+		free(threads->lists[i].lastThreads);
+	}
+	free(threads);
+}
+
+
+int ProcessThreadsUpdate(ProcessThreads *threads, const ProcessSnapshot *snapshot, const pid_t *pids, int count)
+{
+	double now = SampleClockNow();
+	int result = 1;
+	int i, k;
+
+	if (count > PROCESS_THREADS_MAX_PROCESSES)
+	{
+		count = PROCESS_THREADS_MAX_PROCESSES;
+	}
+
+	// forget the processes that left the list, and the ones that exited and had their pid reused
+	for (i = 0; i < PROCESS_THREADS_MAX_PROCESSES; i++)
+	{
+		ProcessThreadList *list = &threads->lists[i];
+		const ProcessSnapshotEntry *entry = NULL;
+
+		if (list->pid == 0)
+		{
+			continue;
+		}
+		for (k = 0; k < count; k++)
+		{
+			if (pids[k] == list->pid)
+			{
+				entry = ProcessSnapshotFind(snapshot, list->pid);
+				break;
+			}
+		}
+		if (entry == NULL || entry->startTime != list->startTime)
+		{
+			list->pid = 0;
+		}
+	}
+
+	for (k = 0; k < count; k++)
+	{
+		const ProcessSnapshotEntry *entry = ProcessSnapshotFind(snapshot, pids[k]);
+		ProcessThreadList *list;
+		ProcessThread *swapThreads;
+		int swapCapacity, status;
+
+		if (entry == NULL || ! entry->known || entry->pid == 0)
+		{
+			continue;
+		}
+		list = findList(threads, entry->pid);
+		if (list == NULL)
+		{
+			// there is always an unused list, since no more processes than lists are kept
+			list = findList(threads, 0);
+			list->pid = entry->pid;
+			list->startTime = entry->startTime;
+			list->timestamp = 0.0;
+			list->count = 0;
+		}
+
+		// the threads of the previous update are kept for the deltas, their array is refilled next time
+		swapThreads = list->lastThreads;
+		swapCapacity = list->lastCapacity;
+		list->lastThreads = list->threads;
+		list->lastCapacity = list->capacity;
+		list->lastCount = list->count;
+		list->threads = swapThreads;
+		list->capacity = swapCapacity;
+		list->count = 0;
+
+		status = readThreads(list, entry);
+		if (status <= 0)
+		{
+			list->pid = 0;
+			if (status < 0)
+			{
+				result = 0;
+			}
+			continue;
+		}
+		qsort(list->threads, list->count, sizeof(ProcessThread), compareThreads);
+		updateUsage(list, now);
+		list->timestamp = now;
+	}
+	return (result);
+}
+
+
+const ProcessThreadList *ProcessThreadsFind(const ProcessThreads *threads, pid_t pid)
+{
+	int i;
+
+	if (pid == 0)
+	{
+		return (NULL);
+	}
+	for (i = 0; i < PROCESS_THREADS_MAX_PROCESSES; i++)
+	{
+		if (threads->lists[i].pid == pid)
+		{
+			return (&threads->lists[i]);
+		}
+	}
+	return (NULL);
+}
+
+
+#if PROCESS_THREADS_BENCHMARK && defined(__linux__)
+
+/*
+ *  Generates a /proc of 1,000 processes with 1 to 16 threads each, checks that the threads of a
+ *  process are read correctly, then prints one tab-separated line for the ten processes with the
+ *  most threads, one for every process in batches of PROCESS_THREADS_MAX_PROCESSES, and one for
+ *  the ten processes of the live /proc with the most threads:
+ *
+ *	scope	processes	threads	updates	ns_per_update	ns_per_thread
+ */
+
+#include <sys/stat.h>
+
+#define BENCHMARK_PROCESSES 1000
+#define BENCHMARK_TOP 10
+
+static double benchmarkNow(void)
+{
+	return (SampleClockNow() * 1.0e9);
+}
+
+static int benchmarkThreadCount(int pid)
+{
+	return (1 + (pid % 16));
+}
+
+static int generateTree(const char *root)
+{
+	char path[512];
+	FILE *file;
+	int pid, thread;
+
+	if (mkdir(root, 0755) != 0)
+	{
+		return (0);
+	}
+	for (pid = 1; pid <= BENCHMARK_PROCESSES; pid++)
+	{
+		snprintf(path, sizeof(path), "%s/%d", root, pid);
+		if (mkdir(path, 0755) != 0)
+		{
+			return (0);
+		}
+		snprintf(path, sizeof(path), "%s/%d/task", root, pid);
+		if (mkdir(path, 0755) != 0)
+		{
+			return (0);
+		}
+		for (thread = 0; thread < benchmarkThreadCount(pid); thread++)
+		{
+			int tid = (thread == 0 ? pid : BENCHMARK_PROCESSES * (thread + 1) + pid);
+
+			snprintf(path, sizeof(path), "%s/%d/task/%d", root, pid, tid);
+			if (mkdir(path, 0755) != 0)
+			{
+				return (0);
+			}
+			snprintf(path, sizeof(path), "%s/%d/task/%d/stat", root, pid, tid);
+			file = fopen(path, "w");
+			if (file == NULL)
+			{
+				return (0);
+			}
+			fprintf(file, "%d (worker %d) %c %d %d %d 0 -1 4194560 %d 0 0 0 %d %d 0 0 %d 0 %d 0 %d %d %d 0 0 0 0 0 0 0 0 0 0 0 0 0 17 0 0 0 0 0 0\n",
+					tid, thread, (thread == 1 ? 'R' : 'S'), 1, pid, pid, pid, tid * 3, tid, 20 - (thread % 3),
+					benchmarkThreadCount(pid), pid * 13, pid * 4096, pid % 977);
+			fclose(file);
+		}
+	}
+	return (1);
+}
+
+static void removeTree(const char *root)
+{
+	char path[512];
+	int pid, thread;
+
+	for (pid = 1; pid <= BENCHMARK_PROCESSES; pid++)
+	{
+		for (thread = 0; thread < benchmarkThreadCount(pid); thread++)
+		{
+			int tid = (thread == 0 ? pid : BENCHMARK_PROCESSES * (thread + 1) + pid);
+
+			snprintf(path, sizeof(path), "%s/%d/task/%d/stat", root, pid, tid);
+			unlink(path);
+			snprintf(path, sizeof(path), "%s/%d/task/%d", root, pid, tid);
+			rmdir(path);
+		}
+		snprintf(path, sizeof(path), "%s/%d/task", root, pid);
+		rmdir(path);
+		snprintf(path, sizeof(path), "%s/%d", root, pid);
+		rmdir(path);
+	}
+	rmdir(root);
+}
+
+// picks the count processes with the most threads, as the panel picks the busiest
+static int topPids(const ProcessSnapshot *snapshot, pid_t *pids, int count)
+{
+	int picked, i, k;
+
+	for (picked = 0; picked < count; picked++)
+	{
+		int best = -1;
+
+		for (i = 0; i < snapshot->count; i++)
+		{
+			int taken = 0;
+
+			for (k = 0; k < picked; k++)
+			{
+				taken |= (pids[k] == snapshot->entries[i].pid);
+			}
+			if (! taken && snapshot->entries[i].known && snapshot->entries[i].pid != 0
+					&& (best < 0 || snapshot->entries[i].threadCount > snapshot->entries[best].threadCount))
+			{
+				best = i;
+			}
+		}
+		if (best < 0)
+		{
+			break;
+		}
+		pids[picked] = snapshot->entries[best].pid;
+	}
+	return (picked);
+}
+
+static long countThreads(const ProcessThreads *threads)
+{
+	long count = 0;
+	int i;
+
+	for (i = 0; i < PROCESS_THREADS_MAX_PROCESSES; i++)
+	{
+		if (threads->lists[i].pid != 0)
+		{
+			count += threads->lists[i].count;
+		}
+	}
+	return (count);
+}
+
+static void benchmarkScope(const char *scope, const ProcessSnapshot *snapshot, const pid_t *pids, int count, int updates)
+{
+	ProcessThreads *threads = ProcessThreadsCreate();
+	double start, elapsed;
+	long threadCount = 0;
+	int update, first;
+
+	for (first = 0; first < count; first += PROCESS_THREADS_MAX_PROCESSES)
+	{
+		ProcessThreadsUpdate(threads, snapshot, pids + first, (count - first < PROCESS_THREADS_MAX_PROCESSES ? count - first : PROCESS_THREADS_MAX_PROCESSES));
+	}
+	start = benchmarkNow();
+	for (update = 0; update < updates; update++)
+	{
+		for (first = 0; first < count; first += PROCESS_THREADS_MAX_PROCESSES)
+		{
+			ProcessThreadsUpdate(threads, snapshot, pids + first, (count - first < PROCESS_THREADS_MAX_PROCESSES ? count - first : PROCESS_THREADS_MAX_PROCESSES));
+			if (update == 0)
+			{
+				threadCount += countThreads(threads);
+			}
+		}
+	}
+	elapsed = (benchmarkNow() - start) / updates;
+	printf("%s\t%d\t%ld\t%d\t%.0f\t%.1f\n", scope, count, threadCount, updates, elapsed, (threadCount > 0 ? elapsed / threadCount : 0.0));
+	ProcessThreadsDispose(threads);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *root = (argc > 1 ? argv[1] : "process_threads_benchmark.proc");
+	ProcessSnapshot snapshot;
+	ProcessSnapshot *live;
+	ProcessThreads *threads;
+	const ProcessThreadList *list;
+	pid_t pids[BENCHMARK_PROCESSES];
+	int i, count;
+
+	if (! generateTree(root))
+	{
+		fprintf(stderr, "failed to generate %s\n", root);
+		removeTree(root);
+		return (1);
+	}
+	procRoot = root;
+
+	// the threads only need the pid, start time and thread count of each process
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.count = BENCHMARK_PROCESSES;
+	snapshot.entries = calloc(BENCHMARK_PROCESSES, sizeof(ProcessSnapshotEntry));
+	for (i = 0; i < BENCHMARK_PROCESSES; i++)
+	{
+		snapshot.entries[i].pid = i + 1;
+		snapshot.entries[i].startTime = i + 1;
+		snapshot.entries[i].known = 1;
+		snapshot.entries[i].threadCount = benchmarkThreadCount(i + 1);
+		pids[i] = i + 1;
+	}
+
+	threads = ProcessThreadsCreate();
+	pids[0] = 47;
+	ProcessThreadsUpdate(threads, &snapshot, pids, 1);
+	list = ProcessThreadsFind(threads, 47);
+	if (list == NULL || list->count != benchmarkThreadCount(47) || list->threads[0].tid != 47 || list->threads[1].tid != 2047
+			|| strcmp(list->threads[1].name, "worker 1") != 0 || list->threads[1].state != ProcessSnapshotStateRunnable
+			|| list->threads[2].priority != 18 || list->threads[1].userTime != 2047 * 3 / (double) sysconf(_SC_CLK_TCK))
+	{
+		fprintf(stderr, "the threads of process 47 were not read correctly\n");
+		removeTree(root);
+		return (1);
+	}
+	ProcessThreadsDispose(threads);
+
+	printf("scope\tprocesses\tthreads\tupdates\tns_per_update\tns_per_thread\n");
+	count = topPids(&snapshot, pids, BENCHMARK_TOP);
+	benchmarkScope("top", &snapshot, pids, count, 200);
+	for (i = 0; i < BENCHMARK_PROCESSES; i++)
+	{
+		pids[i] = i + 1;
+	}
+	benchmarkScope("all", &snapshot, pids, BENCHMARK_PROCESSES, 10);
+	removeTree(root);
+	free(snapshot.entries);
+
+	procRoot = "/proc";
+	live = ProcessSnapshotCreate();
+	if (live != NULL && ProcessSnapshotRefresh(live))
+	{
+		count = topPids(live, pids, BENCHMARK_TOP);
+		benchmarkScope("live", live, pids, count, 200);
+	}
+	ProcessSnapshotDispose(live);
+	return (0);
+}
+
+#endif
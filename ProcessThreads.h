@@ -0,0 +1,75 @@
+/*
+ *  ProcessThreads.h
+ *
+ *  Threads of the few processes a panel shows, with the CPU usage, state and priority of each.
+ *
+ *  The snapshot only has what one task-level call tells about a process: its thread count, a
+ *  state collapsed from how many of its threads are running, and its base priority. Walking the
+ *  threads of every process to tell more would cost a call per thread, thousands of them per
+ *  refresh. ProcessThreadsUpdate() walks them only for the processes it is given, the top of
+ *  the processor panel's list, with task_threads() and THREAD_IDENTIFIER_INFO and
+ *  THREAD_EXTENDED_INFO per thread on Mac OS X, and /proc/[pid]/task/[tid]/stat on Linux.
+ *
+ *  The threads of a process are kept from one update to the next while it stays in the list,
+ *  so the CPU usage of a thread is the change in its user and system time between two updates
+ *  divided by the time between them, as in the snapshot. It is 0 for a thread seen only once.
+ *  A process that leaves the list is forgotten, and its thread arrays are reused by the next one.
+ *
+ *  The benchmark reads the threads of the ten busiest processes of a generated /proc, then of
+ *  all of them, as walking every thread of every process did:
+ *
+ *	cc -O2 -DPROCESS_THREADS_BENCHMARK -o process_threads_benchmark ProcessThreads.c ProcessSnapshot.c ProcessRegistry.c WorkPool.c ProcessColumns.c TopRank.c -lm -lpthread
+ */
+
+#ifndef PROCESS_THREADS_H
+#define PROCESS_THREADS_H
+
+#include <sys/types.h>
+
+#include "ProcessSnapshot.h"
+
+#define PROCESS_THREADS_MAX_PROCESSES 16	// processes whose threads are read at a time
+#define PROCESS_THREADS_NAME_SIZE 32
+
+typedef struct processthread
+{
+	unsigned long long tid;		// thread id on Mac OS X, task id on Linux
+	char name[PROCESS_THREADS_NAME_SIZE];	// empty when the thread has no name
+	ProcessSnapshotState state;
+	int priority;			// current priority, in the units of ProcessSnapshotEntry's
+	double userTime;		// seconds
+	double systemTime;
+	double cpuUsage;		// fraction of one processor since the previous update
+} ProcessThread;
+
+typedef struct processthreadlist
+{
+	pid_t pid;			// 0 marks an unused list
+	double startTime;		// as in ProcessSnapshotEntry, tells a reused pid apart
+	double timestamp;		// SampleClockNow() when the threads were read
+
+	int count;
+	int capacity;
+	ProcessThread *threads;		// sorted by tid
+
+	int lastCount;
+	int lastCapacity;
+	ProcessThread *lastThreads;	// the previous update, for CPU time deltas
+} ProcessThreadList;
+
+typedef struct processthreads
+{
+	ProcessThreadList lists[PROCESS_THREADS_MAX_PROCESSES];
+} ProcessThreads;
+
+ProcessThreads *ProcessThreadsCreate(void);
+void ProcessThreadsDispose(ProcessThreads *threads);
+
+// reads the threads of the first PROCESS_THREADS_MAX_PROCESSES pids and forgets those of any other process,
+// returns 0 if memory could not be allocated
+int ProcessThreadsUpdate(ProcessThreads *threads, const ProcessSnapshot *snapshot, const pid_t *pids, int count);
+
+// returns the threads of pid, or NULL if they weren't read at the last update
+const ProcessThreadList *ProcessThreadsFind(const ProcessThreads *threads, pid_t pid);
+
+#endif
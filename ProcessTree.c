@@ -0,0 +1,354 @@
+/*
+ *  ProcessTree.c
+ *
+ *  Parent and child index over a process snapshot, with usage rolled up by subtree and by
+ *  application.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ProcessTree.h"
+
+
+static int reserveNodes(ProcessTree *tree, int count)
+{
+	ProcessTreeNode *nodes;
+	int *children, *walk;
+	int capacity;
+
+	if (count <= tree->capacity)
+	{
+		return (1);
+	}
+	capacity = (tree->capacity > 0 ? tree->capacity : 256);
+	while (capacity < count)
+	{
+		capacity *= 2;
+	}
+	nodes = realloc(tree->nodes, capacity * sizeof(ProcessTreeNode));
+	if (nodes == NULL)
+	{
+		return (0);
+	}
+	tree->nodes = nodes;
+	children = realloc(tree->children, capacity * sizeof(int));
+	if (children == NULL)
+	{
+		return (0);
+	}
+	tree->children = children;
+	walk = realloc(tree->walk, capacity * sizeof(int));
+	if (walk == NULL)
+	{
+		return (0);
+	}
+	tree->walk = walk;
+	tree->capacity = capacity;
+	return (1);
+}
+
+
+static void addToRollup(ProcessTreeRollup *rollup, const ProcessTreeRollup *other)
+{
+	rollup->count += other->count;
+	rollup->cpuUsage += other->cpuUsage;
+	rollup->averageUsage += other->averageUsage;
+	rollup->residentSize += other->residentSize;
+	rollup->pageins += other->pageins;
+}
+
+
+static void setRollup(ProcessTreeRollup *rollup, const ProcessSnapshotEntry *entry)
+{
+	memset(rollup, 0, sizeof(ProcessTreeRollup));
+	rollup->count = 1;
+	if (entry->known)
+	{
+		rollup->cpuUsage = entry->cpuUsage;
+		rollup->averageUsage = entry->averageUsage;
+		rollup->residentSize = entry->residentSize;
+		rollup->pageins = entry->pageins;
+	}
+}
+
+
+ProcessTree *ProcessTreeCreate(void)
+{
+	return (calloc(1, sizeof(ProcessTree)));
+}
+
+
+void ProcessTreeDispose(ProcessTree *tree)
+{
+	if (tree == NULL)
+	{
+		return;
+	}
+	free(tree->nodes);
+	free(tree->children);
+	free(tree->walk);
+	free(tree);
+}
+
+
+int ProcessTreeBuild(ProcessTree *tree, const ProcessSnapshot *snapshot)
+{
+	ProcessTreeNode *nodes;
+	int count = snapshot->count;
+	int walkCount = 0, walkIndex = 0;
+	int i;
+
+	tree->count = 0;
+	if (! reserveNodes(tree, count))
+	{
+		return (0);
+	}
+	nodes = tree->nodes;
+
+	// the parents, and how many children each process has
+	for (i = 0; i < count; i++)
+	{
+		nodes[i].parent = -1;
+		nodes[i].childCount = 0;
+		nodes[i].application = -1;
+	}
+	for (i = 0; i < count; i++)
+	{
+		const ProcessSnapshotEntry *entry = &snapshot->entries[i];
+		const ProcessSnapshotEntry *parent;
+
+		if (entry->parentPid == entry->pid)
+		{
+			continue;
+		}
+		parent = ProcessSnapshotFind(snapshot, entry->parentPid);
+		if (parent != NULL)
+		{
+			nodes[i].parent = (int) (parent - snapshot->entries);
+			nodes[nodes[i].parent].childCount += 1;
+		}
+	}
+
+	// the children grouped by parent, with a counting sort
+	{
+		int offset = 0;
+
+		for (i = 0; i < count; i++)
+		{
+			nodes[i].firstChild = offset;
+			offset += nodes[i].childCount;
+			nodes[i].childCount = 0;
+		}
+		for (i = 0; i < count; i++)
+		{
+			int parent = nodes[i].parent;
+
+			if (parent >= 0)
+			{
+				tree->children[nodes[parent].firstChild + nodes[parent].childCount] = i;
+				nodes[parent].childCount += 1;
+			}
+		}
+	}
+
+	// breadth first from the roots, a process left out by the walk is in a loop and becomes a root
+	for (i = 0; i < count; i++)
+	{
+		if (nodes[i].parent < 0)
+		{
+			nodes[i].application = i;
+			tree->walk[walkCount++] = i;
+		}
+	}
+	for (i = 0; i <= count; i++)
+	{
+		while (walkIndex < walkCount)
+		{
+			int node = tree->walk[walkIndex++];
+			int child;
+
+			for (child = nodes[node].firstChild; child < nodes[node].firstChild + nodes[node].childCount; child++)
+			{
+				int index = tree->children[child];
+
+				if (nodes[index].application >= 0)
+				{
+					continue;
+				}
+				// the processes started by launchd or init are applications
+				nodes[index].application = (snapshot->entries[node].pid <= 1 ? index : nodes[node].application);
+				tree->walk[walkCount++] = index;
+			}
+		}
+		if (i < count && nodes[i].application < 0)
+		{
+			nodes[i].parent = -1;
+			nodes[i].application = i;
+			tree->walk[walkCount++] = i;
+		}
+	}
+
+	// the rollups, children before their parents
+	for (i = 0; i < count; i++)
+	{
+		setRollup(&nodes[i].subtree, &snapshot->entries[i]);
+		memset(&nodes[i].applicationTotal, 0, sizeof(ProcessTreeRollup));
+	}
+	for (i = walkCount - 1; i >= 0; i--)
+	{
+		int node = tree->walk[i];
+		ProcessTreeRollup own;
+
+		setRollup(&own, &snapshot->entries[node]);
+		addToRollup(&nodes[nodes[node].application].applicationTotal, &own);
+		if (nodes[node].parent >= 0)
+		{
+			addToRollup(&nodes[nodes[node].parent].subtree, &nodes[node].subtree);
+		}
+	}
+
+	tree->count = count;
+	return (1);
+}
+
+
+static int largestApplication(const ProcessTree *tree, const ProcessSnapshot *snapshot, int byResidentSize)
+{
+	int result = -1;
+	double largest = 0.0;
+	int i;
+
+	for (i = 0; i < tree->count; i++)
+	{
+		double value;
+
+		// the kernel isn't an application
+		if (tree->nodes[i].application != i || snapshot->entries[i].pid == 0)
+		{
+			continue;
+		}
+		value = (byResidentSize ? (double) tree->nodes[i].applicationTotal.residentSize : tree->nodes[i].applicationTotal.cpuUsage);
+		if (value > largest)
+		{
+			largest = value;
+			result = i;
+		}
+	}
+	return (result);
+}
+
+
+int ProcessTreeBusiestApplication(const ProcessTree *tree, const ProcessSnapshot *snapshot)
+{
+	return (largestApplication(tree, snapshot, 0));
+}
+
+
+int ProcessTreeLargestApplication(const ProcessTree *tree, const ProcessSnapshot *snapshot)
+{
+	return (largestApplication(tree, snapshot, 1));
+}
+
+
+#if PROCESS_TREE_BENCHMARK
+
+/*
+ *  Builds the tree of 5,000 generated processes, 100 applications of about 50 processes in chains
+ *  below init, checks the rollups and prints one tab-separated line, then the busiest and the
+ *  largest application of the live /proc:
+ *
+ *	processes	builds	ns_per_build	ns_per_process
+ */
+
+#include <stdio.h>
+
+#include "SampleClock.h"
+
+#define BENCHMARK_PROCESSES 5000
+#define BENCHMARK_APPLICATIONS 100
+
+int main(int argc, char *argv[])
+{
+	ProcessSnapshot *snapshot = ProcessSnapshotCreate();
+	ProcessTree *tree = ProcessTreeCreate();
+	const int builds = 1000;
+	double start, elapsed;
+	int i;
+
+	snapshot->entries = calloc(BENCHMARK_PROCESSES, sizeof(ProcessSnapshotEntry));
+	snapshot->capacity = BENCHMARK_PROCESSES;
+	snapshot->count = BENCHMARK_PROCESSES;
+	for (i = 0; i < BENCHMARK_PROCESSES; i++)
+	{
+		ProcessSnapshotEntry *entry = &snapshot->entries[i];
+		int pid = i + 1;
+
+		// pid 1 is init, 2 to 101 are the applications and the others are their descendants
+		entry->pid = pid;
+		entry->parentPid = (pid == 1 ? 0 : (pid <= 1 + BENCHMARK_APPLICATIONS ? 1 : pid - BENCHMARK_APPLICATIONS));
+		entry->known = 1;
+		entry->cpuUsage = 0.01;
+		entry->residentSize = 1000;
+	}
+
+	start = SampleClockNow();
+	for (i = 0; i < builds; i++)
+	{
+		if (! ProcessTreeBuild(tree, snapshot))
+		{
+			fprintf(stderr, "out of memory\n");
+			return (1);
+		}
+	}
+	elapsed = (SampleClockNow() - start) * 1.0e9 / builds;
+
+	// init's subtree is everything, each application has its share and init is on its own
+	if (tree->nodes[0].subtree.count != BENCHMARK_PROCESSES || tree->nodes[0].subtree.residentSize != BENCHMARK_PROCESSES * 1000ULL
+			|| tree->nodes[0].applicationTotal.count != 1)
+	{
+		fprintf(stderr, "init rolls up %d processes\n", tree->nodes[0].subtree.count);
+		return (1);
+	}
+	for (i = 1; i <= BENCHMARK_APPLICATIONS; i++)
+	{
+		if (tree->nodes[i].applicationTotal.count != (BENCHMARK_PROCESSES - (i + 1)) / BENCHMARK_APPLICATIONS + 1)
+		{
+			fprintf(stderr, "application %d has %d processes\n", i + 1, tree->nodes[i].applicationTotal.count);
+			return (1);
+		}
+	}
+
+	printf("processes\tbuilds\tns_per_build\tns_per_process\n");
+	printf("%d\t%d\t%.0f\t%.1f\n", BENCHMARK_PROCESSES, builds, elapsed, elapsed / BENCHMARK_PROCESSES);
+	free(snapshot->entries);
+	snapshot->entries = NULL;
+	snapshot->count = 0;
+	snapshot->capacity = 0;
+
+	// the live processes need two refreshes for their usage
+	ProcessSnapshotRefresh(snapshot);
+	ProcessSnapshotRefresh(snapshot);
+	if (ProcessTreeBuild(tree, snapshot))
+	{
+		int busiest = ProcessTreeBusiestApplication(tree, snapshot);
+		int largest = ProcessTreeLargestApplication(tree, snapshot);
+
+		if (busiest >= 0)
+		{
+			fprintf(stderr, "busiest %s and %d helpers: %.1f%%\n", snapshot->entries[busiest].command,
+					tree->nodes[busiest].applicationTotal.count - 1, tree->nodes[busiest].applicationTotal.cpuUsage * 100.0);
+		}
+		if (largest >= 0)
+		{
+			fprintf(stderr, "largest %s and %d helpers: %llu bytes\n", snapshot->entries[largest].command,
+					tree->nodes[largest].applicationTotal.count - 1, tree->nodes[largest].applicationTotal.residentSize);
+		}
+	}
+
+	ProcessTreeDispose(tree);
+	ProcessSnapshotDispose(snapshot);
+	return (0);
+}
+
+#endif
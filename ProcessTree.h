@@ -0,0 +1,66 @@
+/*
+ *  ProcessTree.h
+ *
+ *  Parent and child index over a process snapshot, with usage rolled up by subtree and by
+ *  application.
+ *
+ *  ProcessTreeBuild() finds each process's parent once, groups the children of every process
+ *  with a counting sort and walks the tree breadth first, so parents come before their children
+ *  in the walk. The rollups are then one pass over the walk backwards. Building costs time in
+ *  proportion to the number of processes, plus a binary search of the snapshot for each parent.
+ *
+ *  An application is a process started by launchd or init (or with no parent) together with
+ *  every process it started, like Xcode and its compilers. launchd and init are applications of
+ *  their own, they don't include the processes below them. A process whose parent chain loops
+ *  back on itself, which pid reuse can cause, is made a root.
+ *
+ *  The benchmark builds the tree of 5,000 generated processes, checks the rollups and shows the
+ *  busiest and the largest application of the live /proc:
+ *
+ *	cc -O2 -DPROCESS_TREE_BENCHMARK -o process_tree_benchmark ProcessTree.c ProcessSnapshot.c ProcessRegistry.c WorkPool.c ProcessColumns.c TopRank.c -lm -lpthread
+ */
+
+#ifndef PROCESS_TREE_H
+#define PROCESS_TREE_H
+
+#include "ProcessSnapshot.h"
+
+typedef struct processtreerollup
+{
+	int count;			// processes included
+	double cpuUsage;
+	double averageUsage;
+	unsigned long long residentSize;
+	unsigned long long pageins;
+} ProcessTreeRollup;
+
+typedef struct processtreenode
+{
+	int parent;			// index of the parent in the snapshot, -1 for a root
+	int firstChild;			// children are children[firstChild] to children[firstChild + childCount - 1]
+	int childCount;
+	int application;		// index of the process that started the application
+	ProcessTreeRollup subtree;	// the process and everything below it
+	ProcessTreeRollup applicationTotal;	// every process of the application, only set on the process that started it
+} ProcessTreeNode;
+
+typedef struct processtree
+{
+	int count;
+	int capacity;
+	ProcessTreeNode *nodes;		// one per snapshot entry, in the same order
+	int *children;
+	int *walk;			// breadth first order, parents before children
+} ProcessTree;
+
+ProcessTree *ProcessTreeCreate(void);
+void ProcessTreeDispose(ProcessTree *tree);
+
+// indexes the processes of the snapshot and rolls up their usage, returns 0 if memory could not be allocated
+int ProcessTreeBuild(ProcessTree *tree, const ProcessSnapshot *snapshot);
+
+// returns the index of the application with the largest rolled up value, or -1 if there is none
+int ProcessTreeBusiestApplication(const ProcessTree *tree, const ProcessSnapshot *snapshot);
+int ProcessTreeLargestApplication(const ProcessTree *tree, const ProcessSnapshot *snapshot);
+
+#endif
@@ -7,17 +7,9 @@
 #import <mach/mach.h>
 #import <mach/mach_types.h>
 
-//#define MAX_PROCESSORS 2
-#define MAX_PROCESSORS 8
-
-typedef struct cpustats
-{
-	int processorCount;
-	unsigned long system[MAX_PROCESSORS];
-	unsigned long user[MAX_PROCESSORS];
-	unsigned long nice[MAX_PROCESSORS];
-	unsigned long idle[MAX_PROCESSORS];
-} cpustats_t;
+#import "CPUSampler.h"
+#import "HistoryRing.h"
+#import "HistoryFile.h"
 
 typedef struct cpudata
 {
@@ -26,29 +18,34 @@ typedef struct cpudata
 	double niceTotal;
 	double idleTotal;
 	int processorCount;
-	double system[MAX_PROCESSORS];
-	double user[MAX_PROCESSORS];
-	double nice[MAX_PROCESSORS];
-	double idle[MAX_PROCESSORS];
+	double *system;		// processorCount fractions, owned by ProcessorInfo
+	double *user;
+	double *nice;
+	double *idle;
 } CPUData, *CPUDataPtr;
 
 
 @interface ProcessorInfo : NSObject
 {
-	int size;
-	int inptr;
-	int outptr;
-	CPUDataPtr cpudata;
-	host_cpu_load_info_data_t lastcpustat;
-	cpustats_t newlastcpustat;
+	HistoryRing history;
+	HistoryRingIterator iterator;
+	int processorCapacity;
+	double *fractions;
+	CPUSampler *sampler;
 }
 
 - (ProcessorInfo *)initWithCapacity:(unsigned)numItems;
 - (void)refresh;
+- (void)restoreFromHistoryFile:(const HistoryFile *)file;
 - (void)startIterate;
 - (BOOL)getNext:(CPUDataPtr)ptr;
 - (void)getCurrent:(CPUDataPtr)ptr;
 - (void)getLast:(CPUDataPtr)ptr;
+- (const CPUData *)nextSample;
+- (const CPUData *)currentSample;
+- (const CPUData *)lastSample;
+- (const HistoryRing *)history;
 - (int)getSize;
+- (int)getProcessorCapacity;
 
 @end
@@ -0,0 +1,298 @@
+/*
+ *  Rollup.c
+ *
+ *  Multi-resolution summaries of a metric in the style of RRDtool's round robin archives.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "Rollup.h"
+
+static const double levelResolution[RollupLevelCount] = { 1.0, 60.0, 60.0 * 60.0, 24.0 * 60.0 * 60.0 };
+static const int levelBucketCount[RollupLevelCount] = { 60 * 60, 24 * 60, 7 * 24, 366 };
+
+
+static void clearBucket(RollupBucket *bucket)
+{
+	bucket->minimum = 0.0;
+	bucket->maximum = 0.0;
+	bucket->sum = 0.0;
+	bucket->last = 0.0;
+	bucket->count = 0;
+}
+
+
+static void combineBucket(RollupBucket *summary, const RollupBucket *bucket)
+{
+	if (bucket->count == 0)
+	{
+		return;
+	}
+	if (summary->count == 0)
+	{
+		*summary = *bucket;
+		return;
+	}
+	if (bucket->minimum < summary->minimum)
+	{
+		summary->minimum = bucket->minimum;
+	}
+	if (bucket->maximum > summary->maximum)
+	{
+		summary->maximum = bucket->maximum;
+	}
+	summary->sum += bucket->sum;
+	summary->count += bucket->count;
+	summary->last = bucket->last;
+}
+
+
+static const RollupBucket *bucketAt(const RollupLevelData *level, long long number)
+{
+	if (number > level->current || number <= level->current - level->bucketCount)
+	{
+		return (NULL);
+	}
+	return (&level->buckets[number % level->bucketCount]);
+}
+
+
+RollupSeries *RollupSeriesCreate(void)
+{
+	RollupSeries *series;
+	int level;
+
+	series = calloc(1, sizeof(RollupSeries));
+	if (series == NULL)
+	{
+		return (NULL);
+	}
+
+	for (level = 0; level < RollupLevelCount; level++)
+	{
+		series->levels[level].resolution = levelResolution[level];
+		series->levels[level].bucketCount = levelBucketCount[level];
+		series->levels[level].current = 0;
+		series->levels[level].buckets = calloc(levelBucketCount[level], sizeof(RollupBucket));
+		if (series->levels[level].buckets == NULL)
+		{
+			RollupSeriesDispose(series);
+			return (NULL);
+		}
+	}
+	return (series);
+}
+
+
+void RollupSeriesDispose(RollupSeries *series)
+{
+	int level;
+
+	if (series == NULL)
+	{
+		return;
+	}
+	for (level = 0; level < RollupLevelCount; level++)
+	{
+		free(series->levels[level].buckets);
+	}
+	free(series);
+}
+
+
+void RollupSeriesAdd(RollupSeries *series, double timestamp, double value)
+{
+	int index;
+
+	for (index = 0; index < RollupLevelCount; index++)
+	{
+		RollupLevelData *level = &series->levels[index];
+		long long number = (long long) floor(timestamp / level->resolution);
+		RollupBucket *bucket;
+
+		if (number > level->current)
+		{
+			// clear the buckets that were skipped, at most one trip around the level
+			long long clear = number - level->current;
+			long long skipped;
+
+			if (clear > level->bucketCount)
+			{
+				clear = level->bucketCount;
+			}
+			for (skipped = number - clear + 1; skipped <= number; skipped++)
+			{
+				clearBucket(&level->buckets[skipped % level->bucketCount]);
+			}
+			level->current = number;
+		}
+
+		bucket = &level->buckets[level->current % level->bucketCount];
+		if (bucket->count == 0)
+		{
+			bucket->minimum = value;
+			bucket->maximum = value;
+		}
+		else
+		{
+			if (value < bucket->minimum)
+			{
+				bucket->minimum = value;
+			}
+			if (value > bucket->maximum)
+			{
+				bucket->maximum = value;
+			}
+		}
+		bucket->sum += value;
+		bucket->last = value;
+		bucket->count += 1;
+	}
+}
+
+
+int RollupSeriesBucket(const RollupSeries *series, RollupLevel level, double now, int ago, RollupBucket *bucket)
+{
+	const RollupLevelData *data = &series->levels[level];
+	const RollupBucket *found = bucketAt(data, (long long) floor(now / data->resolution) - ago);
+
+	if (found == NULL || found->count == 0)
+	{
+		clearBucket(bucket);
+		return (0);
+	}
+	*bucket = *found;
+	return (1);
+}
+
+
+int RollupSeriesSummarize(const RollupSeries *series, double start, double end, RollupBucket *summary)
+{
+	const RollupLevelData *data = NULL;
+	long long first, last, number;
+	int level;
+
+	clearBucket(summary);
+
+	// the finest level that still holds start and needs no more than the limit of buckets
+	for (level = 0; level < RollupLevelCount; level++)
+	{
+		data = &series->levels[level];
+		first = (long long) floor(start / data->resolution);
+		last = (long long) floor(end / data->resolution);
+		if (first > data->current - data->bucketCount && last - first < ROLLUP_SUMMARY_LIMIT)
+		{
+			break;
+		}
+	}
+
+	first = (long long) floor(start / data->resolution);
+	last = (long long) floor(end / data->resolution);
+	if (last > data->current)
+	{
+		last = data->current;
+	}
+	if (first <= data->current - data->bucketCount)
+	{
+		first = data->current - data->bucketCount + 1;
+	}
+	for (number = first; number <= last; number++)
+	{
+		combineBucket(summary, &data->buckets[number % data->bucketCount]);
+	}
+
+	return (summary->count > 0);
+}
+
+
+#if ROLLUP_BENCHMARK
+
+/*
+ *  Adds a week of one second samples, checks the summaries against a direct scan of the samples
+ *  and prints one tab-separated line per operation:
+ *
+ *	operation	span_seconds	samples	ns_per_operation
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+static double benchmarkNow(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((double) now.tv_sec * 1.0e9 + (double) now.tv_nsec);
+}
+
+static double sampleValue(long long second)
+{
+	return (2.0 + sin((double) second / 3600.0) + ((second % 97) / 97.0));
+}
+
+int main(int argc, char *argv[])
+{
+	const long long base = 1700000000LL;
+	const long long count = 7 * 24 * 60 * 60;
+	const double spans[] = { 60.0, 60.0 * 60.0, 24.0 * 60.0 * 60.0, 6.0 * 24.0 * 60.0 * 60.0 };
+	const int passes = 10000;
+	RollupSeries *series;
+	RollupBucket summary;
+	double start, end, sum = 0.0;
+	long long second;
+	int span, pass;
+
+	series = RollupSeriesCreate();
+	if (series == NULL)
+	{
+		fprintf(stderr, "failed to allocate series\n");
+		return (1);
+	}
+
+	printf("operation\tspan_seconds\tsamples\tns_per_operation\n");
+
+	start = benchmarkNow();
+	for (second = 0; second < count; second++)
+	{
+		RollupSeriesAdd(series, (double) (base + second), sampleValue(base + second));
+	}
+	printf("add\t1\t1\t%.1f\n", (benchmarkNow() - start) / count);
+
+	end = (double) (base + count - 1);
+	for (span = 0; span < (int) (sizeof(spans) / sizeof(spans[0])); span++)
+	{
+		double expectedMaximum = 0.0;
+		long long from = base + count - (long long) spans[span];
+
+		// the buckets at the edges can hold samples from outside the span, so the maximum is at least the scanned one
+		for (second = from; second < base + count; second++)
+		{
+			if (sampleValue(second) > expectedMaximum)
+			{
+				expectedMaximum = sampleValue(second);
+			}
+		}
+		RollupSeriesSummarize(series, (double) from, end, &summary);
+		if (summary.count == 0 || summary.maximum < expectedMaximum)
+		{
+			fprintf(stderr, "summary of %.0f seconds does not match\n", spans[span]);
+			return (1);
+		}
+
+		start = benchmarkNow();
+		for (pass = 0; pass < passes; pass++)
+		{
+			RollupSeriesSummarize(series, (double) from, end, &summary);
+			sum += summary.sum / summary.count;
+		}
+		printf("summarize\t%.0f\t%d\t%.1f\n", spans[span], summary.count, (benchmarkNow() - start) / passes);
+	}
+
+	RollupSeriesDispose(series);
+
+	fprintf(stderr, "checksum %f\n", sum);
+	return (0);
+}
+
+#endif
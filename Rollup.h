@@ -0,0 +1,74 @@
+/*
+ *  Rollup.h
+ *
+ *  Multi-resolution summaries of a metric in the style of RRDtool's round robin archives.
+ *
+ *  Every sample updates the current bucket of each level in place, so adding a sample costs the
+ *  same whatever the history holds. A bucket keeps the minimum, maximum, sum, count and last value
+ *  of the samples in it:
+ *
+ *	level		resolution	buckets		span
+ *	RollupSecond	1 second	3600		an hour
+ *	RollupMinute	1 minute	1440		a day
+ *	RollupHour	1 hour		168		a week
+ *	RollupDay	1 day		366		a year
+ *
+ *  Buckets are aligned to UTC, a bucket that had no samples has a count of zero. A summary of any
+ *  span reads at most ROLLUP_SUMMARY_LIMIT buckets from the level that fits it.
+ *
+ *  The benchmark reports the cost of an add and of summaries over spans from a minute to a week:
+ *
+ *	cc -O2 -DROLLUP_BENCHMARK -o rollup_benchmark Rollup.c -lm
+ */
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#define ROLLUP_SUMMARY_LIMIT 360
+
+typedef enum
+{
+	RollupSecond = 0,
+	RollupMinute,
+	RollupHour,
+	RollupDay,
+	RollupLevelCount
+} RollupLevel;
+
+typedef struct rollupbucket
+{
+	double minimum;
+	double maximum;
+	double sum;
+	double last;
+	int count;
+} RollupBucket;
+
+typedef struct rolluplevel
+{
+	double resolution;	// seconds per bucket
+	int bucketCount;
+	long long current;	// number of the newest bucket, seconds since 1970 divided by the resolution
+	RollupBucket *buckets;	// indexed by bucket number modulo bucketCount
+} RollupLevelData;
+
+typedef struct rollupseries
+{
+	RollupLevelData levels[RollupLevelCount];
+} RollupSeries;
+
+// returns NULL if memory could not be allocated
+RollupSeries *RollupSeriesCreate(void);
+void RollupSeriesDispose(RollupSeries *series);
+
+// adds a sample, timestamps are seconds since 1970 and should not decrease -- a sample older than
+// the newest bucket of a level is added to that bucket
+void RollupSeriesAdd(RollupSeries *series, double timestamp, double value);
+
+// gets the bucket that is ago buckets older than the bucket holding now, returns 0 if it has no samples
+int RollupSeriesBucket(const RollupSeries *series, RollupLevel level, double now, int ago, RollupBucket *bucket);
+
+// combines the buckets that overlap start to end into summary, returns 0 if there were no samples
+int RollupSeriesSummarize(const RollupSeries *series, double start, double end, RollupBucket *summary);
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ *  SampleClock.h
+ *
+ *  Monotonic time for sample timestamps. Unlike time() and gettimeofday() the clock never
+ *  jumps when the wall clock is set, so intervals between samples are always correct.
+ */
+
+#ifndef SAMPLE_CLOCK_H
+#define SAMPLE_CLOCK_H
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+// returns seconds since an arbitrary point in the past
+static inline double SampleClockNow(void)
+{
+#if defined(__APPLE__)
+	static double secondsPerTick = 0.0;
+
+	if (secondsPerTick == 0.0)
+	{
+		mach_timebase_info_data_t timebase;
+
+		mach_timebase_info(&timebase);
+		secondsPerTick = ((double) timebase.numer / (double) timebase.denom) / 1.0e9;
+	}
+	return ((double) mach_absolute_time() * secondsPerTick);
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((double) now.tv_sec + ((double) now.tv_nsec / 1.0e9));
+#endif
+}
+
+// returns the factor that scales a counter delta measured over elapsed seconds to the nominal interval
+static inline double SampleClockIntervalScale(double elapsed, double nominal)
+{
+	if (elapsed <= 0.0 || nominal <= 0.0)
+	{
+		return (1.0);
+	}
+	return (nominal / elapsed);
+}
+
+static inline unsigned long long SampleClockScaleCount(unsigned long long count, double scale)
+{
+	return ((unsigned long long) (((double) count * scale) + 0.5));
+}
+
+#endif
@@ -0,0 +1,336 @@
+/*
+ *  SampleScheduler.c
+ *
+ *  Per-source sampling schedule on a hierarchical timer wheel.
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "SampleScheduler.h"
+#include "SampleClock.h"
+
+#define SLOT_BITS 6
+#define SLOT_MASK (SAMPLE_SCHEDULER_SLOTS - 1)
+#define LEVEL_SPAN(level) (1ULL << (SLOT_BITS * ((level) + 1)))
+
+
+static unsigned long long tickForTime(const SampleScheduler *scheduler, double time)
+{
+	double ticks = (time - scheduler->start) / scheduler->resolution;
+
+	if (ticks <= 0.0)
+	{
+		return (0);
+	}
+	return ((unsigned long long) floor(ticks + 1.0e-6));
+}
+
+
+static double timeForTick(const SampleScheduler *scheduler, unsigned long long tick)
+{
+	return (scheduler->start + ((double) tick * scheduler->resolution));
+}
+
+
+static unsigned long long ticksForInterval(const SampleScheduler *scheduler, double interval)
+{
+	double ticks = floor((interval / scheduler->resolution) + 0.5);
+
+	return (ticks < 1.0 ? 1 : (unsigned long long) ticks);
+}
+
+
+static void insertSource(SampleScheduler *scheduler, int index)
+{
+	SampleSource *source = &scheduler->sources[index];
+	unsigned long long position = source->deadline;
+	unsigned long long delta;
+	int level;
+
+	// an overdue source goes in the slot for the current tick so the next run picks it up
+	if (position < scheduler->currentTick)
+	{
+		position = scheduler->currentTick;
+	}
+	delta = position - scheduler->currentTick;
+	if (delta >= LEVEL_SPAN(SAMPLE_SCHEDULER_LEVELS - 1))
+	{
+		// beyond the last wheel, park it in the last slot and let the cascade bring it back
+		position = scheduler->currentTick + LEVEL_SPAN(SAMPLE_SCHEDULER_LEVELS - 1) - 1;
+		delta = position - scheduler->currentTick;
+	}
+
+	for (level = 0; level < SAMPLE_SCHEDULER_LEVELS - 1; level++)
+	{
+		if (delta < LEVEL_SPAN(level))
+		{
+			break;
+		}
+	}
+
+	source->level = level;
+	source->slot = (int) ((position >> (SLOT_BITS * level)) & SLOT_MASK);
+	source->next = scheduler->wheel[level][source->slot];
+	scheduler->wheel[level][source->slot] = index;
+}
+
+
+static void removeSource(SampleScheduler *scheduler, int index)
+{
+	SampleSource *source = &scheduler->sources[index];
+	int *link;
+
+	if (source->level < 0)
+	{
+		return;
+	}
+
+	link = &scheduler->wheel[source->level][source->slot];
+	while (*link != -1)
+	{
+		if (*link == index)
+		{
+			*link = source->next;
+			break;
+		}
+		link = &scheduler->sources[*link].next;
+	}
+	source->level = -1;
+	source->next = -1;
+}
+
+
+// moves every source in a slot of an outer wheel to the wheels below it
+static void cascade(SampleScheduler *scheduler, int level, int slot)
+{
+	int index = scheduler->wheel[level][slot];
+	int next;
+
+	scheduler->wheel[level][slot] = -1;
+	while (index != -1)
+	{
+		next = scheduler->sources[index].next;
+		insertSource(scheduler, index);
+		index = next;
+	}
+}
+
+
+SampleScheduler *SampleSchedulerCreate(double resolution, double now)
+{
+	SampleScheduler *scheduler;
+	int level, slot;
+
+	scheduler = calloc(1, sizeof(SampleScheduler));
+	if (scheduler == NULL)
+	{
+		return (NULL);
+	}
+
+	scheduler->resolution = resolution;
+	scheduler->start = now;
+	scheduler->currentTick = 0;
+	for (level = 0; level < SAMPLE_SCHEDULER_LEVELS; level++)
+	{
+		for (slot = 0; slot < SAMPLE_SCHEDULER_SLOTS; slot++)
+		{
+			scheduler->wheel[level][slot] = -1;
+		}
+	}
+	return (scheduler);
+}
+
+
+void SampleSchedulerDispose(SampleScheduler *scheduler)
+{
+	free(scheduler);
+}
+
+
+int SampleSchedulerAddSource(SampleScheduler *scheduler, const char *name, double interval, SampleCost cost, SampleSchedulerCallback callback, void *context)
+{
+	SampleSource *source;
+	int index;
+
+	if (scheduler->sourceCount >= SAMPLE_SCHEDULER_MAX_SOURCES)
+	{
+		return (-1);
+	}
+
+	index = scheduler->sourceCount++;
+	source = &scheduler->sources[index];
+	source->name = name;
+	source->cost = cost;
+	source->callback = callback;
+	source->context = context;
+	source->interval = ticksForInterval(scheduler, interval);
+	source->deadline = scheduler->currentTick;
+	source->next = -1;
+	source->level = -1;
+
+	insertSource(scheduler, index);
+	return (index);
+}
+
+
+void SampleSchedulerSetInterval(SampleScheduler *scheduler, int index, double interval)
+{
+	SampleSource *source = &scheduler->sources[index];
+	unsigned long long newInterval = ticksForInterval(scheduler, interval);
+	unsigned long long lastRun;
+
+	if (newInterval == source->interval)
+	{
+		return;
+	}
+
+	removeSource(scheduler, index);
+	lastRun = (source->deadline > source->interval ? source->deadline - source->interval : 0);
+	source->interval = newInterval;
+	source->deadline = lastRun + newInterval;
+	insertSource(scheduler, index);
+}
+
+
+int SampleSchedulerRun(SampleScheduler *scheduler, double now)
+{
+	unsigned long long target = tickForTime(scheduler, now);
+	int due[SAMPLE_SCHEDULER_MAX_SOURCES];
+	int dueCount = 0;
+	SampleCost cost;
+	int index, i;
+
+	// expire every tick up to now, cascading the outer wheels as the inner ones wrap
+	while (scheduler->currentTick <= target)
+	{
+		unsigned long long tick = scheduler->currentTick;
+
+		if ((tick & SLOT_MASK) == 0)
+		{
+			if (((tick >> SLOT_BITS) & SLOT_MASK) == 0)
+			{
+				cascade(scheduler, 2, (int) ((tick >> (SLOT_BITS * 2)) & SLOT_MASK));
+			}
+			cascade(scheduler, 1, (int) ((tick >> SLOT_BITS) & SLOT_MASK));
+		}
+
+		index = scheduler->wheel[0][tick & SLOT_MASK];
+		scheduler->wheel[0][tick & SLOT_MASK] = -1;
+		while (index != -1)
+		{
+			SampleSource *source = &scheduler->sources[index];
+			int next = source->next;
+
+			source->level = -1;
+			source->next = -1;
+			if (source->deadline <= target)
+			{
+				due[dueCount++] = index;
+			}
+			else
+			{
+				// parked past the last wheel, not due yet
+				insertSource(scheduler, index);
+			}
+			index = next;
+		}
+
+		scheduler->currentTick++;
+	}
+
+	// light sources run first so a slow heavy source doesn't delay them, ties run in the order they were added
+	for (cost = SampleCostLight; cost <= SampleCostHeavy; cost++)
+	{
+		for (i = 0; i < dueCount; i++)
+		{
+			SampleSource *source;
+			SampleSourceStatistics *statistics;
+			unsigned long long missed;
+			double jitter, started;
+
+			index = due[i];
+			source = &scheduler->sources[index];
+			if (source->cost != cost)
+			{
+				continue;
+			}
+
+			jitter = now - timeForTick(scheduler, source->deadline);
+			if (jitter < 0.0)
+			{
+				jitter = 0.0;
+			}
+
+			// the duration is measured on the real clock, now may be running faster while a trace is replayed
+			started = SampleClockNow();
+			source->callback(source->context);
+
+			statistics = &source->statistics;
+			statistics->lastDuration = SampleClockNow() - started;
+			statistics->runs += 1;
+			statistics->lastJitter = jitter;
+			statistics->averageJitter += (jitter - statistics->averageJitter) / (double) statistics->runs;
+			if (jitter > statistics->maximumJitter)
+			{
+				statistics->maximumJitter = jitter;
+			}
+
+			// run once for any number of missed deadlines and stay on the original phase
+			missed = (target - source->deadline) / source->interval;
+			statistics->missed += missed;
+			source->deadline += (missed + 1) * source->interval;
+
+			insertSource(scheduler, index);
+		}
+	}
+
+	return (dueCount);
+}
+
+
+double SampleSchedulerNextWakeup(const SampleScheduler *scheduler)
+{
+	unsigned long long wakeup = 0;
+	unsigned long long tick;
+	int found = 0;
+	int index;
+
+	for (index = 0; index < scheduler->sourceCount; index++)
+	{
+		const SampleSource *source = &scheduler->sources[index];
+
+		if (source->level < 0)
+		{
+			continue;
+		}
+
+		tick = source->deadline;
+		if (source->cost == SampleCostHeavy)
+		{
+			// heavy sources can wait for another source's wakeup
+			tick += source->interval / 4;
+		}
+		if (! found || tick < wakeup)
+		{
+			wakeup = tick;
+			found = 1;
+		}
+	}
+
+	if (! found)
+	{
+		wakeup = scheduler->currentTick + LEVEL_SPAN(0);
+	}
+	if (wakeup < scheduler->currentTick)
+	{
+		wakeup = scheduler->currentTick;
+	}
+	return (timeForTick(scheduler, wakeup));
+}
+
+
+void SampleSchedulerGetStatistics(const SampleScheduler *scheduler, int index, SampleSourceStatistics *statistics)
+{
+	*statistics = scheduler->sources[index].statistics;
+}
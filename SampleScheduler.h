@@ -0,0 +1,88 @@
+/*
+ *  SampleScheduler.h
+ *
+ *  Per-source sampling schedule on a hierarchical timer wheel.
+ *
+ *  Each source has its own interval and cost class. Deadlines are kept in ticks of a fixed
+ *  resolution on three wheels of 64 slots (the first covers 64 ticks, the second 64 * 64 and the
+ *  third 64 * 64 * 64), so adding a source and expiring a tick take constant time.
+ *
+ *  Wakeups are coalesced: SampleSchedulerNextWakeup() returns the one time the caller should
+ *  sleep until, and heavy sources may be delayed by up to a quarter of their interval so they
+ *  run in the same wakeup as other sources instead of waking the machine on their own.
+ *
+ *  After a missed deadline a source runs once, the deadlines it missed are counted in its
+ *  statistics and the next deadline stays on the source's original phase. Nothing is skipped
+ *  silently and nothing runs several times in a row to catch up.
+ */
+
+#ifndef SAMPLE_SCHEDULER_H
+#define SAMPLE_SCHEDULER_H
+
+#define SAMPLE_SCHEDULER_LEVELS 3
+#define SAMPLE_SCHEDULER_SLOTS 64
+#define SAMPLE_SCHEDULER_MAX_SOURCES 16
+
+typedef enum
+{
+	SampleCostLight = 0,	// cheap call, runs on its deadline
+	SampleCostHeavy = 1	// IOKit, SMC or file system call, can be delayed to share a wakeup
+} SampleCost;
+
+typedef void (*SampleSchedulerCallback)(void *context);
+
+typedef struct samplesourcestatistics
+{
+	unsigned long runs;
+	unsigned long missed;	// deadlines that passed while the source was waiting for an earlier one
+	double lastJitter;	// seconds between the deadline and the run
+	double averageJitter;
+	double maximumJitter;
+	double lastDuration;	// seconds the callback took on its last run
+} SampleSourceStatistics;
+
+typedef struct samplesource
+{
+	const char *name;
+	SampleCost cost;
+	SampleSchedulerCallback callback;
+	void *context;
+
+	unsigned long long interval;	// ticks between runs
+	unsigned long long deadline;	// tick of the next run
+	int next;			// next source in the same wheel slot, -1 at the end
+	int level;			// wheel and slot holding the source, -1 when it isn't scheduled
+	int slot;
+
+	SampleSourceStatistics statistics;
+} SampleSource;
+
+typedef struct samplescheduler
+{
+	double resolution;		// seconds per tick
+	double start;			// clock time of tick 0
+	unsigned long long currentTick;	// next tick to expire
+	int wheel[SAMPLE_SCHEDULER_LEVELS][SAMPLE_SCHEDULER_SLOTS];	// first source in each slot, -1 when empty
+	int sourceCount;
+	SampleSource sources[SAMPLE_SCHEDULER_MAX_SOURCES];
+} SampleScheduler;
+
+// creates a scheduler with ticks of resolution seconds, starting at the clock time now
+SampleScheduler *SampleSchedulerCreate(double resolution, double now);
+void SampleSchedulerDispose(SampleScheduler *scheduler);
+
+// adds a source that runs first at the clock time now and then every interval seconds, returns the source number or -1
+int SampleSchedulerAddSource(SampleScheduler *scheduler, const char *name, double interval, SampleCost cost, SampleSchedulerCallback callback, void *context);
+
+// changes the interval of a source, the next run is one new interval after the last one
+void SampleSchedulerSetInterval(SampleScheduler *scheduler, int source, double interval);
+
+// runs every source whose deadline is at or before the clock time now, returns the number of sources that ran
+int SampleSchedulerRun(SampleScheduler *scheduler, double now);
+
+// returns the clock time of the next wakeup
+double SampleSchedulerNextWakeup(const SampleScheduler *scheduler);
+
+void SampleSchedulerGetStatistics(const SampleScheduler *scheduler, int source, SampleSourceStatistics *statistics);
+
+#endif
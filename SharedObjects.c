@@ -0,0 +1,476 @@
+/*
+ *  SharedObjects.c
+ *
+ *  Attribution of shared and copy-on-write memory objects to the processes that map them.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "SharedObjects.h"
+
+#define SHARED_OBJECTS_BLOCK_SIZE 65536
+
+typedef struct sharedobjectsblock
+{
+	struct sharedobjectsblock *next;
+	size_t used;
+	double data[(SHARED_OBJECTS_BLOCK_SIZE - 2 * sizeof(void *)) / sizeof(double)];
+} SharedObjectsBlock;
+
+
+// returns memory from the arena of the scan, the blocks of earlier scans are used again before new ones are allocated
+static void *allocate(SharedObjects *objects, size_t size)
+{
+	SharedObjectsBlock *block = objects->currentBlock;
+
+	size = (size + sizeof(double) - 1) & ~(sizeof(double) - 1);
+	if (block == NULL || block->used + size > sizeof(block->data))
+	{
+		SharedObjectsBlock *next = (block ? block->next : objects->blocks);
+
+		if (next == NULL)
+		{
+			next = malloc(sizeof(SharedObjectsBlock));
+			if (next == NULL)
+			{
+				return (NULL);
+			}
+			next->next = NULL;
+			if (block)
+			{
+				block->next = next;
+			}
+			else
+			{
+				objects->blocks = next;
+			}
+		}
+		next->used = 0;
+		objects->currentBlock = block = next;
+	}
+
+	block->used += size;
+	return ((char *) block->data + block->used - size);
+}
+
+
+static unsigned int hashObject(int id)
+{
+	unsigned int hash = (unsigned int) id * 2654435761u;
+
+	return (hash ^ (hash >> 16));
+}
+
+
+// returns the slot holding the object, or the empty slot where it would go
+static unsigned int findSlot(const SharedObjects *objects, int id)
+{
+	unsigned int mask = objects->capacity - 1;
+	unsigned int index = hashObject(id) & mask;
+
+	while (objects->slots[index] != NULL && objects->slots[index]->id != id)
+	{
+		index = (index + 1) & mask;
+	}
+	return (index);
+}
+
+
+static int growTable(SharedObjects *objects)
+{
+	SharedObject **oldSlots = objects->slots;
+	int oldCapacity = objects->capacity;
+	int newCapacity = (oldCapacity > 0 ? oldCapacity * 2 : 1024);
+	int i;
+
+	objects->slots = calloc(newCapacity, sizeof(SharedObject *));
+	if (objects->slots == NULL)
+	{
+		objects->slots = oldSlots;
+		return (0);
+	}
+	objects->capacity = newCapacity;
+	for (i = 0; i < oldCapacity; i++)
+	{
+		if (oldSlots[i] != NULL)
+		{
+			objects->slots[findSlot(objects, oldSlots[i]->id)] = oldSlots[i];
+		}
+	}
+	free(oldSlots);
+	return (1);
+}
+
+
+SharedObjects *SharedObjectsCreate(unsigned long pageSize)
+{
+	SharedObjects *objects = calloc(1, sizeof(SharedObjects));
+
+	if (objects == NULL)
+	{
+		return (NULL);
+	}
+	objects->pageSize = pageSize;
+	objects->process = -1;
+	return (objects);
+}
+
+
+void SharedObjectsDispose(SharedObjects *objects)
+{
+	SharedObjectsBlock *block;
+
+	if (objects == NULL)
+	{
+		return;
+	}
+	block = objects->blocks;
+	while (block)
+	{
+		SharedObjectsBlock *next = block->next;
+
+		free(block);
+		block = next;
+	}
+	free(objects->slots);
+	free(objects);
+}
+
+
+void SharedObjectsBeginScan(SharedObjects *objects)
+{
+	if (objects->count > 0)
+	{
+		memset(objects->slots, 0, objects->capacity * sizeof(SharedObject *));
+	}
+	objects->count = 0;
+	objects->currentBlock = NULL;
+	objects->process = -1;
+	objects->references = NULL;
+}
+
+
+void SharedObjectsBeginProcess(SharedObjects *objects, int process)
+{
+	objects->process = process;
+	objects->references = NULL;
+}
+
+
+int SharedObjectsEnter(SharedObjects *objects, int id, int shareType, int residentPageCount, int refCount, unsigned long long size)
+{
+	SharedObject *object;
+	SharedObjectReference *reference;
+	unsigned int index;
+
+	if ((objects->count + 1) * 2 > objects->capacity && ! growTable(objects))
+	{
+		return (0);
+	}
+
+	index = findSlot(objects, id);
+	object = objects->slots[index];
+	if (object == NULL)
+	{
+		object = allocate(objects, sizeof(SharedObject));
+		if (object == NULL)
+		{
+			return (0);
+		}
+		object->id = id;
+		object->shareType = shareType;
+		object->residentPageCount = residentPageCount;
+		object->refCount = refCount;
+		object->lastReference = NULL;
+		objects->slots[index] = object;
+		objects->count += 1;
+	}
+
+	// the first region of the process that maps the object adds it to the list of the process
+	reference = object->lastReference;
+	if (reference == NULL || reference->process != objects->process)
+	{
+		reference = allocate(objects, sizeof(SharedObjectReference));
+		if (reference == NULL)
+		{
+			return (0);
+		}
+		reference->object = object;
+		reference->process = objects->process;
+		reference->taskRefCount = 0;
+		reference->size = 0;
+		reference->next = objects->references;
+		objects->references = reference;
+		object->lastReference = reference;
+	}
+	reference->taskRefCount += 1;
+	reference->size += size;
+	return (1);
+}
+
+
+void SharedObjectsEndProcess(SharedObjects *objects, SharedObjectUsage *usage)
+{
+	SharedObjectReference *reference;
+
+	memset(usage, 0, sizeof(SharedObjectUsage));
+	for (reference = objects->references; reference; reference = reference->next)
+	{
+		SharedObject *object = reference->object;
+
+		// every reference to the object comes from this process
+		if (object->shareType == SharedObjectShared && object->refCount == reference->taskRefCount)
+		{
+			object->shareType = SharedObjectPrivateAliased;
+			usage->aliased += (unsigned long long) object->residentPageCount * objects->pageSize;
+			usage->aliasedSize += reference->size;
+		}
+		if (object->shareType != SharedObjectPrivateAliased)
+		{
+			usage->shared += (unsigned long long) object->residentPageCount * objects->pageSize;
+		}
+		usage->objectCount += 1;
+	}
+	objects->process = -1;
+	objects->references = NULL;
+}
+
+
+#if SHARED_OBJECTS_BENCHMARK
+
+/*
+ *  Scans 500 generated processes, each mapping 60 of 2,000 objects shared by every process and
+ *  80 regions of 40 objects of its own, and checks the attribution of every process against the
+ *  537 bucket table that was walked once for each process. Prints one tab-separated line:
+ *
+ *	processes	objects	regions	ns_per_scan	ns_per_region	bucket_walk_ns_per_scan
+ */
+
+#include <stdio.h>
+
+#include "SampleClock.h"
+
+#define BENCHMARK_PROCESSES 500
+#define BENCHMARK_COMMON_OBJECTS 2000
+#define BENCHMARK_COMMON_REGIONS 60
+#define BENCHMARK_OWN_OBJECTS 40
+#define BENCHMARK_OWN_REGIONS 80
+#define BENCHMARK_REGIONS (BENCHMARK_COMMON_REGIONS + BENCHMARK_OWN_REGIONS)
+#define BENCHMARK_OBJECTS (BENCHMARK_COMMON_OBJECTS + BENCHMARK_PROCESSES * BENCHMARK_OWN_OBJECTS)
+#define BENCHMARK_PAGE_SIZE 4096
+
+typedef struct benchmarkregion
+{
+	int id;
+	int shareType;
+	int residentPageCount;
+	int refCount;
+	unsigned long long size;
+} BenchmarkRegion;
+
+static BenchmarkRegion regions[BENCHMARK_PROCESSES][BENCHMARK_REGIONS];
+static int refCounts[BENCHMARK_OBJECTS];
+static SharedObjectUsage usages[BENCHMARK_PROCESSES];
+
+// the table that was walked for every process, as it was in Process.c
+#define OBJECT_TABLE_SIZE 537
+#define OT_HASH(object) (((unsigned)object)%OBJECT_TABLE_SIZE)
+
+struct object_info {
+	int id;
+	int pid;
+	int share_type;
+	int resident_page_count;
+	int ref_count;
+	int task_ref_count;
+	unsigned long long size;
+	struct object_info *next;
+};
+
+static struct object_info *shared_hash_table[OBJECT_TABLE_SIZE];
+static struct object_info *of_free_list = 0;
+
+static void shared_hash_enter(int obj_id, int share_type, int resident_page_count, int ref_count, unsigned long long size, int pid)
+{
+	struct object_info **bucket;
+	struct object_info *of;
+
+	of = shared_hash_table[OT_HASH(obj_id/OBJECT_TABLE_SIZE)];
+	while (of) {
+		if (of->id == obj_id) {
+			of->size += size;
+			of->task_ref_count++;
+			of->pid = pid;
+			return;
+		}
+		of = of->next;
+	}
+	bucket = &shared_hash_table[OT_HASH(obj_id/OBJECT_TABLE_SIZE)];
+
+	if ((of = of_free_list))
+		of_free_list = of->next;
+	else
+		of = (struct object_info *) malloc(sizeof(*of));
+
+	of->resident_page_count = resident_page_count;
+	of->id = obj_id;
+	of->share_type = share_type;
+	of->ref_count = ref_count;
+	of->task_ref_count = 1;
+	of->pid = pid;
+	of->size = size;
+
+	of->next = *bucket;
+	*bucket = of;
+}
+
+static void shared_hash_walk(int pid, SharedObjectUsage *usage)
+{
+	int i;
+
+	memset(usage, 0, sizeof(SharedObjectUsage));
+	for (i = 0; i < OBJECT_TABLE_SIZE; i++) {
+		struct object_info *sl;
+
+		for (sl = shared_hash_table[i]; sl; sl = sl->next) {
+			if (sl->pid == pid) {
+				if (sl->share_type == SharedObjectShared) {
+					if (sl->ref_count == sl->task_ref_count) {
+						sl->share_type = SharedObjectPrivateAliased;
+						usage->aliased += (unsigned long long) sl->resident_page_count * BENCHMARK_PAGE_SIZE;
+						usage->aliasedSize += sl->size;
+					}
+				}
+				if (sl->share_type != SharedObjectPrivateAliased)
+					usage->shared += (unsigned long long) sl->resident_page_count * BENCHMARK_PAGE_SIZE;
+			}
+			sl->task_ref_count = 0;
+		}
+	}
+}
+
+static void shared_hash_clear(void)
+{
+	int i;
+
+	for (i = 0; i < OBJECT_TABLE_SIZE; i++) {
+		while (shared_hash_table[i]) {
+			struct object_info *of = shared_hash_table[i];
+
+			shared_hash_table[i] = of->next;
+			of->next = of_free_list;
+			of_free_list = of;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	SharedObjects *objects = SharedObjectsCreate(BENCHMARK_PAGE_SIZE);
+	const int scans = 20;
+	unsigned int seed = 1;
+	double start, elapsed, walkElapsed;
+	int mappedObjects = 0;
+	int scan, process, region, object;
+
+	// object ids are spaced like the addresses of kernel objects
+	for (process = 0; process < BENCHMARK_PROCESSES; process++)
+	{
+		for (region = 0; region < BENCHMARK_REGIONS; region++)
+		{
+			BenchmarkRegion *entry = &regions[process][region];
+
+			seed = (seed * 1103515245) + 12345;
+			if (region < BENCHMARK_COMMON_REGIONS)
+			{
+				object = (seed >> 8) % BENCHMARK_COMMON_OBJECTS;
+				entry->shareType = SharedObjectCopyOnWrite + (object % 2);
+			}
+			else
+			{
+				object = BENCHMARK_COMMON_OBJECTS + process * BENCHMARK_OWN_OBJECTS + (seed >> 8) % BENCHMARK_OWN_OBJECTS;
+				entry->shareType = SharedObjectShared;
+			}
+			entry->id = 0x1000000 + object * 96;
+			entry->residentPageCount = 1 + object % 13;
+			entry->size = (unsigned long long) (1 + object % 7) * BENCHMARK_PAGE_SIZE;
+			refCounts[object] += 1;
+		}
+	}
+	for (object = 0; object < BENCHMARK_OBJECTS; object++)
+	{
+		mappedObjects += (refCounts[object] > 0);
+	}
+	for (process = 0; process < BENCHMARK_PROCESSES; process++)
+	{
+		for (region = 0; region < BENCHMARK_REGIONS; region++)
+		{
+			regions[process][region].refCount = refCounts[(regions[process][region].id - 0x1000000) / 96];
+		}
+	}
+
+	start = SampleClockNow();
+	for (scan = 0; scan < scans; scan++)
+	{
+		SharedObjectsBeginScan(objects);
+		for (process = 0; process < BENCHMARK_PROCESSES; process++)
+		{
+			SharedObjectsBeginProcess(objects, process + 1);
+			for (region = 0; region < BENCHMARK_REGIONS; region++)
+			{
+				const BenchmarkRegion *entry = &regions[process][region];
+
+				if (! SharedObjectsEnter(objects, entry->id, entry->shareType, entry->residentPageCount, entry->refCount, entry->size))
+				{
+					fprintf(stderr, "out of memory\n");
+					return (1);
+				}
+			}
+			SharedObjectsEndProcess(objects, &usages[process]);
+		}
+	}
+	elapsed = (SampleClockNow() - start) * 1.0e9 / scans;
+
+	if (objects->count != mappedObjects)
+	{
+		fprintf(stderr, "scan has %d objects, expected %d\n", objects->count, mappedObjects);
+		return (1);
+	}
+
+	start = SampleClockNow();
+	for (scan = 0; scan < scans; scan++)
+	{
+		shared_hash_clear();
+		for (process = 0; process < BENCHMARK_PROCESSES; process++)
+		{
+			SharedObjectUsage usage;
+
+			for (region = 0; region < BENCHMARK_REGIONS; region++)
+			{
+				const BenchmarkRegion *entry = &regions[process][region];
+
+				shared_hash_enter(entry->id, entry->shareType, entry->residentPageCount, entry->refCount, entry->size, process + 1);
+			}
+			shared_hash_walk(process + 1, &usage);
+
+			if (usage.shared != usages[process].shared || usage.aliased != usages[process].aliased
+					|| usage.aliasedSize != usages[process].aliasedSize)
+			{
+				fprintf(stderr, "process %d has %llu shared and %llu aliased, expected %llu and %llu\n", process + 1,
+						usages[process].shared, usages[process].aliased, usage.shared, usage.aliased);
+				return (1);
+			}
+		}
+	}
+	walkElapsed = (SampleClockNow() - start) * 1.0e9 / scans;
+
+	printf("processes\tobjects\tregions\tns_per_scan\tns_per_region\tbucket_walk_ns_per_scan\n");
+	printf("%d\t%d\t%d\t%.0f\t%.1f\t%.0f\n", BENCHMARK_PROCESSES, mappedObjects, BENCHMARK_PROCESSES * BENCHMARK_REGIONS,
+			elapsed, elapsed / (BENCHMARK_PROCESSES * BENCHMARK_REGIONS), walkElapsed);
+
+	SharedObjectsDispose(objects);
+	return (0);
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ *  SharedObjects.h
+ *
+ *  Attribution of shared and copy-on-write memory objects to the processes that map them, for
+ *  the shared and private sizes of the process accounting in Process.c.
+ *
+ *  Every scan of the processes starts with SharedObjectsBeginScan(). The memory of a scan comes
+ *  from an arena that is reset, not freed, by the next scan, so entering an object costs no
+ *  malloc() once the arena has grown to the size of a scan. Objects are found by id in an open
+ *  addressing hash table that grows with the number of objects. Each process gets a list of the
+ *  objects it maps, with how often and how much of each one it maps, so attributing a process
+ *  only walks its own list instead of every object of the scan. Attributing all the processes
+ *  is a single pass over the regions that were entered.
+ *
+ *  An object is private but aliased when every one of its references comes from the process
+ *  being attributed, otherwise its resident pages count as shared.
+ *
+ *  The benchmark scans 500 generated processes mapping about 19,000 objects, checks the
+ *  attribution against the bucket walk it replaced and prints the time of both:
+ *
+ *	cc -O2 -DSHARED_OBJECTS_BENCHMARK -o shared_objects_benchmark SharedObjects.c
+ */
+
+#ifndef SHARED_OBJECTS_H
+#define SHARED_OBJECTS_H
+
+enum
+{
+	SharedObjectCopyOnWrite = 1,
+	SharedObjectShared,
+	SharedObjectPrivateAliased
+};
+
+typedef struct sharedobject
+{
+	int id;
+	int shareType;
+	int residentPageCount;
+	int refCount;		// references from every task, as reported by the kernel
+	struct sharedobjectreference *lastReference;	// reference of the last process that mapped the object
+} SharedObject;
+
+typedef struct sharedobjectreference
+{
+	SharedObject *object;
+	int process;
+	int taskRefCount;	// regions of the process mapping the object
+	unsigned long long size;	// bytes of those regions
+	struct sharedobjectreference *next;
+} SharedObjectReference;
+
+typedef struct sharedobjectusage
+{
+	unsigned long long shared;	// resident bytes of objects shared with other processes
+	unsigned long long aliased;	// resident bytes of objects only this process maps
+	unsigned long long aliasedSize;	// mapped bytes of those objects
+	int objectCount;
+} SharedObjectUsage;
+
+typedef struct sharedobjects
+{
+	unsigned long pageSize;
+	int count;
+	int capacity;		// slots of the hash table, a power of 2
+	SharedObject **slots;
+	struct sharedobjectsblock *blocks;	// arena of the scan
+	struct sharedobjectsblock *currentBlock;
+	int process;		// process being entered, -1 if none
+	SharedObjectReference *references;	// objects of that process
+} SharedObjects;
+
+SharedObjects *SharedObjectsCreate(unsigned long pageSize);
+void SharedObjectsDispose(SharedObjects *objects);
+
+// forgets the objects of the last scan and keeps their memory for this one
+void SharedObjectsBeginScan(SharedObjects *objects);
+
+// starts the list of objects mapped by a process, identified by any number unique in the scan
+void SharedObjectsBeginProcess(SharedObjects *objects, int process);
+
+// records a region of the process mapping an object, returns 0 if memory could not be allocated
+int SharedObjectsEnter(SharedObjects *objects, int id, int shareType, int residentPageCount, int refCount, unsigned long long size);
+
+// attributes the objects of the process and ends its list
+void SharedObjectsEndProcess(SharedObjects *objects, SharedObjectUsage *usage);
+
+#endif
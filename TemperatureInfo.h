@@ -7,6 +7,9 @@
 #import <mach/mach.h>
 #import <mach/mach_types.h>
 
+#import "HistoryRing.h"
+#import "HistoryFile.h"
+
 #define MAX_PROCESSOR_SENSORS 2
 
 typedef struct TemperatureData
@@ -27,10 +30,8 @@ typedef enum
 
 @interface TemperatureInfo : NSObject
 {
-	int size;
-	int inptr;
-	int outptr;
-	TemperatureDataPtr temperatureData;
+	HistoryRing history;
+	HistoryRingIterator iterator;
 	
 	BOOL chudWorkaround;
 
@@ -46,10 +47,15 @@ typedef enum
 
 - (TemperatureInfo *)initWithCapacity:(unsigned)numItems;
 - (void)refresh;
+- (void)restoreFromHistoryFile:(const HistoryFile *)file;
 - (void)startIterate;
 - (BOOL)getNext:(TemperatureDataPtr)ptr;
 - (void)getCurrent:(TemperatureDataPtr)ptr;
 - (void)getLast:(TemperatureDataPtr)ptr;
+- (const TemperatureData *)nextSample;
+- (const TemperatureData *)currentSample;
+- (const TemperatureData *)lastSample;
+- (const HistoryRing *)history;
 - (int)getSize;
 
 @end
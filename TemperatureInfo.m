@@ -7,6 +7,8 @@
 #import <mach/mach_error.h>
 
 #import "TemperatureInfo.h"
+#import "CounterTrace.h"
+#import "SampleClock.h"
 
 #import "Preferences.h"
 
@@ -332,24 +334,23 @@ BOOL getCalibrationCpuid(unsigned short *diodeM, short *diodeB, int *diodeCount)
 	int i, j;
 	
 	self = [super init];
-	size = numItems;
-	temperatureData = calloc(numItems, sizeof(TemperatureData));
-	if (temperatureData == NULL)
+	if (! HistoryRingInit(&history, numItems, sizeof(TemperatureData)))
 	{
 		NSLog (@"Failed to allocate buffer for TemperatureInfo");
 		return (nil);
 	}
 	
-	inptr = 0;
-	outptr = -1;
+	iterator.outptr = -1;
 	
-	for (i = 0; i < size; i++)
+	for (i = 0; i < history.slots; i++)
 	{
-		temperatureData[i].temperatureCount = 0;
+		TemperatureDataPtr sample = HistoryRingSlot(&history, i);
+
+		sample->temperatureCount = 0;
 			
 		for (j = 0; j < MAX_PROCESSOR_SENSORS; j++)
 		{
-			temperatureData[i].temperatureLevel[j] = 0.0;
+			sample->temperatureLevel[j] = 0.0;
 		}
 	}
 
@@ -732,10 +733,21 @@ void getTemperatureCpuid(unsigned short *diodeM, short *diodeB, float *temperatu
 
 - (void)refresh
 {
-	temperatureData[inptr].temperatureCount = 0;
+	TemperatureDataPtr sample = HistoryRingWriteSlot(&history);
+	sample->temperatureCount = 0;
 
 	//NSLog(@"Sensor type = %d", sensorType);
 	
+	if (CounterTraceGetMode() == CounterTraceReplaying)
+	{
+		// at the end of a replayed trace the history keeps the last samples it replayed
+		if (CounterTraceReplay(CounterTraceTemperature, sample, sizeof(TemperatureData), NULL))
+		{
+			HistoryRingAdvance(&history);
+		}
+		return;
+	}
+
 	switch (sensorType)
 	{
 	default:
@@ -743,14 +755,14 @@ void getTemperatureCpuid(unsigned short *diodeM, short *diodeB, float *temperatu
 		break;
 	case IOHWSensorSensorType:
 		{
-			temperatureData[inptr].temperatureLevel[0] = getTemperatureIOHWSensor();
-			temperatureData[inptr].temperatureCount = 1;
+			sample->temperatureLevel[0] = getTemperatureIOHWSensor();
+			sample->temperatureCount = 1;
 		}
 		break;
 	case AppleCPUThermoSensorType:
 		{
-			temperatureData[inptr].temperatureLevel[0] = getTemperatureAppleCPUThermo();
-			temperatureData[inptr].temperatureCount = 1;
+			sample->temperatureLevel[0] = getTemperatureAppleCPUThermo();
+			sample->temperatureCount = 1;
 		}
 		break;
 	case CpuidSensorType:
@@ -758,9 +770,9 @@ void getTemperatureCpuid(unsigned short *diodeM, short *diodeB, float *temperatu
 			float temperatures[MAX_PROCESSOR_SENSORS];
 			int temperatureCount;
 			getTemperatureCpuid(diodeM, diodeB, temperatures, &temperatureCount);
-			temperatureData[inptr].temperatureLevel[0] = temperatures[0];
-			temperatureData[inptr].temperatureLevel[1] = temperatures[1];
-			temperatureData[inptr].temperatureCount = temperatureCount;
+			sample->temperatureLevel[0] = temperatures[0];
+			sample->temperatureLevel[1] = temperatures[1];
+			sample->temperatureCount = temperatureCount;
 		}
 		break;
 	case SMCSensorType:
@@ -771,9 +783,9 @@ void getTemperatureCpuid(unsigned short *diodeM, short *diodeB, float *temperatu
 			//NSLog(@"TemperatureInfo: SMC keys are: ");
 			//SMCPrintAll();
 
-			temperatureData[inptr].temperatureLevel[0] = 0;
-			temperatureData[inptr].temperatureLevel[1] = 0;
-			temperatureData[inptr].temperatureCount = 0;
+			sample->temperatureLevel[0] = 0;
+			sample->temperatureLevel[1] = 0;
+			sample->temperatureCount = 0;
 
 			result = SMCReadKey(smcSensorKey, &val);
 //#warning "Disable logging in release build"
@@ -789,52 +801,100 @@ void getTemperatureCpuid(unsigned short *diodeM, short *diodeB, float *temperatu
 //#warning "Disable logging in release build"
 //				NSLog(@"%s val0 = %x, val1 = %x, temp = %f", __PRETTY_FUNCTION__, val0, val1, temp);
 
-				temperatureData[inptr].temperatureLevel[0] = temp;
-				temperatureData[inptr].temperatureCount = 1;
+				sample->temperatureLevel[0] = temp;
+				sample->temperatureCount = 1;
 			}
 		}
 		break;
 	}
 
-	if (++inptr >= size)
-		inptr = 0;
+	CounterTraceRecord(CounterTraceTemperature, sample, sizeof(TemperatureData), SampleClockNow());
+
+	HistoryRingAdvance(&history);
+}
+
+
+- (void)restoreFromHistoryFile:(const HistoryFile *)file
+{
+	// seeds the history with the records from the last run that are still within its reach, before the first refresh
+	int count = HistoryFileCount(file);
+	int index;
+	double interval = [[NSUserDefaults standardUserDefaults] floatForKey:GLOBAL_UPDATE_FREQUENCY_KEY] / 10.0;
+	int first = HistoryFileFirstSince(file, HistoryFileNow() - (int64_t)(history.size * interval * 1000.0));
+	
+	for (index = (first > count - history.size ? first : count - history.size); index < count; index++)
+	{
+		TemperatureDataPtr sample = HistoryRingWriteSlot(&history);
+		
+		sample->temperatureCount = HistoryFileValueAt(file, index, HistoryFileTemperatureCount);
+		if (sample->temperatureCount > MAX_PROCESSOR_SENSORS)
+		{
+			sample->temperatureCount = MAX_PROCESSOR_SENSORS;
+		}
+		sample->temperatureLevel[0] = HistoryFileValueAt(file, index, HistoryFileTemperature0);
+		sample->temperatureLevel[1] = HistoryFileValueAt(file, index, HistoryFileTemperature1);
+		
+		HistoryRingAdvance(&history);
+	}
 }
 
 
 - (void)startIterate
 {
-	outptr = inptr;
+	HistoryRingStartIterate(&history, &iterator);
 }
 
 
 - (BOOL)getNext:(TemperatureDataPtr)ptr
 {
-	if (outptr == -1)
+	const TemperatureData *sample = HistoryRingNext(&iterator);
+
+	if (sample == NULL)
 		return (FALSE);
-	*ptr = temperatureData[outptr++];
-	if (outptr >= size)
-		outptr = 0;
-	if (outptr == inptr)
-		outptr = -1;
+	*ptr = *sample;
 	return (TRUE);
 }
 
 
 - (void)getCurrent:(TemperatureDataPtr)ptr
 {
-	*ptr = temperatureData[inptr ? inptr - 1 : size - 1];
+	*ptr = *(const TemperatureData *)HistoryRingCurrent(&history);
 }
 
 
 - (void)getLast:(TemperatureDataPtr)ptr
 {
-	*ptr = temperatureData[inptr > 1 ? inptr - 2 : size + inptr - 2];
+	*ptr = *(const TemperatureData *)HistoryRingLast(&history);
+}
+
+
+- (const TemperatureData *)nextSample
+{
+	return (HistoryRingNext(&iterator));
+}
+
+
+- (const TemperatureData *)currentSample
+{
+	return (HistoryRingCurrent(&history));
+}
+
+
+- (const TemperatureData *)lastSample
+{
+	return (HistoryRingLast(&history));
+}
+
+
+- (const HistoryRing *)history
+{
+	return (&history);
 }
 
 
 - (int)getSize
 {
-	return (size);
+	return (history.size);
 }
 
 
@@ -0,0 +1,203 @@
+/*
+ *  TopRank.c
+ *
+ *  Selection of the items with the largest keys, for the process lists in the info panels.
+ */
+
+#include "TopRank.h"
+
+
+static void siftDown(TopRankItem *items, int count, int parent)
+{
+	TopRankItem item = items[parent];
+
+	for (;;)
+	{
+		int child = (2 * parent) + 1;
+
+		if (child >= count)
+		{
+			break;
+		}
+		if (child + 1 < count && items[child + 1].key < items[child].key)
+		{
+			child += 1;
+		}
+		if (items[child].key >= item.key)
+		{
+			break;
+		}
+		items[parent] = items[child];
+		parent = child;
+	}
+	items[parent] = item;
+}
+
+
+static void siftUp(TopRankItem *items, int child)
+{
+	TopRankItem item = items[child];
+
+	while (child > 0)
+	{
+		int parent = (child - 1) / 2;
+
+		if (items[parent].key <= item.key)
+		{
+			break;
+		}
+		items[child] = items[parent];
+		child = parent;
+	}
+	items[child] = item;
+}
+
+
+void TopRankInit(TopRank *rank, TopRankItem *items, int limit)
+{
+	rank->limit = limit;
+	rank->count = 0;
+	rank->items = items;
+}
+
+
+void TopRankOffer(TopRank *rank, double key, int index)
+{
+	if (rank->count < rank->limit)
+	{
+		rank->items[rank->count].key = key;
+		rank->items[rank->count].index = index;
+		siftUp(rank->items, rank->count);
+		rank->count += 1;
+	}
+	else if (rank->limit > 0 && key > rank->items[0].key)
+	{
+		// replaces the smallest of the kept keys
+		rank->items[0].key = key;
+		rank->items[0].index = index;
+		siftDown(rank->items, rank->count, 0);
+	}
+}
+
+
+int TopRankFinish(TopRank *rank)
+{
+	int count;
+
+	// heap sort, each pass moves the smallest remaining key to the end
+	for (count = rank->count; count > 1; count--)
+	{
+		TopRankItem smallest = rank->items[0];
+
+		rank->items[0] = rank->items[count - 1];
+		rank->items[count - 1] = smallest;
+		siftDown(rank->items, count - 1, 0);
+	}
+	return (rank->count);
+}
+
+
+#if TOP_RANK_BENCHMARK
+
+/*
+ *  Ranks 5,000 processes by CPU usage for the ten rows of a panel, checks the result against a
+ *  full sort and prints one tab-separated line per method:
+ *
+ *	method	processes	rows	ns_per_ranking
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BENCHMARK_PROCESSES 5000
+#define BENCHMARK_ROWS 10
+
+typedef struct benchmarkprocess
+{
+	int pid;
+	double cpuUsage;
+	unsigned long long residentSize;
+} BenchmarkProcess;
+
+static double benchmarkNow(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((double) now.tv_sec * 1.0e9 + (double) now.tv_nsec);
+}
+
+static int compareUsage(const void *value1, const void *value2)
+{
+	double usage1 = (*(const BenchmarkProcess **) value1)->cpuUsage;
+	double usage2 = (*(const BenchmarkProcess **) value2)->cpuUsage;
+
+	return ((usage1 < usage2) - (usage1 > usage2));
+}
+
+int main(int argc, char *argv[])
+{
+	static BenchmarkProcess processes[BENCHMARK_PROCESSES];
+	static const BenchmarkProcess *sorted[BENCHMARK_PROCESSES];
+	TopRankItem items[BENCHMARK_ROWS];
+	TopRank rank;
+	const int passes = 2000;
+	double start;
+	unsigned int seed = 1;
+	long checksum = 0;
+	int pass, i, count;
+
+	// most processes are idle, a few are busy
+	for (i = 0; i < BENCHMARK_PROCESSES; i++)
+	{
+		seed = (seed * 1103515245) + 12345;
+		processes[i].pid = i + 1;
+		processes[i].cpuUsage = ((seed >> 8) % 10 == 0 ? (double) ((seed >> 12) % 100000) / 100000.0 : 0.0);
+		processes[i].residentSize = (seed >> 4) % 100000000;
+	}
+
+	printf("method\tprocesses\trows\tns_per_ranking\n");
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		for (i = 0; i < BENCHMARK_PROCESSES; i++)
+		{
+			sorted[i] = &processes[i];
+		}
+		qsort(sorted, BENCHMARK_PROCESSES, sizeof(sorted[0]), compareUsage);
+		checksum += sorted[0]->pid;
+	}
+	printf("sort\t%d\t%d\t%.0f\n", BENCHMARK_PROCESSES, BENCHMARK_ROWS, (benchmarkNow() - start) / passes);
+
+	start = benchmarkNow();
+	for (pass = 0; pass < passes; pass++)
+	{
+		TopRankInit(&rank, items, BENCHMARK_ROWS);
+		for (i = 0; i < BENCHMARK_PROCESSES; i++)
+		{
+			if (processes[i].cpuUsage > 0.0)
+			{
+				TopRankOffer(&rank, processes[i].cpuUsage, i);
+			}
+		}
+		count = TopRankFinish(&rank);
+		checksum += processes[items[0].index].pid;
+	}
+	printf("top\t%d\t%d\t%.0f\n", BENCHMARK_PROCESSES, BENCHMARK_ROWS, (benchmarkNow() - start) / passes);
+
+	for (i = 0; i < count; i++)
+	{
+		if (processes[items[i].index].cpuUsage != sorted[i]->cpuUsage)
+		{
+			fprintf(stderr, "row %d is %f, expected %f\n", i, processes[items[i].index].cpuUsage, sorted[i]->cpuUsage);
+			return (1);
+		}
+	}
+
+	fprintf(stderr, "checksum %ld\n", checksum);
+	return (0);
+}
+
+#endif
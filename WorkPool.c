@@ -0,0 +1,288 @@
+/*
+ *  WorkPool.c
+ *
+ *  Small pool of threads that share the work of a loop over independent items.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "WorkPool.h"
+
+
+// claims chunks from the worker's own range, then from the others, until every range is empty
+static void work(WorkPool *pool, int index)
+{
+	int i;
+
+	for (i = 0; i < pool->workerCount; i++)
+	{
+		WorkPoolRange *range = &pool->ranges[(index + i) % pool->workerCount];
+
+		for (;;)
+		{
+			int first = __sync_fetch_and_add(&range->next, pool->chunkSize);
+			int last;
+
+			if (first >= range->end)
+			{
+				break;
+			}
+			last = (first + pool->chunkSize < range->end ? first + pool->chunkSize : range->end);
+			pool->function(pool->context, first, last);
+		}
+	}
+}
+
+
+static void *workerMain(void *argument)
+{
+	WorkPoolWorker *worker = (WorkPoolWorker *) argument;
+	WorkPool *pool = worker->pool;
+	unsigned int run = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;)
+	{
+		while (pool->run == run && ! pool->quitting)
+		{
+			pthread_cond_wait(&pool->started, &pool->lock);
+		}
+		if (pool->quitting)
+		{
+			break;
+		}
+		run = pool->run;
+		pthread_mutex_unlock(&pool->lock);
+
+		work(pool, worker->index);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->busyCount -= 1;
+		if (pool->busyCount == 0)
+		{
+			pthread_cond_signal(&pool->finished);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return (NULL);
+}
+
+
+int WorkPoolDefaultWorkerCount(int maximum)
+{
+	long processorCount = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (maximum > WORK_POOL_MAX_WORKERS)
+	{
+		maximum = WORK_POOL_MAX_WORKERS;
+	}
+	if (processorCount < 1)
+	{
+		processorCount = 1;
+	}
+	return (processorCount < maximum ? (int) processorCount : maximum);
+}
+
+
+WorkPool *WorkPoolCreate(int workerCount)
+{
+	WorkPool *pool;
+	int i;
+
+	if (workerCount < 1 || workerCount > WORK_POOL_MAX_WORKERS)
+	{
+		return (NULL);
+	}
+	pool = calloc(1, sizeof(WorkPool));
+	if (pool == NULL)
+	{
+		return (NULL);
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->started, NULL);
+	pthread_cond_init(&pool->finished, NULL);
+
+	// the calling thread is the first worker
+	pool->workerCount = 1;
+	for (i = 1; i < workerCount; i++)
+	{
+		pool->workers[i].pool = pool;
+		pool->workers[i].index = i;
+		if (pthread_create(&pool->threads[i], NULL, workerMain, &pool->workers[i]) != 0)
+		{
+			WorkPoolDispose(pool);
+			return (NULL);
+		}
+		pool->workerCount += 1;
+	}
+	return (pool);
+}
+
+
+void WorkPoolDispose(WorkPool *pool)
+{
+	int i;
+
+	if (pool == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->quitting = 1;
+	pthread_cond_broadcast(&pool->started);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 1; i < pool->workerCount; i++)
+	{
+		pthread_join(pool->threads[i], NULL);
+	}
+	pthread_cond_destroy(&pool->finished);
+	pthread_cond_destroy(&pool->started);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+
+void WorkPoolRun(WorkPool *pool, int count, int chunkSize, WorkPoolFunction function, void *context)
+{
+	int i;
+
+	if (count <= 0)
+	{
+		return;
+	}
+	if (chunkSize < 1)
+	{
+		chunkSize = 1;
+	}
+
+	// waking the threads costs more than a loop that fits in one chunk per worker
+	if (pool == NULL || pool->workerCount == 1 || count <= chunkSize)
+	{
+		function(context, 0, count);
+		return;
+	}
+
+	pool->function = function;
+	pool->context = context;
+	pool->chunkSize = chunkSize;
+	for (i = 0; i < pool->workerCount; i++)
+	{
+		pool->ranges[i].next = (int) ((long long) count * i / pool->workerCount);
+		pool->ranges[i].end = (int) ((long long) count * (i + 1) / pool->workerCount);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->run += 1;
+	pool->busyCount = pool->workerCount - 1;
+	pthread_cond_broadcast(&pool->started);
+	pthread_mutex_unlock(&pool->lock);
+
+	work(pool, 0);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->busyCount > 0)
+	{
+		pthread_cond_wait(&pool->finished, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+#if WORK_POOL_BENCHMARK
+
+/*
+ *  Runs a loop of 100,000 items where every hundredth item costs a hundred times more, checks
+ *  that every item was handled once, and prints one tab-separated line per worker count:
+ *
+ *	workers	items	runs	ns_per_run	speedup
+ */
+
+#include <time.h>
+
+#define BENCHMARK_ITEMS 100000
+
+typedef struct benchmarkcontext
+{
+	unsigned int *results;		// times each item was handled
+	unsigned int *values;		// what each item computed, so the work isn't optimized away
+} BenchmarkContext;
+
+static double benchmarkNow(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1.0e9 + now.tv_nsec);
+}
+
+static void handleItems(void *context, int first, int last)
+{
+	BenchmarkContext *benchmark = (BenchmarkContext *) context;
+	int i, k;
+
+	for (i = first; i < last; i++)
+	{
+		unsigned int value = i;
+		int cost = (i % 100 == 0 ? 10000 : 100);
+
+		for (k = 0; k < cost; k++)
+		{
+			value = (value * 1103515245) + 12345;
+		}
+		benchmark->values[i] = value;
+		benchmark->results[i] += 1;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	BenchmarkContext context;
+	const int runs = 20;
+	double serialTime = 0.0;
+	int workerCount, run, i;
+
+	context.results = calloc(BENCHMARK_ITEMS, sizeof(unsigned int));
+	context.values = calloc(BENCHMARK_ITEMS, sizeof(unsigned int));
+	printf("workers\titems\truns\tns_per_run\tspeedup\n");
+	for (workerCount = 1; workerCount <= WORK_POOL_MAX_WORKERS; workerCount *= 2)
+	{
+		WorkPool *pool = WorkPoolCreate(workerCount);
+		double start, elapsed;
+
+		if (pool == NULL)
+		{
+			fprintf(stderr, "failed to start %d workers\n", workerCount);
+			return (1);
+		}
+		memset(context.results, 0, BENCHMARK_ITEMS * sizeof(unsigned int));
+		start = benchmarkNow();
+		for (run = 0; run < runs; run++)
+		{
+			WorkPoolRun(pool, BENCHMARK_ITEMS, 256, handleItems, &context);
+		}
+		elapsed = (benchmarkNow() - start) / runs;
+		WorkPoolDispose(pool);
+
+		for (i = 0; i < BENCHMARK_ITEMS; i++)
+		{
+			if (context.results[i] != (unsigned int) runs)
+			{
+				fprintf(stderr, "item %d was handled %u times in %d runs\n", i, context.results[i], runs);
+				return (1);
+			}
+		}
+		if (workerCount == 1)
+		{
+			serialTime = elapsed;
+		}
+		printf("%d\t%d\t%d\t%.0f\t%.2f\n", workerCount, BENCHMARK_ITEMS, runs, elapsed, serialTime / elapsed);
+	}
+	free(context.results);
+	free(context.values);
+	return (0);
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ *  WorkPool.h
+ *
+ *  Small pool of threads that share the work of a loop over independent items.
+ *
+ *  WorkPoolRun() splits the items into one contiguous range per worker, the calling thread being
+ *  the first worker. Each worker claims chunks from the front of its own range with an atomic
+ *  add, and when its range is empty it claims chunks from the ranges of the others, so a worker
+ *  that got slow items doesn't hold up the rest. Claiming a chunk is the only shared write, so the
+ *  function called for each chunk needs no lock as long as it only writes its own items. The
+ *  threads sleep on a condition between runs and are only woken at the start of one.
+ *
+ *  The benchmark runs a loop of 100,000 items of uneven cost with 1 to 8 workers:
+ *
+ *	cc -O2 -DWORK_POOL_BENCHMARK -o work_pool_benchmark WorkPool.c -lpthread
+ */
+
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <pthread.h>
+
+#define WORK_POOL_MAX_WORKERS 8
+
+// handles the items from first up to but not including last
+typedef void (*WorkPoolFunction)(void *context, int first, int last);
+
+typedef struct workpoolrange
+{
+	volatile int next;		// first item not claimed yet
+	int end;
+	char padding[64 - 2 * sizeof(int)];	// each range has its own cache line
+} WorkPoolRange;
+
+typedef struct workpoolworker
+{
+	struct workpool *pool;
+	int index;
+} WorkPoolWorker;
+
+typedef struct workpool
+{
+	int workerCount;		// including the thread that calls WorkPoolRun()
+	pthread_t threads[WORK_POOL_MAX_WORKERS];
+	WorkPoolWorker workers[WORK_POOL_MAX_WORKERS];
+	pthread_mutex_t lock;
+	pthread_cond_t started;
+	pthread_cond_t finished;
+	unsigned int run;		// incremented by every WorkPoolRun()
+	int busyCount;			// threads that haven't finished the run
+	int quitting;
+
+	WorkPoolFunction function;
+	void *context;
+	int chunkSize;
+	WorkPoolRange ranges[WORK_POOL_MAX_WORKERS];
+} WorkPool;
+
+// returns the number of workers for a pool sized to the processors, at most maximum
+int WorkPoolDefaultWorkerCount(int maximum);
+
+// starts workerCount - 1 threads, returns NULL if they can't be started
+WorkPool *WorkPoolCreate(int workerCount);
+void WorkPoolDispose(WorkPool *pool);
+
+// calls function for the count items, in chunks of chunkSize, and returns once they are all done
+void WorkPoolRun(WorkPool *pool, int count, int chunkSize, WorkPoolFunction function, void *context);
+
+#endif